@@ -44,6 +44,10 @@ Copyright (c) 1995-2007 Andrew Johnson
 #include <errMdef.h>
 #include <drvSup.h>
 #include <epicsStdio.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
 #include <cantProceed.h>
 #include <devLib.h>
 #include <iocsh.h>
@@ -53,21 +57,60 @@ Copyright (c) 1995-2007 Andrew Johnson
 #include "drvIpac.h"
 
 
-#define IPAC_MAX_CARRIERS 21
+#define IPAC_MAX_CARRIERS USHRT_MAX	/* USHRT_MAX itself means no carrier */
+#define IPAC_INIT_CARRIERS 8	/* Initial size of the carrier table */
+#define IPAC_SCAN_TASKS 8	/* Default number of ipacScanAll() tasks */
+#define IPAC_PROM_WORDS 64	/* Size of the ID Prom space, in words */
 
 
 /* Private carrier data structures */
+
+/* Snapshot of a slot's ID Prom, taken by slotScan() */
+struct slotInfo {
+    int scanned;		/* The rest is valid */
+    double scanTime;		/* Seconds slotScan() took */
+    int status;			/* ipmCheck() result */
+    int crcStatus;		/* OK or S_IPAC_badCRC */
+    int format;			/* ID Prom format, 1 or 2 */
+    epicsUInt32 manufacturerId;
+    epicsUInt16 modelId;
+    epicsUInt16 revision;
+    epicsUInt16 prom[IPAC_PROM_WORDS];	/* Words read, the rest zero */
+};
+
 struct carrierInfo {
     ipac_carrier_t *driver;
     void *cPrivate;
+    struct slotInfo *slot;	/* numberSlots entries */
+    char *name;			/* From ipacNameCarrier(), or NULL */
+};
+
+LOCAL void slotScan(int carrier, int slot);
+
+/* Set by ipacDeferScan() */
+LOCAL int deferScan;
+
+/* Slot handle, returned by ipmOpen() */
+struct ipac_slot_s {
+    int carrier;
+    epicsUInt16 slot;
+    void *cPrivate;
+    void *addr[ipac_addrMem + 1];
+    int (*irqCmd)(void *cPrivate, epicsUInt16 slot,
+		epicsUInt16 irqNumber, ipac_irqCmd_t cmd);
 };
 
+/* The info table is replaced by a larger copy when it fills up.  It is
+   not locked: carriers may only be added and named from the startup
+   script before iocInit, while nothing else is using the driver. */
+
 LOCAL struct {
     int number;
     int latest;
-    struct carrierInfo info[IPAC_MAX_CARRIERS];
+    int size;			/* Entries allocated in info */
+    struct carrierInfo *info;
 } carriers = {
-    0, USHRT_MAX
+    0, USHRT_MAX, 0, NULL
 };
 
 
@@ -106,13 +149,129 @@ static void ipacAddNullCallFunc(const iocshArgBuf *args) {
     ipacAddNullCarrier();
 }
 
+static const iocshArg ipacRescanArg0 = { "carrier", iocshArgInt};
+static const iocshArg ipacRescanArg1 = { "slot", iocshArgInt};
+static const iocshArg * const ipacRescanArgs[2] = {
+    &ipacRescanArg0, &ipacRescanArg1};
+static const iocshFuncDef ipacRescanFuncDef = {"ipacRescan",2,ipacRescanArgs};
+static void ipacRescanCallFunc(const iocshArgBuf *args) {
+    int status = ipacRescan(args[0].ival, args[1].ival);
+    if (status) {
+	printf("ipacRescan: Error %d\n", status & 0xffff);
+    }
+}
+
+static const iocshArg ipacNameArg0 = { "carrier", iocshArgInt};
+static const iocshArg ipacNameArg1 = { "name", iocshArgString};
+static const iocshArg * const ipacNameArgs[2] = {
+    &ipacNameArg0, &ipacNameArg1};
+static const iocshFuncDef ipacNameFuncDef = {"ipacNameCarrier",2,ipacNameArgs};
+static void ipacNameCallFunc(const iocshArgBuf *args) {
+    int status = ipacNameCarrier(args[0].ival, args[1].sval);
+    if (status) {
+	printf("ipacNameCarrier: Error %d\n", status & 0xffff);
+    }
+}
+
+static const iocshArg ipacDeferScanArg0 = { "defer", iocshArgInt};
+static const iocshArg * const ipacDeferScanArgs[1] = {&ipacDeferScanArg0};
+static const iocshFuncDef ipacDeferScanFuncDef =
+    {"ipacDeferScan",1,ipacDeferScanArgs};
+static void ipacDeferScanCallFunc(const iocshArgBuf *args) {
+    ipacDeferScan(args[0].ival);
+}
+
+static const iocshArg ipacScanAllArg0 = { "tasks", iocshArgInt};
+static const iocshArg * const ipacScanAllArgs[1] = {&ipacScanAllArg0};
+static const iocshFuncDef ipacScanAllFuncDef =
+    {"ipacScanAll",1,ipacScanAllArgs};
+static void ipacScanAllCallFunc(const iocshArgBuf *args) {
+    ipacScanAll(args[0].ival);
+}
+
+static const iocshArg ipacCrcSelfTestArg0 = { "images", iocshArgInt};
+static const iocshArg ipacCrcSelfTestArg1 = { "loops", iocshArgInt};
+static const iocshArg * const ipacCrcSelfTestArgs[2] = {
+    &ipacCrcSelfTestArg0, &ipacCrcSelfTestArg1};
+static const iocshFuncDef ipacCrcSelfTestFuncDef =
+    {"ipacCrcSelfTest",2,ipacCrcSelfTestArgs};
+static void ipacCrcSelfTestCallFunc(const iocshArgBuf *args) {
+    int status = ipacCrcSelfTest(args[0].ival, args[1].ival);
+    if (status) {
+	printf("ipacCrcSelfTest: Error %d\n", status & 0xffff);
+    }
+}
+
+static const iocshArg ipacSlotBenchArg0 = { "carrier", iocshArgInt};
+static const iocshArg ipacSlotBenchArg1 = { "slot", iocshArgInt};
+static const iocshArg ipacSlotBenchArg2 = { "loops", iocshArgInt};
+static const iocshArg * const ipacSlotBenchArgs[3] = {
+    &ipacSlotBenchArg0, &ipacSlotBenchArg1, &ipacSlotBenchArg2};
+static const iocshFuncDef ipacSlotBenchFuncDef =
+    {"ipacSlotBench",3,ipacSlotBenchArgs};
+static void ipacSlotBenchCallFunc(const iocshArgBuf *args) {
+    int status = ipacSlotBench(args[0].ival, args[1].ival, args[2].ival);
+    if (status) {
+	printf("ipacSlotBench: Error %d\n", status & 0xffff);
+    }
+}
+
 void ipacRegistrar(void) {
     iocshRegister(&ipacReportFuncDef, ipacReportCallFunc);
     iocshRegister(&ipacAddNullFuncDef, ipacAddNullCallFunc);
+    iocshRegister(&ipacRescanFuncDef, ipacRescanCallFunc);
+    iocshRegister(&ipacNameFuncDef, ipacNameCallFunc);
+    iocshRegister(&ipacDeferScanFuncDef, ipacDeferScanCallFunc);
+    iocshRegister(&ipacScanAllFuncDef, ipacScanAllCallFunc);
+    iocshRegister(&ipacCrcSelfTestFuncDef, ipacCrcSelfTestCallFunc);
+    iocshRegister(&ipacSlotBenchFuncDef, ipacSlotBenchCallFunc);
 }
 epicsExportRegistrar(ipacRegistrar);
 
 
+/*******************************************************************************
+
+Routine:
+    growCarriers
+
+Function:
+    Make room in the carrier table for another carrier.
+
+Description:
+    Doubles the size of the carrier table when it is full, copying the
+    existing entries so that carrier numbers do not change, and frees the
+    old table.  Nothing else may be using the table at the time.
+
+Returns:
+    0 = OK,
+    S_IPAC_noMemory = No memory for the larger table.
+
+*/
+
+LOCAL int growCarriers (void) {
+    struct carrierInfo *info;
+    int size;
+
+    if (carriers.number < carriers.size) {
+	return OK;
+    }
+
+    size = carriers.size ? 2 * carriers.size : IPAC_INIT_CARRIERS;
+    info = calloc(size, sizeof(struct carrierInfo));
+    if (info == NULL) {
+	return S_IPAC_noMemory;
+    }
+    if (carriers.number) {
+	memcpy(info, carriers.info, carriers.number * sizeof(struct carrierInfo));
+    }
+
+    free(carriers.info);
+    carriers.info = info;
+    carriers.size = size;
+    return OK;
+}
+
+
 /*******************************************************************************
 
 Routine:
@@ -128,6 +287,11 @@ Description:
     Note that only the carrier initialise routine is called at this stage.  
     The order in which carriers are registered with this routine specifies 
     the carrier number which they will be allocated, starting from zero.
+    The carrier table grows as needed, and a carrier keeps its number for
+    as long as the IOC runs; ipacNameCarrier() can also give it a name.
+    The table is not locked, so carriers must be added before iocInit and
+    before any module driver has started a task or connected an interrupt
+    that uses the IPAC driver.
 
     Checks that the carrier descriptor table looks sensible, then calls the
     initialise routine with the given card parameters, and saves the carrier 
@@ -146,10 +310,18 @@ Description:
     move down by one.  In the event of an error, the null carrier table is
     used for the current carrier number instead of the requested table.
 
+    Once the carrier is initialised the ID Prom of each of its slots is
+    read into RAM, and ipmCheck(), ipmValidate() and ipmReport() work from
+    that copy without touching the bus again.  If modules are changed
+    later, ipacRescan() must be called to read them again.  After a call
+    to ipacDeferScan(1) the slots are not read until ipacScanAll() or the
+    first ipmCheck() of each slot instead.
+
 Returns:
     0 = OK,
     S_IPAC_tooMany = Carrier Info Table full,
-    S_IPAC_badTable = Carrier Table invalid.
+    S_IPAC_badTable = Carrier Table invalid,
+    S_IPAC_noMemory = No memory for the carrier table or ID Prom copies.
 
 Example:
     ipacAddCarrier(&vipc310, "0x6000");
@@ -168,6 +340,12 @@ int ipacAddCarrier (
 	return S_IPAC_tooMany;
     }
 
+    if (growCarriers()) {
+	printf("ipacAddCarrier: No memory for carrier table.\n");
+	carriers.latest = USHRT_MAX;
+	return S_IPAC_noMemory;
+    }
+
     /* Start with Null Carrier table in case of initialization errors */
     carriers.latest = carriers.number++;
     carriers.info[carriers.latest].driver = &nullCarrier;
@@ -192,9 +370,20 @@ int ipacAddCarrier (
 	return status;
     }
 
+    carriers.info[carriers.latest].slot = calloc(pcarrierTable->numberSlots,
+						 sizeof(struct slotInfo));
+    if (carriers.info[carriers.latest].slot == NULL) {
+	printf("ipacAddCarrier: No memory for %s slot table.\n",
+		pcarrierTable->carrierType);
+	return S_IPAC_noMemory;
+    }
+
     carriers.info[carriers.latest].driver = pcarrierTable;
 
-    return OK;
+    if (deferScan) {
+	return OK;
+    }
+    return ipacRescan(carriers.latest, -1);
 }
 
 
@@ -234,7 +423,8 @@ Function:
 Description:
     Returns the index into the carrier table of the most recently added
     carrier board, or USHRT_MAX if the most recent call to ipacAddCarrier
-    could not be fulfilled because the carrier table was already full.
+    could not be fulfilled because the carrier table was already full or
+    could not be extended.
     The value returned can always be used as the carrier argument to any
     drvIpac routine without checking it first; if the carrier board was
     not properly initialized for any reason then these routines will fail
@@ -255,205 +445,900 @@ int ipacLatestCarrier(void)
 /*******************************************************************************
 
 Routine:
-    ipcCheckId
+    ipacNameCarrier
+
+Function:
+    Give a carrier board a name that module drivers can look it up by.
+
+Description:
+    Names carrier number carrier, or the most recently added carrier if
+    carrier is -1.  Names must be unique; a NULL or empty name removes the
+    carrier's name.  Null carriers may be named, so a name can be reserved
+    for a board that is not currently installed.  Like ipacAddCarrier()
+    this must only be used from the startup script before iocInit.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = Bad carrier number,
+    S_IPAC_nameInUse = Another carrier already has this name,
+    S_IPAC_noMemory = No memory for the name.
+
+Example:
+    ipacNameCarrier(-1, "crate2A");
+
+*/
+
+int ipacNameCarrier (
+    int carrier,
+    const char *name
+) {
+    char *copy = NULL;
+    int other;
+
+    if (carrier == -1) {
+	carrier = carriers.latest;
+    }
+    if (carrier < 0 ||
+	carrier >= carriers.number) {
+	return S_IPAC_badAddress;
+    }
+
+    if (name != NULL && *name != '\0') {
+	other = ipacFindCarrier(name);
+	if (other == carrier) {
+	    return OK;
+	}
+	if (other != USHRT_MAX) {
+	    return S_IPAC_nameInUse;
+	}
+
+	copy = malloc(strlen(name) + 1);
+	if (copy == NULL) {
+	    return S_IPAC_noMemory;
+	}
+	strcpy(copy, name);
+    }
+
+    free(carriers.info[carrier].name);
+    carriers.info[carrier].name = copy;
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacFindCarrier
+
+Function:
+    Get the carrier number of a named carrier board.
+
+Description:
+    Looks up a name given by ipacNameCarrier().  As with ipacLatestCarrier()
+    the value returned can be used as the carrier argument to any drvIpac
+    routine without checking it first, as those routines will then fail.
+
+Returns:
+    The carrier number, or
+    USHRT_MAX if no carrier has that name.
+
+*/
+
+int ipacFindCarrier (
+    const char *name
+) {
+    int carrier;
+
+    if (name == NULL) {
+	return USHRT_MAX;
+    }
+
+    for (carrier = 0; carrier < carriers.number; carrier++) {
+	if (carriers.info[carrier].name != NULL &&
+	    strcmp(carriers.info[carrier].name, name) == 0) {
+	    return carrier;
+	}
+    }
+    return USHRT_MAX;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipcCheckId
+
+Function:
+    Check on presence of an IPAC ID Prom at the given location.
+
+Description:
+    This routine must not be called if no module is present and an
+    access to the id pointer could trigger a bus error or SEGV. It
+    checks that the ID Prom starts with the format-1 "IPAC" or "IPAH"
+    or format-2 "VITA4 " identifiers.
+
+Returns:
+    0 = OK,
+    S_IPAC_badDriver = NULL pointer passed for id
+    S_IPAC_noIpacId = "IPAC"/"IPAH"/"VITA4 " identifier not found
+
+*/
+
+int ipcCheckId (
+    ipac_idProm_t *id
+) {
+    epicsUInt16 word;
+
+    if (id == NULL) {
+	return S_IPAC_badDriver;
+    }
+    word = id->asciiI;
+    if ((word & 0xff) != 'I') {
+	return S_IPAC_noIpacId;
+    }
+
+    /*
+     * The Format-1 check is deliberately de-optimized to fix a problem with
+     * IP modules which can't handle back-to-back accesses that compilers
+     * may generate if the "IPAC" ID is tested in a single if () statement.
+     * Format-2 modules should be Ok though.
+     */
+
+    if ((id->asciiP & 0xff) != 'P') {
+	/* Format-2 ID Prom? */
+	ipac_idProm2_t *id2 = (ipac_idProm2_t *) id;
+	if (id2->asciiVI == ('V' << 8 | 'I') &&
+	    id2->asciiTA == ('T' << 8 | 'A') &&
+	    id2->ascii4_ == ('4' << 8 | ' ') ) {
+	    return OK;
+	}
+	return S_IPAC_noIpacId;
+    }
+    if ((id->asciiA & 0xff) != 'A') {
+	return S_IPAC_noIpacId;
+    }
+    word = id->asciiC & 0xff;
+    if ((word != 'C') && (word != 'H')) {
+	return S_IPAC_noIpacId;
+    }
+
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    slotProbe
+
+Function:
+    Check on presence of an IPAC module in the hardware of the given slot.
+
+Description:
+    Probes for the presence of an ID Prom, delegating this operation to the
+    carrier driver if it provides a moduleProbe() routine. If access to a the
+    ID Prom space is safe it delegates checking the IPAC header to the
+    ipcCheckId() routine.  The carrier and slot numbers must be legal.
+
+Returns:
+    0 = OK,
+    S_IPAC_badDriver = Carrier driver returned NULL ID address,
+    S_IPAC_noModule = No module installed,
+    S_IPAC_noIpacId = "IPAC"/"IPAH"/"VITA4 " identifier not found.
+
+*/
+
+LOCAL int slotProbe (
+    int carrier,
+    int slot
+) {
+    ipac_idProm_t *id;
+
+    id = (ipac_idProm_t *) ipmBaseAddr(carrier, slot, ipac_addrID);
+
+    if (carriers.info[carrier].driver->moduleProbe == NULL) {
+	epicsUInt16 word;
+
+	if (devReadProbe(sizeof(word), (void *)&id->asciiI, (char *)&word)) {
+	    return S_IPAC_noModule;
+	}
+    }
+    else {
+	if (carriers.info[carrier].driver->moduleProbe(
+		carriers.info[carrier].cPrivate, slot) == 0)
+	return S_IPAC_noModule;
+    }
+    return ipcCheckId(id);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipmCheck
+
+Function:
+    Check on presence of an IPAC module at the given carrier & slot number.
+
+Description:
+    Checks to make sure the carrier and slot numbers are legal, then returns
+    the result of probing the slot when its ID Prom was last read, by
+    ipacAddCarrier(), ipacRescan() or ipacScanAll().  If the slot has not
+    been read yet because of ipacDeferScan() it is read now.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = Bad carrier or slot number,
+    S_IPAC_badDriver = Carrier driver returned NULL ID address,
+    S_IPAC_noModule = No module installed,
+    S_IPAC_noIpacId = "IPAC"/"IPAH"/"VITA4 " identifier not found.
+
+*/
+
+int ipmCheck (
+    int carrier,
+    int slot
+) {
+    if (carrier < 0 ||
+	carrier >= carriers.number ||
+	slot < 0 ||
+	slot >= carriers.info[carrier].driver->numberSlots) {
+	return S_IPAC_badAddress;
+    }
+
+    if (!carriers.info[carrier].slot[slot].scanned) {
+	slotScan(carrier, slot);
+    }
+    return carriers.info[carrier].slot[slot].status;
+}
+
+
+/* CCITT CRC-16 (x^16 + x^12 + x^5 + 1) of each byte value, MSB first */
+
+LOCAL const epicsUInt16 crcTable[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+    0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+    0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+    0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+    0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+    0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+    0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+    0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+    0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+    0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+    0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+    0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+    0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+    0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+    0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+};
+
+#define CRC_BYTE(crc, byte) \
+    crc = (epicsUInt16) (crc << 8) ^ crcTable[((crc >> 8) ^ (byte)) & 0xff]
+
+
+/*******************************************************************************
+
+Routine:
+    crcIdProm
+
+Function:
+    Calculate the CRC of an IDprom of either format.
+
+Description:
+    Generates an industry standard CRC of the ID Prom data as described in the
+    Industry Pack specification, a byte at a time from crcTable.  Format-1
+    Proms hold one byte in the low half of each word, Format-2 Proms two bytes
+    with the most significant first; wide selects the latter.  The word at
+    index crcIndex holds the CRC itself and is read as zero.
+
+Returns:
+    The calculated CRC value.
+
+*/
+
+LOCAL epicsUInt16 crcIdProm (
+    const epicsUInt16 *data,
+    int length,
+    int crcIndex,
+    int wide
+) {
+    epicsUInt16 crc = 0xffff;
+    int limit = length < crcIndex ? length : crcIndex;
+    int i = 0;
+
+    /* Skipping the CRC word splits the data into two runs */
+    while (limit <= length) {
+	if (wide) {
+	    for (; i < limit; i++) {
+		CRC_BYTE(crc, data[i] >> 8);
+		CRC_BYTE(crc, data[i]);
+	    }
+	} else {
+	    for (; i < limit; i++) {
+		CRC_BYTE(crc, data[i]);
+	    }
+	}
+	if (i == length) break;
+
+	if (wide) {
+	    CRC_BYTE(crc, 0);
+	}
+	CRC_BYTE(crc, 0);
+	i++;
+	limit = length;
+    }
+
+    return ~crc;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    crcBitwise
+
+Function:
+    Calculate the CRC of an IDprom a bit at a time.
+
+Description:
+    The original shift-and-xor form of crcIdProm, with the same parameters.
+    It is kept as the reference that ipacCrcSelfTest checks crcIdProm and
+    its table against, and is not used to check real ID Proms.
+
+Returns:
+    The calculated CRC value.
+
+*/
+
+LOCAL epicsUInt16 crcBitwise (
+    const epicsUInt16 *data,
+    int length,
+    int crcIndex,
+    int wide
+) {
+    int i;
+    epicsUInt32 crc = 0xffff;
+    epicsUInt16 mask;
+
+    for (i = 0; i < length; i++) {
+	mask = wide ? 0x8000 : 0x80;
+	while (mask) {
+	    if ((data[i] & mask) && (i != crcIndex)) {
+		crc ^= 0x8000;
+	    }
+	    crc <<= 1;
+	    if (crc & 0x10000) {
+		crc ^= 0x11021;
+	    }
+	    mask >>= 1;
+	}
+    }
+
+    return (~crc) & 0xffff;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    checkCRC_8
+
+Function:
+    Calculate the CRC of the Format-1 IDprom at the given address.
+
+Description:
+    Uses crcIdProm.  The CRC byte in the Prom (at address 0x17) is read as
+    zero for the purpose of calculating the CRC.
+
+Returns:
+    The low 8 bits of the calculated CRC value.
+
+*/
+
+LOCAL int checkCRC_8 (
+    const epicsUInt16 *data,
+    int length
+) {
+    return crcIdProm(data, length, 0xb, 0) & 0xff;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    checkCRC16
+
+Function:
+    Calculate the CRC of the Format-2 IDprom at the given address.
+
+Description:
+    Uses crcIdProm.  The CRC word in the Prom (at address 0x18) is read as
+    zero for the purpose of calculating the CRC.
+
+Returns:
+    The low 16 bits of the calculated CRC value.
+
+*/
+
+LOCAL int checkCRC16 (
+    const epicsUInt16 *data,
+    int length
+) {
+    return crcIdProm(data, length, 0xc, 1);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipcCalcCRC
+
+Function:
+    Calculate the CRC that belongs in the given ID Prom.
+
+Description:
+    Works out whether the ID Prom is in Format-1 or Format-2 and returns the
+    CRC of its contents as defined in the Industry Pack specification.  This
+    is the value that ipmValidate() will compare with the CRC stored in the
+    ID Prom; it is provided for carrier drivers that have to generate their
+    own ID Prom data, such as the simulated carrier.  The caller must have
+    already checked the ID Prom identifier with ipcCheckId().
+
+Returns:
+    The low 8 (Format-1) or 16 (Format-2) bits of the calculated CRC.
+
+*/
+
+int ipcCalcCRC (
+    ipac_idProm_t *id
+) {
+    if ((id->asciiP & 0xff) == 'P') {
+	return checkCRC_8((epicsUInt16 *) id, id->bytesUsed & 0xff);
+    } else {
+	ipac_idProm2_t *id2 = (ipac_idProm2_t *) id;
+	return checkCRC16((epicsUInt16 *) id2, id2->bytesUsed);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacCrcSelfTest
+
+Function:
+    Check and time the table-driven ID Prom CRC against the bitwise one.
+
+Description:
+    Fills images ID Prom images of 0 to 64 words with pseudo-random data and
+    compares the CRCs from crcIdProm and crcBitwise for both ID Prom formats,
+    printing any image on which they differ.  Then it times loops passes of
+    each routine over all the images and prints the mean time per image and
+    the speed-up.  Zero or negative images or loops select 1000 and 100.  The
+    images are the same on every run.
+
+Returns:
+    0 = OK,
+    S_IPAC_badCRC = The routines disagreed on at least one image,
+    S_IPAC_noMemory = No memory for the images.
+
+Example:
+    ipacCrcSelfTest(1000, 100)
+
+*/
+
+int ipacCrcSelfTest (
+    int images,
+    int loops
+) {
+    epicsUInt16 *data;
+    int *length;
+    epicsUInt32 seed = 12345;
+    epicsTimeStamp start, end;
+    double tableTime, bitTime;
+    volatile epicsUInt16 sink = 0;
+    int i, j, loop, wide, errors = 0;
+
+    if (images <= 0) images = 1000;
+    if (loops <= 0) loops = 100;
+
+    data = calloc(images, IPAC_PROM_WORDS * sizeof(epicsUInt16));
+    length = calloc(images, sizeof(int));
+    if (data == NULL || length == NULL) {
+	free(data);
+	free(length);
+	return S_IPAC_noMemory;
+    }
+    for (i = 0; i < images; i++) {
+	seed = seed * 1103515245 + 12345;
+	length[i] = (seed >> 16) % (IPAC_PROM_WORDS + 1);
+	for (j = 0; j < length[i]; j++) {
+	    seed = seed * 1103515245 + 12345;
+	    data[i * IPAC_PROM_WORDS + j] = seed >> 16;
+	}
+    }
+
+    for (i = 0; i < images; i++) {
+	const epicsUInt16 *image = &data[i * IPAC_PROM_WORDS];
+
+	for (wide = 0; wide <= 1; wide++) {
+	    int crcIndex = wide ? 0xc : 0xb;
+	    epicsUInt16 table = crcIdProm(image, length[i], crcIndex, wide);
+	    epicsUInt16 bits = crcBitwise(image, length[i], crcIndex, wide);
+
+	    if (table != bits) {
+		if (errors++ < 10) {
+		    printf("ipacCrcSelfTest: Format-%d image %d, %d words: "
+			   "table 0x%04x, bitwise 0x%04x\n",
+			   wide + 1, i, length[i], table, bits);
+		}
+	    }
+	}
+    }
+
+    epicsTimeGetCurrent(&start);
+    for (loop = 0; loop < loops; loop++) {
+	for (i = 0; i < images; i++) {
+	    sink ^= crcIdProm(&data[i * IPAC_PROM_WORDS], length[i], 0xc, 1);
+	}
+    }
+    epicsTimeGetCurrent(&end);
+    tableTime = epicsTimeDiffInSeconds(&end, &start);
+
+    epicsTimeGetCurrent(&start);
+    for (loop = 0; loop < loops; loop++) {
+	for (i = 0; i < images; i++) {
+	    sink ^= crcBitwise(&data[i * IPAC_PROM_WORDS], length[i], 0xc, 1);
+	}
+    }
+    epicsTimeGetCurrent(&end);
+    bitTime = epicsTimeDiffInSeconds(&end, &start);
+
+    printf("ipacCrcSelfTest: %d images, %d mismatches\n", images, errors);
+    printf("    Format-2 CRC, %d passes: table %.1f nsec/image, "
+	   "bitwise %.1f nsec/image, %.1f times faster\n", loops,
+	   1e9 * tableTime / ((double) loops * images),
+	   1e9 * bitTime / ((double) loops * images),
+	   tableTime > 0 ? bitTime / tableTime : 0.0);
+
+    free(data);
+    free(length);
+    return errors ? S_IPAC_badCRC : OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    slotRead
+
+Function:
+    Read the ID Prom of the given slot into its slotInfo.
+
+Description:
+    Probes the slot with slotProbe(), then copies the words of the ID Prom
+    that hold its header and are covered by its CRC, checks the CRC and
+    decodes the manufacturer, model and revision.  The carrier and slot
+    numbers must be legal.
+
+Returns:
+    void
+
+*/
+
+LOCAL void slotRead (
+    int carrier,
+    int slot
+) {
+    struct slotInfo *pslot = &carriers.info[carrier].slot[slot];
+    volatile epicsUInt16 *pword;
+    ipac_idProm_t *id;
+    ipac_idProm2_t *id2;
+    int words, crcWords, i;
+
+    memset(pslot, 0, sizeof(struct slotInfo));
+    pslot->status = slotProbe(carrier, slot);
+    if (pslot->status) {
+	return;
+    }
+
+    pword = (volatile epicsUInt16 *) ipmBaseAddr(carrier, slot, ipac_addrID);
+    id = (ipac_idProm_t *) pword;
+    id2 = (ipac_idProm2_t *) pword;
+    if ((id->asciiP & 0xff) == 'P') {
+	pslot->format = 1;
+	crcWords = id->bytesUsed & 0xff;
+	words = 12;
+    } else {
+	pslot->format = 2;
+	crcWords = id2->bytesUsed;
+	words = 13;
+    }
+    if (crcWords > IPAC_PROM_WORDS) crcWords = IPAC_PROM_WORDS;
+    if (words < crcWords) words = crcWords;
+
+    for (i = 0; i < words; i++) {
+	pslot->prom[i] = pword[i];
+    }
+
+    /* Decode the copy */
+    id = (ipac_idProm_t *) pslot->prom;
+    id2 = (ipac_idProm2_t *) pslot->prom;
+    if (pslot->format == 1) {
+	pslot->manufacturerId = id->manufacturerId & 0xff;
+	pslot->modelId = id->modelId & 0xff;
+	pslot->revision = id->revision & 0xff;
+	if (checkCRC_8(pslot->prom, crcWords) != (id->CRC & 0xff)) {
+	    pslot->crcStatus = S_IPAC_badCRC;
+	}
+    } else {
+	pslot->manufacturerId = (id2->manufacturerIdHigh & 0xff) << 16 |
+				id2->manufacturerIdLow;
+	pslot->modelId = id2->modelId;
+	pslot->revision = id2->revision;
+	/* The CRC is optional */
+	if (id2->CRC &&
+	    id2->CRC != checkCRC16(pslot->prom, crcWords)) {
+	    pslot->crcStatus = S_IPAC_badCRC;
+	}
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    slotScan
 
 Function:
-    Check on presence of an IPAC ID Prom at the given location.
+    Read the ID Prom of the given slot and time how long it took.
 
 Description:
-    This routine must not be called if no module is present and an
-    access to the id pointer could trigger a bus error or SEGV. It
-    checks that the ID Prom starts with the format-1 "IPAC" or "IPAH"
-    or format-2 "VITA4 " identifiers.
+    Calls slotRead, then marks the slotInfo as valid.  Different slots may
+    be scanned by different tasks at the same time.
 
 Returns:
-    0 = OK,
-    S_IPAC_badDriver = NULL pointer passed for id
-    S_IPAC_noIpacId = "IPAC"/"IPAH"/"VITA4 " identifier not found
+    void
 
 */
 
-int ipcCheckId (
-    ipac_idProm_t *id
+LOCAL void slotScan (
+    int carrier,
+    int slot
 ) {
-    epicsUInt16 word;
-
-    if (id == NULL) {
-	return S_IPAC_badDriver;
-    }
-    word = id->asciiI;
-    if ((word & 0xff) != 'I') {
-	return S_IPAC_noIpacId;
-    }
-
-    /*
-     * The Format-1 check is deliberately de-optimized to fix a problem with
-     * IP modules which can't handle back-to-back accesses that compilers
-     * may generate if the "IPAC" ID is tested in a single if () statement.
-     * Format-2 modules should be Ok though.
-     */
-
-    if ((id->asciiP & 0xff) != 'P') {
-	/* Format-2 ID Prom? */
-	ipac_idProm2_t *id2 = (ipac_idProm2_t *) id;
-	if (id2->asciiVI == ('V' << 8 | 'I') &&
-	    id2->asciiTA == ('T' << 8 | 'A') &&
-	    id2->ascii4_ == ('4' << 8 | ' ') ) {
-	    return OK;
-	}
-	return S_IPAC_noIpacId;
-    }
-    if ((id->asciiA & 0xff) != 'A') {
-	return S_IPAC_noIpacId;
-    }
-    word = id->asciiC & 0xff;
-    if ((word != 'C') && (word != 'H')) {
-	return S_IPAC_noIpacId;
-    }
-
-    return OK;
+    struct slotInfo *pslot = &carriers.info[carrier].slot[slot];
+    epicsTimeStamp start, end;
+
+    epicsTimeGetCurrent(&start);
+    slotRead(carrier, slot);
+    epicsTimeGetCurrent(&end);
+    pslot->scanTime = epicsTimeDiffInSeconds(&end, &start);
+    pslot->scanned = 1;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    ipmCheck
+    ipacRescan
 
 Function:
-    Check on presence of an IPAC module at the given carrier & slot number.
+    Read the ID Proms of a carrier's slots again.
 
 Description:
-    Checks to make sure the carrier and slot numbers are legal, then probes for
-    the presence of an ID Prom, delegating this operation to the carrier driver
-    if it provides a moduleProbe() routine. If access to a the ID Prom space is
-    safe it delegates checking the IPAC header to the ipcCheckId() routine.
+    ipacAddCarrier() reads the ID Prom of every slot of a carrier once, and
+    the ipmCheck(), ipmValidate() and ipmReport() routines use that copy.
+    After a module has been inserted, removed or replaced, or an ID Prom
+    loaded into a simulated slot, this must be called to read the slot
+    again.  A slot of -1 rescans all the slots of the carrier.  The module
+    driver for a slot that changes will not know about it.
 
 Returns:
     0 = OK,
-    S_IPAC_badAddress = Bad carrier or slot number,
-    S_IPAC_badDriver = Carrier driver returned NULL ID address,
-    S_IPAC_noModule = No module installed,
-    S_IPAC_noIpacId = "IPAC"/"IPAH"/"VITA4 " identifier not found.
+    S_IPAC_badAddress = Bad carrier or slot number.
+
+Example:
+    ipacRescan(0, -1);
 
 */
 
-int ipmCheck (
+int ipacRescan (
     int carrier,
     int slot
 ) {
-    ipac_idProm_t *id;
-
     if (carrier < 0 ||
 	carrier >= carriers.number ||
-	slot < 0 ||
+	slot < -1 ||
 	slot >= carriers.info[carrier].driver->numberSlots) {
 	return S_IPAC_badAddress;
     }
 
-    id = (ipac_idProm_t *) ipmBaseAddr(carrier, slot, ipac_addrID);
-
-    if (carriers.info[carrier].driver->moduleProbe == NULL) {
-	epicsUInt16 word;
-
-	if (devReadProbe(sizeof(word), (void *)&id->asciiI, (char *)&word)) {
-	    return S_IPAC_noModule;
+    if (slot >= 0) {
+	slotScan(carrier, slot);
+    } else {
+	for (slot = 0; slot < carriers.info[carrier].driver->numberSlots;
+	     slot++) {
+	    slotScan(carrier, slot);
 	}
     }
-    else {
-	if (carriers.info[carrier].driver->moduleProbe(
-		carriers.info[carrier].cPrivate, slot) == 0)
-	return S_IPAC_noModule;
-    }
-    return ipcCheckId(id);
+    return OK;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    checkCRC_8
+    ipacDeferScan
 
 Function:
-    Calculate the CRC of the Format-1 IDprom at the given address.
+    Stop ipacAddCarrier() from reading the ID Proms of the carrier's slots.
 
 Description:
-    Generates an industry standard CRC of the ID Prom data as described  in the
-    Industry Pack specification.  The CRC byte in the Prom (at address 0x17)
-    is read as zero for the purpose of calculating  the CRC.
+    With defer set, carriers added afterwards have their slots read when
+    ipacScanAll() is called, or one at a time as module drivers first call
+    ipmCheck() or ipmValidate() for them.  Setting defer back to 0 only
+    affects carriers added after that.
 
 Returns:
-    The low 8 bits of the calculated CRC value.
+    void
+
+Example:
+    ipacDeferScan(1);
 
 */
 
-LOCAL int checkCRC_8 (
-    epicsUInt16 *data,
-    int length
+void ipacDeferScan (
+    int defer
 ) {
-    int i;
-    epicsUInt32 crc = 0xffff;
-    epicsUInt16 mask;
-
-    for (i = 0; i < length; i++) {
-	mask = 0x80;
-	while (mask) {
-	    if ((data[i] & mask) && (i != 0xb)) {
-		crc ^= 0x8000;
-	    }
-	    crc <<= 1;
-	    if (crc & 0x10000) {
-		crc ^= 0x11021;
-	    }
-	    mask >>= 1;
-	}
-    }
-
-    return (~crc) & 0xff;
+    deferScan = defer;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    checkCRC16
+    ipacScanAll
 
 Function:
-    Calculate the CRC of the Format-2 IDprom at the given address.
+    Read the ID Proms of all slots of all carriers, in parallel.
 
 Description:
-    Generates an industry standard CRC of the ID Prom data as described  in the
-    Industry Pack specification.  The CRC word in the Prom (at address 0x18)
-    is read as zero for the purpose of calculating  the CRC.
+    Starts up to tasks tasks (IPAC_SCAN_TASKS if tasks is 0 or less) which
+    take slots from a shared list and read each one with slotScan(), and
+    waits for them to finish.  A probe of an empty slot can take a bus
+    error timeout, so reading many slots at the same time makes the scan
+    take about as long as the slowest slots instead of the sum of them.
+    Each slot's scan time is shown by ipacReport() at interest level 2.
+    The carrier drivers' baseAddr() and moduleProbe() routines must cope
+    with being called from several tasks at once.  No other task may add
+    carriers while this runs.
 
 Returns:
-    The low 16 bits of the calculated CRC value.
+    0 = OK,
+    S_IPAC_noMemory = Couldn't start any scan tasks.
+
+Example:
+    ipacScanAll(0);
 
 */
 
-LOCAL int checkCRC16 (
-    epicsUInt16 *data,
-    int length
+LOCAL struct {
+    epicsMutexId lock;		/* Protects the rest */
+    epicsEventId done;		/* Signalled by the last task */
+    int carrier, slot;		/* Next slot to scan */
+    int running;		/* Tasks still running */
+} scanWork;
+
+LOCAL void scanTask (
+    void *parm
 ) {
-    int i;
-    epicsUInt32 crc = 0xffff;
-    epicsUInt16 mask;
+    int carrier, slot, last;
+
+    for (;;) {
+	epicsMutexMustLock(scanWork.lock);
+	while (scanWork.carrier < carriers.number &&
+	       scanWork.slot >= carriers.info[scanWork.carrier].driver->numberSlots) {
+	    scanWork.carrier++;
+	    scanWork.slot = 0;
+	}
+	carrier = scanWork.carrier;
+	slot = scanWork.slot++;
+	last = carrier >= carriers.number && --scanWork.running == 0;
+	epicsMutexUnlock(scanWork.lock);
 
-    for (i = 0; i < length; i++) {
-	mask = 0x8000;
-	while (mask) {
-	    if ((data[i] & mask) && (i != 0xc)) {
-		crc ^= 0x8000;
-	    }
-	    crc <<= 1;
-	    if (crc & 0x10000) {
-		crc ^= 0x11021;
-	    }
-	    mask >>= 1;
+	if (carrier >= carriers.number) break;
+	slotScan(carrier, slot);
+    }
+
+    /* The lock and event are never destroyed, so this is safe */
+    if (last) {
+	epicsEventSignal(scanWork.done);
+    }
+}
+
+int ipacScanAll (
+    int tasks
+) {
+    epicsTimeStamp start, end;
+    int carrier, slot, slots = 0, started = 0;
+    int slowCarrier = -1, slowSlot = -1;
+    double slowTime = 0.0;
+
+    if (scanWork.lock == NULL) {
+	scanWork.lock = epicsMutexMustCreate();
+	scanWork.done = epicsEventMustCreate(epicsEventEmpty);
+    }
+
+    for (carrier = 0; carrier < carriers.number; carrier++) {
+	slots += carriers.info[carrier].driver->numberSlots;
+    }
+    if (tasks <= 0) tasks = IPAC_SCAN_TASKS;
+    if (tasks > slots) tasks = slots;
+    if (tasks == 0) {
+	return OK;
+    }
+
+    epicsTimeGetCurrent(&start);
+    epicsMutexMustLock(scanWork.lock);
+    scanWork.carrier = 0;
+    scanWork.slot = 0;
+    scanWork.running = tasks;
+    while (started < tasks) {
+	char name[16];
+
+	epicsSnprintf(name, sizeof(name), "ipacScan%d", started);
+	if (epicsThreadCreate(name, epicsThreadPriorityMedium,
+		epicsThreadGetStackSize(epicsThreadStackSmall),
+		scanTask, NULL) == NULL) {
+	    break;
 	}
+	started++;
     }
+    scanWork.running -= tasks - started;
+    epicsMutexUnlock(scanWork.lock);
 
-    return (~crc) & 0xffff;
+    if (started == 0) {
+	printf("ipacScanAll: Can't start scan tasks.\n");
+	return S_IPAC_noMemory;
+    }
+    epicsEventMustWait(scanWork.done);
+    epicsTimeGetCurrent(&end);
+
+    for (carrier = 0; carrier < carriers.number; carrier++) {
+	for (slot = 0; slot < carriers.info[carrier].driver->numberSlots;
+	     slot++) {
+	    if (carriers.info[carrier].slot[slot].scanTime > slowTime) {
+		slowTime = carriers.info[carrier].slot[slot].scanTime;
+		slowCarrier = carrier;
+		slowSlot = slot;
+	    }
+	}
+    }
+    printf("ipacScanAll: %d slots in %.3f sec using %d tasks",
+	    slots, epicsTimeDiffInSeconds(&end, &start), started);
+    if (slowCarrier >= 0) {
+	printf(", slowest %d/%d %.3f sec", slowCarrier, slowSlot, slowTime);
+    }
+    printf("\n");
+    return OK;
 }
 
 
@@ -466,10 +1351,10 @@ Function:
     Validate a particular IPAC module type at the given carrier & slot number.
 
 Description:
-    Uses ipmCheck to ensure the carrier and slot numbers are legal, probe the 
-    IDprom and check that the IDprom looks like an IPAC module.  Calculates 
-    the CRC for the ID Prom, and compares the manufacturer and model ID values 
-    in the Prom to the ones given.
+    Uses ipmCheck to ensure the carrier and slot numbers are legal and that
+    the IDprom looked like an IPAC module.  Then checks the result of the
+    CRC test made when the IDprom was read, and compares the manufacturer
+    and model ID values from it to the ones given.
 
 Returns:
     0 = OK,
@@ -487,7 +1372,7 @@ int ipmValidate (
     int manufacturerId,
     int modelId
 ) {
-    ipac_idProm_t *id;
+    struct slotInfo *pslot;
     int status;
 
     status = ipmCheck(carrier, slot);
@@ -495,32 +1380,14 @@ int ipmValidate (
 	return status;
     }
 
-    id = (ipac_idProm_t *) ipmBaseAddr(carrier, slot, ipac_addrID);
-    if ((id->asciiP & 0xff) == 'P') {
-	/* Format-1 ID Prom */
-	int crc = checkCRC_8((epicsUInt16 *) id, id->bytesUsed & 0xff);
-	if (crc != (id->CRC & 0xff)) {
-	    return S_IPAC_badCRC;
-	}
-
-	if ((id->manufacturerId & 0xff)!= manufacturerId ||
-	    (id->modelId & 0xff) != modelId) {
-	    return S_IPAC_badModule;
-	}
-    } else {
-	/* Format-2 ID Prom, CRC optional */
-	ipac_idProm2_t *id2 = (ipac_idProm2_t *) id;
-	int crc = id2->CRC;
-	if (crc &&
-	    crc != checkCRC16((epicsUInt16 *) id2, id2->bytesUsed)) {
-	    return S_IPAC_badCRC;
-	}
+    pslot = &carriers.info[carrier].slot[slot];
+    if (pslot->crcStatus) {
+	return pslot->crcStatus;
+    }
 
-	if (((id2->manufacturerIdHigh & 0xff) << 16 | id2->manufacturerIdLow)
-	        != manufacturerId ||
-	    id2->modelId != modelId) {
-	    return S_IPAC_badModule;
-	}
+    if (pslot->manufacturerId != (epicsUInt32) manufacturerId ||
+	pslot->modelId != modelId) {
+	return S_IPAC_badModule;
     }
 
     return OK;
@@ -569,24 +1436,17 @@ char *ipmReport (
     } else if (status == S_IPAC_noIpacId) {
 	strcat(report, "No IPAC ID");
     } else {
-	ipac_idProm_t *id;
+	struct slotInfo *pslot = &carriers.info[carrier].slot[slot];
+	char module[16];
 
-	id = (ipac_idProm_t *) ipmBaseAddr(carrier, slot, ipac_addrID);
-	if ((id->asciiP & 0xff) == 'P') {
-	    /* Format-1 ID Prom */
-	    char module[10];
+	if (pslot->format == 1) {
 	    epicsSnprintf(module, sizeof(module), "0x%2.2x/0x%2.2x",
-			  id->manufacturerId & 0xff, id->modelId & 0xff);
-	    strcat(report, module);
+			  (unsigned) pslot->manufacturerId, pslot->modelId);
 	} else {
-	    /* Format-2 ID Prom */
-	    char module[16];
-	    ipac_idProm2_t *id2 = (ipac_idProm2_t *) id;
-	    epicsSnprintf(module, sizeof(module), "0x%2.2x%4.4x/0x%4.4x",
-			  id2->manufacturerIdHigh & 0xff,
-			  id2->manufacturerIdLow, id2->modelId);
-	    strcat(report, module);
+	    epicsSnprintf(module, sizeof(module), "0x%6.6x/0x%4.4x",
+			  (unsigned) pslot->manufacturerId, pslot->modelId);
 	}
+	strcat(report, module);
     }
 
     if (carriers.info[carrier].driver->report != NULL) {
@@ -762,6 +1622,195 @@ int ipmIntConnect (
 }
 
 
+/*******************************************************************************
+
+Routine:
+    ipmOpen
+
+Function:
+    Get a handle for the given carrier & slot number.
+
+Description:
+    Checks the carrier and slot numbers once, then asks the carrier driver
+    for the base addresses of all four address spaces of the slot and saves
+    them in the handle with the carrier's private pointer and irqCmd routine.
+    The ipmSlot...() routines take the handle instead of the carrier and
+    slot numbers and work like the ipm...() routines, but without checking
+    the numbers or looking up the carrier again on each call, which suits
+    module drivers that send interrupt commands from their ISR.  Handles
+    are never freed, so a driver should only open each slot once.
+
+Returns:
+    The slot handle, or
+    NULL if the carrier or slot number is bad or there is no memory.
+
+Example:
+    ipac_slot_t handle = ipmOpen(0, 1);
+
+*/
+
+ipac_slot_t ipmOpen (
+    int carrier,
+    int slot
+) {
+    ipac_slot_t handle;
+    ipac_addr_t space;
+
+    if (carrier < 0 ||
+	carrier >= carriers.number ||
+	slot < 0 ||
+	slot >= carriers.info[carrier].driver->numberSlots) {
+	return NULL;
+    }
+
+    handle = calloc(1, sizeof(struct ipac_slot_s));
+    if (handle == NULL) {
+	return NULL;
+    }
+
+    handle->carrier = carrier;
+    handle->slot = slot;
+    handle->cPrivate = carriers.info[carrier].cPrivate;
+    handle->irqCmd = carriers.info[carrier].driver->irqCmd;
+    for (space = ipac_addrID; space <= ipac_addrMem; space++) {
+	handle->addr[space] = carriers.info[carrier].driver->baseAddr(
+		handle->cPrivate, slot, space);
+    }
+    return handle;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipmSlotAddr, ipmSlotIrqCmd, ipmSlotIntConnect
+
+Function:
+    Slot handle versions of ipmBaseAddr, ipmIrqCmd and ipmIntConnect
+
+Description:
+    ipmSlotAddr returns the address saved when the handle was opened.
+    ipmSlotIrqCmd calls the carrier driver directly after checking only the
+    irqNumber.  ipmSlotIntConnect is not expected to be called often, so it
+    just calls ipmIntConnect.  The handle must have come from ipmOpen().
+
+Returns:
+    As ipmBaseAddr, ipmIrqCmd and ipmIntConnect.
+
+*/
+
+void *ipmSlotAddr (
+    ipac_slot_t handle,
+    ipac_addr_t space
+) {
+    if ((unsigned) space > ipac_addrMem) {
+	return NULL;
+    }
+    return handle->addr[space];
+}
+
+int ipmSlotIrqCmd (
+    ipac_slot_t handle,
+    int irqNumber,
+    ipac_irqCmd_t cmd
+) {
+    if ((unsigned) irqNumber > 1) {
+	return S_IPAC_badAddress;
+    }
+    return handle->irqCmd(handle->cPrivate, handle->slot, irqNumber, cmd);
+}
+
+int ipmSlotIntConnect (
+    ipac_slot_t handle,
+    int vecNum,
+    void (*routine)(int parameter),
+    int parameter
+) {
+    return ipmIntConnect(handle->carrier, handle->slot, vecNum,
+			 routine, parameter);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacSlotBench
+
+Function:
+    Time the slot handle routines against the carrier and slot ones.
+
+Description:
+    Opens a handle for the given slot, then times loops calls of ipmIrqCmd()
+    followed by ipmBaseAddr() against the same number of ipmSlotIrqCmd()
+    and ipmSlotAddr() calls, the pair a module driver's ISR typically makes.
+    The command is ipac_irqGetLevel, which only asks the carrier for the
+    slot's interrupt level, so the module is not disturbed.  Prints the mean
+    time per pair of calls for each and the difference.  A zero or negative
+    loops selects 100000.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = Bad carrier or slot number,
+    S_IPAC_noMemory = No memory for the handle.
+
+Example:
+    ipacSlotBench(0, 1, 100000)
+
+*/
+
+int ipacSlotBench (
+    int carrier,
+    int slot,
+    int loops
+) {
+    ipac_slot_t handle;
+    epicsTimeStamp start, end;
+    double numberTime, handleTime;
+    void * volatile sink;
+    int i;
+
+    if (loops <= 0) loops = 100000;
+    if (carrier < 0 ||
+	carrier >= carriers.number ||
+	slot < 0 ||
+	slot >= carriers.info[carrier].driver->numberSlots) {
+	return S_IPAC_badAddress;
+    }
+    handle = ipmOpen(carrier, slot);
+    if (handle == NULL) {
+	return S_IPAC_noMemory;
+    }
+
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < loops; i++) {
+	ipmIrqCmd(carrier, slot, 0, ipac_irqGetLevel);
+	sink = ipmBaseAddr(carrier, slot, ipac_addrIO);
+    }
+    epicsTimeGetCurrent(&end);
+    numberTime = epicsTimeDiffInSeconds(&end, &start);
+
+    epicsTimeGetCurrent(&start);
+    for (i = 0; i < loops; i++) {
+	ipmSlotIrqCmd(handle, 0, ipac_irqGetLevel);
+	sink = ipmSlotAddr(handle, ipac_addrIO);
+    }
+    epicsTimeGetCurrent(&end);
+    handleTime = epicsTimeDiffInSeconds(&end, &start);
+    (void) sink;
+
+    /* The benchmark's handle is the only one that is ever freed */
+    free(handle);
+
+    printf("ipacSlotBench: carrier %d slot %d, %d loops\n",
+	   carrier, slot, loops);
+    printf("    ipmIrqCmd+ipmBaseAddr %.1f nsec, "
+	   "ipmSlotIrqCmd+ipmSlotAddr %.1f nsec, saving %.1f nsec\n",
+	   1e9 * numberTime / loops, 1e9 * handleTime / loops,
+	   1e9 * (numberTime - handleTime) / loops);
+    return OK;
+}
+
+
 /*******************************************************************************
 
 Routine:
@@ -775,7 +1824,8 @@ Description:
     specified interest level.  Level 0 lists carriers only, with the number 
     of slots it supports.  Level 1 gives each slot, manufacturer & model ID 
     of the installed module (if any), and the carrier driver report for that
-    slot.  Level 2 adds the address of each memory space for the slot.
+    slot.  Level 2 adds the address of each memory space for the slot and
+    how long its ID Prom took to read.
 
 Returns:
     OK.
@@ -788,9 +1838,13 @@ int ipacReport (
     int carrier, slot;
 
     for (carrier=0; carrier < carriers.number; carrier++) {
-	printf("  IP Carrier %2d: %s, %d slots\n", carrier, 
+	printf("  IP Carrier %2d: %s, %d slots", carrier, 
 		carriers.info[carrier].driver->carrierType,
 		carriers.info[carrier].driver->numberSlots);
+	if (carriers.info[carrier].name != NULL) {
+	    printf(", \"%s\"", carriers.info[carrier].name);
+	}
+	printf("\n");
 
 	if (interest > 0) {
 	    void *memBase, *io32Base;
@@ -812,6 +1866,10 @@ int ipacReport (
 			printf(", Mem = %p", memBase);
 		    }
 		    printf("\n");
+		    if (carriers.info[carrier].slot[slot].scanned) {
+			printf("      ID Prom read in %.3f msec\n",
+				carriers.info[carrier].slot[slot].scanTime * 1e3);
+		    }
 		}
 	    }
 	}
@@ -82,6 +82,7 @@ extern "C" {
 #define S_IPAC_vectorInUse (M_ipac| 11) /*Interrupt vector in use*/
 #define S_IPAC_badIntLevel (M_ipac| 12) /*Bad interrupt level*/
 #define S_IPAC_noMemory   (M_ipac | 13) /*Malloc failed*/
+#define S_IPAC_nameInUse  (M_ipac | 14) /*IPAC carrier name already in use*/
 
 
 /* Maximum size of IP carrier report string */
@@ -205,11 +206,19 @@ epicsShareFunc int ipacAddCarrier(ipac_carrier_t *pcarrier, const char *cardPara
 epicsShareFunc int ipacReport(int interest);
 epicsShareFunc int ipacAddNullCarrier (void);
 epicsShareFunc int ipacLatestCarrier(void);
+epicsShareFunc int ipacRescan(int carrier, int slot);
+epicsShareFunc int ipacNameCarrier(int carrier, const char *name);
+epicsShareFunc int ipacFindCarrier(const char *name);
+epicsShareFunc void ipacDeferScan(int defer);
+epicsShareFunc int ipacScanAll(int tasks);
+epicsShareFunc int ipacCrcSelfTest(int images, int loops);
+epicsShareFunc int ipacSlotBench(int carrier, int slot, int loops);
 
 
 /* Functions for use in IPAC carrier drivers */
 
 epicsShareFunc int ipcCheckId(ipac_idProm_t *id);
+epicsShareFunc int ipcCalcCRC(ipac_idProm_t *id);
 
 
 /* Functions for use in IPAC module drivers */
@@ -224,6 +233,17 @@ epicsShareFunc int ipmIrqCmd(int carrier, int slot,
 epicsShareFunc int ipmIntConnect(int carrier, int slot, int vector, 
 		void (*routine)(int parameter), int parameter);
 
+/* Slot handles, for module drivers that call the above frequently */
+
+typedef struct ipac_slot_s *ipac_slot_t;
+
+epicsShareFunc ipac_slot_t ipmOpen(int carrier, int slot);
+epicsShareFunc void *ipmSlotAddr(ipac_slot_t handle, ipac_addr_t space);
+epicsShareFunc int ipmSlotIrqCmd(ipac_slot_t handle,
+		int irqNumber, ipac_irqCmd_t cmd);
+epicsShareFunc int ipmSlotIntConnect(ipac_slot_t handle, int vector,
+		void (*routine)(int parameter), int parameter);
+
 
 #ifdef __cplusplus
 }
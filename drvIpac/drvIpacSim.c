@@ -0,0 +1,707 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    drvIpacSim.c
+
+Description:
+    IPAC Carrier Driver for a simulated carrier board, which allows IP module
+    drivers to be run on a Linux host without any IP hardware.  The ID, IO,
+    IO32 and Mem spaces of each slot are backed by a memory-mapped file or by
+    anonymous shared memory, the ID Prom for each slot can be loaded from a
+    short description, and interrupts are raised by calling the routine
+    ipacSimInterrupt() from a test or emulator thread.
+
+    A simulated carrier has 4 slots.  Each slot occupies a contiguous region
+    of the backing memory, laid out at the offsets given in drvIpacSim.h, so
+    another process that maps the same file sees the same registers.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+/* ANSI headers */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/* POSIX headers */
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* EPICS headers */
+#include <epicsTypes.h>
+#include <errMdef.h>
+#include <dbDefs.h>
+#include <epicsInterrupt.h>
+#include <epicsStdio.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+/* Module headers */
+#include "drvIpac.h"
+#include "drvIpacSim.h"
+
+
+/* Characteristics of the simulated card */
+
+#define SLOTS 4         /* Number of IP slots */
+#define IRQS 2          /* Interrupt lines per slot */
+#define VECTORS 4       /* Interrupt routines per slot */
+#define MAX_MEM 8192    /* Largest Mem space in KB */
+
+
+/* Connected interrupt routine */
+
+typedef struct {
+    int vector;
+    void (*routine)(int parameter);
+    int parameter;
+} simIsr_t;
+
+
+/* Per-slot state */
+
+typedef struct {
+    void *addr[IPAC_ADDR_SPACES];
+    int irqLevel[IRQS];
+    int irqEnabled;
+    int numIsrs;
+    simIsr_t isr[VECTORS];
+    unsigned long intCount;
+    unsigned long intMissed;
+} simSlot_t;
+
+
+/* Carrier Private structure, one instance per simulated board */
+
+typedef struct private_s {
+    struct private_s *pnext;
+    epicsUInt16 carrier;
+    char *fileName;
+    size_t memSize;
+    size_t mapSize;
+    char *pbase;
+    simSlot_t slot[SLOTS];
+} private_t;
+
+static private_t *list_head = NULL;
+
+
+/*******************************************************************************
+
+Routine:
+    findCarrier
+
+Purpose:
+    Returns the private structure for a simulated carrier number
+
+Returns:
+    Pointer to the carrier's private structure, or NULL if the carrier
+    number given does not belong to a simulated carrier.
+
+*/
+
+static private_t *findCarrier (
+    int carrier
+) {
+    private_t *pcard = list_head;
+
+    while (pcard != NULL && pcard->carrier != carrier)
+	pcard = pcard->pnext;
+    return pcard;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    initialise
+
+Purpose:
+    Creates a new simulated carrier and maps its memory
+
+Description:
+    Parses the parameter string, works out how much memory the four slots
+    need and maps it, either from the named file (which is created or
+    extended as necessary) or as anonymous shared memory.  The contents of
+    an existing file are kept, so ID Proms and register values written by a
+    previous run or by another process are seen by the module drivers.
+
+Parameters:
+    The parameter string has the form "[<file>][,<memKB>]" where both parts
+    are optional.  If no file name is given anonymous memory is used, which
+    starts off zeroed so all slots appear empty.  The memKB value sets the
+    size of each slot's Mem space in kilobytes, up to 8192; if zero or
+    omitted the slots have no Mem space.
+
+Examples:
+    ""
+        Anonymous memory, no Mem space.
+    "/tmp/ipsim0,64"
+        Slots are backed by the file /tmp/ipsim0 and each has a 64KB Mem
+        space.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = Parameter string error, or file can't be mapped
+    S_IPAC_noMemory = Out of memory
+
+*/
+
+static int initialise (
+    const char *cardParams,
+    void **pprivate,
+    epicsUInt16 carrier
+) {
+    char *fileName = NULL;
+    unsigned long memKB = 0;
+    size_t slotSize;
+    private_t *pcard;
+    int slot;
+
+    if (cardParams != NULL && *cardParams != 0) {
+	const char *comma = strrchr(cardParams, ',');
+	size_t nameLen = comma ? (size_t) (comma - cardParams)
+			       : strlen(cardParams);
+
+	if (comma) {
+	    char *end;
+	    memKB = strtoul(comma + 1, &end, 0);
+	    if (*end != 0 || memKB > MAX_MEM)
+		return S_IPAC_badAddress;
+	}
+	if (nameLen) {
+	    fileName = malloc(nameLen + 1);
+	    if (!fileName)
+		return S_IPAC_noMemory;
+	    strncpy(fileName, cardParams, nameLen);
+	    fileName[nameLen] = 0;
+	}
+    }
+
+    pcard = calloc(1, sizeof(private_t));
+    if (!pcard) {
+	free(fileName);
+	return S_IPAC_noMemory;
+    }
+    pcard->carrier = carrier;
+    pcard->fileName = fileName;
+    pcard->memSize = memKB * 1024;
+    slotSize = IPAC_SIM_MEM_OFFSET + pcard->memSize;
+    pcard->mapSize = slotSize * SLOTS;
+
+    if (fileName) {
+	struct stat info;
+	void *ptr;
+	int fd = open(fileName, O_RDWR | O_CREAT, 0644);
+
+	if (fd < 0) {
+	    printf("ipacAddSimCarrier: Can't open '%s'\n", fileName);
+	    goto fail;
+	}
+	if (fstat(fd, &info) < 0 ||
+	    ((size_t) info.st_size < pcard->mapSize &&
+	     ftruncate(fd, pcard->mapSize) < 0)) {
+	    printf("ipacAddSimCarrier: Can't resize '%s'\n", fileName);
+	    close(fd);
+	    goto fail;
+	}
+	ptr = mmap(NULL, pcard->mapSize, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED) {
+	    printf("ipacAddSimCarrier: Can't map '%s'\n", fileName);
+	    goto fail;
+	}
+	pcard->pbase = (char *) ptr;
+    } else {
+	void *ptr = mmap(NULL, pcard->mapSize, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED) {
+	    free(pcard);
+	    return S_IPAC_noMemory;
+	}
+	pcard->pbase = (char *) ptr;
+    }
+
+    for (slot = 0; slot < SLOTS; slot++) {
+	char *pslot = pcard->pbase + slotSize * slot;
+	simSlot_t *psim = &pcard->slot[slot];
+
+	psim->addr[ipac_addrID] = pslot + IPAC_SIM_ID_OFFSET;
+	psim->addr[ipac_addrIO] = pslot + IPAC_SIM_IO_OFFSET;
+	psim->addr[ipac_addrIO32] = pslot + IPAC_SIM_IO32_OFFSET;
+	psim->addr[ipac_addrMem] = pcard->memSize ?
+	    pslot + IPAC_SIM_MEM_OFFSET : NULL;
+    }
+
+    pcard->pnext = list_head;
+    list_head = pcard;
+
+    *pprivate = (void *)pcard;
+    return OK;
+
+fail:
+    free(fileName);
+    free(pcard);
+    return S_IPAC_badAddress;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    report
+
+Purpose:
+    Returns a status string for the requested slot
+
+Description:
+    Shows the interrupt level set for each interrupt line, whether interrupts
+    have been enabled, and how many simulated interrupts have been delivered
+    to and discarded by the slot.
+
+Returns:
+    A static string containing the slot's status.
+
+*/
+
+static char *report (
+    void *private,
+    epicsUInt16 slot
+) {
+    private_t *pcard = (private_t *)private;
+    simSlot_t *psim = &pcard->slot[slot];
+    static char output[IPAC_REPORT_LEN];
+
+    epicsSnprintf(output, sizeof(output),
+	"Int0: level %d    Int1: level %d%s, %lu interrupts, %lu discarded",
+	psim->irqLevel[0], psim->irqLevel[1],
+	psim->irqEnabled ? ", enabled" : "",
+	psim->intCount, psim->intMissed);
+    return output;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    baseAddr
+
+Purpose:
+    Returns the base address for the requested slot & address space
+
+Description:
+    A table lookup in the private slot structure, which was filled in by
+    the initialise routine.
+
+Returns:
+    The requested address, or NULL if the carrier has no Mem space.
+
+*/
+
+static void *baseAddr (
+    void *private,
+    epicsUInt16 slot,
+    ipac_addr_t space
+) {
+    private_t *pcard = (private_t *)private;
+    return pcard->slot[slot].addr[space];
+}
+
+
+/*******************************************************************************
+
+Routine:
+    irqCmd
+
+Purpose:
+    Handles interrupter commands and status requests
+
+Description:
+    The interrupt levels are only remembered for reporting, as there is no
+    real interrupter.  Interrupts raised by ipacSimInterrupt() are discarded
+    until ipac_irqEnable has been given for the slot, and after an
+    ipac_irqDisable.  Simulated interrupts are delivered synchronously, so
+    an interrupt is never pending when polled.
+
+Returns:
+    ipac_irqLevel0-7 return 0 = OK,
+    ipac_irqGetLevel returns the current interrupt level,
+    ipac_irqEnable, ipac_irqDisable return 0 = OK,
+    ipac_irqPoll returns 0 = no interrupt pending,
+    ipac_irqSetEdge, ipac_irqSetLevel, ipac_irqClear return 0 = OK,
+    ipac_slotReset returns 0 = OK,
+    other calls return S_IPAC_notImplemented.
+
+*/
+
+static int irqCmd (
+    void *private,
+    epicsUInt16 slot,
+    epicsUInt16 irqNumber,
+    ipac_irqCmd_t cmd
+) {
+    private_t *pcard = (private_t *)private;
+    simSlot_t *psim = &pcard->slot[slot];
+
+    switch (cmd) {
+	case ipac_irqLevel0:
+	case ipac_irqLevel1:
+	case ipac_irqLevel2:
+	case ipac_irqLevel3:
+	case ipac_irqLevel4:
+	case ipac_irqLevel5:
+	case ipac_irqLevel6:
+	case ipac_irqLevel7:
+	    psim->irqLevel[irqNumber] = cmd;
+	    return OK;
+
+	case ipac_irqGetLevel:
+	    return psim->irqLevel[irqNumber];
+
+	case ipac_irqEnable:
+	    psim->irqEnabled = 1;
+	    return OK;
+
+	case ipac_irqDisable:
+	    psim->irqEnabled = 0;
+	    return OK;
+
+	case ipac_irqPoll:
+	    return 0;
+
+	case ipac_irqSetEdge:
+	case ipac_irqSetLevel:
+	case ipac_irqClear:
+	case ipac_slotReset:
+	    return OK;
+
+	default:
+	    return S_IPAC_notImplemented;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    intConnect
+
+Purpose:
+    Connect a module driver routine to a slot's interrupt vector
+
+Description:
+    Saves the routine and parameter in the slot's interrupt table, so that
+    ipacSimInterrupt() can call it later.  Connecting a second routine to a
+    vector replaces the first.  The table is updated with interrupts locked
+    so that it is safe to connect routines while a test thread is raising
+    interrupts.
+
+Returns:
+    0 = OK,
+    S_IPAC_vectorInUse = The slot's interrupt table is full.
+
+*/
+
+static int intConnect (
+    void *private,
+    epicsUInt16 slot,
+    epicsUInt16 vecNum,
+    void (*routine)(int parameter),
+    int parameter
+) {
+    private_t *pcard = (private_t *)private;
+    simSlot_t *psim = &pcard->slot[slot];
+    simIsr_t *pisr;
+    int i, key;
+
+    for (i = 0; i < psim->numIsrs; i++) {
+	if (psim->isr[i].vector == vecNum)
+	    break;
+    }
+    if (i >= VECTORS)
+	return S_IPAC_vectorInUse;
+
+    pisr = &psim->isr[i];
+    key = epicsInterruptLock();
+    pisr->vector = vecNum;
+    pisr->routine = routine;
+    pisr->parameter = parameter;
+    if (i == psim->numIsrs)
+	psim->numIsrs++;
+    epicsInterruptUnlock(key);
+    return OK;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    moduleProbe
+
+Purpose:
+    Reports whether a module is installed in the slot
+
+Description:
+    A slot whose ID Prom has never been loaded reads as all zeros, which is
+    treated as an empty slot.
+
+Returns:
+    0 = Slot is empty, 1 = ID Prom has been loaded.
+
+*/
+
+static int moduleProbe (
+    void *private,
+    epicsUInt16 slot
+) {
+    private_t *pcard = (private_t *)private;
+    ipac_idProm_t *id = (ipac_idProm_t *) pcard->slot[slot].addr[ipac_addrID];
+
+    return id->asciiI != 0;
+}
+
+
+/******************************************************************************/
+
+/* IPAC Carrier Table */
+
+static ipac_carrier_t simCarrier = {
+    "Simulated carrier",
+    SLOTS,
+    initialise,
+    report,
+    baseAddr,
+    irqCmd,
+    intConnect,
+    moduleProbe
+};
+
+int ipacAddSimCarrier(const char *cardParams) {
+    return ipacAddCarrier(&simCarrier, cardParams);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacSimLoadId
+
+Purpose:
+    Loads the ID Prom of a simulated slot from a description
+
+Description:
+    The description has the form "<manufacturer>/<model>[/<revision>]",
+    with each number in decimal or in hex with a leading 0x, the same form
+    that ipacReport() displays.  If both IDs fit into 8 bits a Format-1
+    "IPAC" ID Prom is generated, otherwise a Format-2 "VITA4 " one.  The
+    CRC is calculated and stored, so the slot will pass ipmValidate().  An
+    empty or NULL description clears the ID Prom, making the slot look empty.
+    The slot is then rescanned so ipmCheck() and friends see the change.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = Not a simulated carrier, or bad slot number,
+    S_IPAC_badModule = The description could not be parsed.
+
+Example:
+    ipacSimLoadId(0, 0, "0xb3/0x01")
+        Makes slot A of carrier 0 look like a TEWS TIP810.
+
+*/
+
+int ipacSimLoadId (
+    int carrier,
+    int slot,
+    const char *idDesc
+) {
+    private_t *pcard = findCarrier(carrier);
+    ipac_idProm_t *id;
+    unsigned long manufacturer, model, revision = 0;
+    char *end;
+
+    if (pcard == NULL || slot < 0 || slot >= SLOTS)
+	return S_IPAC_badAddress;
+
+    id = (ipac_idProm_t *) pcard->slot[slot].addr[ipac_addrID];
+
+    if (idDesc == NULL || *idDesc == 0) {
+	memset((void *)id, 0, IPAC_SIM_ID_SIZE);
+	return ipacRescan(carrier, slot);
+    }
+
+    manufacturer = strtoul(idDesc, &end, 0);
+    if (end == idDesc || *end != '/' || manufacturer > 0xffffff)
+	return S_IPAC_badModule;
+    idDesc = end + 1;
+    model = strtoul(idDesc, &end, 0);
+    if (end == idDesc || model > 0xffff)
+	return S_IPAC_badModule;
+    if (*end == '/') {
+	idDesc = end + 1;
+	revision = strtoul(idDesc, &end, 0);
+	if (end == idDesc || revision > 0xffff)
+	    return S_IPAC_badModule;
+    }
+    if (*end != 0)
+	return S_IPAC_badModule;
+
+    memset((void *)id, 0, IPAC_SIM_ID_SIZE);
+    if (manufacturer <= 0xff && model <= 0xff && revision <= 0xff) {
+	/* Format-1 ID Prom */
+	id->asciiI = 'I';
+	id->asciiP = 'P';
+	id->asciiA = 'A';
+	id->asciiC = 'C';
+	id->manufacturerId = manufacturer;
+	id->modelId = model;
+	id->revision = revision;
+	id->bytesUsed = 0x0c;
+	id->CRC = ipcCalcCRC(id);
+    } else {
+	/* Format-2 ID Prom */
+	ipac_idProm2_t *id2 = (ipac_idProm2_t *) id;
+	id2->asciiVI = 'V' << 8 | 'I';
+	id2->asciiTA = 'T' << 8 | 'A';
+	id2->ascii4_ = '4' << 8 | ' ';
+	id2->manufacturerIdHigh = manufacturer >> 16;
+	id2->manufacturerIdLow = manufacturer & 0xffff;
+	id2->modelId = model;
+	id2->revision = revision;
+	id2->bytesUsed = 0x0d;
+	id2->CRC = ipcCalcCRC(id);
+    }
+    return ipacRescan(carrier, slot);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    ipacSimInterrupt
+
+Purpose:
+    Raises a simulated interrupt from a slot
+
+Description:
+    Calls the routine connected to the given vector of the slot, or if the
+    vector is negative all routines connected to the slot, with interrupts
+    locked so that the module driver sees the same exclusion from its own
+    epicsInterruptLock() sections as it would from a real ISR.  May be
+    called from any thread; the routines run in the caller's context.
+
+Returns:
+    0 = OK,
+    S_IPAC_badAddress = Not a simulated carrier, or bad slot number,
+    S_IPAC_badIntLevel = Interrupts are not enabled for the slot,
+    S_IPAC_badVector = No routine is connected to the vector.
+
+*/
+
+int ipacSimInterrupt (
+    int carrier,
+    int slot,
+    int vector
+) {
+    private_t *pcard = findCarrier(carrier);
+    simSlot_t *psim;
+    int i, called = 0, key;
+
+    if (pcard == NULL || slot < 0 || slot >= SLOTS)
+	return S_IPAC_badAddress;
+
+    psim = &pcard->slot[slot];
+    key = epicsInterruptLock();
+    if (!psim->irqEnabled) {
+	psim->intMissed++;
+	epicsInterruptUnlock(key);
+	return S_IPAC_badIntLevel;
+    }
+    for (i = 0; i < psim->numIsrs; i++) {
+	simIsr_t *pisr = &psim->isr[i];
+
+	if (vector < 0 || pisr->vector == vector) {
+	    pisr->routine(pisr->parameter);
+	    called++;
+	}
+    }
+    if (called)
+	psim->intCount++;
+    else
+	psim->intMissed++;
+    epicsInterruptUnlock(key);
+
+    return called ? OK : S_IPAC_badVector;
+}
+
+
+/* iocsh Command Table and Registrar */
+
+static const iocshArg simArg0 =
+    {"cardParams", iocshArgString};
+static const iocshArg * const addArgs[] =
+    {&simArg0};
+
+static const iocshFuncDef simAddFuncDef =
+    {"ipacAddSimCarrier", NELEMENTS(addArgs), addArgs};
+
+static void simAddCallFunc(const iocshArgBuf *args) {
+    ipacAddSimCarrier(args[0].sval);
+}
+
+static const iocshArg simArgCarrier =
+    {"carrier", iocshArgInt};
+static const iocshArg simArgSlot =
+    {"slot", iocshArgInt};
+static const iocshArg simArgIdDesc =
+    {"idDesc", iocshArgString};
+static const iocshArg simArgVector =
+    {"vector", iocshArgInt};
+static const iocshArg * const loadIdArgs[] =
+    {&simArgCarrier, &simArgSlot, &simArgIdDesc};
+static const iocshArg * const interruptArgs[] =
+    {&simArgCarrier, &simArgSlot, &simArgVector};
+
+static const iocshFuncDef simLoadIdFuncDef =
+    {"ipacSimLoadId", NELEMENTS(loadIdArgs), loadIdArgs};
+
+static void simLoadIdCallFunc(const iocshArgBuf *args) {
+    int status = ipacSimLoadId(args[0].ival, args[1].ival, args[2].sval);
+    if (status)
+	printf("ipacSimLoadId: Error %d\n", status & 0xffff);
+}
+
+static const iocshFuncDef simInterruptFuncDef =
+    {"ipacSimInterrupt", NELEMENTS(interruptArgs), interruptArgs};
+
+static void simInterruptCallFunc(const iocshArgBuf *args) {
+    int status = ipacSimInterrupt(args[0].ival, args[1].ival, args[2].ival);
+    if (status)
+	printf("ipacSimInterrupt: Error %d\n", status & 0xffff);
+}
+
+static void epicsShareAPI ipacSimRegistrar(void) {
+    iocshRegister(&simAddFuncDef, simAddCallFunc);
+    iocshRegister(&simLoadIdFuncDef, simLoadIdCallFunc);
+    iocshRegister(&simInterruptFuncDef, simInterruptCallFunc);
+}
+
+epicsExportRegistrar(ipacSimRegistrar);
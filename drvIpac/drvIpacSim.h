@@ -0,0 +1,64 @@
+/*******************************************************************************
+
+Project:
+    IndustryPack Driver Interface for EPICS
+
+File:
+    drvIpacSim.h
+
+Description:
+    Header file for the simulated IPAC carrier, which provides the routines
+    that test code uses to load ID Proms into and raise interrupts from the
+    simulated slots.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#ifndef INCdrvIpacSimH
+#define INCdrvIpacSimH
+
+#include "shareLib.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Size of each simulated address space, except Mem which is configurable */
+
+#define IPAC_SIM_ID_SIZE    0x080
+#define IPAC_SIM_IO_SIZE    0x080
+#define IPAC_SIM_IO32_SIZE  0x100
+
+/* Offset of each space within a slot's region of the backing file */
+
+#define IPAC_SIM_ID_OFFSET    0x000
+#define IPAC_SIM_IO_OFFSET    0x100
+#define IPAC_SIM_IO32_OFFSET  0x200
+#define IPAC_SIM_MEM_OFFSET   0x400
+
+
+epicsShareFunc int ipacAddSimCarrier(const char *cardParams);
+epicsShareFunc int ipacSimLoadId(int carrier, int slot, const char *idDesc);
+epicsShareFunc int ipacSimInterrupt(int carrier, int slot, int vector);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* INCdrvIpacSimH */
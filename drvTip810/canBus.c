@@ -0,0 +1,789 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canBus.c
+
+Description:
+    Bus registry and address parsing routines which are common to all CAN
+    bus drivers.  Each driver registers the names of its buses here along
+    with its entry table, and canOpen looks them up through a hash table,
+    so finding a bus costs the same however many buses the IOC has.  The
+    bus routines such as canWrite and canMessage call through the entry
+    table of the bus they are given, so device support works with any
+    type of CAN controller.  The registry holds the only copy
+    of each bus name, which canIoParse hands out rather than allocating a
+    copy for every record.  Device support compiles its address strings
+    through a second table, so records with identical addresses share one
+    read-only canIo_t and the string is only parsed once.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include <epicsTypes.h>
+#include <epicsThread.h>
+#include <epicsTimer.h>
+#include <gpHash.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+
+
+#define BUS_TABLE_SIZE 256	/* Hash table buckets, power of 2 */
+#define IO_TABLE_SIZE 4096	/* Address cache buckets, power of 2 */
+
+
+/* Registered bus, allocated together with its name */
+
+struct canBusID_s {
+    const canDriver_t *pdriver;
+    void *pdevice;		/* Driver's device pointer */
+    char name[1];		/* Bus name, extended by malloc */
+};
+
+/* Address cache entry, allocated together with its key string */
+
+typedef struct ioEntry_s {
+    canIo_t io;			/* Must be first */
+    struct ioEntry_s *next;
+    unsigned long users;
+    char key[1];		/* Address string, extended by malloc */
+} ioEntry_t;
+
+
+static struct gphPvt *busTable = NULL;
+static struct gphPvt *ioTable = NULL;
+static ioEntry_t *ioFirst = NULL;
+
+static unsigned long ioEntries = 0;
+static unsigned long ioLookups = 0;
+static unsigned long ioHits = 0;
+static unsigned long ioFailures = 0;
+static size_t ioBytes = 0;
+
+int canSilenceErrors = FALSE;	/* for EPICS device support use */
+epicsTimerQueueId canTimerQ = NULL;	/* Shared by all the drivers */
+
+
+/*******************************************************************************
+
+Routine:
+    canBusRegister
+
+Purpose:
+    Add a CAN bus to the registry
+
+Description:
+    Called by a CAN bus driver for each bus it creates, giving its entry
+    table and the device pointer to be passed to the entry routines.  The
+    registry takes its own copy of the bus name, which is never freed.
+    Bus names must be unique across all drivers.  The first registration
+    also creates canTimerQ, which the drivers and device support share.
+
+Returns:
+    0, or
+    S_can_badAddress if the name is empty or too long,
+    S_can_duplicateBus if the name is already registered,
+    ENOMEM if malloc() fails.
+
+Example:
+    status = canBusRegister("CAN1", &t810Driver, pdevice);
+
+*/
+
+int canBusRegister (
+    const char *pbusName,
+    const canDriver_t *pdriver,
+    void *pdevice
+) {
+    GPHENTRY *pgph;
+    canBusID_t pbus;
+    size_t len;
+
+    if (pbusName == NULL ||
+	(len = strlen(pbusName)) == 0 ||
+	len >= CAN_BUSNAME_SIZE) {
+	return S_can_badAddress;
+    }
+
+    if (busTable == NULL) {
+	gphInitPvt(&busTable, BUS_TABLE_SIZE);
+    }
+
+    if (gphFind(busTable, pbusName, NULL) != NULL) {
+	return S_can_duplicateBus;
+    }
+
+    if (canTimerQ == NULL) {
+	canTimerQ = epicsTimerQueueAllocate(1, epicsThreadPriorityLow);
+	if (canTimerQ == NULL) {
+	    return ENOMEM;
+	}
+    }
+
+    pbus = malloc(sizeof(struct canBusID_s) + len);
+    if (pbus == NULL) {
+	return ENOMEM;
+    }
+    pbus->pdriver = pdriver;
+    pbus->pdevice = pdevice;
+    strcpy(pbus->name, pbusName);
+
+    pgph = gphAdd(busTable, pbus->name, NULL);
+    if (pgph == NULL) {
+	free(pbus);
+	return ENOMEM;
+    }
+    pgph->userPvt = pbus;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusDevice
+
+Purpose:
+    Return a driver's device pointer for a bus
+
+Description:
+    Lets a driver's own routines check that a bus ID belongs to it.
+
+Returns:
+    The device pointer given to canBusRegister, or NULL if busID is not
+    a bus of the driver whose entry table is pdriver.
+
+Example:
+    t810Dev_t *pdevice = canBusDevice(busID, &t810Driver);
+
+*/
+
+void *canBusDevice (
+    canBusID_t busID,
+    const canDriver_t *pdriver
+) {
+    if (busID == NULL ||
+	busID->pdriver != pdriver) {
+	return NULL;
+    }
+    return busID->pdevice;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canOpen
+
+Purpose:
+    Return device pointer for given CAN bus name
+
+Description:
+    Looks up the bus name in the registry, and returns the bus ID to be
+    passed to the other bus routines.
+
+Returns:
+    0, or S_can_noDevice if no match found.
+
+Example:
+    void *can1;
+    status = canOpen("CAN1", &can1);
+
+*/
+
+int canOpen (
+    const char *pbusName,
+    canBusID_t *pbusID
+) {
+    GPHENTRY *pgph;
+
+    if (busTable == NULL ||
+	(pgph = gphFind(busTable, pbusName, NULL)) == NULL) {
+	return S_can_noDevice;
+    }
+
+    *pbusID = pgph->userPvt;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusReset, canBusStop, canBusRestart
+
+Purpose:
+    Reset, stop or restart the named CANbus
+
+Description:
+    Looks up the bus and calls its driver.  canBusReset resets the
+    controller and its counters, canBusStop holds the controller so the
+    bus is idle, and canBusRestart lets it run again after a canBusStop.
+    The name lookup takes the registry's lock, so these must not be called
+    from interrupt context; a driver's ISR calls its own routines instead.
+
+Returns:
+    0, or
+    S_can_noDevice if no match found,
+    any error status from the driver.
+
+Example:
+    status = canBusReset("CAN1");
+
+*/
+
+int canBusReset (
+    const char *pbusName
+) {
+    canBusID_t busID;
+    int status = canOpen(pbusName, &busID);
+
+    if (status) return status;
+    return (*busID->pdriver->busReset)(busID->pdevice);
+}
+
+int canBusStop (
+    const char *pbusName
+) {
+    canBusID_t busID;
+    int status = canOpen(pbusName, &busID);
+
+    if (status) return status;
+    return (*busID->pdriver->busStop)(busID->pdevice);
+}
+
+int canBusRestart (
+    const char *pbusName
+) {
+    canBusID_t busID;
+    int status = canOpen(pbusName, &busID);
+
+    if (status) return status;
+    return (*busID->pdriver->busRestart)(busID->pdevice);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canWrite, canWriteNotify, canMessage, canMsgDelete, canSignal,
+    canRead, canReadAsync
+
+Purpose:
+    CAN bus I/O routines
+
+Description:
+    Each routine calls the routine of the same purpose in the entry table
+    of the driver that registered the bus, which does all the checking
+    of the other parameters.  The drivers' documentation describes what
+    the routines do.
+
+Returns:
+    S_can_noDevice for a NULL bus ID, or
+    the driver's status.
+
+*/
+
+int canWrite (
+    canBusID_t busID,
+    const canMessage_t *pmessage,
+    double timeout
+) {
+    if (busID == NULL) return S_can_noDevice;
+    return (*busID->pdriver->write)(busID->pdevice, pmessage, timeout);
+}
+
+int canWriteNotify (
+    canBusID_t busID,
+    const canMessage_t *pmessage,
+    canTxCallback_t *pcallback,
+    void *pprivate,
+    double timeout
+) {
+    if (busID == NULL) return S_can_noDevice;
+    return (*busID->pdriver->writeNotify)(busID->pdevice, pmessage,
+					  pcallback, pprivate, timeout);
+}
+
+int canMessage (
+    canBusID_t busID,
+    canID_t identifier,
+    canMsgCallback_t *pcallback,
+    void *pprivate
+) {
+    if (busID == NULL) return S_can_noDevice;
+    return (*busID->pdriver->message)(busID->pdevice, identifier,
+				      pcallback, pprivate);
+}
+
+int canMsgDelete (
+    canBusID_t busID,
+    canID_t identifier,
+    canMsgCallback_t *pcallback,
+    void *pprivate
+) {
+    if (busID == NULL) return S_can_noDevice;
+    return (*busID->pdriver->msgDelete)(busID->pdevice, identifier,
+					pcallback, pprivate);
+}
+
+int canSignal (
+    canBusID_t busID,
+    canSigCallback_t *pcallback,
+    void *pprivate
+) {
+    if (busID == NULL) return S_can_noDevice;
+    return (*busID->pdriver->signal)(busID->pdevice, pcallback, pprivate);
+}
+
+int canRead (
+    canBusID_t busID,
+    canMessage_t *pmessage,
+    double timeout
+) {
+    if (busID == NULL) return S_can_noDevice;
+    return (*busID->pdriver->read)(busID->pdevice, pmessage, timeout);
+}
+
+int canReadAsync (
+    canBusID_t busID,
+    canID_t identifier,
+    canReadCallback_t *pcallback,
+    void *pprivate,
+    double timeout
+) {
+    if (busID == NULL) return S_can_noDevice;
+    return (*busID->pdriver->readAsync)(busID->pdevice, identifier,
+					pcallback, pprivate, timeout);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canBusStats
+
+Purpose:
+    Find the traffic statistics for a bus
+
+Description:
+    Returns the statistics block that the bus's driver keeps, which stays
+    valid for the life of the IOC and may be read at any time; see
+    canStats.h for its layout.  Drivers that keep no statistics leave the
+    stats entry of their table NULL.
+
+Returns:
+    Pointer to the statistics, or
+    NULL for a NULL bus ID or a driver without them.
+
+*/
+
+const canStats_t *canBusStats (
+    canBusID_t busID
+) {
+    if (busID == NULL ||
+	busID->pdriver->stats == NULL) {
+	return NULL;
+    }
+    return (*busID->pdriver->stats)(busID->pdevice);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canIoParse
+
+Purpose:
+    Parse a CAN address string into a canIo_t structure
+
+Description:
+    canString which must match the format below is converted by this routine
+    into the relevent fields of the canIo_t structure pointed to by pcanIo:
+
+    	busname{/timeout}:id{+n}{.offset} parameter
+
+    where
+    	busname is alphanumeric, all other fields are hex, decimal or octal
+    	timeout is in milliseconds
+	id and any number of +n components are summed to give the CAN Id
+	a trailing x marks the Id as a 29-bit extended identifier
+	offset is the byte offset into the message
+	parameter is a string or integer for use by device support
+
+    The busName returned is the registry's copy of the name, which is shared
+    by every record on that bus and must not be modified or freed.  It is
+    NULL if the bus name is not registered.
+
+    The fsd, mask and sign fields are precomputed from the parameter for
+    the analogue device supports.  A non-zero parameter gives the full
+    scale of the raw value, which is put in fsd less one if it is a power
+    of two, and mask is set to cover it; a negative parameter means the
+    value is signed, and sign is then the value of its sign bit.
+    A zero parameter leaves mask zero, and sign is set to 4 or 8 if the
+    parameter string is "float" or "double" respectively.
+
+    An Id above 0x7ff is always an extended identifier; the x is only
+    needed for extended identifiers that would otherwise be standard ones.
+    Extended identifiers are returned with the CAN_ID_EXTENDED bit set.
+
+Returns:
+    0, or
+    S_can_badAddress for illegal input strings,
+    S_can_noDevice for an unregistered bus name.
+
+Example:
+    canIoParse("CAN1/20:0126+4+1.4 0xfff", &myIo);
+    canIoParse("CAN1:0x18ff0100+0x21x.2 255", &myIo);
+
+*/
+
+int canIoParse (
+    char *canString,
+    canIo_t *pcanIo
+) {
+    char name[CAN_BUSNAME_SIZE];
+    char separator;
+    char *pname;
+    GPHENTRY *pgph;
+    epicsUInt32 fsd;
+    unsigned long id;
+
+    if (canString == NULL ||
+	pcanIo == NULL) {
+	return S_can_badAddress;
+    }
+
+    pcanIo->canBusID = NULL;
+    pcanIo->busName = NULL;
+
+    /* Get rid of leading whitespace and non-alphanumeric chars */
+    while (!isalnum(0xff & *canString)) {
+	if (*canString++ == '\0') {
+	    return S_can_badAddress;
+	}
+    }
+
+    /* First part of string is the bus name */
+    pname = canString;
+
+    /* find the end of the busName */
+    canString = strpbrk(canString, "/:");
+    if (canString == NULL ||
+	*canString == '\0') {
+	return S_can_badAddress;
+    }
+
+    /* now we're at character after the end of the busName */
+    if (canString - pname >= CAN_BUSNAME_SIZE) {
+	return S_can_noDevice;		/* Too long to be registered */
+    }
+    memcpy(name, pname, canString - pname);
+    name[canString - pname] = '\0';
+    separator = *canString++;
+
+    /* Handle /<timeout> if present, convert from ms to seconds */
+    if (separator == '/') {
+	pcanIo->timeout = ((double)strtol(canString, &canString, 0))/1000.0;
+	separator = *canString++;
+    } else {
+	pcanIo->timeout = -1.0;
+    }
+
+    /* String must contain :<canID> */
+    if (separator != ':') {
+	return S_can_badAddress;
+    }
+    id = strtoul(canString, &canString, 0);
+    separator = *canString++;
+
+    /* Handle any number of optional +<n> additions to the ID */
+    while (separator == '+') {
+	id += strtol(canString, &canString, 0);
+	separator = *canString++;
+    }
+
+    /* Handle x for an extended ID; large IDs are extended anyway */
+    if (separator == 'x' ||
+	id >= CAN_IDENTIFIERS) {
+	if (id >= CAN_EXT_IDENTIFIERS) {
+	    return S_can_badAddress;
+	}
+	id |= CAN_ID_EXTENDED;
+	if (separator == 'x') {
+	    separator = *canString++;
+	}
+    }
+    pcanIo->identifier = id;
+
+    /* Handle .<offset> if present */
+    if (separator == '.') {
+	pcanIo->offset = strtoul(canString, &canString, 0);
+	if (pcanIo->offset >= CAN_DATA_SIZE) {
+	    return S_can_badAddress;
+	}
+	separator = *canString++;
+    } else {
+	pcanIo->offset = 0;
+    }
+
+    /* Final parameter is separated by whitespace */
+    if (separator != ' ' &&
+	separator != '\t') {
+	return S_can_badAddress;
+    }
+    pcanIo->parameter = strtol(canString, &pcanIo->paramStr, 0);
+
+    /* Precompute the full scale, raw value mask and sign bit */
+    fsd = abs(pcanIo->parameter);
+    pcanIo->fsd = pcanIo->mask = pcanIo->sign = 0;
+    if (fsd > 0) {
+	if ((fsd & (fsd-1)) == 0) {
+	    fsd--;
+	}
+	pcanIo->fsd = fsd;
+	pcanIo->mask = 1;
+	while (pcanIo->mask < fsd) {
+	    pcanIo->mask <<= 1;
+	}
+	pcanIo->mask--;
+	if (pcanIo->parameter < 0) {
+	    pcanIo->sign = (pcanIo->mask >> 1) + 1;
+	}
+    } else if (pcanIo->paramStr) {
+	if (strcmp(pcanIo->paramStr, "float") == 0) {
+	    pcanIo->sign = 4;
+	} else if (strcmp(pcanIo->paramStr, "double") == 0) {
+	    pcanIo->sign = 8;
+	}
+    }
+
+    /* Ok, finally look up the bus name */
+    if (busTable == NULL ||
+	(pgph = gphFind(busTable, name, NULL)) == NULL) {
+	return S_can_noDevice;
+    }
+    pcanIo->busName = pgph->name;
+    pcanIo->canBusID = pgph->userPvt;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canIoCompile
+
+Purpose:
+    Return a shared, parsed canIo_t structure for a CAN address string
+
+Description:
+    Looks up canString in the address cache, and if it isn't there parses
+    it with canIoParse into a new cache entry.  Every caller with the same
+    address string gets a pointer to the same canIo_t, which is never freed
+    and must not be modified; its paramStr points into the cache's own copy
+    of the string.  Strings that fail to parse are not cached, and return
+    NULL through ppcanIo.
+
+    Like the bus registry, the cache has no lock, so this must only be
+    called while the IOC is being initialised, as the device supports do
+    from their init_record routines.  Nothing locks the lookup counts
+    either, so two threads calling it at once could corrupt the cache.
+
+Returns:
+    0, or
+    S_can_badAddress for illegal input strings,
+    S_can_noDevice for an unregistered bus name,
+    ENOMEM if malloc() fails.
+
+Example:
+    const canIo_t *pinp;
+    status = canIoCompile("CAN1/20:0126+4+1.4 0xfff", &pinp);
+
+*/
+
+int canIoCompile (
+    const char *canString,
+    const canIo_t **ppcanIo
+) {
+    GPHENTRY *pgph;
+    ioEntry_t *pentry;
+    size_t size;
+    int status;
+
+    *ppcanIo = NULL;
+    if (canString == NULL) {
+	return S_can_badAddress;
+    }
+
+    if (ioTable == NULL) {
+	gphInitPvt(&ioTable, IO_TABLE_SIZE);
+    }
+
+    ioLookups++;
+    pgph = gphFind(ioTable, canString, NULL);
+    if (pgph != NULL) {
+	pentry = pgph->userPvt;
+	pentry->users++;
+	ioHits++;
+	*ppcanIo = &pentry->io;
+	return 0;
+    }
+
+    size = offsetof(ioEntry_t, key) + strlen(canString) + 1;
+    pentry = malloc(size);
+    if (pentry == NULL) {
+	return ENOMEM;
+    }
+    strcpy(pentry->key, canString);
+
+    status = canIoParse(pentry->key, &pentry->io);
+    if (status) {
+	free(pentry);
+	ioFailures++;
+	return status;
+    }
+
+    pgph = gphAdd(ioTable, pentry->key, NULL);
+    if (pgph == NULL) {
+	free(pentry);
+	return ENOMEM;
+    }
+    pgph->userPvt = pentry;
+    pentry->users = 1;
+    pentry->next = ioFirst;
+    ioFirst = pentry;
+    ioEntries++;
+    ioBytes += size;
+
+    *ppcanIo = &pentry->io;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canIoCacheReport
+
+Purpose:
+    Print address cache statistics
+
+Description:
+    Prints the number of compiled addresses and how often canIoCompile
+    found a string already in the cache.  With interest > 0 it also lists
+    each cached address and the number of records sharing it.
+
+Returns:
+    void
+
+Example:
+    canIoCacheReport 1
+
+*/
+
+void canIoCacheReport (
+    int interest
+) {
+    ioEntry_t *pentry;
+
+    printf("CAN address cache: %lu entries, %lu bytes\n",
+	   ioEntries, (unsigned long) ioBytes);
+    printf("  %lu lookups, %lu hits (%.1f%%), %lu failures\n",
+	   ioLookups, ioHits,
+	   ioLookups ? 100.0 * ioHits / ioLookups : 0.0, ioFailures);
+
+    if (interest > 0) {
+	for (pentry = ioFirst; pentry != NULL; pentry = pentry->next) {
+	    printf("  %5lu  \"%s\" bus=%s id=%#x off=%u parm=%ld",
+		   pentry->users, pentry->key, pentry->io.busName,
+		   pentry->io.identifier, pentry->io.offset,
+		   (long) pentry->io.parameter);
+	    if (pentry->io.mask || pentry->io.sign) {
+		printf(" mask=%#lx sign=%#lx",
+		       (unsigned long) pentry->io.mask,
+		       (unsigned long) pentry->io.sign);
+	    }
+	    printf("\n");
+	}
+    }
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* canIoCacheReport(int interest) */
+static const iocshArg canIoCacheReportArg0 = {"interest", iocshArgInt};
+static const iocshArg * const canIoCacheReportArgs[1] = {
+    &canIoCacheReportArg0};
+static const iocshFuncDef canIoCacheReportFuncDef =
+    {"canIoCacheReport",1,canIoCacheReportArgs};
+static void canIoCacheReportCallFunc(const iocshArgBuf *args)
+{
+    canIoCacheReport(args[0].ival);
+}
+
+/* canBusReset(char *pbusName) */
+static const iocshArg canBusResetArg0 = {"busName", iocshArgString};
+static const iocshArg * const canBusResetArgs[1] = {&canBusResetArg0};
+static const iocshFuncDef canBusResetFuncDef =
+    {"canBusReset",1,canBusResetArgs};
+static void canBusResetCallFunc(const iocshArgBuf *args)
+{
+    canBusReset(args[0].sval);
+}
+
+/* canBusStop(char *pbusName) */
+static const iocshArg canBusStopArg0 = {"busName", iocshArgString};
+static const iocshArg * const canBusStopArgs[1] = {&canBusStopArg0};
+static const iocshFuncDef canBusStopFuncDef =
+    {"canBusStop",1,canBusStopArgs};
+static void canBusStopCallFunc(const iocshArgBuf *args)
+{
+    canBusStop(args[0].sval);
+}
+
+/* canBusRestart(char *pbusName) */
+static const iocshArg canBusRestartArg0 = {"busName", iocshArgString};
+static const iocshArg * const canBusRestartArgs[1] = {&canBusRestartArg0};
+static const iocshFuncDef canBusRestartFuncDef =
+    {"canBusRestart",1,canBusRestartArgs};
+static void canBusRestartCallFunc(const iocshArgBuf *args)
+{
+    canBusRestart(args[0].sval);
+}
+
+static void canBusRegistrar(void) {
+    iocshRegister(&canIoCacheReportFuncDef,canIoCacheReportCallFunc);
+    iocshRegister(&canBusResetFuncDef,canBusResetCallFunc);
+    iocshRegister(&canBusStopFuncDef,canBusStopCallFunc);
+    iocshRegister(&canBusRestartFuncDef,canBusRestartCallFunc);
+}
+epicsExportRegistrar(canBusRegistrar);
@@ -37,12 +37,16 @@ Copyright (c) 1995-2000 Andrew Johnson
 #define INCcanBusH
 
 #include "epicsTypes.h"
+#include "epicsTime.h"
 #include "epicsTimer.h"
 #include "shareLib.h"
 
 
-#define CAN_IDENTIFIERS 2048
+#define CAN_IDENTIFIERS 2048		/* Standard 11-bit identifiers */
+#define CAN_EXT_IDENTIFIERS 0x20000000	/* Extended 29-bit identifiers */
+#define CAN_ID_EXTENDED 0x80000000	/* Flags an extended identifier */
 #define CAN_DATA_SIZE 8
+#define CAN_BUSNAME_SIZE 40	/* Longest bus name + 1 */
 
 #define CAN_BUS_OK 0
 #define CAN_BUS_ERROR 1
@@ -57,43 +61,102 @@ Copyright (c) 1995-2000 Andrew Johnson
 #define S_can_badAddress	(M_can| 2) /*CAN address syntax error*/
 #define S_can_noDevice		(M_can| 3) /*CAN bus name does not exist*/
 #define S_can_noMessage 	(M_can| 4) /*no matching CAN message callback*/
+#define S_can_txAborted 	(M_can| 5) /*CAN transmission aborted by reset*/
+#define S_can_duplicateBus	(M_can| 6) /*CAN bus name already registered*/
+#define S_can_timeout		(M_can| 7) /*no reply to CAN remote request*/
+#define S_can_badParameter	(M_can| 8) /*illegal CAN bus driver parameter*/
 
-typedef epicsUInt16 canID_t;
+typedef epicsUInt32 canID_t;
 typedef struct canBusID_s *canBusID_t;
+typedef struct canStats_s canStats_t;
 
 typedef struct {
-    canID_t identifier;		/* 0 .. 2047 with holes! */
+    canID_t identifier;		/* 0 .. 2047 with holes! or
+				   CAN_ID_EXTENDED | 0 .. 0x1fffffff */
     enum {
 	SEND = 0, RTR = 1
     } rtr;			/* Remote Transmission Request */
     epicsUInt8 length;		/* 0 .. 8 */
     epicsUInt8 data[CAN_DATA_SIZE];
+    epicsTimeStamp timestamp;	/* Received messages: arrival time */
 } canMessage_t;
 
 typedef struct {
-    char *busName;
+    const char *busName;	/* Shared, owned by the bus registry */
     double timeout;
     canID_t identifier;
     epicsUInt16 offset;
     epicsInt32 parameter;
     char *paramStr;
     canBusID_t canBusID;
+    epicsUInt32 fsd;		/* Full scale raw value, 0 if none */
+    epicsUInt32 mask;		/* Raw data mask from parameter, 0 if none */
+    epicsUInt32 sign;		/* Sign bit, or 4/8 for float/double */
 } canIo_t;
 
 typedef void canMsgCallback_t(void *pprivate, const canMessage_t *pmessage);
 typedef void canSigCallback_t(void *pprivate, int status);
+typedef void canTxCallback_t(void *pprivate, int status);
+typedef void canReadCallback_t(void *pprivate, int status,
+		    const canMessage_t *pmessage);
+
+/* Driver entry table, one for each type of CAN controller.  The routines
+ * below implement the bus routines of the same name, and are given the
+ * device pointer that the driver passed to canBusRegister. */
+
+typedef struct {
+    const char *driverName;
+			/* Controller type, for reports */
+    int (*busReset)(void *pdevice);
+			/* Reset the controller and its counters */
+    int (*busStop)(void *pdevice);
+			/* Stop I/O on the bus */
+    int (*busRestart)(void *pdevice);
+			/* Restart I/O after a busStop */
+    int (*write)(void *pdevice, const canMessage_t *pmessage,
+		double timeout);
+			/* Send a message */
+    int (*writeNotify)(void *pdevice, const canMessage_t *pmessage,
+		canTxCallback_t *pcallback, void *pprivate, double timeout);
+			/* Queue a message, call back once it's sent */
+    int (*message)(void *pdevice, canID_t identifier,
+		canMsgCallback_t *pcallback, void *pprivate);
+			/* Register a message callback */
+    int (*msgDelete)(void *pdevice, canID_t identifier,
+		canMsgCallback_t *pcallback, void *pprivate);
+			/* Remove a message callback */
+    int (*signal)(void *pdevice, canSigCallback_t *pcallback,
+		void *pprivate);
+			/* Register an error signal callback */
+    int (*read)(void *pdevice, canMessage_t *pmessage, double timeout);
+			/* Send an RTR and wait for the reply */
+    int (*readAsync)(void *pdevice, canID_t identifier,
+		canReadCallback_t *pcallback, void *pprivate, double timeout);
+			/* Send an RTR, call back with the reply */
+    const canStats_t *(*stats)(void *pdevice);
+			/* Return the bus statistics, or NULL */
+} canDriver_t;
 
 
 extern int canSilenceErrors;
 extern epicsTimerQueueId canTimerQ;
 
+epicsShareFunc int canBusRegister(const char *busName,
+		    const canDriver_t *pdriver, void *pdevice);
+epicsShareFunc void *canBusDevice(canBusID_t busID,
+		    const canDriver_t *pdriver);
 epicsShareFunc int canOpen(const char *busName, canBusID_t *pbusID);
 epicsShareFunc int canBusReset(const char *busName);
 epicsShareFunc int canBusStop(const char *busName);
 epicsShareFunc int canBusRestart(const char *busName);
+epicsShareFunc const canStats_t *canBusStats(canBusID_t busID);
 epicsShareFunc int canRead(canBusID_t busID, canMessage_t *pmessage, double timeout);
+epicsShareFunc int canReadAsync(canBusID_t busID, canID_t identifier,
+		    canReadCallback_t callback, void *pprivate, double timeout);
 epicsShareFunc int canWrite(canBusID_t busID, const canMessage_t *pmessage,
 		    double timeout);
+epicsShareFunc int canWriteNotify(canBusID_t busID, const canMessage_t *pmessage,
+		    canTxCallback_t callback, void *pprivate, double timeout);
 epicsShareFunc int canMessage(canBusID_t busID, canID_t identifier, 
 		      canMsgCallback_t callback, void *pprivate);
 epicsShareFunc int canMsgDelete(canBusID_t busID, canID_t identifier, 
@@ -101,6 +164,8 @@ epicsShareFunc int canMsgDelete(canBusID_t busID, canID_t identifier,
 epicsShareFunc int canSignal(canBusID_t busID, canSigCallback_t callback,
 		     void *pprivate);
 epicsShareFunc int canIoParse(char *canString, canIo_t *pcanIo);
+epicsShareFunc int canIoCompile(const char *canString, const canIo_t **ppcanIo);
+epicsShareFunc void canIoCacheReport(int interest);
 
 
 #endif /* INCcanBusH */
@@ -0,0 +1,528 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canCombine.c
+
+Description:
+    Output combiners for the CAN device supports.  There is one combiner
+    for each message identifier on each bus that output records write, and
+    it holds a shadow copy of that message.  Each record owns a byte or bit
+    field of the message, and a write merges the new field value into the
+    shadow before a frame is sent, so records that share an identifier no
+    longer clobber each other's bytes.  The first write starts a short
+    coalescing window and the frame is sent when it expires, so all of the
+    records written during one scan pass produce only one frame.  EPICS
+    has no hook at the end of a scan pass, so the window stands in for
+    one; canCombinerWindow() changes it, and a window of zero sends every
+    write at once.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsTimer.h>
+#include <gpHash.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+#include "canCombine.h"
+
+
+#define COMBINER_TABLE_SIZE 256	/* Hash table buckets, power of 2 */
+#define COMBINER_WINDOW 0.002	/* Default coalescing window, seconds */
+
+
+struct canCombiner_s {
+    struct canCombiner_s *next;
+    const char *busName;	/* Shared, owned by the bus registry */
+    canBusID_t busID;
+    canID_t identifier;
+    char key[12];		/* Hash key, identifier in hex */
+    epicsMutexId lock;		/* Protects everything below */
+    epicsTimerId timer;		/* Created when first needed */
+    canMessage_t frame;		/* Shadow copy of the message */
+    int pending;		/* Frame waiting for the window to expire */
+    int status;			/* Latched error from the last flush */
+    unsigned long users;
+    unsigned long writes;
+    unsigned long frames;
+    unsigned long failures;
+};
+
+
+static struct gphPvt *combinerTable = NULL;
+static struct canCombiner_s *firstCombiner = NULL;
+static double combineWindow = COMBINER_WINDOW;
+
+
+/*******************************************************************************
+
+Routine:
+    mergeField
+
+Purpose:
+    Insert an unsigned value into a field of the shadow frame
+
+Description:
+    The field is read as a big-endian word, the bits selected by the
+    field's mask and shift are replaced by those of value, and the word is
+    written back.  A mask of zero selects the whole field.  The caller
+    must hold the combiner's lock.
+
+Returns:
+    void
+
+*/
+
+static void mergeField (
+    struct canCombiner_s *pcomb,
+    const canField_t *pfield,
+    epicsUInt32 value
+) {
+    epicsUInt8 *pdata = &pcomb->frame.data[pfield->offset];
+    epicsUInt32 word = 0;
+    epicsUInt32 mask;
+    int n;
+
+    for (n = 0; n < pfield->length; n++) {
+	word = (word << 8) | pdata[n];
+    }
+    mask = pfield->mask ? pfield->mask : 0xffffffff;
+    mask <<= pfield->shift;
+    word = (word & ~mask) | ((value << pfield->shift) & mask);
+    for (n = pfield->length; n--; ) {
+	pdata[n] = word & 0xff;
+	word >>= 8;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    sendFrame
+
+Purpose:
+    Send the shadow frame
+
+Description:
+    Calls canWrite() with the combiner's current frame and counts the
+    result.  The caller must hold the combiner's lock, which stops a later
+    write from overtaking this one with an older copy of the frame.
+
+Returns:
+    The status from canWrite().
+
+*/
+
+static int sendFrame (
+    struct canCombiner_s *pcomb,
+    double timeout
+) {
+    int status = canWrite(pcomb->busID, &pcomb->frame, timeout);
+
+    if (status) {
+	pcomb->failures++;
+    } else {
+	pcomb->frames++;
+    }
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    windowExpired
+
+Purpose:
+    Timer callback that flushes a combiner
+
+Description:
+    Runs on the canTimerQ thread when a combiner's coalescing window ends,
+    and sends the frame with all of the fields written during the window.
+    It must not block, so the frame is queued without waiting; a failure
+    is latched and reported to the next record that writes to the
+    combiner.
+
+Returns:
+    void
+
+*/
+
+static void windowExpired (
+    void *pprivate
+) {
+    struct canCombiner_s *pcomb = pprivate;
+
+    epicsMutexLock(pcomb->lock);
+    if (pcomb->pending) {
+	int status = sendFrame(pcomb, 0);
+
+	if (status) {
+	    pcomb->status = status;
+	}
+	pcomb->pending = FALSE;
+    }
+    epicsMutexUnlock(pcomb->lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canCombinerField
+
+Purpose:
+    Claim a field of a CAN output message
+
+Description:
+    Finds or creates the combiner for the bus and identifier given in
+    pcanIo, and returns it through pcombiner.  The message length sent by
+    the combiner grows to cover the field if necessary; bytes that no
+    record has written are sent as zero.  A CAN_FIELD_UINT field with a
+    length of zero claims no bytes, for records that send a message with
+    no data.  Fields of different records may
+    overlap, in which case the latest write wins for the shared bits.
+
+    Intended to be called while the IOC is being initialised; the
+    combiner table is not locked.
+
+Returns:
+    0, or
+    S_can_badAddress if the field doesn't fit within a message,
+    ENOMEM if memory could not be allocated.
+
+Example:
+    canField_t bit = {CAN_FIELD_UINT, 2, 1, 5, 1};
+    status = canCombinerField(pcanIo, &bit, &pcombiner);
+
+*/
+
+int canCombinerField (
+    const canIo_t *pcanIo,
+    const canField_t *pfield,
+    canCombinerID_t *pcombiner
+) {
+    struct canCombiner_s *pcomb;
+    GPHENTRY *pgph;
+    char key[12];
+
+    if (pfield->offset + pfield->length > CAN_DATA_SIZE ||
+	(pfield->type == CAN_FIELD_UINT && pfield->length > 4) ||
+	(pfield->type == CAN_FIELD_FLOAT &&
+	    pfield->length != sizeof(float) &&
+	    pfield->length != sizeof(double)) ||
+	pfield->type > CAN_FIELD_FLOAT) {
+	return S_can_badAddress;
+    }
+
+    if (combinerTable == NULL) {
+	gphInitPvt(&combinerTable, COMBINER_TABLE_SIZE);
+    }
+
+    sprintf(key, "%x", pcanIo->identifier);
+    pgph = gphFind(combinerTable, key, pcanIo->canBusID);
+    if (pgph != NULL) {
+	pcomb = pgph->userPvt;
+    } else {
+	pcomb = calloc(1, sizeof(struct canCombiner_s));
+	if (pcomb == NULL) {
+	    return ENOMEM;
+	}
+	pcomb->busName = pcanIo->busName;
+	pcomb->busID = pcanIo->canBusID;
+	pcomb->identifier = pcanIo->identifier;
+	pcomb->frame.identifier = pcanIo->identifier;
+	pcomb->frame.rtr = SEND;
+	strcpy(pcomb->key, key);
+	pcomb->lock = epicsMutexCreate();
+	if (pcomb->lock == NULL) {
+	    free(pcomb);
+	    return ENOMEM;
+	}
+
+	pgph = gphAdd(combinerTable, pcomb->key, pcomb->busID);
+	if (pgph == NULL) {
+	    epicsMutexDestroy(pcomb->lock);
+	    free(pcomb);
+	    return ENOMEM;
+	}
+	pgph->userPvt = pcomb;
+	pcomb->next = firstCombiner;
+	firstCombiner = pcomb;
+    }
+
+    epicsMutexLock(pcomb->lock);
+    if (pcomb->frame.length < pfield->offset + pfield->length) {
+	pcomb->frame.length = pfield->offset + pfield->length;
+    }
+    pcomb->users++;
+    epicsMutexUnlock(pcomb->lock);
+
+    *pcombiner = pcomb;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    combineSend
+
+Purpose:
+    Send a combiner's frame now or when its window expires
+
+Description:
+    Called after a field has been merged into the frame, with the
+    combiner's lock held.  With a zero coalescing window the frame is sent
+    at once.  Otherwise the first write starts the window timer and the
+    frame is left for windowExpired() to send; the status of the previous
+    flush is returned instead, so a failure still reaches a record.
+
+Returns:
+    0, or
+    any error status from canWrite().
+
+*/
+
+static int combineSend (
+    struct canCombiner_s *pcomb,
+    double timeout
+) {
+    int status;
+
+    pcomb->writes++;
+    if (combineWindow <= 0.0) {
+	return sendFrame(pcomb, timeout);
+    }
+
+    status = pcomb->status;
+    pcomb->status = 0;
+    if (!pcomb->pending) {
+	if (pcomb->timer == NULL) {
+	    pcomb->timer = epicsTimerQueueCreateTimer(canTimerQ,
+						      windowExpired, pcomb);
+	    if (pcomb->timer == NULL) {
+		return sendFrame(pcomb, timeout);
+	    }
+	}
+	pcomb->pending = TRUE;
+	epicsTimerStartDelay(pcomb->timer, combineWindow);
+    }
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canCombinerValue, canCombinerDouble
+
+Purpose:
+    Write a field and send the combined message
+
+Description:
+    canCombinerValue merges a CAN_FIELD_UINT field value into the
+    combiner's frame, and canCombinerDouble a CAN_FIELD_FLOAT value.
+
+    With the default coalescing window the routine never blocks: the
+    first write starts the window and the frame is sent when it expires.
+    The status returned is then that of the previous flush, if it failed.
+    With a zero window the frame is sent immediately, and the routine may
+    wait up to timeout seconds for the transmit queue.
+
+Returns:
+    0, or
+    any error status from canWrite().
+
+Example:
+    status = canCombinerValue(pcombiner, &bit, prec->rval, 0.1);
+
+*/
+
+int canCombinerValue (
+    canCombinerID_t pcomb,
+    const canField_t *pfield,
+    epicsUInt32 value,
+    double timeout
+) {
+    int status;
+
+    epicsMutexLock(pcomb->lock);
+    mergeField(pcomb, pfield, value);
+    status = combineSend(pcomb, timeout);
+    epicsMutexUnlock(pcomb->lock);
+    return status;
+}
+
+int canCombinerDouble (
+    canCombinerID_t pcomb,
+    const canField_t *pfield,
+    double value,
+    double timeout
+) {
+    epicsUInt8 *pdata = &pcomb->frame.data[pfield->offset];
+    int status;
+
+    epicsMutexLock(pcomb->lock);
+    if (pfield->length == sizeof(float)) {
+	float fval = value;
+	memcpy(pdata, &fval, sizeof(float));
+    } else {
+	memcpy(pdata, &value, sizeof(double));
+    }
+    status = combineSend(pcomb, timeout);
+    epicsMutexUnlock(pcomb->lock);
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canCombinerWindow
+
+Purpose:
+    Set the coalescing window for all combiners
+
+Description:
+    A positive window holds the frame for that many seconds after the
+    first write to it, so records processed by the same scan pass, or by a
+    burst of puts, are sent as one frame.  The default is 2 milliseconds,
+    longer than a scan pass of a typical IOC takes to process its output
+    records.  A window of zero sends every write at once and returns its
+    status to the record.  Frames already waiting are not affected.
+
+Returns:
+    void
+
+Example:
+    canCombinerWindow 0.01
+
+*/
+
+void canCombinerWindow (
+    double seconds
+) {
+    combineWindow = seconds > 0.0 ? seconds : 0.0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canCombinerReport
+
+Purpose:
+    Print combiner statistics
+
+Description:
+    Prints the window, the number of combiners and their records, and how
+    many record writes were combined into how many frames.  With
+    interest > 0 it lists each combiner and its current frame.
+
+Returns:
+    void
+
+Example:
+    canCombinerReport 1
+
+*/
+
+void canCombinerReport (
+    int interest
+) {
+    struct canCombiner_s *pcomb;
+    unsigned long combiners = 0, users = 0, writes = 0, frames = 0,
+		  failures = 0;
+
+    for (pcomb = firstCombiner; pcomb != NULL; pcomb = pcomb->next) {
+	epicsMutexLock(pcomb->lock);
+	combiners++;
+	users += pcomb->users;
+	writes += pcomb->writes;
+	frames += pcomb->frames;
+	failures += pcomb->failures;
+	epicsMutexUnlock(pcomb->lock);
+    }
+
+    printf("CAN output combiners: %lu combiners, %lu records, "
+	   "window %g sec\n", combiners, users, combineWindow);
+    printf("  %lu writes sent as %lu frames, %lu failed\n",
+	   writes, frames, failures);
+
+    if (interest > 0) {
+	for (pcomb = firstCombiner; pcomb != NULL; pcomb = pcomb->next) {
+	    int i;
+
+	    epicsMutexLock(pcomb->lock);
+	    printf("  %s:%#x  %lu records, %lu writes, %lu frames%s\n  ",
+		   pcomb->busName, pcomb->identifier, pcomb->users,
+		   pcomb->writes, pcomb->frames,
+		   pcomb->pending ? ", pending" : "");
+	    for (i = 0; i < pcomb->frame.length; i++) {
+		printf(" %02x", pcomb->frame.data[i]);
+	    }
+	    printf("\n");
+	    epicsMutexUnlock(pcomb->lock);
+	}
+    }
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* canCombinerWindow(double seconds) */
+static const iocshArg canCombinerWindowArg0 = {"seconds", iocshArgDouble};
+static const iocshArg * const canCombinerWindowArgs[1] = {
+    &canCombinerWindowArg0};
+static const iocshFuncDef canCombinerWindowFuncDef =
+    {"canCombinerWindow",1,canCombinerWindowArgs};
+static void canCombinerWindowCallFunc(const iocshArgBuf *args)
+{
+    canCombinerWindow(args[0].dval);
+}
+
+/* canCombinerReport(int interest) */
+static const iocshArg canCombinerReportArg0 = {"interest", iocshArgInt};
+static const iocshArg * const canCombinerReportArgs[1] = {
+    &canCombinerReportArg0};
+static const iocshFuncDef canCombinerReportFuncDef =
+    {"canCombinerReport",1,canCombinerReportArgs};
+static void canCombinerReportCallFunc(const iocshArgBuf *args)
+{
+    canCombinerReport(args[0].ival);
+}
+
+static void canCombineRegistrar(void) {
+    iocshRegister(&canCombinerWindowFuncDef,canCombinerWindowCallFunc);
+    iocshRegister(&canCombinerReportFuncDef,canCombinerReportCallFunc);
+}
+epicsExportRegistrar(canCombineRegistrar);
@@ -0,0 +1,53 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canCombine.h
+
+Description:
+    Header file for the CAN output combiners, which merge the fields that
+    output records write into a shadow copy of each message so that
+    records sharing a message identifier can send it as one frame.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#ifndef INCcanCombineH
+#define INCcanCombineH
+
+#include "epicsTypes.h"
+#include "shareLib.h"
+#include "canBus.h"
+#include "canDecode.h"
+
+
+typedef struct canCombiner_s *canCombinerID_t;
+
+
+epicsShareFunc int canCombinerField(const canIo_t *pcanIo,
+		    const canField_t *pfield, canCombinerID_t *pcombiner);
+epicsShareFunc int canCombinerValue(canCombinerID_t combiner,
+		    const canField_t *pfield, epicsUInt32 value, double timeout);
+epicsShareFunc int canCombinerDouble(canCombinerID_t combiner,
+		    const canField_t *pfield, double value, double timeout);
+epicsShareFunc void canCombinerWindow(double seconds);
+epicsShareFunc void canCombinerReport(int interest);
+
+
+#endif /* INCcanCombineH */
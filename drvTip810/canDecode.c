@@ -0,0 +1,475 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canDecode.c
+
+Description:
+    Shared frame decoders for the CAN device supports.  There is one decoder
+    for each message identifier on each bus that records read, and it is the
+    only thing registered with canMessage() for that identifier.  Records
+    subscribe to a byte or bit field of the message, and identical fields
+    are shared.  When a frame arrives the decoder extracts every field into
+    its field array once, then makes a single scanIoRequest() for all of
+    the I/O Intr records on that identifier.  Records that poll with an RTR
+    are told when the reply arrives by canReadAsync(), which the driver
+    calls after the decoders have seen the frame.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsTime.h>
+#include <gpHash.h>
+#include <dbAccess.h>
+#include <dbScan.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+#include "canDecode.h"
+
+
+#define DECODER_TABLE_SIZE 1024	/* Hash table buckets, power of 2 */
+#define DECODER_FIELDS 4	/* Initial field array size */
+
+
+typedef struct {
+    canField_t spec;
+    union {
+	epicsUInt32 ival;
+	double dval;
+    } value;
+    unsigned long users;
+} decodeField_t;
+
+struct canDecoder_s {
+    struct canDecoder_s *next;
+    const char *busName;	/* Shared, owned by the bus registry */
+    canBusID_t busID;
+    canID_t identifier;
+    char key[12];		/* Hash key, identifier in hex */
+    epicsMutexId lock;		/* Protects everything below */
+    IOSCANPVT ioscanpvt;
+    int numFields;
+    int maxFields;
+    decodeField_t *field;
+    epicsTimeStamp timestamp;	/* Arrival time of the latest frame */
+    unsigned long users;
+    unsigned long frames;
+};
+
+
+static struct gphPvt *decoderTable = NULL;
+static struct canDecoder_s *firstDecoder = NULL;
+
+
+/*******************************************************************************
+
+Routine:
+    decodeFrame
+
+Purpose:
+    canMessage callback for a decoder
+
+Description:
+    Extracts all of the decoder's fields from the message, then makes one
+    scanIoRequest for all of its I/O Intr records.
+
+Returns:
+    void
+
+*/
+
+static void decodeFrame (
+    void *pprivate,
+    const canMessage_t *pmessage
+) {
+    struct canDecoder_s *pdec = pprivate;
+    decodeField_t *pfield;
+    int i;
+
+    if (!interruptAccept ||
+	pmessage->rtr == RTR) {
+	return;
+    }
+
+    epicsMutexLock(pdec->lock);
+    for (i = 0, pfield = pdec->field; i < pdec->numFields; i++, pfield++) {
+	const epicsUInt8 *pdata = &pmessage->data[pfield->spec.offset];
+
+	if (pfield->spec.type == CAN_FIELD_FLOAT) {
+	    if (pfield->spec.length == sizeof(float)) {
+		float fval;
+		memcpy(&fval, pdata, sizeof(float));
+		pfield->value.dval = fval;
+	    } else {
+		memcpy(&pfield->value.dval, pdata, sizeof(double));
+	    }
+	} else {
+	    epicsUInt32 ival = 0;
+	    int n = pfield->spec.length;
+
+	    while (n--) {
+		ival = (ival << 8) | *pdata++;
+	    }
+	    ival >>= pfield->spec.shift;
+	    if (pfield->spec.mask) {
+		ival &= pfield->spec.mask;
+	    }
+	    pfield->value.ival = ival;
+	}
+    }
+    pdec->timestamp = pmessage->timestamp;
+    pdec->frames++;
+    epicsMutexUnlock(pdec->lock);
+
+    scanIoRequest(pdec->ioscanpvt);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDecoderField
+
+Purpose:
+    Subscribe to a field of a CAN message
+
+Description:
+    Finds or creates the decoder for the bus and identifier given in
+    pcanIo, and returns it through pdecoder.  If the decoder already
+    extracts a field with the same specification that field is shared,
+    otherwise a new one is added.  The field's index is returned through
+    pindex, for use with canDecoderValue() or canDecoderDouble().
+
+    Intended to be called while the IOC is being initialised; the decoder
+    table is not locked.
+
+Returns:
+    0, or
+    S_can_badAddress if the field doesn't fit within a message,
+    ENOMEM if malloc() fails,
+    any error status from canMessage().
+
+Example:
+    canField_t byte = {CAN_FIELD_UINT, 4, 1, 0, 0};
+    status = canDecoderField(pcanIo, &byte, &pdecoder, &index);
+
+*/
+
+int canDecoderField (
+    const canIo_t *pcanIo,
+    const canField_t *pfield,
+    canDecoderID_t *pdecoder,
+    int *pindex
+) {
+    struct canDecoder_s *pdec;
+    GPHENTRY *pgph;
+    char key[12];
+    int status;
+    int i;
+
+    if (pfield->offset + pfield->length > CAN_DATA_SIZE ||
+	(pfield->type == CAN_FIELD_UINT &&
+	    (pfield->length < 1 || pfield->length > 4)) ||
+	(pfield->type == CAN_FIELD_FLOAT &&
+	    pfield->length != sizeof(float) &&
+	    pfield->length != sizeof(double)) ||
+	pfield->type > CAN_FIELD_FLOAT) {
+	return S_can_badAddress;
+    }
+
+    if (decoderTable == NULL) {
+	gphInitPvt(&decoderTable, DECODER_TABLE_SIZE);
+    }
+
+    sprintf(key, "%x", pcanIo->identifier);
+    pgph = gphFind(decoderTable, key, pcanIo->canBusID);
+    if (pgph != NULL) {
+	pdec = pgph->userPvt;
+    } else {
+	pdec = calloc(1, sizeof(struct canDecoder_s));
+	if (pdec == NULL) {
+	    return ENOMEM;
+	}
+	pdec->busName = pcanIo->busName;
+	pdec->busID = pcanIo->canBusID;
+	pdec->identifier = pcanIo->identifier;
+	strcpy(pdec->key, key);
+	pdec->lock = epicsMutexCreate();
+	if (pdec->lock == NULL) {
+	    free(pdec);
+	    return ENOMEM;
+	}
+	scanIoInit(&pdec->ioscanpvt);
+
+	pgph = gphAdd(decoderTable, pdec->key, pdec->busID);
+	if (pgph == NULL) {
+	    epicsMutexDestroy(pdec->lock);
+	    free(pdec);
+	    return ENOMEM;
+	}
+
+	status = canMessage(pdec->busID, pdec->identifier, decodeFrame, pdec);
+	if (status) {
+	    gphDelete(decoderTable, pdec->key, pdec->busID);
+	    epicsMutexDestroy(pdec->lock);
+	    free(pdec);
+	    return status;
+	}
+	pgph->userPvt = pdec;
+	pdec->next = firstDecoder;
+	firstDecoder = pdec;
+    }
+
+    epicsMutexLock(pdec->lock);
+    for (i = 0; i < pdec->numFields; i++) {
+	canField_t *pspec = &pdec->field[i].spec;
+
+	if (pspec->type == pfield->type &&
+	    pspec->offset == pfield->offset &&
+	    pspec->length == pfield->length &&
+	    pspec->shift == pfield->shift &&
+	    pspec->mask == pfield->mask)
+	    break;
+    }
+    if (i == pdec->numFields) {
+	if (pdec->numFields == pdec->maxFields) {
+	    int newMax = pdec->maxFields ? 2 * pdec->maxFields
+					 : DECODER_FIELDS;
+	    decodeField_t *pnew = realloc(pdec->field,
+					  newMax * sizeof(decodeField_t));
+	    if (pnew == NULL) {
+		epicsMutexUnlock(pdec->lock);
+		return ENOMEM;
+	    }
+	    pdec->field = pnew;
+	    pdec->maxFields = newMax;
+	}
+	memset(&pdec->field[i], 0, sizeof(decodeField_t));
+	pdec->field[i].spec = *pfield;
+	pdec->numFields++;
+    }
+    pdec->field[i].users++;
+    pdec->users++;
+    epicsMutexUnlock(pdec->lock);
+
+    *pdecoder = pdec;
+    *pindex = i;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDecoderIoScan
+
+Purpose:
+    Return the I/O Intr scan list of a decoder
+
+Description:
+    Every record subscribed to a decoder that is scanned on I/O Intr should
+    return this from its get_ioint_info routine, so one scanIoRequest()
+    processes them all.
+
+Returns:
+    IOSCANPVT
+
+*/
+
+IOSCANPVT canDecoderIoScan (
+    canDecoderID_t pdec
+) {
+    return pdec->ioscanpvt;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDecoderValue, canDecoderDouble
+
+Purpose:
+    Return the latest decoded value of a field
+
+Description:
+    canDecoderValue returns a CAN_FIELD_UINT field, and canDecoderDouble a
+    CAN_FIELD_FLOAT field.  Both return zero if no message has arrived.
+
+Returns:
+    The field value.
+
+*/
+
+epicsUInt32 canDecoderValue (
+    canDecoderID_t pdec,
+    int index
+) {
+    epicsUInt32 ival;
+
+    epicsMutexLock(pdec->lock);
+    ival = pdec->field[index].value.ival;
+    epicsMutexUnlock(pdec->lock);
+    return ival;
+}
+
+double canDecoderDouble (
+    canDecoderID_t pdec,
+    int index
+) {
+    double dval;
+
+    epicsMutexLock(pdec->lock);
+    dval = pdec->field[index].value.dval;
+    epicsMutexUnlock(pdec->lock);
+    return dval;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDecoderTime
+
+Purpose:
+    Return the arrival time of the latest message
+
+Description:
+    Copies the timestamp that the bus driver gave the latest message
+    decoded into *ptime, for device support to use as the record's time
+    when its TSE field is epicsTimeEventDeviceTime.
+
+Returns:
+    void
+
+*/
+
+void canDecoderTime (
+    canDecoderID_t pdec,
+    epicsTimeStamp *ptime
+) {
+    epicsMutexLock(pdec->lock);
+    *ptime = pdec->timestamp;
+    epicsMutexUnlock(pdec->lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDecoderReport
+
+Purpose:
+    Print decoder statistics
+
+Description:
+    Prints the number of decoders, fields and subscribed records, and the
+    number of frames decoded.  With interest > 0 it lists each decoder,
+    and with interest > 1 each of its fields as well.
+
+Returns:
+    void
+
+Example:
+    canDecoderReport 1
+
+*/
+
+void canDecoderReport (
+    int interest
+) {
+    struct canDecoder_s *pdec;
+    unsigned long decoders = 0, fields = 0, users = 0, frames = 0;
+    double fanout = 0.0;
+
+    for (pdec = firstDecoder; pdec != NULL; pdec = pdec->next) {
+	epicsMutexLock(pdec->lock);
+	decoders++;
+	fields += pdec->numFields;
+	users += pdec->users;
+	frames += pdec->frames;
+	fanout += (double) pdec->frames * pdec->users;
+	epicsMutexUnlock(pdec->lock);
+    }
+
+    printf("CAN frame decoders: %lu decoders, %lu fields, %lu records\n",
+	   decoders, fields, users);
+    printf("  %lu frames decoded for %.0f record updates\n",
+	   frames, fanout);
+
+    if (interest > 0) {
+	for (pdec = firstDecoder; pdec != NULL; pdec = pdec->next) {
+	    int i;
+
+	    epicsMutexLock(pdec->lock);
+	    printf("  %s:%#x  %d fields, %lu records, %lu frames\n",
+		   pdec->busName, pdec->identifier, pdec->numFields,
+		   pdec->users, pdec->frames);
+	    if (interest > 1) {
+		for (i = 0; i < pdec->numFields; i++) {
+		    decodeField_t *pfield = &pdec->field[i];
+
+		    if (pfield->spec.type == CAN_FIELD_FLOAT) {
+			printf("    [%d] float%d at %u, %lu records, value %g\n",
+			       i, 8 * pfield->spec.length, pfield->spec.offset,
+			       pfield->users, pfield->value.dval);
+		    } else {
+			printf("    [%d] %u bytes at %u >> %u & %#lx, "
+			       "%lu records, value %#lx\n",
+			       i, pfield->spec.length, pfield->spec.offset,
+			       pfield->spec.shift,
+			       (unsigned long) pfield->spec.mask,
+			       pfield->users,
+			       (unsigned long) pfield->value.ival);
+		    }
+		}
+	    }
+	    epicsMutexUnlock(pdec->lock);
+	}
+    }
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* canDecoderReport(int interest) */
+static const iocshArg canDecoderReportArg0 = {"interest", iocshArgInt};
+static const iocshArg * const canDecoderReportArgs[1] = {
+    &canDecoderReportArg0};
+static const iocshFuncDef canDecoderReportFuncDef =
+    {"canDecoderReport",1,canDecoderReportArgs};
+static void canDecoderReportCallFunc(const iocshArgBuf *args)
+{
+    canDecoderReport(args[0].ival);
+}
+
+static void canDecodeRegistrar(void) {
+    iocshRegister(&canDecoderReportFuncDef,canDecoderReportCallFunc);
+}
+epicsExportRegistrar(canDecodeRegistrar);
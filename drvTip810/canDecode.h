@@ -0,0 +1,66 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canDecode.h
+
+Description:
+    Header file for the shared CAN frame decoders, which extract the fields
+    that records want from each received message once, however many
+    records are reading that message identifier.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#ifndef INCcanDecodeH
+#define INCcanDecodeH
+
+#include "epicsTypes.h"
+#include "epicsTime.h"
+#include "dbScan.h"
+#include "shareLib.h"
+#include "canBus.h"
+
+
+#define CAN_FIELD_UINT 0	/* Big-endian unsigned integer */
+#define CAN_FIELD_FLOAT 1	/* Native float or double */
+
+typedef struct {
+    epicsUInt8 type;		/* CAN_FIELD_UINT or CAN_FIELD_FLOAT */
+    epicsUInt8 offset;		/* First byte in the message */
+    epicsUInt8 length;		/* 1 .. 4 for UINT, 4 or 8 for FLOAT */
+    epicsUInt8 shift;		/* UINT only: right shift for bit fields */
+    epicsUInt32 mask;		/* UINT only: mask after shift, 0 = none */
+} canField_t;
+
+typedef struct canDecoder_s *canDecoderID_t;
+
+
+epicsShareFunc int canDecoderField(const canIo_t *pcanIo,
+		    const canField_t *pfield, canDecoderID_t *pdecoder,
+		    int *pindex);
+epicsShareFunc IOSCANPVT canDecoderIoScan(canDecoderID_t decoder);
+epicsShareFunc epicsUInt32 canDecoderValue(canDecoderID_t decoder, int index);
+epicsShareFunc double canDecoderDouble(canDecoderID_t decoder, int index);
+epicsShareFunc void canDecoderTime(canDecoderID_t decoder,
+		    epicsTimeStamp *ptime);
+epicsShareFunc void canDecoderReport(int interest);
+
+
+#endif /* INCcanDecodeH */
@@ -0,0 +1,909 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canDispatch.c
+
+Description:
+    Message dispatchers for CAN controller drivers.  A dispatcher holds the
+    callbacks registered with canMessage() for one bus, and publishes them
+    as an immutable dispatch table which the driver's receive thread uses
+    to find the callbacks for each message without taking a lock.  The
+    table holds only the identifiers in use, with a hash index over them,
+    so lookups stay O(1) for standard and sparse 29-bit extended
+    identifiers alike.  A change builds a new table and swaps a pointer;
+    the old table is freed, by the writer or by the reader as it leaves a
+    table, once the reader's epoch counter shows that it has finished
+    with it.  While iocInit initialises the records, which
+    is when almost all callbacks are registered, rebuilds are deferred and
+    each table is built once afterwards.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsInterrupt.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <errlog.h>
+#include <initHooks.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+#include "canDispatch.h"
+
+
+#define DISPATCH_REG_SIZE 64	/* Initial registration space */
+#define HASH_MULTIPLIER 2654435761U	/* Golden ratio * 2^32 */
+
+/* Full memory barrier between the table pointer and the reader's epoch.
+ * GCC before 4.1 has no builtin, but its targets are uniprocessors where
+ * stopping the compiler from reordering is enough; elsewhere the host
+ * interrupt lock is a mutex, whose lock and unlock order memory. */
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 1))
+#define dispatchBarrier() __sync_synchronize()
+#elif defined(__GNUC__)
+#define dispatchBarrier() __asm__ __volatile__ ("" : : : "memory")
+#else
+#define dispatchBarrier() epicsInterruptUnlock(epicsInterruptLock())
+#endif
+
+
+typedef struct {
+    canMsgCallback_t *pcallback;	/* registered routine */
+    void *pprivate;			/* reference for callback routine */
+} handler_t;
+
+typedef struct {
+    canID_t identifier;			/* message ID */
+    unsigned long sequence;		/* registration order */
+    handler_t handler;
+} registration_t;
+
+/* The IDs in use are sorted in pid[], and the handlers for pid[i] are
+ * phandler[j] for pfirst[i] <= j < pfirst[i+1].  phash[] is an open
+ * addressed hash index holding i+1 for pid[i], 0 for an empty bucket.
+ * All four arrays follow the header in the same allocation. */
+struct canDispatchTable_s {
+    struct canDispatchTable_s *pretired;	/* list waiting to be freed */
+    unsigned epoch;			/* reader's epoch when retired */
+    int numIds;				/* IDs in pid[] */
+    int numHandlers;			/* entries in phandler[] */
+    int hashShift;			/* 32 - log2(hash buckets) */
+    unsigned hashMask;			/* hash buckets - 1 */
+    handler_t *phandler;		/* handlers, grouped by ID */
+    int *pfirst;			/* numIds+1 indices into phandler[] */
+    int *phash;				/* hash index into pid[] */
+    canID_t *pid;			/* sorted IDs with handlers */
+    size_t size;			/* bytes allocated */
+};
+
+struct canDispatcher_s {
+    struct canDispatcher_s *next;
+    const char *name;
+    epicsMutexId lock;			/* Serialises changes */
+    const canDispatchTable_t * volatile ptable;	/* Published table */
+    volatile unsigned epoch;		/* Odd while the reader dispatches */
+    registration_t *preg;		/* Registrations, unsorted */
+    int numReg;
+    int maxReg;
+    unsigned long sequence;		/* Next registration number */
+    canDispatchTable_t *pretired;	/* Replaced tables not yet freed */
+    volatile int retiredCount;		/* Also read by the reader */
+    int stale;				/* ptable needs rebuilding */
+    int builds;				/* Times ptable has been rebuilt */
+};
+
+
+static struct canDispatcher_s *firstDispatcher = NULL;
+static int dispatchDeferred = FALSE;	/* iocInit initialising records */
+
+
+/*******************************************************************************
+
+Routine:
+    tableBuild
+
+Purpose:
+    Build a dispatch table from a list of registrations
+
+Description:
+    Sorts a copy of the registrations by identifier, keeping the order in
+    which callbacks for the same identifier were registered, and lays out
+    the table in a single allocation.  An empty list gives a NULL table.
+
+Returns:
+    0, or
+    ENOMEM if malloc() fails.
+
+*/
+
+static int regCompare (
+    const void *p1,
+    const void *p2
+) {
+    const registration_t *preg1 = p1, *preg2 = p2;
+
+    if (preg1->identifier != preg2->identifier) {
+	return preg1->identifier < preg2->identifier ? -1 : 1;
+    }
+    return preg1->sequence < preg2->sequence ? -1 :
+	   preg1->sequence > preg2->sequence;
+}
+
+static int tableBuild (
+    const registration_t *preg,
+    int count,
+    canDispatchTable_t **pptable
+) {
+    canDispatchTable_t *ptable;
+    registration_t *psorted;
+    int numIds, hashBits, i;
+    size_t size;
+
+    *pptable = NULL;
+    if (count == 0) return 0;
+
+    psorted = malloc(count * sizeof(registration_t));
+    if (psorted == NULL) return ENOMEM;
+    memcpy(psorted, preg, count * sizeof(registration_t));
+    qsort(psorted, count, sizeof(registration_t), regCompare);
+
+    numIds = 1;
+    for (i = 1; i < count; i++) {
+	if (psorted[i].identifier != psorted[i-1].identifier) numIds++;
+    }
+
+    /* At least twice as many hash buckets as IDs */
+    for (hashBits = 1; (1 << hashBits) < 2 * numIds; hashBits++);
+
+    size = sizeof(canDispatchTable_t) +
+	   count * sizeof(handler_t) +
+	   (numIds + 1) * sizeof(int) +
+	   (1 << hashBits) * sizeof(int) +
+	   numIds * sizeof(canID_t);
+    ptable = calloc(1, size);
+    if (ptable == NULL) {
+	free(psorted);
+	return ENOMEM;
+    }
+    ptable->size = size;
+    ptable->numIds = numIds;
+    ptable->numHandlers = count;
+    ptable->hashShift = 32 - hashBits;
+    ptable->hashMask = (1 << hashBits) - 1;
+    ptable->phandler = (handler_t *) (ptable + 1);
+    ptable->pfirst = (int *) (ptable->phandler + count);
+    ptable->phash = ptable->pfirst + numIds + 1;
+    ptable->pid = (canID_t *) (ptable->phash + (1 << hashBits));
+
+    numIds = 0;
+    for (i = 0; i < count; i++) {
+	if (i == 0 || psorted[i].identifier != psorted[i-1].identifier) {
+	    canID_t id = psorted[i].identifier;
+	    unsigned bucket = (epicsUInt32) (id * HASH_MULTIPLIER) >>
+			      ptable->hashShift;
+
+	    while (ptable->phash[bucket]) {
+		bucket = (bucket + 1) & ptable->hashMask;
+	    }
+	    ptable->phash[bucket] = numIds + 1;
+	    ptable->pid[numIds] = id;
+	    ptable->pfirst[numIds++] = i;
+	}
+	ptable->phandler[i] = psorted[i].handler;
+    }
+    ptable->pfirst[numIds] = count;
+
+    free(psorted);
+    *pptable = ptable;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    tableFind
+
+Purpose:
+    Look up the callbacks for an identifier
+
+Description:
+    Probes the table's hash index.  The table may be NULL.
+
+Returns:
+    The number of callbacks, with the first returned through pphandler.
+
+*/
+
+static int tableFind (
+    const canDispatchTable_t *ptable,
+    canID_t identifier,
+    const handler_t **pphandler
+) {
+    unsigned bucket;
+    int index;
+
+    if (ptable == NULL) return 0;
+
+    bucket = (epicsUInt32) (identifier * HASH_MULTIPLIER) >>
+	     ptable->hashShift;
+    while ((index = ptable->phash[bucket]) != 0) {
+	if (ptable->pid[--index] == identifier) {
+	    *pphandler = &ptable->phandler[ptable->pfirst[index]];
+	    return ptable->pfirst[index + 1] - ptable->pfirst[index];
+	}
+	bucket = (bucket + 1) & ptable->hashMask;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    dispatchUpdate
+
+Purpose:
+    Rebuild and publish a dispatcher's table
+
+Description:
+    Replaces the published table with one built from the current
+    registrations, unless rebuilds are being deferred.  The reader may
+    still be using the old table, so it is put on the retired list with
+    the reader's current epoch, and freed by dispatchReclaim once the
+    epoch has moved on by at least two.  The barrier before the pointer
+    is published orders the table's contents before it, and the one
+    after it orders the publication before the epoch is read; the reader
+    has the matching barriers in canDispatchEnter and canDispatchLeave.
+    Called with the lock held.
+
+Returns:
+    0, or
+    ENOMEM if malloc() fails.
+
+*/
+
+static void dispatchReclaim (
+    struct canDispatcher_s *pd
+) {
+    canDispatchTable_t **pptable = &pd->pretired;
+    unsigned epoch = pd->epoch;
+
+    dispatchBarrier();
+    while (*pptable != NULL) {
+	canDispatchTable_t *ptable = *pptable;
+
+	if (epoch - ptable->epoch >= 2) {
+	    *pptable = ptable->pretired;
+	    free(ptable);
+	    pd->retiredCount--;
+	} else {
+	    pptable = &ptable->pretired;
+	}
+    }
+}
+
+static int dispatchUpdate (
+    struct canDispatcher_s *pd
+) {
+    canDispatchTable_t *pold, *pnew;
+    int status;
+
+    if (dispatchDeferred) {
+	pd->stale = TRUE;
+	return 0;
+    }
+
+    status = tableBuild(pd->preg, pd->numReg, &pnew);
+    if (status) return status;
+
+    pold = (canDispatchTable_t *) pd->ptable;
+    dispatchBarrier();
+    pd->ptable = pnew;
+    dispatchBarrier();
+    pd->stale = FALSE;
+    pd->builds++;
+
+    if (pold != NULL) {
+	pold->epoch = pd->epoch;
+	pold->pretired = pd->pretired;
+	pd->pretired = pold;
+	pd->retiredCount++;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    dispatchInitHook
+
+Purpose:
+    Defer table rebuilds while iocInit initialises the records
+
+Description:
+    Rebuilds are deferred from the start of iocInit until the database
+    has been initialised, when every dispatcher with changes gets its
+    table built.
+
+Returns:
+    void
+
+*/
+
+static void dispatchInitHook (
+    initHookState state
+) {
+    struct canDispatcher_s *pd;
+
+    switch (state) {
+	case initHookAtBeginning:
+	    dispatchDeferred = TRUE;
+	    break;
+
+	case initHookAfterInitDatabase:
+	    dispatchDeferred = FALSE;
+	    for (pd = firstDispatcher; pd != NULL; pd = pd->next) {
+		epicsMutexLock(pd->lock);
+		if (pd->stale &&
+		    dispatchUpdate(pd)) {
+		    errlogPrintf("canDispatch: No memory for %s table\n",
+				 pd->name);
+		}
+		epicsMutexUnlock(pd->lock);
+	    }
+	    break;
+
+	default:
+	    break;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDispatcherCreate
+
+Purpose:
+    Create a message dispatcher
+
+Description:
+    Creates an empty dispatcher for a CAN controller driver to hold the
+    message callbacks for one bus; name is used in reports and must
+    remain valid.  Intended to be called while the IOC is being
+    initialised; the list of dispatchers is not locked.
+
+Returns:
+    0, or
+    ENOMEM if memory could not be allocated.
+
+Example:
+    status = canDispatcherCreate(pbusName, &pdevice->dispatcher);
+
+*/
+
+int canDispatcherCreate (
+    const char *name,
+    canDispatcherID_t *pdispatcher
+) {
+    struct canDispatcher_s *pd = calloc(1, sizeof(struct canDispatcher_s));
+
+    if (pd == NULL) {
+	return ENOMEM;
+    }
+    pd->name = name;
+    pd->lock = epicsMutexCreate();
+    if (pd->lock == NULL) {
+	free(pd);
+	return ENOMEM;
+    }
+
+    if (firstDispatcher == NULL) {
+	initHookRegister(dispatchInitHook);
+    }
+    pd->next = firstDispatcher;
+    firstDispatcher = pd;
+
+    *pdispatcher = pd;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDispatcherDestroy
+
+Purpose:
+    Delete a message dispatcher
+
+Description:
+    Frees a dispatcher and everything it holds, for a driver whose bus
+    could not be created after all.  It must not be in use; like
+    canDispatcherCreate the list of dispatchers is not locked.
+
+Returns:
+    void
+
+Example:
+    canDispatcherDestroy(pdevice->dispatcher);
+
+*/
+
+void canDispatcherDestroy (
+    canDispatcherID_t pd
+) {
+    struct canDispatcher_s **ppd;
+
+    for (ppd = &firstDispatcher; *ppd != NULL; ppd = &(*ppd)->next) {
+	if (*ppd == pd) {
+	    *ppd = pd->next;
+	    break;
+	}
+    }
+
+    while (pd->pretired != NULL) {
+	canDispatchTable_t *ptable = pd->pretired;
+
+	pd->pretired = ptable->pretired;
+	free(ptable);
+    }
+    free((void *) pd->ptable);
+    free(pd->preg);
+    epicsMutexDestroy(pd->lock);
+    free(pd);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDispatcherAdd, canDispatcherDelete
+
+Purpose:
+    Register or remove a message callback
+
+Description:
+    canDispatcherAdd appends the callback to the registrations for the
+    identifier, and canDispatcherDelete removes the first registration
+    matching all three parameters.  The identifier is not checked, that
+    is up to the driver.  The table is then rebuilt and published; if
+    that fails the change is undone.  Messages whose dispatch has already
+    begun still go to the callbacks of the old table.
+
+Returns:
+    0, or
+    S_can_noMessage if there was no registration to delete,
+    ENOMEM if malloc() fails.
+
+Example:
+    status = canDispatcherAdd(pdevice->dispatcher, 0x123, myCallback, &me);
+
+*/
+
+int canDispatcherAdd (
+    canDispatcherID_t pd,
+    canID_t identifier,
+    canMsgCallback_t *pcallback,
+    void *pprivate
+) {
+    registration_t *preg;
+    int status;
+
+    epicsMutexLock(pd->lock);
+    dispatchReclaim(pd);
+
+    if (pd->numReg == pd->maxReg) {
+	int newMax = pd->maxReg ? 2 * pd->maxReg : DISPATCH_REG_SIZE;
+	registration_t *pnew = realloc(pd->preg,
+				       newMax * sizeof(registration_t));
+	if (pnew == NULL) {
+	    epicsMutexUnlock(pd->lock);
+	    return ENOMEM;
+	}
+	pd->preg = pnew;
+	pd->maxReg = newMax;
+    }
+    preg = &pd->preg[pd->numReg++];
+    preg->identifier = identifier;
+    preg->sequence = pd->sequence++;
+    preg->handler.pcallback = pcallback;
+    preg->handler.pprivate = pprivate;
+
+    status = dispatchUpdate(pd);
+    if (status) {
+	pd->numReg--;
+    }
+    epicsMutexUnlock(pd->lock);
+    return status;
+}
+
+int canDispatcherDelete (
+    canDispatcherID_t pd,
+    canID_t identifier,
+    canMsgCallback_t *pcallback,
+    void *pprivate
+) {
+    registration_t *preg, removed;
+    int i, status;
+
+    epicsMutexLock(pd->lock);
+    dispatchReclaim(pd);
+
+    for (i = 0, preg = pd->preg; i < pd->numReg; i++, preg++) {
+	if (preg->identifier == identifier &&
+	    preg->handler.pcallback == pcallback &&
+	    preg->handler.pprivate == pprivate) break;
+    }
+    if (i == pd->numReg) {
+	epicsMutexUnlock(pd->lock);
+	return S_can_noMessage;
+    }
+    removed = *preg;
+    memmove(preg, preg + 1, (pd->numReg - i - 1) * sizeof(registration_t));
+    pd->numReg--;
+
+    status = dispatchUpdate(pd);
+    if (status) {
+	memmove(preg + 1, preg, (pd->numReg - i) * sizeof(registration_t));
+	*preg = removed;
+	pd->numReg++;
+    }
+    epicsMutexUnlock(pd->lock);
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDispatchEnter, canDispatch, canDispatchLeave
+
+Purpose:
+    Deliver received messages to their callbacks
+
+Description:
+    The driver's receive thread, which must be the only thread that
+    dispatches through this dispatcher, calls canDispatchEnter to get the
+    current table, then canDispatch for each message, then
+    canDispatchLeave when it has finished with the table.  The table must
+    not be used after canDispatchLeave.  Entering once for a whole batch
+    of messages is cheaper than once per message, but the batch should
+    be bounded since old tables can't be freed while it lasts.
+
+    canDispatch calls every callback registered for the message's
+    identifier, in the order they were registered.  canDispatchLeave
+    frees any replaced tables that the reader can no longer be using, so
+    they don't wait for the next change to the callbacks; it only does
+    so if the dispatcher's lock is free, and never waits for it.  None of
+    the other routines takes a lock.
+
+Returns:
+    canDispatchEnter returns the table, which may be NULL.
+    canDispatch returns the number of callbacks called, 0 if the
+    identifier has none.
+
+Example:
+    ptable = canDispatchEnter(pdevice->dispatcher);
+    for (i = 0; i < n; i++) {
+	if (canDispatch(ptable, &messages[i]) == 0) unused++;
+    }
+    canDispatchLeave(pdevice->dispatcher);
+
+*/
+
+const canDispatchTable_t *canDispatchEnter (
+    canDispatcherID_t pd
+) {
+    pd->epoch++;		/* Odd: a table may be in use */
+    dispatchBarrier();		/* Epoch stored before the table is read */
+    return pd->ptable;
+}
+
+int canDispatch (
+    const canDispatchTable_t *ptable,
+    const canMessage_t *pmessage
+) {
+    const handler_t *phandler, *pend;
+    int count = tableFind(ptable, pmessage->identifier, &phandler);
+
+    for (pend = phandler + count; phandler < pend; phandler++) {
+	(*phandler->pcallback)(phandler->pprivate, pmessage);
+    }
+    return count;
+}
+
+void canDispatchLeave (
+    canDispatcherID_t pd
+) {
+    dispatchBarrier();		/* Table finished with before the epoch */
+    pd->epoch++;		/* Even: no table in use */
+
+    if (pd->retiredCount &&
+	epicsMutexTryLock(pd->lock) == epicsMutexLockOK) {
+	dispatchReclaim(pd);
+	epicsMutexUnlock(pd->lock);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDispatcherSync
+
+Purpose:
+    Wait for the reader to finish with the tables it has entered
+
+Description:
+    If the receive thread is dispatching when this is called, waits until
+    it calls canDispatchLeave.  Afterwards no callback deleted before the
+    call can be called again, so its private data may be freed.  This
+    polls, and must not be called from a message callback, which would
+    wait for itself.
+
+Returns:
+    void
+
+Example:
+    canDispatcherDelete(pdevice->dispatcher, 0x123, myCallback, pme);
+    canDispatcherSync(pdevice->dispatcher);
+    free(pme);
+
+*/
+
+void canDispatcherSync (
+    canDispatcherID_t pd
+) {
+    unsigned epoch;
+
+    dispatchBarrier();
+    epoch = pd->epoch;
+    if (epoch & 1) {
+	while (pd->epoch == epoch) {
+	    epicsThreadSleep(0.01);
+	}
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDispatcherIds
+
+Purpose:
+    List the identifiers that have callbacks
+
+Description:
+    Copies up to maxIds of the identifiers in the current table into
+    pids, in ascending order.  pids may be NULL to just count them.
+
+Returns:
+    The number of identifiers that have callbacks.
+
+*/
+
+int canDispatcherIds (
+    canDispatcherID_t pd,
+    canID_t *pids,
+    int maxIds
+) {
+    const canDispatchTable_t *ptable;
+    int numIds = 0;
+
+    epicsMutexLock(pd->lock);
+    ptable = pd->ptable;
+    if (ptable != NULL) {
+	numIds = ptable->numIds;
+	if (pids != NULL) {
+	    memcpy(pids, ptable->pid,
+		   (numIds < maxIds ? numIds : maxIds) * sizeof(canID_t));
+	}
+    }
+    epicsMutexUnlock(pd->lock);
+    return numIds;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDispatcherReport
+
+Purpose:
+    Print a dispatcher's statistics
+
+Description:
+    Prints the size of the current table and how often it has been
+    rebuilt.  With interest > 0 it also lists the identifiers in use.
+
+Returns:
+    void
+
+*/
+
+void canDispatcherReport (
+    canDispatcherID_t pd,
+    int interest
+) {
+    const canDispatchTable_t *ptable;
+
+    epicsMutexLock(pd->lock);
+    ptable = pd->ptable;
+    printf("\tDispatch table : %d IDs, %d handlers, %lu bytes\n",
+	   ptable ? ptable->numIds : 0, ptable ? ptable->numHandlers : 0,
+	   ptable ? (unsigned long) ptable->size : 0UL);
+    printf("\tTable rebuilds : %d, %d old tables awaiting reclaim%s\n",
+	   pd->builds, pd->retiredCount,
+	   pd->stale ? ", rebuild deferred" : "");
+    if (interest > 0 && ptable != NULL) {
+	int i;
+
+	printf("\tCallbacks registered:");
+	for (i = 0; i < ptable->numIds; i++) {
+	    if (i % 8 == 0) {
+		printf("\n\t    ");
+	    }
+	    if (ptable->pid[i] & CAN_ID_EXTENDED) {
+		printf("0x%08xx ", ptable->pid[i] & ~CAN_ID_EXTENDED);
+	    } else {
+		printf("0x%-3x       ", ptable->pid[i]);
+	    }
+	}
+	printf("\n");
+    }
+    epicsMutexUnlock(pd->lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canDispatchBench
+
+Purpose:
+    Measure the dispatch table
+
+Description:
+    Builds a private table with numIds extended identifiers spread evenly
+    over the 29-bit range and perId callbacks on each, then times the
+    dispatch of loops times that many messages, half of them to
+    identifiers that have callbacks and half to ones that don't.  The
+    callbacks only count their calls, so the figures are the cost of the
+    lookup and the calls themselves.  Prints the time taken to build the
+    table, its size, and the mean time per message and per callback.
+
+Returns:
+    0, or
+    S_can_badMessage if numIds, perId or loops is out of range,
+    ENOMEM if memory could not be allocated.
+
+Example:
+    canDispatchBench 2000, 2, 1000
+
+*/
+
+static void benchCallback (
+    void *pprivate,
+    const canMessage_t *pmessage
+) {
+    (*(unsigned long *) pprivate)++;
+}
+
+int canDispatchBench (
+    int numIds,
+    int perId,
+    int loops
+) {
+    canDispatchTable_t *ptable;
+    registration_t *preg;
+    canMessage_t message;
+    unsigned long calls = 0, messages = 0;
+    epicsUInt32 stride;
+    epicsTimeStamp start, end;
+    double buildTime, runTime;
+    int count = numIds * perId;
+    int i, loop, status;
+
+    if (numIds < 1 || numIds > CAN_EXT_IDENTIFIERS / 2 ||
+	perId < 1 || perId > 64 ||
+	loops < 1) {
+	return S_can_badMessage;
+    }
+    stride = CAN_EXT_IDENTIFIERS / numIds;
+
+    preg = calloc(count, sizeof(registration_t));
+    if (preg == NULL) return ENOMEM;
+    for (i = 0; i < count; i++) {
+	preg[i].identifier = CAN_ID_EXTENDED | ((i % numIds) * stride);
+	preg[i].sequence = i;
+	preg[i].handler.pcallback = benchCallback;
+	preg[i].handler.pprivate = &calls;
+    }
+
+    epicsTimeGetCurrent(&start);
+    status = tableBuild(preg, count, &ptable);
+    epicsTimeGetCurrent(&end);
+    free(preg);
+    if (status) return status;
+    buildTime = epicsTimeDiffInSeconds(&end, &start);
+
+    memset(&message, 0, sizeof(message));
+    epicsTimeGetCurrent(&start);
+    for (loop = 0; loop < loops; loop++) {
+	for (i = 0; i < 2 * numIds; i++) {
+	    /* Odd i misses, falling halfway between two IDs in use */
+	    message.identifier = CAN_ID_EXTENDED |
+		((i >> 1) * stride + (i & 1) * (stride >> 1));
+	    canDispatch(ptable, &message);
+	}
+	messages += 2 * numIds;
+    }
+    epicsTimeGetCurrent(&end);
+    runTime = epicsTimeDiffInSeconds(&end, &start);
+
+    printf("canDispatchBench: %d IDs x %d callbacks, built in %.1f usec, "
+	   "%lu bytes\n", ptable->numIds, perId, 1e6 * buildTime,
+	   (unsigned long) ptable->size);
+    printf("    %lu messages, %lu callbacks in %.3f sec: "
+	   "%.1f nsec/message, %.1f nsec/callback\n",
+	   messages, calls, runTime, 1e9 * runTime / messages,
+	   calls ? 1e9 * runTime / calls : 0.0);
+
+    free(ptable);
+    return 0;
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* canDispatchBench(int numIds, int perId, int loops) */
+static const iocshArg canDispatchBenchArg0 = {"numIds", iocshArgInt};
+static const iocshArg canDispatchBenchArg1 = {"perId", iocshArgInt};
+static const iocshArg canDispatchBenchArg2 = {"loops", iocshArgInt};
+static const iocshArg * const canDispatchBenchArgs[3] = {
+    &canDispatchBenchArg0, &canDispatchBenchArg1, &canDispatchBenchArg2};
+static const iocshFuncDef canDispatchBenchFuncDef =
+    {"canDispatchBench",3,canDispatchBenchArgs};
+static void canDispatchBenchCallFunc(const iocshArgBuf *args)
+{
+    int status = canDispatchBench(args[0].ival, args[1].ival, args[2].ival);
+    if (status) {
+	printf("canDispatchBench: Error %#x\n", status);
+    }
+}
+
+static void canDispatchRegistrar(void) {
+    iocshRegister(&canDispatchBenchFuncDef,canDispatchBenchCallFunc);
+}
+epicsExportRegistrar(canDispatchRegistrar);
@@ -0,0 +1,64 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canDispatch.h
+
+Description:
+    Header file for the message dispatchers, which CAN controller drivers
+    use to hold the callbacks registered with canMessage() and to find
+    those for each received message without taking a lock.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#ifndef INCcanDispatchH
+#define INCcanDispatchH
+
+#include "shareLib.h"
+#include "canBus.h"
+
+
+typedef struct canDispatcher_s *canDispatcherID_t;
+typedef struct canDispatchTable_s canDispatchTable_t;
+
+
+epicsShareFunc int canDispatcherCreate(const char *name,
+		    canDispatcherID_t *pdispatcher);
+epicsShareFunc void canDispatcherDestroy(canDispatcherID_t dispatcher);
+epicsShareFunc int canDispatcherAdd(canDispatcherID_t dispatcher,
+		    canID_t identifier, canMsgCallback_t *pcallback,
+		    void *pprivate);
+epicsShareFunc int canDispatcherDelete(canDispatcherID_t dispatcher,
+		    canID_t identifier, canMsgCallback_t *pcallback,
+		    void *pprivate);
+epicsShareFunc const canDispatchTable_t *canDispatchEnter(
+		    canDispatcherID_t dispatcher);
+epicsShareFunc int canDispatch(const canDispatchTable_t *ptable,
+		    const canMessage_t *pmessage);
+epicsShareFunc void canDispatchLeave(canDispatcherID_t dispatcher);
+epicsShareFunc void canDispatcherSync(canDispatcherID_t dispatcher);
+epicsShareFunc int canDispatcherIds(canDispatcherID_t dispatcher,
+		    canID_t *pids, int maxIds);
+epicsShareFunc void canDispatcherReport(canDispatcherID_t dispatcher,
+		    int interest);
+epicsShareFunc int canDispatchBench(int numIds, int perId, int loops);
+
+
+#endif /* INCcanDispatchH */
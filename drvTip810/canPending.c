@@ -0,0 +1,540 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canPending.c
+
+Description:
+    Pending read tables for CAN controller drivers.  A driver implements
+    canRead() and canReadAsync() by handing them to canPendingRead() and
+    canPendingReadAsync() together with its own routine for sending the
+    Remote Transmission Request, and passes every message its receive
+    task takes in to canPendingComplete().  Each read waits in a bucket
+    chosen by hashing its identifier, so standard and extended
+    identifiers cost the same, and the entries are kept on a free list
+    together with the event and timer they need, so a bus that is being
+    polled allocates nothing once it has settled down.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <epicsTypes.h>
+#include <epicsEvent.h>
+#include <epicsMutex.h>
+#include <epicsTimer.h>
+
+#include "canBus.h"
+#include "canPending.h"
+
+
+#define PENDING_HASH_BITS 8	/* 256 buckets */
+#define HASH_MULTIPLIER 2654435761U	/* Golden ratio * 2^32 */
+
+
+typedef struct pendingRead_s {
+    struct pendingRead_s *pnext;	/* same bucket, or free list */
+    struct canPending_s *ppending;	/* owning table */
+    canID_t identifier;			/* ID being read */
+    canMessage_t *pmessage;		/* canRead: reply destination buffer */
+    epicsEventId done;			/* canRead: signalled on reply */
+    canReadCallback_t *pcallback;	/* canReadAsync: NULL for canRead */
+    void *pprivate;			/* canReadAsync: its reference */
+    epicsTimerId timer;			/* canReadAsync: reply timeout */
+} pendingRead_t;
+
+struct canPending_s {
+    epicsMutexId lock;			/* Protects everything below */
+    pendingRead_t *pfree;		/* Spare entries */
+    int numPending;			/* Reads waiting for replies */
+    int maxPending;			/* High-water mark for numPending */
+    pendingRead_t * volatile pbucket[1 << PENDING_HASH_BITS];
+};
+
+
+static unsigned pendingHash (
+    canID_t identifier
+) {
+    return ((epicsUInt32) identifier * HASH_MULTIPLIER) >>
+	   (32 - PENDING_HASH_BITS);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canPendingCreate, canPendingDestroy
+
+Purpose:
+    Create or delete a pending read table
+
+Description:
+    A driver creates one table per bus.  canPendingDestroy frees the
+    table and its spare entries, and is only for a bus whose creation
+    failed; no reads may be waiting.
+
+Returns:
+    canPendingCreate returns 0, or
+    ENOMEM if memory could not be allocated.
+
+Example:
+    status = canPendingCreate(&pdevice->pending);
+
+*/
+
+int canPendingCreate (
+    canPendingID_t *ppending
+) {
+    struct canPending_s *pp = calloc(1, sizeof(struct canPending_s));
+
+    if (pp == NULL) {
+	return ENOMEM;
+    }
+    pp->lock = epicsMutexCreate();
+    if (pp->lock == NULL) {
+	free(pp);
+	return ENOMEM;
+    }
+    *ppending = pp;
+    return 0;
+}
+
+void canPendingDestroy (
+    canPendingID_t pp
+) {
+    while (pp->pfree != NULL) {
+	pendingRead_t *pentry = pp->pfree;
+
+	pp->pfree = pentry->pnext;
+	epicsEventDestroy(pentry->done);
+	epicsTimerQueueDestroyTimer(canTimerQ, pentry->timer);
+	free(pentry);
+    }
+    epicsMutexDestroy(pp->lock);
+    free(pp);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    entryGet, entryPut
+
+Purpose:
+    Take an entry from, or return one to, the free list
+
+Description:
+    Entries are only allocated when the free list is empty, so a table
+    holds as many as its bus has had reads outstanding at once.  Each has
+    its own event for canRead and timer for canReadAsync, made once and
+    reused.
+
+Returns:
+    entryGet returns the entry, or NULL if memory ran out.
+
+*/
+
+static void entryTimeout(void *parg);
+
+static pendingRead_t * entryGet (
+    struct canPending_s *pp
+) {
+    pendingRead_t *pentry;
+
+    epicsMutexLock(pp->lock);
+    pentry = pp->pfree;
+    if (pentry != NULL) {
+	pp->pfree = pentry->pnext;
+    }
+    epicsMutexUnlock(pp->lock);
+    if (pentry != NULL) return pentry;
+
+    pentry = calloc(1, sizeof(pendingRead_t));
+    if (pentry == NULL) return NULL;
+    pentry->ppending = pp;
+    pentry->done = epicsEventCreate(epicsEventEmpty);
+    pentry->timer = epicsTimerQueueCreateTimer(canTimerQ, entryTimeout, pentry);
+    if (pentry->done == NULL ||
+	pentry->timer == NULL) {
+	if (pentry->done) epicsEventDestroy(pentry->done);
+	if (pentry->timer) epicsTimerQueueDestroyTimer(canTimerQ, pentry->timer);
+	free(pentry);
+	return NULL;
+    }
+    return pentry;
+}
+
+static void entryPut (
+    struct canPending_s *pp,
+    pendingRead_t *pentry
+) {
+    epicsMutexLock(pp->lock);
+    pentry->pnext = pp->pfree;
+    pp->pfree = pentry;
+    epicsMutexUnlock(pp->lock);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    entryAdd, entryWithdraw
+
+Purpose:
+    Enter a read in, or take it out of, the table
+
+Description:
+    entryAdd puts the entry at the head of its bucket.  entryWithdraw
+    removes it again if it is still there.  Once an entry has been taken
+    out by a reply or by its timer, that path owns it and must finish
+    the read.
+
+Returns:
+    entryWithdraw returns TRUE if it removed the entry, FALSE if it had
+    already been taken out.
+
+*/
+
+static void entryAdd (
+    struct canPending_s *pp,
+    pendingRead_t *pentry
+) {
+    unsigned hash = pendingHash(pentry->identifier);
+
+    epicsMutexLock(pp->lock);
+    pentry->pnext = pp->pbucket[hash];
+    pp->pbucket[hash] = pentry;
+    if (++pp->numPending > pp->maxPending) {
+	pp->maxPending = pp->numPending;
+    }
+    epicsMutexUnlock(pp->lock);
+}
+
+static int entryWithdraw (
+    struct canPending_s *pp,
+    pendingRead_t *pentry
+) {
+    pendingRead_t * volatile *ppentry;
+    int found = FALSE;
+
+    epicsMutexLock(pp->lock);
+    ppentry = &pp->pbucket[pendingHash(pentry->identifier)];
+    while (*ppentry != NULL && *ppentry != pentry) {
+	ppentry = &(*ppentry)->pnext;
+    }
+    if (*ppentry != NULL) {
+	*ppentry = pentry->pnext;
+	pp->numPending--;
+	found = TRUE;
+    }
+    epicsMutexUnlock(pp->lock);
+    return found;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    asyncDone, entryTimeout
+
+Purpose:
+    Finish a canReadAsync request
+
+Description:
+    asyncDone is called once the entry has been taken out of the table.
+    It returns the entry to the free list before calling the completion
+    routine, with the reply or a NULL message pointer, so the routine can
+    start another canReadAsync without allocating anything.  entryTimeout
+    is the expiry routine of the entry's timer.
+
+Returns:
+    void
+
+*/
+
+static void asyncDone (
+    struct canPending_s *pp,
+    pendingRead_t *pentry,
+    int status,
+    const canMessage_t *pmessage
+) {
+    canReadCallback_t *pcallback = pentry->pcallback;
+    void *pprivate = pentry->pprivate;
+
+    entryPut(pp, pentry);
+    (*pcallback)(pprivate, status, pmessage);
+}
+
+static void entryTimeout (
+    void *parg
+) {
+    pendingRead_t *pentry = parg;
+    struct canPending_s *pp = pentry->ppending;
+
+    if (entryWithdraw(pp, pentry)) {
+	asyncDone(pp, pentry, S_can_timeout, NULL);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canPendingRead
+
+Purpose:
+    Send an RTR and wait for the reply
+
+Description:
+    Enters a read for pmessage->identifier in the table, then calls
+    psend(pdev, &request, timeout) to send the RTR and waits up to
+    timeout seconds for canPendingComplete() to copy the reply into
+    *pmessage.  A negative timeout waits forever.  The identifier and
+    length are not checked, that is up to the driver.
+
+Returns:
+    0, or
+    S_can_timeout if no reply arrived in time,
+    ENOMEM if an entry could not be allocated,
+    any error status from psend().
+
+Example:
+    return canPendingRead(pdevice->pending, loopWrite, pdevice,
+			  pmessage, timeout);
+
+*/
+
+int canPendingRead (
+    canPendingID_t pp,
+    canPendingSend_t *psend,
+    void *pdev,
+    canMessage_t *pmessage,
+    double timeout
+) {
+    canMessage_t request;
+    pendingRead_t *pentry;
+    int status;
+
+    pentry = entryGet(pp);
+    if (pentry == NULL) {
+	return ENOMEM;
+    }
+    pentry->identifier = pmessage->identifier;
+    pentry->pmessage   = pmessage;
+    pentry->pcallback  = NULL;
+
+    /* The reply may overwrite *pmessage as soon as the entry is added */
+    request = *pmessage;
+    request.rtr = RTR;
+
+    entryAdd(pp, pentry);
+    status = (*psend)(pdev, &request, timeout);
+    if (status == 0) {
+	if (timeout < 0) {
+	    epicsEventWait(pentry->done);
+	} else if (epicsEventWaitWithTimeout(pentry->done, timeout) !=
+		   epicsEventWaitOK) {
+	    status = S_can_timeout;
+	}
+    }
+
+    /* Withdraw the entry, unless the reply arrived after we gave up, in
+     * which case take its signal so the next user doesn't see it */
+    if (!entryWithdraw(pp, pentry)) {
+	epicsEventTryWait(pentry->done);
+	status = 0;
+    }
+    entryPut(pp, pentry);
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canPendingReadAsync
+
+Purpose:
+    Send an RTR and return at once
+
+Description:
+    Enters a read for identifier in the table, starts its timer and
+    calls psend(pdev, &request, 0) to queue an RTR asking for a full 8
+    byte message.  Then pcallback(pprivate, status, pmessage) is called
+    exactly once, from the driver's receive task with status 0 and the
+    reply, or from the canTimerQ thread with S_can_timeout and a NULL
+    pmessage.  A negative timeout waits forever.  If psend() fails the
+    read is withdrawn and the callback will not be called.  Neither the
+    identifier nor pcallback is checked, that is up to the driver.
+
+Returns:
+    0, or
+    ENOMEM if an entry could not be allocated,
+    any error status from psend().
+
+Example:
+    return canPendingReadAsync(pdevice->pending, loopWrite, pdevice,
+			       identifier, pcallback, pprivate, timeout);
+
+*/
+
+int canPendingReadAsync (
+    canPendingID_t pp,
+    canPendingSend_t *psend,
+    void *pdev,
+    canID_t identifier,
+    canReadCallback_t *pcallback,
+    void *pprivate,
+    double timeout
+) {
+    canMessage_t request;
+    pendingRead_t *pentry;
+    int status;
+
+    pentry = entryGet(pp);
+    if (pentry == NULL) {
+	return ENOMEM;
+    }
+    pentry->identifier = identifier;
+    pentry->pmessage   = NULL;
+    pentry->pcallback  = pcallback;
+    pentry->pprivate   = pprivate;
+    entryAdd(pp, pentry);
+
+    if (timeout >= 0) {
+	epicsTimerStartDelay(pentry->timer, timeout);
+    }
+
+    request.identifier = identifier;
+    request.rtr        = RTR;
+    request.length     = CAN_DATA_SIZE;
+    status = (*psend)(pdev, &request, 0);
+
+    /* If the entry has already gone, its callback has been or will be
+     * called, so the caller must see success */
+    if (status &&
+	entryWithdraw(pp, pentry)) {
+	epicsTimerCancel(pentry->timer);
+	entryPut(pp, pentry);
+	return status;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canPendingComplete
+
+Purpose:
+    Give a received message to the reads waiting for it
+
+Description:
+    Called by the driver's receive task for every message it takes in.
+    RTRs and messages whose bucket is empty are dismissed without taking
+    the lock.  Otherwise every read of the message's identifier is taken
+    out of the table.  A canRead has the message copied into its buffer
+    and is woken with the lock held, so when it times out it either
+    finds its entry still in the table or its buffer already filled in.
+    The canReadAsync requests have their timers cancelled and their
+    completion routines called after the lock has been released.
+
+Returns:
+    void
+
+*/
+
+void canPendingComplete (
+    canPendingID_t pp,
+    const canMessage_t *pmessage
+) {
+    pendingRead_t * volatile *ppentry;
+    pendingRead_t *pentry, *pasync = NULL;
+    unsigned hash;
+
+    if (pmessage->rtr == RTR) return;
+    hash = pendingHash(pmessage->identifier);
+    if (pp->pbucket[hash] == NULL) return;
+
+    epicsMutexLock(pp->lock);
+    ppentry = &pp->pbucket[hash];
+    while ((pentry = *ppentry) != NULL) {
+	if (pentry->identifier != pmessage->identifier) {
+	    ppentry = &pentry->pnext;
+	    continue;
+	}
+	*ppentry = pentry->pnext;
+	pp->numPending--;
+	if (pentry->pcallback == NULL) {
+	    *pentry->pmessage = *pmessage;
+	    epicsEventSignal(pentry->done);
+	} else {
+	    pentry->pnext = pasync;
+	    pasync = pentry;
+	}
+    }
+    epicsMutexUnlock(pp->lock);
+
+    while (pasync != NULL) {
+	pentry = pasync->pnext;
+	epicsTimerCancel(pasync->timer);
+	asyncDone(pp, pasync, 0, pmessage);
+	pasync = pentry;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canPendingClear, canPendingReport
+
+Purpose:
+    Reset or print the table's statistics
+
+Description:
+    canPendingClear restarts the high-water mark from the number of
+    reads waiting now, for the driver's canBusReset routine.
+    canPendingReport prints both on one line of a driver report.
+
+Returns:
+    void
+
+*/
+
+void canPendingClear (
+    canPendingID_t pp
+) {
+    epicsMutexLock(pp->lock);
+    pp->maxPending = pp->numPending;
+    epicsMutexUnlock(pp->lock);
+}
+
+void canPendingReport (
+    canPendingID_t pp
+) {
+    epicsMutexLock(pp->lock);
+    printf("\tcanRead Status : %d waiting, max %d\n",
+	   pp->numPending, pp->maxPending);
+    epicsMutexUnlock(pp->lock);
+}
@@ -0,0 +1,60 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canPending.h
+
+Description:
+    Header file for the pending read tables, which CAN controller drivers
+    use to implement canRead() and canReadAsync() by matching the replies
+    they receive against the Remote Transmission Requests sent for them.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#ifndef INCcanPendingH
+#define INCcanPendingH
+
+#include "shareLib.h"
+#include "canBus.h"
+
+
+typedef struct canPending_s *canPendingID_t;
+
+/* Driver routine that sends the RTR; it must not block if timeout is 0 */
+typedef int canPendingSend_t(void *pdev, const canMessage_t *prequest,
+		double timeout);
+
+
+epicsShareFunc int canPendingCreate(canPendingID_t *ppending);
+epicsShareFunc void canPendingDestroy(canPendingID_t pending);
+epicsShareFunc int canPendingRead(canPendingID_t pending,
+		    canPendingSend_t *psend, void *pdev,
+		    canMessage_t *pmessage, double timeout);
+epicsShareFunc int canPendingReadAsync(canPendingID_t pending,
+		    canPendingSend_t *psend, void *pdev, canID_t identifier,
+		    canReadCallback_t *pcallback, void *pprivate,
+		    double timeout);
+epicsShareFunc void canPendingComplete(canPendingID_t pending,
+		    const canMessage_t *pmessage);
+epicsShareFunc void canPendingClear(canPendingID_t pending);
+epicsShareFunc void canPendingReport(canPendingID_t pending);
+
+
+#endif /* INCcanPendingH */
@@ -0,0 +1,419 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canStats.c
+
+Description:
+    Per-bus traffic statistics for CAN controller drivers.  A driver
+    embeds a canStats_t in its device structure, updates it from its ISR
+    and receive task with the routines here, and returns it from the stats
+    entry of its canDriver_t, so device support and the reports can read
+    it through canBusStats() while the bus is running.  The counters have
+    one writer each and are read without locks; see canStats.h.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+
+#include "canBus.h"
+#include "canStats.h"
+
+
+#define HASH_MULTIPLIER 2654435761U	/* Golden ratio * 2^32 */
+#define HASH_SHIFT 24			/* Leaves 8 bits, CAN_STATS_IDS */
+#define FRAME_BITS_STD 47		/* Standard frame, no data or stuffing */
+#define FRAME_BITS_EXT 67		/* Extended frame, ditto */
+
+
+/*******************************************************************************
+
+Routine:
+    canStatsInit, canStatsClear
+
+Purpose:
+    Initialise or zero a statistics block
+
+Description:
+    canStatsInit sets up a new block for a bus running at busRate Kbits/sec
+    (0 if the driver doesn't know), before the block is published.
+    canStatsClear zeroes the counters of a live block, for the driver's
+    busReset routine.  An increment made at the same moment may be lost
+    or may survive the clear; the resets count tells readers to discard
+    the values they remembered from before it.
+
+Returns:
+    void
+
+*/
+
+void canStatsInit (
+    canStats_t *pstats,
+    int busRate
+) {
+    memset(pstats, 0, sizeof(canStats_t));
+    pstats->busRate = busRate;
+    canStatsClear(pstats);
+    pstats->resets = 0;
+}
+
+void canStatsClear (
+    canStats_t *pstats
+) {
+    int i;
+
+    pstats->txFrames = 0;
+    pstats->txBytes = 0;
+    pstats->txBits = 0;
+    pstats->rxFrames = 0;
+    pstats->rxBytes = 0;
+    pstats->rxBits = 0;
+    pstats->unused = 0;
+    pstats->lost = 0;
+    pstats->overruns = 0;
+    pstats->aborts = 0;
+    pstats->errors = 0;
+    pstats->busOffs = 0;
+    pstats->recvMaxQueued = pstats->recvQueued;
+    pstats->txMaxQueued = pstats->txQueued;
+    pstats->isrCount = 0;
+    pstats->isrTime = 0;
+    pstats->isrMax = 0;
+    pstats->latencyMax = 0;
+    for (i = 0; i < CAN_STATS_LATENCY_BINS; i++) {
+	pstats->latency[i] = 0;
+    }
+
+    /* Empty the ID table before zeroing its counts, so a reader never
+     * sees an old identifier against a new count */
+    pstats->idsUsed = 0;
+    for (i = 0; i < CAN_STATS_IDS; i++) {
+	pstats->ids[i].identifier = CAN_STATS_NO_ID;
+    }
+    for (i = 0; i < CAN_STATS_IDS; i++) {
+	pstats->ids[i].count = 0;
+    }
+    pstats->idsOther = 0;
+    pstats->resets++;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canStatsBits
+
+Purpose:
+    Estimate how many bit times a message occupies on the bus
+
+Description:
+    Counts the frame fields from the start of frame bit to the end of the
+    interframe space, but not the stuff bits, which depend on the data.
+    Bus loads calculated from this are about 10 to 20 % low when the bus
+    is busy.
+
+Returns:
+    Bit times.
+
+*/
+
+epicsUInt32 canStatsBits (
+    const canMessage_t *pmessage
+) {
+    epicsUInt32 bits = (pmessage->identifier & CAN_ID_EXTENDED) ?
+		       FRAME_BITS_EXT : FRAME_BITS_STD;
+
+    if (pmessage->rtr != RTR) {
+	bits += 8 * pmessage->length;
+    }
+    return bits;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canStatsTx, canStatsRx, canStatsIsr
+
+Purpose:
+    Count transmitted and received messages, and the time spent in an ISR
+
+Description:
+    canStatsTx is called once a message has been sent, and canStatsRx as
+    each received message is dispatched, with the time since it arrived;
+    a negative latency means that time isn't known, and the message is
+    left out of the latency histogram.
+    canStatsRx also counts the message against its identifier, taking the
+    next free entry in the ID table the first time it sees one; once the
+    table is full, messages with new identifiers are only counted in
+    idsOther.  canStatsIsr is given the time stamp taken as the ISR was
+    entered and is called as it leaves; if either clock read fails, the
+    interrupt is counted but not timed.  canStatsTx and canStatsIsr use
+    only integer arithmetic, so they may be called from an ISR.  Each
+    routine must only ever be called from one thread for a given block.
+
+Returns:
+    void
+
+*/
+
+void canStatsTx (
+    canStats_t *pstats,
+    const canMessage_t *pmessage
+) {
+    pstats->txFrames++;
+    if (pmessage->rtr != RTR) {
+	pstats->txBytes += pmessage->length;
+    }
+    pstats->txBits += canStatsBits(pmessage);
+}
+
+void canStatsRx (
+    canStats_t *pstats,
+    const canMessage_t *pmessage,
+    double latency
+) {
+    canID_t identifier = pmessage->identifier;
+    unsigned index = (identifier * HASH_MULTIPLIER) >> HASH_SHIFT;
+    epicsUInt32 usec;
+    int bin, probe;
+
+    pstats->rxFrames++;
+    if (pmessage->rtr != RTR) {
+	pstats->rxBytes += pmessage->length;
+    }
+    pstats->rxBits += canStatsBits(pmessage);
+
+    if (latency >= 0.0) {
+	usec = (epicsUInt32) (latency * 1e6);
+	if (usec > pstats->latencyMax) {
+	    pstats->latencyMax = usec;
+	}
+	for (bin = 0; usec != 0 && bin < CAN_STATS_LATENCY_BINS - 1; bin++) {
+	    usec >>= 1;
+	}
+	pstats->latency[bin]++;
+    }
+
+    for (probe = 0; probe < CAN_STATS_IDS; probe++) {
+	canStatsId_t *pid = &pstats->ids[index];
+
+	if (pid->identifier == identifier) {
+	    pid->count++;
+	    return;
+	}
+	if (pid->identifier == CAN_STATS_NO_ID) {
+	    /* Set the count before publishing the identifier */
+	    pid->count = 1;
+	    pid->identifier = identifier;
+	    pstats->idsUsed++;
+	    return;
+	}
+	index = (index + 1) % CAN_STATS_IDS;
+    }
+    pstats->idsOther++;
+}
+
+void canStatsIsr (
+    canStats_t *pstats,
+    const epicsTimeStamp *pentry
+) {
+    epicsTimeStamp now;
+    epicsUInt32 usec;
+
+    if ((pentry->secPastEpoch == 0 && pentry->nsec == 0) ||
+	epicsTimeGetCurrentInt(&now) != epicsTimeOK) {
+	usec = 0;			/* No ISR-safe clock */
+    } else {
+	usec = (now.secPastEpoch - pentry->secPastEpoch) * 1000000 +
+	       (epicsInt32) (now.nsec - pentry->nsec) / 1000;
+	if (usec > 1000000) usec = 0;	/* Clock stepped backwards */
+    }
+
+    pstats->isrCount++;
+    pstats->isrTime += usec;
+    if (usec > pstats->isrMax) {
+	pstats->isrMax = usec;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canStatsIdCount
+
+Purpose:
+    Return the number of messages received with a given identifier
+
+Returns:
+    The count, 0 if the identifier isn't in the ID table.
+
+*/
+
+epicsUInt32 canStatsIdCount (
+    const canStats_t *pstats,
+    canID_t identifier
+) {
+    unsigned index = (identifier * HASH_MULTIPLIER) >> HASH_SHIFT;
+    int probe;
+
+    for (probe = 0; probe < CAN_STATS_IDS; probe++) {
+	const canStatsId_t *pid = &pstats->ids[index];
+
+	if (pid->identifier == identifier) return pid->count;
+	if (pid->identifier == CAN_STATS_NO_ID) return 0;
+	index = (index + 1) % CAN_STATS_IDS;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canStatsPercentile
+
+Purpose:
+    Estimate a percentile of a latency histogram
+
+Description:
+    Finds the bin holding the given fraction (0.0 .. 1.0) of the counts in
+    a histogram laid out like canStats_t.latency, and interpolates within
+    it.  Device support passes the difference between two readings of the
+    histogram to get the percentile over the interval between them.
+
+Returns:
+    The latency in microseconds, 0 if the histogram is empty.
+
+*/
+
+double canStatsPercentile (
+    const epicsUInt32 *platency,
+    double fraction
+) {
+    double total = 0.0, wanted, below = 0.0;
+    double low, high;
+    int bin;
+
+    for (bin = 0; bin < CAN_STATS_LATENCY_BINS; bin++) {
+	total += platency[bin];
+    }
+    if (total == 0.0) return 0.0;
+
+    wanted = fraction * total;
+    for (bin = 0; bin < CAN_STATS_LATENCY_BINS - 1; bin++) {
+	if (below + platency[bin] >= wanted) break;
+	below += platency[bin];
+    }
+    if (platency[bin] == 0) return 0.0;
+
+    low = bin ? (double) (1 << (bin - 1)) : 0.0;
+    high = (double) (1 << bin);
+    return low + (high - low) * (wanted - below) / platency[bin];
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canStatsReport
+
+Purpose:
+    Print the rate-independent statistics for a bus
+
+Description:
+    Drivers call this from their report routines.  Interest level 1 prints
+    the ISR time and the receive latency percentiles, level 2 the busiest
+    identifiers.  The percentiles are interpolated within the histogram's
+    power of 2 bins, and are limited to the maximum latency seen.
+
+Returns:
+    void
+
+*/
+
+void canStatsReport (
+    const canStats_t *pstats,
+    int interest
+) {
+    epicsUInt32 latency[CAN_STATS_LATENCY_BINS];
+    epicsUInt32 isrCount = pstats->isrCount;
+    double latencyMax = pstats->latencyMax;
+    double percentile[3];
+    int i;
+
+    if (interest == 1 && isrCount > 0) {
+	printf("\tISR time mean %.1f usec, max %u usec, %u interrupts.\n",
+		(double) pstats->isrTime / isrCount,
+		(unsigned) pstats->isrMax, (unsigned) isrCount);
+    }
+    for (i = 0; i < CAN_STATS_LATENCY_BINS; i++) {
+	latency[i] = pstats->latency[i];
+    }
+    percentile[0] = canStatsPercentile(latency, 0.5);
+    percentile[1] = canStatsPercentile(latency, 0.9);
+    percentile[2] = canStatsPercentile(latency, 0.99);
+    for (i = 0; i < 3; i++) {
+	if (percentile[i] > latencyMax) percentile[i] = latencyMax;
+    }
+    if (interest == 1 && pstats->rxFrames > 0) {
+	printf("\tReceive latency 50%% %.1f, 90%% %.1f, 99%% %.1f, "
+	       "max %.0f usec.\n", percentile[0], percentile[1],
+	       percentile[2], latencyMax);
+    }
+
+    if (interest > 1 && pstats->idsUsed > 0) {
+	const canStatsId_t *pbusiest[8];
+	int found = 0, j;
+
+	/* Keep the eight busiest entries, in order */
+	for (i = 0; i < CAN_STATS_IDS; i++) {
+	    const canStatsId_t *pid = &pstats->ids[i];
+
+	    if (pid->identifier == CAN_STATS_NO_ID) continue;
+	    for (j = found; j > 0 && pbusiest[j-1]->count < pid->count; j--) {
+		if (j < 8) pbusiest[j] = pbusiest[j-1];
+	    }
+	    if (j < 8) pbusiest[j] = pid;
+	    if (found < 8) found++;
+	}
+
+	printf("\tBusiest IDs of %u seen:", (unsigned) pstats->idsUsed);
+	for (i = 0; i < found; i++) {
+	    canID_t identifier = pbusiest[i]->identifier;
+
+	    if (identifier & CAN_ID_EXTENDED) {
+		printf(" 0x%08xx:%u", identifier & ~CAN_ID_EXTENDED,
+		       (unsigned) pbusiest[i]->count);
+	    } else {
+		printf(" 0x%x:%u", identifier, (unsigned) pbusiest[i]->count);
+	    }
+	}
+	if (pstats->idsOther > 0) {
+	    printf(" others:%u", (unsigned) pstats->idsOther);
+	}
+	printf("\n");
+    }
+}
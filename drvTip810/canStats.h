@@ -0,0 +1,103 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    canStats.h
+
+Description:
+    Header file for the per-bus traffic statistics, which CAN controller
+    drivers keep and canBusStats() exports to device support.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#ifndef INCcanStatsH
+#define INCcanStatsH
+
+#include "epicsTypes.h"
+#include "epicsTime.h"
+#include "shareLib.h"
+#include "canBus.h"
+
+
+#define CAN_STATS_LATENCY_BINS 24	/* Latency histogram, log2 usec */
+#define CAN_STATS_IDS 256		/* Identifiers counted separately */
+#define CAN_STATS_NO_ID 0xffffffff	/* Marks an unused ids[] entry */
+
+/* Every counter has exactly one writer, either the driver's ISR or one
+ * task or a code path under one lock, and is a naturally aligned 32-bit
+ * word, so readers in other threads always see a whole value without a
+ * lock.  The counters wrap modulo 2^32; readers take differences.  Only
+ * canStatsClear() has a second writer, so it bumps resets to tell the
+ * readers to start again. */
+
+typedef struct {
+    volatile epicsUInt32 identifier;	/* CAN_STATS_NO_ID if unused */
+    volatile epicsUInt32 count;		/* Messages received with it */
+} canStatsId_t;
+
+struct canStats_s {
+    int busRate;			/* Kbits/sec, 0 if not known */
+    volatile epicsUInt32 resets;	/* Times canStatsClear was called */
+    volatile epicsUInt32 txFrames;	/* Messages transmitted */
+    volatile epicsUInt32 txBytes;	/*   their data bytes */
+    volatile epicsUInt32 txBits;	/*   and estimated bits on the bus */
+    volatile epicsUInt32 rxFrames;	/* Messages received */
+    volatile epicsUInt32 rxBytes;	/*   their data bytes */
+    volatile epicsUInt32 rxBits;	/*   and estimated bits on the bus */
+    volatile epicsUInt32 unused;	/* Received without a callback */
+    volatile epicsUInt32 lost;		/* Lost, receive queue full */
+    volatile epicsUInt32 overruns;	/* Lost, controller overrun */
+    volatile epicsUInt32 aborts;	/* Transmissions aborted */
+    volatile epicsUInt32 errors;	/* Times entered Error state */
+    volatile epicsUInt32 busOffs;	/* Times entered Bus Off state */
+    volatile epicsUInt32 recvQueued;	/* Receive queue depth, last seen */
+    volatile epicsUInt32 recvMaxQueued;	/*   and its high-water mark */
+    volatile epicsUInt32 txQueued;	/* Transmit queue depth */
+    volatile epicsUInt32 txMaxQueued;	/*   and its high-water mark */
+    volatile epicsUInt32 isrCount;	/* Interrupts serviced */
+    volatile epicsUInt32 isrTime;	/*   total time in the ISR, usec */
+    volatile epicsUInt32 isrMax;	/*   and the longest, usec */
+    volatile epicsUInt32 latencyMax;	/* Longest receive -> callback, usec */
+    volatile epicsUInt32 latency[CAN_STATS_LATENCY_BINS];
+			/* Receive -> callback delays; bin 0 < 1 usec, then
+			   bin n counts 2^(n-1) to 2^n - 1 usec */
+    volatile epicsUInt32 idsUsed;	/* Entries filled in ids[] */
+    volatile epicsUInt32 idsOther;	/* Messages whose ID didn't fit */
+    canStatsId_t ids[CAN_STATS_IDS];	/* Received messages by ID */
+};
+
+
+epicsShareFunc void canStatsInit(canStats_t *pstats, int busRate);
+epicsShareFunc void canStatsClear(canStats_t *pstats);
+epicsShareFunc void canStatsTx(canStats_t *pstats,
+		    const canMessage_t *pmessage);
+epicsShareFunc void canStatsRx(canStats_t *pstats,
+		    const canMessage_t *pmessage, double latency);
+epicsShareFunc void canStatsIsr(canStats_t *pstats,
+		    const epicsTimeStamp *pentry);
+epicsShareFunc epicsUInt32 canStatsBits(const canMessage_t *pmessage);
+epicsShareFunc epicsUInt32 canStatsIdCount(const canStats_t *pstats,
+		    canID_t identifier);
+epicsShareFunc double canStatsPercentile(const epicsUInt32 *platency,
+		    double fraction);
+epicsShareFunc void canStatsReport(const canStats_t *pstats, int interest);
+
+
+#endif /* INCcanStatsH */
@@ -38,7 +38,6 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <string.h>
 
 #include <epicsTypes.h>
-#include <epicsTimer.h>
 #include <errMdef.h>
 #include <devLib.h>
 #include <dbDefs.h>
@@ -57,6 +56,7 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <epicsExport.h>
 
 #include "canBus.h"
+#include "canDecode.h"
 
 
 #define CONVERT 0
@@ -66,14 +66,10 @@ Copyright (c) 1995-2000 Andrew Johnson
 typedef struct aiCanPrivate_s {
     CALLBACK callback;
     struct aiCanPrivate_s *nextPrivate;
-    epicsTimerId timId;
-    IOSCANPVT ioscanpvt;
     dbCommon *prec;
-    canIo_t inp;
-    epicsUInt32 mask;
-    epicsUInt32 sign;
-    epicsUInt32 data;
-    double dval;
+    const canIo_t *inp;
+    canDecoderID_t decoder;
+    int field;
     int status;
 } aiCanPrivate_t;
 
@@ -90,7 +86,8 @@ static long get_ioint_info(int cmd, struct aiRecord *prec, IOSCANPVT *ppvt);
 static long read_ai(struct aiRecord *prec);
 static long special_linconv(struct aiRecord *prec, int after);
 static void ProcessCallback(CALLBACK *pcallback);
-static void aiMessage(void *private, const canMessage_t *pmessage);
+static void aiDone(void *private, int status,
+		    const canMessage_t *pmessage);
 static void busSignal(void *private, int status);
 static void busCallback(CALLBACK *pCallback);
 
@@ -121,8 +118,8 @@ static long init_ai (
 ) {
     aiCanPrivate_t *pcanAi;
     aiCanBus_t *pbus;
+    canField_t spec;
     int status;
-    epicsUInt32 fsd;
 
     if (prec->inp.type != INST_IO) {
 	recGblRecordError(S_db_badField, prec,
@@ -136,14 +133,13 @@ static long init_ai (
     }
     prec->dpvt = pcanAi;
     pcanAi->prec = (dbCommon *) prec;
-    pcanAi->ioscanpvt = NULL;
     pcanAi->status = NO_ALARM;
 
-    /* Convert the address string into members of the canIo structure */
-    status = canIoParse(prec->inp.value.instio.string, &pcanAi->inp);
+    /* Get the shared canIo structure for this address string */
+    status = canIoCompile(prec->inp.value.instio.string, &pcanAi->inp);
     if (status) {
 	if (canSilenceErrors) {
-	    pcanAi->inp.canBusID = NULL;
+	    pcanAi->inp = NULL;
 	    prec->pact = TRUE;
 	    return 0;
 	} else {
@@ -155,9 +151,9 @@ static long init_ai (
 
     #ifdef DEBUG
 	printf("aiCan %s: Init bus=%s, id=%#x, off=%u, parm=%ld str=%s\n",
-		    prec->name, pcanAi->inp.busName, pcanAi->inp.identifier,
-		    pcanAi->inp.offset, pcanAi->inp.parameter,
-		    pcanAi->inp.paramStr);
+		    prec->name, pcanAi->inp->busName, pcanAi->inp->identifier,
+		    pcanAi->inp->offset, pcanAi->inp->parameter,
+		    pcanAi->inp->paramStr);
     #endif
 
     /* For ai records, the final parameter specifies the raw input size.
@@ -165,52 +161,57 @@ static long init_ai (
 	specify a signed value, eg -4095 means a 12-bit signed value.
 	The range does not have to be a power of two, eg 99 is legal. */
 
-    fsd = abs(pcanAi->inp.parameter);
-    if (fsd > 0) {
-	if ((fsd & (fsd-1)) == 0) {
-	    fsd--;
-	}
-
-	/* Make a mask to contain only the valid input bits based on fsd */
-	pcanAi->mask = 1;
-	while (pcanAi->mask < fsd) {
-	    pcanAi->mask <<= 1;
-	}
-	pcanAi->mask--;
-
-	if (pcanAi->inp.parameter < 0) {
-	    /* signed: rval = sign-extend(data & mask) */
-	    pcanAi->sign = (pcanAi->mask >> 1) + 1;
-	} else {
-	    /* unsigned: rval = data & mask */
-	    pcanAi->sign = 0;
-	}
-
+    /* canIoCompile has already worked out the full scale and sign */
+    if (pcanAi->inp->fsd > 0) {
 	if (prec->linr == menuConvertLINEAR) {
-	    prec->roff = pcanAi->sign;
-	    prec->eslo = (prec->eguf - prec->egul) / fsd;
+	    prec->roff = pcanAi->inp->sign;
+	    prec->eslo = (prec->eguf - prec->egul) / pcanAi->inp->fsd;
 	} else {
 	    prec->roff = 0;
 	}
-    } else {
-	pcanAi->mask = pcanAi->sign = 0;
-	if (pcanAi->inp.paramStr) {
-	    if (strcmp(pcanAi->inp.paramStr, "float") == 0) {
-		pcanAi->sign = 4;
-	    } else if (strcmp(pcanAi->inp.paramStr, "double") == 0) {
-		pcanAi->sign = 8;
-	    }
-	}
     }
 
     #ifdef DEBUG
-	printf("  fsd=%ld, eslo=%g, roff = %ld, mask=%#lx, sign=%lu\n", 
-		fsd, prec->eslo, prec->roff, pcanAi->mask, pcanAi->sign);
+	printf("  fsd=%lu, eslo=%g, roff = %ld, mask=%#lx, sign=%lu\n", 
+		pcanAi->inp->fsd, prec->eslo, prec->roff, pcanAi->inp->mask,
+		pcanAi->inp->sign);
     #endif
 
+    /* Work out which message bytes hold the raw value */
+    spec.type = CAN_FIELD_UINT;
+    spec.offset = pcanAi->inp->offset;
+    spec.shift = 0;
+    spec.mask = 0;
+    if (pcanAi->inp->mask == 0 && pcanAi->inp->sign) {
+	/* FIXME: These have FP format problems... */
+	spec.type = CAN_FIELD_FLOAT;
+	spec.length = pcanAi->inp->sign;
+	if (spec.length == sizeof(double)) {
+	    spec.offset = 0;
+	}
+    } else if (pcanAi->inp->mask <= 0xff) {
+	spec.length = 1;
+    } else if (pcanAi->inp->mask <= 0xffff) {
+	spec.length = 2;
+    } else if (pcanAi->inp->mask <= 0xffffff) {
+	spec.length = 3;
+    } else {
+	spec.length = 4;
+    }
+
+    /* Subscribe to those bytes through the shared frame decoder */
+    status = canDecoderField(pcanAi->inp, &spec,
+			     &pcanAi->decoder, &pcanAi->field);
+    if (status) {
+	pcanAi->inp = NULL;
+	recGblRecordError(status, prec,
+			  "devAiCan (init_record) canDecoderField failed");
+	return status;
+    }
+
     /* Find the bus matching this record */
     for (pbus = firstBus; pbus != NULL; pbus = pbus->nextBus) {
-	if (pbus->canBusID == pcanAi->inp.canBusID) break;
+	if (pbus->canBusID == pcanAi->inp->canBusID) break;
     }
 
     /* If not found, create one */
@@ -220,7 +221,7 @@ static long init_ai (
 
 	/* Fill it in */
 	pbus->firstPrivate = NULL;
-	pbus->canBusID = pcanAi->inp.canBusID;
+	pbus->canBusID = pcanAi->inp->canBusID;
 	callbackSetUser(pbus, &pbus->callback);
 	callbackSetCallback(busCallback, &pbus->callback);
 	callbackSetPriority(priorityMedium, &pbus->callback);
@@ -242,16 +243,6 @@ static long init_ai (
     callbackSetCallback(ProcessCallback, &pcanAi->callback);
     callbackSetPriority(prec->prio, &pcanAi->callback);
 
-    /* and create a timer for CANbus RTR timeouts */
-    pcanAi->timId = epicsTimerQueueCreateTimer(canTimerQ,
-		(epicsTimerCallback) callbackRequest, pcanAi);
-    if (pcanAi->timId == NULL) {
-	return S_dev_noMemory;
-    }
-
-    /* Register the message handler with the Canbus driver */
-    canMessage(pcanAi->inp.canBusID, pcanAi->inp.identifier, aiMessage, pcanAi);
-
     return 0;
 }
 
@@ -261,16 +252,22 @@ static long get_ioint_info (
     IOSCANPVT *ppvt
 ) {
     aiCanPrivate_t *pcanAi = prec->dpvt;
+    static IOSCANPVT noScan = NULL;
 
-    if (pcanAi->ioscanpvt == NULL) {
-	scanIoInit(&pcanAi->ioscanpvt);
+    if (pcanAi->inp == NULL) {
+	/* Bad address, use a scan list that nothing ever requests */
+	if (noScan == NULL) {
+	    scanIoInit(&noScan);
+	}
+	*ppvt = noScan;
+	return 0;
     }
 
     #ifdef DEBUG
 	printf("canAi %s: get_ioint_info %d\n", prec->name, cmd);
     #endif
 
-    *ppvt = pcanAi->ioscanpvt;
+    *ppvt = canDecoderIoScan(pcanAi->decoder);
     return 0;
 }
 
@@ -279,7 +276,7 @@ static long read_ai (
 ) {
     aiCanPrivate_t *pcanAi = prec->dpvt;
 
-    if (pcanAi->inp.canBusID == NULL) {
+    if (pcanAi->inp == NULL) {
 	return DO_NOT_CONVERT;
     }
 
@@ -296,41 +293,47 @@ static long read_ai (
 
 	case NO_ALARM:
 	    if (prec->pact || prec->scan == SCAN_IO_EVENT) {
-		#ifdef DEBUG
-		    printf("canAi %s: message id=%#x, data=%#lx\n", 
-			    prec->name, pcanAi->inp.identifier, pcanAi->data);
+		epicsUInt32 data;
+
+		#ifdef epicsTimeEventDeviceTime
+		if (prec->tse == epicsTimeEventDeviceTime) {
+		    canDecoderTime(pcanAi->decoder, &prec->time);
+		}
 		#endif
 
-		if ((pcanAi->mask == 0) && pcanAi->sign) {
+		if ((pcanAi->inp->mask == 0) && pcanAi->inp->sign) {
+		    prec->val = canDecoderDouble(pcanAi->decoder, pcanAi->field);
 		    #ifdef DEBUG
-			printf("canAi %s: VAL=%g\n", prec->name, pcanAi->dval);
+			printf("canAi %s: VAL=%g\n", prec->name, prec->val);
 		    #endif
-		    prec->val = pcanAi->dval;
 		    prec->udf = FALSE;
 		    return DO_NOT_CONVERT;
 		}
-		prec->rval = pcanAi->data & pcanAi->mask;
-		if (pcanAi->sign & prec->rval) {
-		    prec->rval |= ~pcanAi->mask;
+
+		data = canDecoderValue(pcanAi->decoder, pcanAi->field);
+		#ifdef DEBUG
+		    printf("canAi %s: message id=%#x, data=%#lx\n", 
+			    prec->name, pcanAi->inp->identifier, data);
+		#endif
+
+		prec->rval = data & pcanAi->inp->mask;
+		if (pcanAi->inp->sign & prec->rval) {
+		    prec->rval |= ~pcanAi->inp->mask;
 		}
 		return CONVERT;
 	    } else {
-		canMessage_t message;
-
-		message.identifier = pcanAi->inp.identifier;
-		message.rtr = RTR;
-		message.length = 8;
-
 		#ifdef DEBUG
 		    printf("canAi %s: RTR, id=%#x\n", 
-			    prec->name, pcanAi->inp.identifier);
+			    prec->name, pcanAi->inp->identifier);
 		#endif
 
 		prec->pact = TRUE;
 		pcanAi->status = TIMEOUT_ALARM;
-
-		epicsTimerStartDelay(pcanAi->timId, pcanAi->inp.timeout);
-		canWrite(pcanAi->inp.canBusID, &message, pcanAi->inp.timeout);
+		if (canReadAsync(pcanAi->inp->canBusID, pcanAi->inp->identifier,
+				 aiDone, pcanAi, pcanAi->inp->timeout)) {
+		    pcanAi->status = COMM_ALARM;
+		    callbackRequest(&pcanAi->callback);
+		}
 		return CONVERT;
 	    }
 	default:
@@ -346,13 +349,9 @@ static long special_linconv (
 ) {
     if (after) {
 	aiCanPrivate_t *pcanAi = prec->dpvt;
-	epicsUInt32 fsd = abs(pcanAi->inp.parameter);
-	if (fsd > 0) {
-	    if ((fsd & (fsd-1)) == 0) {
-		fsd--;
-	    }
-	    prec->roff = pcanAi->sign;
-	    prec->eslo = (prec->eguf - prec->egul) / fsd;
+	if (pcanAi->inp && pcanAi->inp->fsd > 0) {
+	    prec->roff = pcanAi->inp->sign;
+	    prec->eslo = (prec->eguf - prec->egul) / pcanAi->inp->fsd;
 	}
     }
     return 0;
@@ -368,53 +367,17 @@ static void ProcessCallback(CALLBACK *pcallback)
     dbScanUnlock(pRec);
 }
 
-static void aiMessage (
+static void aiDone (
     void *private,
+    int status,
     const canMessage_t *pmessage
 ) {
     aiCanPrivate_t *pcanAi = private;
 
-    if (!interruptAccept ||
-	pmessage->rtr == RTR) {
-	return;
-    }
-
-    if (pcanAi->mask == 0) {
-	/* FIXME: These have FP format problems... */
-	float ival;
-	switch (pcanAi->sign) {
-	case 4: 	/* float */
-	    memcpy(&ival, &pmessage->data[pcanAi->inp.offset], sizeof(float));
-	    pcanAi->dval = ival;
-	    break;
-	case 8: 	/* double */
-	    memcpy(&pcanAi->dval, &pmessage->data[0], sizeof(double));
-	    break;
-	default:
-	    pcanAi->data = 0;
+    if (pcanAi->status == TIMEOUT_ALARM) {
+	if (status == 0) {
+	    pcanAi->status = NO_ALARM;
 	}
-    } else if (pcanAi->mask <= 0xff) {
-	pcanAi->data = pmessage->data[pcanAi->inp.offset+0];
-    } else if (pcanAi->mask <= 0xffff) {
-	pcanAi->data = pmessage->data[pcanAi->inp.offset+0] <<  8 |
-		       pmessage->data[pcanAi->inp.offset+1];
-    } else if (pcanAi->mask <= 0xffffff) {
-	pcanAi->data = pmessage->data[pcanAi->inp.offset+0] << 16 |
-		       pmessage->data[pcanAi->inp.offset+1] <<  8 |
-		       pmessage->data[pcanAi->inp.offset+2];
-    } else {
-	pcanAi->data = pmessage->data[pcanAi->inp.offset+0] << 24 |
-		       pmessage->data[pcanAi->inp.offset+1] << 16 |
-		       pmessage->data[pcanAi->inp.offset+2] <<  8 |
-		       pmessage->data[pcanAi->inp.offset+3];
-    }
-
-    if (pcanAi->prec->scan == SCAN_IO_EVENT) {
-	pcanAi->status = NO_ALARM;
-	scanIoRequest(pcanAi->ioscanpvt);
-    } else if (pcanAi->status == TIMEOUT_ALARM) {
-	pcanAi->status = NO_ALARM;
-	epicsTimerCancel(pcanAi->timId);
 	callbackRequest(&pcanAi->callback);
     }
 }
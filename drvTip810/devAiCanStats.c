@@ -0,0 +1,330 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    devAiCanStats.c
+
+Description:
+    CANbus traffic statistics Analogue Input device support.  Each record
+    reads one value from the statistics that the bus driver returns from
+    canBusStats().  Rates and other interval values are calculated over
+    the time since the record was last processed, so they follow the
+    record's SCAN period.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <epicsTypes.h>
+#include <epicsTime.h>
+#include <dbDefs.h>
+#include <dbAccess.h>
+#include <recSup.h>
+#include <recGbl.h>
+#include <alarm.h>
+#include <devSup.h>
+#include <devLib.h>
+#include <aiRecord.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+#include "canStats.h"
+
+
+#define DO_NOT_CONVERT 2
+
+#define STAT(member) offsetof(canStats_t, member)
+
+typedef enum {
+    STAT_VALUE,		/* Counter or gauge, as it is */
+    STAT_RATE,		/* Counter change per second */
+    STAT_LOAD,		/* Bus load %, from txBits + rxBits */
+    STAT_ISR_TIME,	/* Mean ISR time over the interval, usec */
+    STAT_PERCENTILE,	/* Receive latency over the interval, usec */
+    STAT_ID_COUNT,	/* Messages received with one ID */
+    STAT_ID_RATE	/*   and their rate */
+} statKind_t;
+
+typedef struct {
+    const char *name;
+    statKind_t kind;
+    size_t offset;	/* STAT_VALUE, STAT_RATE: counter in canStats_t */
+    double fraction;	/* STAT_PERCENTILE: which one */
+} statItem_t;
+
+static const statItem_t statItems[] = {
+    { "TX_FRAMES",	STAT_VALUE,	STAT(txFrames),		0.0 },
+    { "RX_FRAMES",	STAT_VALUE,	STAT(rxFrames),		0.0 },
+    { "TX_RATE",	STAT_RATE,	STAT(txFrames),		0.0 },
+    { "RX_RATE",	STAT_RATE,	STAT(rxFrames),		0.0 },
+    { "TX_BYTE_RATE",	STAT_RATE,	STAT(txBytes),		0.0 },
+    { "RX_BYTE_RATE",	STAT_RATE,	STAT(rxBytes),		0.0 },
+    { "BUS_LOAD",	STAT_LOAD,	0,			0.0 },
+    { "UNUSED",		STAT_VALUE,	STAT(unused),		0.0 },
+    { "LOST",		STAT_VALUE,	STAT(lost),		0.0 },
+    { "LOST_RATE",	STAT_RATE,	STAT(lost),		0.0 },
+    { "OVERRUNS",	STAT_VALUE,	STAT(overruns),		0.0 },
+    { "ABORTS",		STAT_VALUE,	STAT(aborts),		0.0 },
+    { "ERRORS",		STAT_VALUE,	STAT(errors),		0.0 },
+    { "BUS_OFFS",	STAT_VALUE,	STAT(busOffs),		0.0 },
+    { "RX_QUEUE",	STAT_VALUE,	STAT(recvQueued),	0.0 },
+    { "RX_QUEUE_MAX",	STAT_VALUE,	STAT(recvMaxQueued),	0.0 },
+    { "TX_QUEUE",	STAT_VALUE,	STAT(txQueued),		0.0 },
+    { "TX_QUEUE_MAX",	STAT_VALUE,	STAT(txMaxQueued),	0.0 },
+    { "ISR_RATE",	STAT_RATE,	STAT(isrCount),		0.0 },
+    { "ISR_TIME",	STAT_ISR_TIME,	0,			0.0 },
+    { "ISR_MAX",	STAT_VALUE,	STAT(isrMax),		0.0 },
+    { "LATENCY_P50",	STAT_PERCENTILE, 0,			0.50 },
+    { "LATENCY_P90",	STAT_PERCENTILE, 0,			0.90 },
+    { "LATENCY_P99",	STAT_PERCENTILE, 0,			0.99 },
+    { "LATENCY_MAX",	STAT_VALUE,	STAT(latencyMax),	0.0 },
+    { "ID_COUNT",	STAT_ID_COUNT,	0,			0.0 },
+    { "ID_RATE",	STAT_ID_RATE,	0,			0.0 },
+    { NULL,		STAT_VALUE,	0,			0.0 }
+};
+
+typedef struct {
+    const canStats_t *pstats;
+    const statItem_t *pitem;
+    canID_t identifier;		/* STAT_ID_*: message ID */
+    int primed;			/* last[] etc. hold a reading */
+    epicsUInt32 resets;		/* pstats->resets at that reading */
+    epicsTimeStamp then;	/* when it was taken */
+    epicsUInt32 last[2];	/* counters then */
+    epicsUInt32 latency[CAN_STATS_LATENCY_BINS];  /* STAT_PERCENTILE */
+} aiStats_t;
+
+
+/* Create the dset for devAiCanStats */
+static long init_ai(struct aiRecord *prec);
+static long read_ai(struct aiRecord *prec);
+
+struct {
+	long		number;
+	DEVSUPFUN	report;
+	DEVSUPFUN	init;
+	DEVSUPFUN	init_record;
+	DEVSUPFUN	get_ioint_info;
+	DEVSUPFUN	read_ai;
+	DEVSUPFUN	special_linconv;
+} devAiCanStats = {
+	6,
+	NULL,
+	NULL,
+	init_ai,
+	NULL,
+	read_ai,
+	NULL
+};
+epicsExportAddress(dset, devAiCanStats);
+
+
+/* Address is "busName:ITEM" or "busName:ID_COUNT:id" */
+
+static long init_ai (
+    struct aiRecord *prec
+) {
+    aiStats_t *pvt;
+    char *canString;
+    char *name;
+    char separator;
+    canBusID_t busID;
+    const canStats_t *pstats;
+    const statItem_t *pitem;
+    size_t length;
+    unsigned long id;
+    long status;
+
+    /* ai.inp must be an INST_IO */
+    if (prec->inp.type != INST_IO) goto error;
+
+    canString = ((struct instio *)&(prec->inp.value))->string;
+
+    /* Strip leading whitespace & non-alphanumeric chars */
+    while (!isalnum(0xff & *canString)) {
+	if (*canString++ == '\0') goto error;
+    }
+
+    /* First part of string is the bus name */
+    name = canString;
+
+    /* find the end of the busName */
+    canString = strpbrk(canString, "/:");
+    if (canString == NULL || *canString == '\0') goto error;
+
+    /* Temporarily truncate string after name and look up the bus */
+    separator = *canString;
+    *canString = '\0';
+    status = canOpen(name, &busID);
+    *canString++ = separator;
+    if (status) goto error;
+
+    pstats = canBusStats(busID);
+    if (pstats == NULL) goto error;
+
+    /* After the bus name comes the name of the statistic */
+    length = strcspn(canString, ":");
+    for (pitem = statItems; pitem->name != NULL; pitem++) {
+	if (strlen(pitem->name) == length &&
+	    strncmp(canString, pitem->name, length) == 0) break;
+    }
+    if (pitem->name == NULL) goto error;
+    canString += length;
+
+    /* The ID items end with :<canID>, as in a CANbus address */
+    id = 0;
+    if (pitem->kind == STAT_ID_COUNT ||
+	pitem->kind == STAT_ID_RATE) {
+	if (*canString++ != ':') goto error;
+	id = strtoul(canString, &canString, 0);
+	if (*canString == 'x' ||
+	    id >= CAN_IDENTIFIERS) {
+	    if (id >= CAN_EXT_IDENTIFIERS) goto error;
+	    id |= CAN_ID_EXTENDED;
+	    if (*canString == 'x') canString++;
+	}
+    }
+    if (*canString != '\0' &&
+	!isspace(0xff & *canString)) goto error;
+
+    pvt = calloc(1, sizeof(aiStats_t));
+    if (pvt == NULL) {
+	return S_dev_noMemory;
+    }
+    pvt->pstats = pstats;
+    pvt->pitem = pitem;
+    pvt->identifier = id;
+    prec->dpvt = pvt;
+    return 0;
+
+error:
+    if (canSilenceErrors) {
+	prec->pact = TRUE;
+	return 0;
+    } else {
+	recGblRecordError(S_db_badField,(void *)prec,
+			  "devAiCanStats: Bad INP field type or value");
+	return S_db_badField;
+    }
+}
+
+static epicsUInt32 counter (
+    const canStats_t *pstats,
+    size_t offset
+) {
+    return *(volatile const epicsUInt32 *) ((const char *) pstats + offset);
+}
+
+static long read_ai(struct aiRecord *prec)
+{
+    aiStats_t *pvt = prec->dpvt;
+    const canStats_t *pstats;
+    const statItem_t *pitem;
+    epicsUInt32 now[2] = {0, 0};
+    epicsUInt32 latency[CAN_STATS_LATENCY_BINS];
+    epicsTimeStamp when;
+    double interval;
+    int fresh, bin;
+
+    if (pvt == NULL) {
+	prec->pact = TRUE;
+	return S_dev_noDevice;
+    }
+    pstats = pvt->pstats;
+    pitem = pvt->pitem;
+
+    /* Take the values this item needs */
+    fresh = !pvt->primed || pvt->resets != pstats->resets;
+    pvt->resets = pstats->resets;
+    epicsTimeGetCurrent(&when);
+    switch (pitem->kind) {
+	case STAT_VALUE:
+	case STAT_RATE:
+	    now[0] = counter(pstats, pitem->offset);
+	    break;
+	case STAT_LOAD:
+	    now[0] = pstats->txBits;
+	    now[1] = pstats->rxBits;
+	    break;
+	case STAT_ISR_TIME:
+	    now[0] = pstats->isrTime;
+	    now[1] = pstats->isrCount;
+	    break;
+	case STAT_PERCENTILE:
+	    for (bin = 0; bin < CAN_STATS_LATENCY_BINS; bin++) {
+		latency[bin] = pstats->latency[bin];
+	    }
+	    break;
+	case STAT_ID_COUNT:
+	case STAT_ID_RATE:
+	    now[0] = canStatsIdCount(pstats, pvt->identifier);
+	    break;
+    }
+    interval = epicsTimeDiffInSeconds(&when, &pvt->then);
+
+    /* Work out the value; interval items read zero the first time.
+     * The counters wrap, so differences are taken modulo 2^32. */
+    prec->val = 0.0;
+    switch (pitem->kind) {
+	case STAT_VALUE:
+	case STAT_ID_COUNT:
+	    prec->val = now[0];
+	    break;
+	case STAT_RATE:
+	case STAT_ID_RATE:
+	    if (!fresh && interval > 0.0) {
+		prec->val = (epicsUInt32) (now[0] - pvt->last[0]) / interval;
+	    }
+	    break;
+	case STAT_LOAD:
+	    if (!fresh && interval > 0.0 && pstats->busRate > 0) {
+		prec->val = 100.0 * ((epicsUInt32) (now[0] - pvt->last[0]) +
+				     (epicsUInt32) (now[1] - pvt->last[1])) /
+			    (interval * 1000.0 * pstats->busRate);
+	    }
+	    break;
+	case STAT_ISR_TIME:
+	    if (!fresh && now[1] != pvt->last[1]) {
+		prec->val = (double) (epicsUInt32) (now[0] - pvt->last[0]) /
+			    (epicsUInt32) (now[1] - pvt->last[1]);
+	    }
+	    break;
+	case STAT_PERCENTILE:
+	    if (!fresh) {
+		epicsUInt32 delta[CAN_STATS_LATENCY_BINS];
+
+		for (bin = 0; bin < CAN_STATS_LATENCY_BINS; bin++) {
+		    delta[bin] = latency[bin] - pvt->latency[bin];
+		}
+		prec->val = canStatsPercentile(delta, pitem->fraction);
+	    }
+	    memcpy(pvt->latency, latency, sizeof(latency));
+	    break;
+    }
+
+    pvt->last[0] = now[0];
+    pvt->last[1] = now[1];
+    pvt->then = when;
+    pvt->primed = TRUE;
+    prec->udf = FALSE;
+    return DO_NOT_CONVERT;
+}
@@ -58,6 +58,8 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <epicsExport.h>
 
 #include "canBus.h"
+#include "canDecode.h"
+#include "canCombine.h"
 
 
 #define DO_NOT_CONVERT	2
@@ -67,9 +69,9 @@ typedef struct aoCanPrivate_s {
     struct aoCanPrivate_s *nextPrivate;
     IOSCANPVT ioscanpvt;
     dbCommon *prec;
-    canIo_t out;
-    epicsUInt32 mask;
-    epicsUInt32 sign;
+    const canIo_t *out;
+    canCombinerID_t combiner;
+    canField_t field;
     epicsUInt32 data;
     int status;
 } aoCanPrivate_t;
@@ -118,7 +120,6 @@ static long init_ao (
     aoCanPrivate_t *pcanAo;
     aoCanBus_t *pbus;
     int status;
-    epicsUInt32 fsd;
 
     if (prec->out.type != INST_IO) {
 	recGblRecordError(S_db_badField, prec,
@@ -135,11 +136,11 @@ static long init_ao (
     pcanAo->ioscanpvt = NULL;
     pcanAo->status = NO_ALARM;
 
-    /* Convert the parameter string into members of the canIo structure */
-    status = canIoParse(prec->out.value.instio.string, &pcanAo->out);
+    /* Get the shared canIo structure for this address string */
+    status = canIoCompile(prec->out.value.instio.string, &pcanAo->out);
     if (status) {
 	if (canSilenceErrors) {
-	    pcanAo->out.canBusID = NULL;
+	    pcanAo->out = NULL;
 	    prec->pact = TRUE;
 	    return DO_NOT_CONVERT;
 	} else {
@@ -151,8 +152,8 @@ static long init_ao (
 
     #ifdef DEBUG
 	printf("canAo %s: Init bus=%s, id=%#x, off=%d, parm=%ld\n",
-		    prec->name, pcanAo->out.busName, pcanAo->out.identifier,
-		    pcanAo->out.offset, pcanAo->out.parameter);
+		    prec->name, pcanAo->out->busName, pcanAo->out->identifier,
+		    pcanAo->out->offset, pcanAo->out->parameter);
     #endif
 
     /* For ao records, the final parameter specifies the raw output size. 
@@ -160,50 +161,59 @@ static long init_ao (
        specify a signed value, eg -256 means an 8-bit signed value.
        The range does not have to be a power of two, eg 99 is legal. */
 
-    fsd = abs(pcanAo->out.parameter);
-    if (fsd > 0) {
-	if ((fsd & (fsd-1)) == 0) {
-	    fsd--;
-	}
-
-	/* Make a mask to contain only the valid out bits based on fsd */
-	pcanAo->mask = 1;
-	while (pcanAo->mask < fsd) {
-	    pcanAo->mask <<= 1;
-	}
-	pcanAo->mask--;
-
-	if (pcanAo->out.parameter < 0) {
-	    /* signed data */
-	    pcanAo->sign = (pcanAo->mask >> 1) + 1;
-	} else {
-	    pcanAo->sign = 0;
-	}
+    /* canIoCompile has already worked out the full scale and sign */
+    if (pcanAo->out->fsd > 0) {
 	if (prec->linr == menuConvertLINEAR) {
-	    prec->roff = pcanAo->sign;
-	    prec->eslo = (prec->eguf - prec->egul) / fsd;
+	    prec->roff = pcanAo->out->sign;
+	    prec->eslo = (prec->eguf - prec->egul) / pcanAo->out->fsd;
 	} else {
 	    prec->roff = 0;
 	}
-    } else {
-	pcanAo->mask = pcanAo->sign = 0;
-	if (pcanAo->out.paramStr) {
-	    if (strcmp(pcanAo->out.paramStr, "float") == 0) {
-		pcanAo->sign = 4;
-	    } else if (strcmp(pcanAo->out.paramStr, "double") == 0) {
-		pcanAo->sign = 8;
-	    }
-	}
     }
 
     #ifdef DEBUG
-	printf("  fsd=%ld, eslo=%g, roff=%ld, mask=%#lx, sign=%ld\n", 
-		fsd, prec->eslo, prec->roff, pcanAo->mask, pcanAo->sign);
+	printf("  fsd=%lu, eslo=%g, roff=%ld, mask=%#lx, sign=%ld\n", 
+		pcanAo->out->fsd, prec->eslo, prec->roff, pcanAo->out->mask,
+		pcanAo->out->sign);
     #endif
 
+    /* Work out which message bytes hold the raw value */
+    pcanAo->field.type = CAN_FIELD_UINT;
+    pcanAo->field.offset = pcanAo->out->offset;
+    pcanAo->field.shift = 0;
+    pcanAo->field.mask = pcanAo->out->mask;
+    if (pcanAo->out->mask == 0) {
+	if (pcanAo->out->sign) {
+	    /* FIXME: These have endian problems... */
+	    pcanAo->field.type = CAN_FIELD_FLOAT;
+	    pcanAo->field.length = pcanAo->out->sign;
+	} else {
+	    /* No data bytes, as before */
+	    pcanAo->field.length = 0;
+	}
+    } else if (pcanAo->out->mask <= 0xff) {
+	pcanAo->field.length = 1;
+    } else if (pcanAo->out->mask <= 0xffff) {
+	pcanAo->field.length = 2;
+    } else if (pcanAo->out->mask <= 0xffffff) {
+	pcanAo->field.length = 3;
+    } else {
+	pcanAo->field.length = 4;
+    }
+
+    /* Claim those bytes through the shared output combiner */
+    status = canCombinerField(pcanAo->out, &pcanAo->field,
+			      &pcanAo->combiner);
+    if (status) {
+	pcanAo->out = NULL;
+	recGblRecordError(status, prec,
+			  "devAoCan (init_record) canCombinerField failed");
+	return status;
+    }
+
     /* Find the bus matching this record */
     for (pbus = firstBus; pbus != NULL; pbus = pbus->nextBus) {
-    	if (pbus->canBusID == pcanAo->out.canBusID) break;
+    	if (pbus->canBusID == pcanAo->out->canBusID) break;
     }
 
     /* If not found, create one */
@@ -213,7 +223,7 @@ static long init_ao (
 
 	/* Fill it in */
 	pbus->firstPrivate = NULL;
-	pbus->canBusID = pcanAo->out.canBusID;
+	pbus->canBusID = pcanAo->out->canBusID;
 	callbackSetUser(pbus, &pbus->callback);
 	callbackSetCallback(busCallback, &pbus->callback);
 	callbackSetPriority(priorityMedium, &pbus->callback);
@@ -231,7 +241,7 @@ static long init_ao (
     pbus->firstPrivate = pcanAo;
 
     /* Register the message handler with the Canbus driver */
-    canMessage(pcanAo->out.canBusID, pcanAo->out.identifier, aoMessage, pcanAo);
+    canMessage(pcanAo->out->canBusID, pcanAo->out->identifier, aoMessage, pcanAo);
 
     return DO_NOT_CONVERT;
 }
@@ -260,7 +270,7 @@ static long write_ao (
 ) {
     aoCanPrivate_t *pcanAo = prec->dpvt;
 
-    if (pcanAo->out.canBusID == NULL) {
+    if (pcanAo->out == NULL) {
 	return -1;
     }
 
@@ -276,67 +286,43 @@ static long write_ao (
 
 	case NO_ALARM:
 	    {
-		canMessage_t message;
 		int status;
 
-		message.identifier = pcanAo->out.identifier;
-		message.rtr = SEND;
-
-		pcanAo->data = prec->rval & pcanAo->mask;
+		if (pcanAo->field.type == CAN_FIELD_FLOAT) {
+		    double oval = prec->oval;
 
-		if (pcanAo->mask == 0) {
-		    /* FIXME: These have endian problems... */
-		    float oval;
-		    message.length = pcanAo->sign;
-		    switch (message.length) {
-		    case 4:	/* float */
-			if (fabs(prec->oval) < FLT_MIN) {
+		    if (pcanAo->field.length == sizeof(float)) {
+			if (fabs(oval) < FLT_MIN) {
 			    oval = 0.0;
-			} else if (fabs (prec->oval) > FLT_MAX) {
+			} else if (fabs(oval) > FLT_MAX) {
 			    recGblSetSevr(prec, WRITE_ALARM, INVALID_ALARM);
 			    return -1;
-			} else {
-			    oval = prec->oval;
 			}
-			memcpy(&message.data[0], &oval, sizeof(float));
-			break;
-		    case 8:	/* double */
-		        memcpy(&message.data[0], &prec->oval, sizeof(double));
-			break;
-		    default:
-		        break;
 		    }
-		} else if (pcanAo->mask <= 0xff) {
-		    message.data[0] = (pcanAo->data      ) & 0xff;
-		    message.length  = 1;
-		} else if (pcanAo->mask <= 0xffff) {
-		    message.data[0] = (pcanAo->data >>  8) & 0xff;
-		    message.data[1] = (pcanAo->data      ) & 0xff;
-		    message.length  = 2;
-		} else if (pcanAo->mask <= 0xffffff) {
-		    message.data[0] = (pcanAo->data >> 16) & 0xff;
-		    message.data[1] = (pcanAo->data >>  8) & 0xff;
-		    message.data[2] = (pcanAo->data      ) & 0xff;
-		    message.length  = 3;
+
+		    #ifdef DEBUG
+			printf("canAo %s: SEND id=%#x, offset=%d, oval=%g\n", 
+				prec->name, pcanAo->out->identifier,
+				pcanAo->field.offset, oval);
+		    #endif
+
+		    status = canCombinerDouble(pcanAo->combiner, &pcanAo->field,
+					       oval, pcanAo->out->timeout);
 		} else {
-		    message.data[0] = (pcanAo->data >> 24) & 0xff;
-		    message.data[1] = (pcanAo->data >> 16) & 0xff;
-		    message.data[2] = (pcanAo->data >>  8) & 0xff;
-		    message.data[3] = (pcanAo->data      ) & 0xff;
-		    message.length  = 4;
-		}
+		    pcanAo->data = prec->rval & pcanAo->out->mask;
 
-		#ifdef DEBUG
-		    printf("canAo %s: SEND id=%#x, length=%d, data=%#lx\n", 
-			    prec->name, message.identifier, message.length, 
-			    pcanAo->data);
-		#endif
+		    #ifdef DEBUG
+			printf("canAo %s: SEND id=%#x, offset=%d, data=%#lx\n", 
+				prec->name, pcanAo->out->identifier,
+				pcanAo->field.offset, pcanAo->data);
+		    #endif
 
-		status = canWrite(pcanAo->out.canBusID, &message, 
-				  pcanAo->out.timeout);
+		    status = canCombinerValue(pcanAo->combiner, &pcanAo->field,
+					      pcanAo->data, pcanAo->out->timeout);
+		}
 		if (status) {
 		    #ifdef DEBUG
-			printf("canAo %s: canWrite status=%#x\n", 
+			printf("canAo %s: canCombinerValue status=%#x\n", 
 				prec->name, status);
 		    #endif
 
@@ -358,13 +344,9 @@ static long special_linconv (
 ) {
     if (after) {
 	aoCanPrivate_t *pcanAo = prec->dpvt;
-	epicsUInt32 fsd = abs(pcanAo->out.parameter);
-	if (fsd > 0) {
-	    if ((fsd & (fsd-1)) == 0) {
-		fsd--;
-	    }
-	    prec->roff = pcanAo->sign;
-	    prec->eslo = (prec->eguf - prec->egul) / fsd;
+	if (pcanAo->out && pcanAo->out->fsd > 0) {
+	    prec->roff = pcanAo->out->sign;
+	    prec->eslo = (prec->eguf - prec->egul) / pcanAo->out->fsd;
 	}
     }
     return 0;
@@ -37,7 +37,6 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <stdlib.h>
 
 #include <epicsTypes.h>
-#include <epicsTimer.h>
 #include <errMdef.h>
 #include <devLib.h>
 #include <dbAccess.h>
@@ -54,6 +53,7 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <epicsExport.h>
 
 #include "canBus.h"
+#include "canDecode.h"
 
 
 #define CONVERT 0
@@ -63,11 +63,10 @@ Copyright (c) 1995-2000 Andrew Johnson
 typedef struct biCanPrivate_s {
     CALLBACK callback;
     struct biCanPrivate_s *nextPrivate;
-    epicsTimerId timId;
-    IOSCANPVT ioscanpvt;
     struct dbCommon *prec;
-    canIo_t inp;
-    epicsUInt32 data;
+    const canIo_t *inp;
+    canDecoderID_t decoder;
+    int field;
     int status;
 } biCanPrivate_t;
 
@@ -83,7 +82,8 @@ static long init_bi(struct biRecord *prec);
 static long get_ioint_info(int cmd, struct biRecord *prec, IOSCANPVT *ppvt);
 static long read_bi(struct biRecord *prec);
 static void ProcessCallback(CALLBACK *pcallback);
-static void biMessage(void *private, const canMessage_t *pmessage);
+static void biDone(void *private, int status,
+		    const canMessage_t *pmessage);
 static void busSignal(void *private, int status);
 static void busCallback(CALLBACK *pcallback);
 
@@ -112,6 +112,7 @@ static long init_bi (
 ) {
     biCanPrivate_t *pcanBi;
     biCanBus_t *pbus;
+    canField_t spec = {CAN_FIELD_UINT, 0, 1, 0, 0};
     int status;
 
     if (prec->inp.type != INST_IO) {
@@ -126,16 +127,15 @@ static long init_bi (
     }
     prec->dpvt = pcanBi;
     pcanBi->prec = (dbCommon *) prec;
-    pcanBi->ioscanpvt = NULL;
     pcanBi->status = NO_ALARM;
 
-    /* Convert the address string into members of the canIo structure */
-    status = canIoParse(prec->inp.value.instio.string, &pcanBi->inp);
+    /* Get the shared canIo structure for this address string */
+    status = canIoCompile(prec->inp.value.instio.string, &pcanBi->inp);
     if (status ||
-	pcanBi->inp.parameter < 0 ||
-	pcanBi->inp.parameter > 7) {
+	pcanBi->inp->parameter < 0 ||
+	pcanBi->inp->parameter > 7) {
 	if (canSilenceErrors) {
-	    pcanBi->inp.canBusID = NULL;
+	    pcanBi->inp = NULL;
 	    prec->pact = TRUE;
 	    return 0;
 	} else {
@@ -147,22 +147,33 @@ static long init_bi (
 
     #ifdef DEBUG
 	printf("biCan %s: Init bus=%s, id=%#x, off=%d, parm=%ld\n",
-		    prec->name, pcanBi->inp.busName, pcanBi->inp.identifier,
-		    pcanBi->inp.offset, pcanBi->inp.parameter);
+		    prec->name, pcanBi->inp->busName, pcanBi->inp->identifier,
+		    pcanBi->inp->offset, pcanBi->inp->parameter);
     #endif
 
     /* For bi records, the final parameter specifies the input bit number,
        with offset specifying the message byte number. */
-    prec->mask = 1 << pcanBi->inp.parameter;
+    prec->mask = 1 << pcanBi->inp->parameter;
 
     #ifdef DEBUG
 	printf("  bit=%ld, mask=%#lx\n", 
-		pcanBi->inp.parameter, prec->mask);
+		pcanBi->inp->parameter, prec->mask);
     #endif
 
+    /* Subscribe to the message byte through the shared frame decoder */
+    spec.offset = pcanBi->inp->offset;
+    status = canDecoderField(pcanBi->inp, &spec,
+			     &pcanBi->decoder, &pcanBi->field);
+    if (status) {
+	pcanBi->inp = NULL;
+	recGblRecordError(status, prec,
+			  "devBiCan (init_record) canDecoderField failed");
+	return status;
+    }
+
     /* Find the bus matching this record */
     for (pbus = firstBus; pbus != NULL; pbus = pbus->nextBus) {
-    	if (pbus->canBusID == pcanBi->inp.canBusID) break;
+    	if (pbus->canBusID == pcanBi->inp->canBusID) break;
     }
 
     /* If not found, create one */
@@ -172,7 +183,7 @@ static long init_bi (
 
 	/* Fill it in */
 	pbus->firstPrivate = NULL;
-	pbus->canBusID = pcanBi->inp.canBusID;
+	pbus->canBusID = pcanBi->inp->canBusID;
 	callbackSetUser(pbus, &pbus->callback);
 	callbackSetCallback(busCallback, &pbus->callback);
 	callbackSetPriority(priorityMedium, &pbus->callback);
@@ -194,16 +205,6 @@ static long init_bi (
     callbackSetCallback(ProcessCallback, &pcanBi->callback);
     callbackSetPriority(prec->prio, &pcanBi->callback);
 
-    /* and create a timer for CANbus RTR timeouts */
-    pcanBi->timId = epicsTimerQueueCreateTimer(canTimerQ,
-		(epicsTimerCallback)callbackRequest, pcanBi);
-    if (pcanBi->timId == NULL) {
-	return S_dev_noMemory;
-    }
-
-    /* Register the message handler with the Canbus driver */
-    canMessage(pcanBi->inp.canBusID, pcanBi->inp.identifier, biMessage, pcanBi);
-
     return 0;
 }
 
@@ -213,16 +214,22 @@ static long get_ioint_info (
     IOSCANPVT *ppvt
 ) {
     biCanPrivate_t *pcanBi = prec->dpvt;
+    static IOSCANPVT noScan = NULL;
 
-    if (pcanBi->ioscanpvt == NULL) {
-	scanIoInit(&pcanBi->ioscanpvt);
+    if (pcanBi->inp == NULL) {
+	/* Bad address, use a scan list that nothing ever requests */
+	if (noScan == NULL) {
+	    scanIoInit(&noScan);
+	}
+	*ppvt = noScan;
+	return 0;
     }
 
     #ifdef DEBUG
 	printf("canBi %s: get_ioint_info %d\n", prec->name, cmd);
     #endif
 
-    *ppvt = pcanBi->ioscanpvt;
+    *ppvt = canDecoderIoScan(pcanBi->decoder);
     return 0;
 }
 
@@ -231,7 +238,7 @@ static long read_bi (
 ) {
     biCanPrivate_t *pcanBi = prec->dpvt;
 
-    if (pcanBi->inp.canBusID == NULL) {
+    if (pcanBi->inp == NULL) {
 	return DO_NOT_CONVERT;
     }
 
@@ -248,30 +255,34 @@ static long read_bi (
 
 	case NO_ALARM:
 	    if (prec->pact || prec->scan == SCAN_IO_EVENT) {
+		epicsUInt32 data = canDecoderValue(pcanBi->decoder,
+						    pcanBi->field);
+
 		#ifdef DEBUG
 		    printf("canBi %s: message id=%#x, data=%#lx\n", 
-			    prec->name, pcanBi->inp.identifier, pcanBi->data);
+			    prec->name, pcanBi->inp->identifier, data);
 		#endif
 
-		prec->rval = pcanBi->data & prec->mask;
+		prec->rval = data & prec->mask;
+		#ifdef epicsTimeEventDeviceTime
+		if (prec->tse == epicsTimeEventDeviceTime) {
+		    canDecoderTime(pcanBi->decoder, &prec->time);
+		}
+		#endif
 		return CONVERT;
 	    } else {
-		canMessage_t message;
-
-		message.identifier = pcanBi->inp.identifier;
-		message.rtr = RTR;
-		message.length = 8;
-
 		#ifdef DEBUG
 		    printf("canBi %s: RTR, id=%#x\n", 
-			    prec->name, pcanBi->inp.identifier);
+			    prec->name, pcanBi->inp->identifier);
 		#endif
 
 		prec->pact = TRUE;
 		pcanBi->status = TIMEOUT_ALARM;
-
-		epicsTimerStartDelay(pcanBi->timId, pcanBi->inp.timeout);
-		canWrite(pcanBi->inp.canBusID, &message, pcanBi->inp.timeout);
+		if (canReadAsync(pcanBi->inp->canBusID, pcanBi->inp->identifier,
+				 biDone, pcanBi, pcanBi->inp->timeout)) {
+		    pcanBi->status = COMM_ALARM;
+		    callbackRequest(&pcanBi->callback);
+		}
 		return DO_NOT_CONVERT;
 	    }
 	default:
@@ -291,25 +302,17 @@ static void ProcessCallback(CALLBACK *pcallback)
     dbScanUnlock(pRec);
 }
 
-static void biMessage (
+static void biDone (
     void *private,
+    int status,
     const canMessage_t *pmessage
 ) {
     biCanPrivate_t *pcanBi = private;
 
-    if (!interruptAccept ||
-	pmessage->rtr == RTR) {
-	return;
-    }
-
-    pcanBi->data = pmessage->data[pcanBi->inp.offset];
-
-    if (pcanBi->prec->scan == SCAN_IO_EVENT) {
-	pcanBi->status = NO_ALARM;
-	scanIoRequest(pcanBi->ioscanpvt);
-    } else if (pcanBi->status == TIMEOUT_ALARM) {
-	pcanBi->status = NO_ALARM;
-	epicsTimerCancel(pcanBi->timId);
+    if (pcanBi->status == TIMEOUT_ALARM) {
+	if (status == 0) {
+	    pcanBi->status = NO_ALARM;
+	}
 	callbackRequest(&pcanBi->callback);
     }
 }
@@ -54,6 +54,8 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <epicsExport.h>
 
 #include "canBus.h"
+#include "canDecode.h"
+#include "canCombine.h"
 
 
 #define DO_NOT_CONVERT	2
@@ -63,7 +65,9 @@ typedef struct boCanPrivate_s {
     struct boCanPrivate_s *nextPrivate;
     IOSCANPVT ioscanpvt;
     dbCommon *prec;
-    canIo_t out;
+    const canIo_t *out;
+    canCombinerID_t combiner;
+    canField_t field;
     epicsUInt32 data;
     int status;
 } boCanPrivate_t;
@@ -125,13 +129,13 @@ static long init_bo (
     pcanBo->ioscanpvt = NULL;
     pcanBo->status = NO_ALARM;
 
-    /* Convert the parameter string into members of the canIo structure */
-    status = canIoParse(prec->out.value.instio.string, &pcanBo->out);
+    /* Get the shared canIo structure for this address string */
+    status = canIoCompile(prec->out.value.instio.string, &pcanBo->out);
     if (status ||
-	pcanBo->out.parameter < 0 ||
-	pcanBo->out.parameter > 7) {
+	pcanBo->out->parameter < 0 ||
+	pcanBo->out->parameter > 7) {
 	if (canSilenceErrors) {
-	    pcanBo->out.canBusID = NULL;
+	    pcanBo->out = NULL;
 	    prec->pact = TRUE;
 	    return DO_NOT_CONVERT;
 	} else {
@@ -143,21 +147,36 @@ static long init_bo (
 
     #ifdef DEBUG
 	printf("canBo %s: Init bus=%s, id=%#x, off=%d, parm=%ld\n",
-		    prec->name, pcanBo->out.busName, pcanBo->out.identifier,
-		    pcanBo->out.offset, pcanBo->out.parameter);
+		    prec->name, pcanBo->out->busName, pcanBo->out->identifier,
+		    pcanBo->out->offset, pcanBo->out->parameter);
     #endif
 
     /* For bo records, the final parameter specifies the output bit number,
        with the offset specifying the message byte number. */
-    prec->mask = 1 << pcanBo->out.parameter;
+    prec->mask = 1 << pcanBo->out->parameter;
 
     #ifdef DEBUG
-	printf("  bit=%ld, mask=%#lx\n", pcanBo->out.parameter, prec->mask);
+	printf("  bit=%ld, mask=%#lx\n", pcanBo->out->parameter, prec->mask);
     #endif
 
+    /* Claim the message bit through the shared output combiner */
+    pcanBo->field.type = CAN_FIELD_UINT;
+    pcanBo->field.offset = pcanBo->out->offset;
+    pcanBo->field.length = 1;
+    pcanBo->field.shift = 0;
+    pcanBo->field.mask = prec->mask;
+    status = canCombinerField(pcanBo->out, &pcanBo->field,
+			      &pcanBo->combiner);
+    if (status) {
+	pcanBo->out = NULL;
+	recGblRecordError(status, prec,
+			  "devBoCan (init_record) canCombinerField failed");
+	return status;
+    }
+
     /* Find the bus matching this record */
     for (pbus = firstBus; pbus != NULL; pbus = pbus->nextBus) {
-    	if (pbus->canBusID == pcanBo->out.canBusID) break;
+    	if (pbus->canBusID == pcanBo->out->canBusID) break;
     }
 
     /* If not found, create one */
@@ -167,7 +186,7 @@ static long init_bo (
 
 	/* Fill it in */
 	pbus->firstPrivate = NULL;
-	pbus->canBusID = pcanBo->out.canBusID;
+	pbus->canBusID = pcanBo->out->canBusID;
 	callbackSetUser(pbus, &pbus->callback);
 	callbackSetCallback(busCallback, &pbus->callback);
 	callbackSetPriority(priorityMedium, &pbus->callback);
@@ -185,7 +204,7 @@ static long init_bo (
     pbus->firstPrivate = pcanBo;
 
     /* Register the message handler with the Canbus driver */
-    canMessage(pcanBo->out.canBusID, pcanBo->out.identifier, boMessage, pcanBo);
+    canMessage(pcanBo->out->canBusID, pcanBo->out->identifier, boMessage, pcanBo);
 
     return DO_NOT_CONVERT;
 }
@@ -214,7 +233,7 @@ static long write_bo (
 ) {
     boCanPrivate_t *pcanBo = prec->dpvt;
 
-    if (pcanBo->out.canBusID == NULL) {
+    if (pcanBo->out == NULL) {
 	return -1;
     }
 
@@ -230,28 +249,23 @@ static long write_bo (
 
 	case NO_ALARM:
 	    {
-		canMessage_t message;
 		int status;
 
-		message.identifier = pcanBo->out.identifier;
-		message.rtr = SEND;
-
 		pcanBo->data = prec->rval & prec->mask;
 
-		message.data[pcanBo->out.offset] = pcanBo->data;
-		message.length  = pcanBo->out.offset + 1;
-
 		#ifdef DEBUG
-		    printf("canBo %s: SEND id=%#x, length=%d, data=%#lx\n", 
-			    prec->name, message.identifier, message.length, 
+		    printf("canBo %s: SEND id=%#x, offset=%d, data=%#lx\n", 
+			    prec->name, pcanBo->out->identifier,
+			    pcanBo->out->offset, 
 			    pcanBo->data);
 		#endif
 
-		status = canWrite(pcanBo->out.canBusID, &message, 
-				  pcanBo->out.timeout);
+		status = canCombinerValue(pcanBo->combiner, &pcanBo->field,
+					  pcanBo->data,
+					  pcanBo->out->timeout);
 		if (status) {
 		    #ifdef DEBUG
-			printf("canBo %s: canWrite status=%#x\n",
+			printf("canBo %s: canCombinerValue status=%#x\n",
 				prec->name, status);
 		    #endif
 
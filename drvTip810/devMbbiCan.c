@@ -37,7 +37,6 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <stdlib.h>
 
 #include <epicsTypes.h>
-#include <epicsTimer.h>
 #include <errMdef.h>
 #include <devLib.h>
 #include <dbAccess.h>
@@ -54,6 +53,7 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <epicsExport.h>
 
 #include "canBus.h"
+#include "canDecode.h"
 
 
 #define CONVERT 0
@@ -63,11 +63,10 @@ Copyright (c) 1995-2000 Andrew Johnson
 typedef struct mbbiCanPrivate_s {
     CALLBACK callback;
     struct mbbiCanPrivate_s *nextPrivate;
-    epicsTimerId timId;
-    IOSCANPVT ioscanpvt;
     dbCommon *prec;
-    canIo_t inp;
-    epicsUInt32 data;
+    const canIo_t *inp;
+    canDecoderID_t decoder;
+    int field;
     int status;
 } mbbiCanPrivate_t;
 
@@ -83,7 +82,8 @@ static long init_mbbi(struct mbbiRecord *prec);
 static long get_ioint_info(int cmd, struct mbbiRecord *prec, IOSCANPVT *ppvt);
 static long read_mbbi(struct mbbiRecord *prec);
 static void ProcessCallback(CALLBACK *pCallback);
-static void mbbiMessage(void *private, const canMessage_t *pmessage);
+static void mbbiDone(void *private, int status,
+		    const canMessage_t *pmessage);
 static void busSignal(void *private, int status);
 static void busCallback(CALLBACK *pCallback);
 
@@ -112,6 +112,7 @@ static long init_mbbi (
 ) {
     mbbiCanPrivate_t *pcanMbbi;
     mbbiCanBus_t *pbus;
+    canField_t spec = {CAN_FIELD_UINT, 0, 1, 0, 0};
     int status;
 
     if (prec->inp.type != INST_IO) {
@@ -126,16 +127,15 @@ static long init_mbbi (
     }
     prec->dpvt = pcanMbbi;
     pcanMbbi->prec = (dbCommon *) prec;
-    pcanMbbi->ioscanpvt = NULL;
     pcanMbbi->status = NO_ALARM;
 
-    /* Convert the address string into members of the canIo structure */
-    status = canIoParse(prec->inp.value.instio.string, &pcanMbbi->inp);
+    /* Get the shared canIo structure for this address string */
+    status = canIoCompile(prec->inp.value.instio.string, &pcanMbbi->inp);
     if (status ||
-	pcanMbbi->inp.parameter < 0 ||
-	pcanMbbi->inp.parameter > 7) {
+	pcanMbbi->inp->parameter < 0 ||
+	pcanMbbi->inp->parameter > 7) {
 	if (canSilenceErrors) {
-	    pcanMbbi->inp.canBusID = NULL;
+	    pcanMbbi->inp = NULL;
 	    prec->pact = TRUE;
 	    return 0;
 	} else {
@@ -147,23 +147,34 @@ static long init_mbbi (
 
     #ifdef DEBUG
 	printf("mbbiCan %s: Init bus=%s, id=%#x, off=%d, parm=%ld\n",
-		prec->name, pcanMbbi->inp.busName, pcanMbbi->inp.identifier,
-		pcanMbbi->inp.offset, pcanMbbi->inp.parameter);
+		prec->name, pcanMbbi->inp->busName, pcanMbbi->inp->identifier,
+		pcanMbbi->inp->offset, pcanMbbi->inp->parameter);
     #endif
 
     /* For mbbi records, the final parameter specifies the input bit shift,
        with offset specifying the message byte number. */
-    prec->shft = pcanMbbi->inp.parameter;
-    prec->mask <<= pcanMbbi->inp.parameter;
+    prec->shft = pcanMbbi->inp->parameter;
+    prec->mask <<= pcanMbbi->inp->parameter;
 
     #ifdef DEBUG
 	printf("  shft=%ld, mask=%#lx\n", 
-		pcanMbbi->inp.parameter, prec->mask);
+		pcanMbbi->inp->parameter, prec->mask);
     #endif
 
+    /* Subscribe to the message byte through the shared frame decoder */
+    spec.offset = pcanMbbi->inp->offset;
+    status = canDecoderField(pcanMbbi->inp, &spec,
+			     &pcanMbbi->decoder, &pcanMbbi->field);
+    if (status) {
+	pcanMbbi->inp = NULL;
+	recGblRecordError(status, prec,
+			  "devMbbiCan (init_record) canDecoderField failed");
+	return status;
+    }
+
     /* Find the bus matching this record */
     for (pbus = firstBus; pbus != NULL; pbus = pbus->nextBus) {
-      if (pbus->canBusID == pcanMbbi->inp.canBusID) break;
+      if (pbus->canBusID == pcanMbbi->inp->canBusID) break;
     }  
 
     /* If not found, create one */
@@ -173,7 +184,7 @@ static long init_mbbi (
 
 	/* Fill it in */
 	pbus->firstPrivate = NULL;
-	pbus->canBusID = pcanMbbi->inp.canBusID;
+	pbus->canBusID = pcanMbbi->inp->canBusID;
 	callbackSetUser(pbus, &pbus->callback);
 	callbackSetCallback(busCallback, &pbus->callback);
 	callbackSetPriority(priorityMedium, &pbus->callback);
@@ -195,17 +206,6 @@ static long init_mbbi (
     callbackSetCallback(ProcessCallback, &pcanMbbi->callback);
     callbackSetPriority(prec->prio, &pcanMbbi->callback);
 
-    /* and create a timer for CANbus RTR timeouts */
-    pcanMbbi->timId = epicsTimerQueueCreateTimer( canTimerQ,
-		(epicsTimerCallback) callbackRequest, pcanMbbi);
-    if (pcanMbbi->timId == NULL) {
-	return S_dev_noMemory;
-    }
-
-    /* Register the message handler with the Canbus driver */
-    canMessage(pcanMbbi->inp.canBusID, pcanMbbi->inp.identifier, 
-	       mbbiMessage, pcanMbbi);
-
     return 0;
 }
 
@@ -215,16 +215,22 @@ static long get_ioint_info (
     IOSCANPVT *ppvt
 ) {
     mbbiCanPrivate_t *pcanMbbi = prec->dpvt;
+    static IOSCANPVT noScan = NULL;
 
-    if (pcanMbbi->ioscanpvt == NULL) {
-	scanIoInit(&pcanMbbi->ioscanpvt);
+    if (pcanMbbi->inp == NULL) {
+	/* Bad address, use a scan list that nothing ever requests */
+	if (noScan == NULL) {
+	    scanIoInit(&noScan);
+	}
+	*ppvt = noScan;
+	return 0;
     }
 
     #ifdef DEBUG
 	printf("canMbbi %s: get_ioint_info %d\n", prec->name, cmd);
     #endif
 
-    *ppvt = pcanMbbi->ioscanpvt;
+    *ppvt = canDecoderIoScan(pcanMbbi->decoder);
     return 0;
 }
 
@@ -233,7 +239,7 @@ static long read_mbbi (
 ) {
     mbbiCanPrivate_t *pcanMbbi = prec->dpvt;
 
-    if (pcanMbbi->inp.canBusID == NULL) {
+    if (pcanMbbi->inp == NULL) {
 	return DO_NOT_CONVERT;
     }
 
@@ -250,30 +256,34 @@ static long read_mbbi (
 
 	case NO_ALARM:
 	    if (prec->pact || prec->scan == SCAN_IO_EVENT) {
+		epicsUInt32 data = canDecoderValue(pcanMbbi->decoder,
+						    pcanMbbi->field);
+
 		#ifdef DEBUG
 		    printf("canMbbi %s: message id=%#x, data=%#lx\n", 
-			    prec->name, pcanMbbi->inp.identifier, pcanMbbi->data);
+			    prec->name, pcanMbbi->inp->identifier, data);
 		#endif
 
-		prec->rval = pcanMbbi->data & prec->mask;
+		prec->rval = data & prec->mask;
+		#ifdef epicsTimeEventDeviceTime
+		if (prec->tse == epicsTimeEventDeviceTime) {
+		    canDecoderTime(pcanMbbi->decoder, &prec->time);
+		}
+		#endif
 		return CONVERT;
 	    } else {
-		canMessage_t message;
-
-		message.identifier = pcanMbbi->inp.identifier;
-		message.rtr = RTR;
-		message.length = 8;
-
 		#ifdef DEBUG
 		    printf("canMbbi %s: RTR, id=%#x\n", 
-			    prec->name, pcanMbbi->inp.identifier);
+			    prec->name, pcanMbbi->inp->identifier);
 		#endif
 
 		prec->pact = TRUE;
 		pcanMbbi->status = TIMEOUT_ALARM;
-
-		epicsTimerStartDelay(pcanMbbi->timId, pcanMbbi->inp.timeout);
-		canWrite(pcanMbbi->inp.canBusID, &message, pcanMbbi->inp.timeout);
+		if (canReadAsync(pcanMbbi->inp->canBusID, pcanMbbi->inp->identifier,
+				 mbbiDone, pcanMbbi, pcanMbbi->inp->timeout)) {
+		    pcanMbbi->status = COMM_ALARM;
+		    callbackRequest(&pcanMbbi->callback);
+		}
 		return DO_NOT_CONVERT;
 	    }
 	default:
@@ -293,25 +303,17 @@ static void ProcessCallback(CALLBACK *pcallback)
     dbScanUnlock(pRec);
 }
 
-static void mbbiMessage (
+static void mbbiDone (
     void *private,
+    int status,
     const canMessage_t *pmessage
 ) {
     mbbiCanPrivate_t *pcanMbbi = private;
 
-    if (!interruptAccept ||
-	pmessage->rtr == RTR) {
-	return;
-    }
-
-    pcanMbbi->data = pmessage->data[pcanMbbi->inp.offset];
-
-    if (pcanMbbi->prec->scan == SCAN_IO_EVENT) {
-	pcanMbbi->status = NO_ALARM;
-	scanIoRequest(pcanMbbi->ioscanpvt);
-    } else if (pcanMbbi->status == TIMEOUT_ALARM) {
-	pcanMbbi->status = NO_ALARM;
-	epicsTimerCancel(pcanMbbi->timId);
+    if (pcanMbbi->status == TIMEOUT_ALARM) {
+	if (status == 0) {
+	    pcanMbbi->status = NO_ALARM;
+	}
 	callbackRequest(&pcanMbbi->callback);
     }
 }
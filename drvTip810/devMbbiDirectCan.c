@@ -37,7 +37,6 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <stdlib.h>
 
 #include <epicsTypes.h>
-#include <epicsTimer.h>
 #include <errMdef.h>
 #include <devLib.h>
 #include <dbAccess.h>
@@ -54,6 +53,7 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <epicsExport.h>
 
 #include "canBus.h"
+#include "canDecode.h"
 
 
 #define CONVERT 0
@@ -63,11 +63,10 @@ Copyright (c) 1995-2000 Andrew Johnson
 typedef struct mbbiDirectCanPrivate_s {
     CALLBACK callback;
     struct mbbiDirectCanPrivate_s *nextPrivate;
-    epicsTimerId timId;
-    IOSCANPVT ioscanpvt;
     dbCommon *prec;
-    canIo_t inp;
-    epicsUInt32 data;
+    const canIo_t *inp;
+    canDecoderID_t decoder;
+    int field;
     int status;
 } mbbiDirectCanPrivate_t;
 
@@ -83,7 +82,8 @@ static long init_mbbiDirect(struct mbbiDirectRecord *prec);
 static long get_ioint_info(int cmd, struct mbbiDirectRecord *prec, IOSCANPVT *ppvt);
 static long read_mbbiDirect(struct mbbiDirectRecord *prec);
 static void ProcessCallback(CALLBACK *pcallback);
-static void mbbiDirectMessage(void *private, const canMessage_t *pmessage);
+static void mbbiDirectDone(void *private, int status,
+		    const canMessage_t *pmessage);
 static void busSignal(void *private, int status);
 static void busCallback(CALLBACK *pCallback);
 
@@ -112,6 +112,7 @@ static long init_mbbiDirect (
 ) {
     mbbiDirectCanPrivate_t *pcanMbbiDirect;
     mbbiDirectCanBus_t *pbus;
+    canField_t spec = {CAN_FIELD_UINT, 0, 1, 0, 0};
     int status;
 
     if (prec->inp.type != INST_IO) {
@@ -126,16 +127,15 @@ static long init_mbbiDirect (
     }
     prec->dpvt = pcanMbbiDirect;
     pcanMbbiDirect->prec = (dbCommon *) prec;
-    pcanMbbiDirect->ioscanpvt = NULL;
     pcanMbbiDirect->status = NO_ALARM;
 
-    /* Convert the address string into members of the canIo structure */
-    status = canIoParse(prec->inp.value.instio.string, &pcanMbbiDirect->inp);
+    /* Get the shared canIo structure for this address string */
+    status = canIoCompile(prec->inp.value.instio.string, &pcanMbbiDirect->inp);
     if (status ||
-	pcanMbbiDirect->inp.parameter < 0 ||
-	pcanMbbiDirect->inp.parameter > 7) {
+	pcanMbbiDirect->inp->parameter < 0 ||
+	pcanMbbiDirect->inp->parameter > 7) {
 	if (canSilenceErrors) {
-	    pcanMbbiDirect->inp.canBusID = NULL;
+	    pcanMbbiDirect->inp = NULL;
 	    prec->pact = TRUE;
 	    return 0;
 	} else {
@@ -147,23 +147,34 @@ static long init_mbbiDirect (
 
     #ifdef DEBUG
 	printf("mbbiDirectCan %s: Init bus=%s, id=%#x, off=%d, parm=%ld\n",
-		    prec->name, pcanMbbiDirect->inp.busName, pcanMbbiDirect->inp.identifier,
-		    pcanMbbiDirect->inp.offset, pcanMbbiDirect->inp.parameter);
+		    prec->name, pcanMbbiDirect->inp->busName, pcanMbbiDirect->inp->identifier,
+		    pcanMbbiDirect->inp->offset, pcanMbbiDirect->inp->parameter);
     #endif
 
     /* For mbbiDirect records, the final parameter specifies the input bit shift,
        with offset specifying the message byte number. */
-    prec->shft = pcanMbbiDirect->inp.parameter;
-    prec->mask <<= pcanMbbiDirect->inp.parameter;
+    prec->shft = pcanMbbiDirect->inp->parameter;
+    prec->mask <<= pcanMbbiDirect->inp->parameter;
 
     #ifdef DEBUG
 	printf("  shft=%ld, mask=%#lx\n", 
-		pcanMbbiDirect->inp.parameter, prec->mask);
+		pcanMbbiDirect->inp->parameter, prec->mask);
     #endif
 
+    /* Subscribe to the message byte through the shared frame decoder */
+    spec.offset = pcanMbbiDirect->inp->offset;
+    status = canDecoderField(pcanMbbiDirect->inp, &spec,
+			     &pcanMbbiDirect->decoder, &pcanMbbiDirect->field);
+    if (status) {
+	pcanMbbiDirect->inp = NULL;
+	recGblRecordError(status, prec,
+			  "devMbbiDirectCan (init_record) canDecoderField failed");
+	return status;
+    }
+
     /* Find the bus matching this record */
     for (pbus = firstBus; pbus != NULL; pbus = pbus->nextBus) {
-      if (pbus->canBusID == pcanMbbiDirect->inp.canBusID) break;
+      if (pbus->canBusID == pcanMbbiDirect->inp->canBusID) break;
     }  
 
     /* If not found, create one */
@@ -173,7 +184,7 @@ static long init_mbbiDirect (
 
       /* Fill it in */
       pbus->firstPrivate = NULL;
-      pbus->canBusID = pcanMbbiDirect->inp.canBusID;
+      pbus->canBusID = pcanMbbiDirect->inp->canBusID;
       callbackSetUser(pbus, &pbus->callback);
       callbackSetCallback(busCallback, &pbus->callback);
       callbackSetPriority(priorityMedium, &pbus->callback);
@@ -195,17 +206,6 @@ static long init_mbbiDirect (
     callbackSetCallback(ProcessCallback, &pcanMbbiDirect->callback);
     callbackSetPriority(prec->prio, &pcanMbbiDirect->callback);
 
-    /* and create a timer for CANbus RTR timeouts */
-    pcanMbbiDirect->timId = epicsTimerQueueCreateTimer(canTimerQ,
-		(epicsTimerCallback) callbackRequest, pcanMbbiDirect);
-    if (pcanMbbiDirect->timId == NULL) {
-	return S_dev_noMemory;
-    }
-
-    /* Register the message handler with the Canbus driver */
-    canMessage(pcanMbbiDirect->inp.canBusID, pcanMbbiDirect->inp.identifier, 
-		mbbiDirectMessage, pcanMbbiDirect);
-
     return 0;
 }
 
@@ -215,16 +215,22 @@ static long get_ioint_info (
     IOSCANPVT *ppvt
 ) {
     mbbiDirectCanPrivate_t *pcanMbbiDirect = prec->dpvt;
+    static IOSCANPVT noScan = NULL;
 
-    if (pcanMbbiDirect->ioscanpvt == NULL) {
-	scanIoInit(&pcanMbbiDirect->ioscanpvt);
+    if (pcanMbbiDirect->inp == NULL) {
+	/* Bad address, use a scan list that nothing ever requests */
+	if (noScan == NULL) {
+	    scanIoInit(&noScan);
+	}
+	*ppvt = noScan;
+	return 0;
     }
 
     #ifdef DEBUG
 	printf("canMbbiDirect %s: get_ioint_info %d\n", prec->name, cmd);
     #endif
 
-    *ppvt = pcanMbbiDirect->ioscanpvt;
+    *ppvt = canDecoderIoScan(pcanMbbiDirect->decoder);
     return 0;
 }
 
@@ -233,7 +239,7 @@ static long read_mbbiDirect (
 ) {
     mbbiDirectCanPrivate_t *pcanMbbiDirect = prec->dpvt;
 
-    if (pcanMbbiDirect->inp.canBusID == NULL) {
+    if (pcanMbbiDirect->inp == NULL) {
 	return DO_NOT_CONVERT;
     }
 
@@ -250,32 +256,36 @@ static long read_mbbiDirect (
 
 	case NO_ALARM:
 	    if (prec->pact || prec->scan == SCAN_IO_EVENT) {
+		epicsUInt32 data = canDecoderValue(pcanMbbiDirect->decoder,
+						    pcanMbbiDirect->field);
+
 		#ifdef DEBUG
 		    printf("canMbbiDirect %s: message id=%#x, data=%#lx\n", 
-			    prec->name, pcanMbbiDirect->inp.identifier, pcanMbbiDirect->data);
+			    prec->name, pcanMbbiDirect->inp->identifier, data);
 		#endif
 
-		prec->rval = pcanMbbiDirect->data & prec->mask;
+		prec->rval = data & prec->mask;
+		#ifdef epicsTimeEventDeviceTime
+		if (prec->tse == epicsTimeEventDeviceTime) {
+		    canDecoderTime(pcanMbbiDirect->decoder, &prec->time);
+		}
+		#endif
 		return CONVERT;
 	    } else {
-		canMessage_t message;
-
-		message.identifier = pcanMbbiDirect->inp.identifier;
-		message.rtr = RTR;
-		message.length = 8;
-
 		#ifdef DEBUG
 		    printf("canMbbiDirect %s: RTR, id=%#x\n", 
-			    prec->name, pcanMbbiDirect->inp.identifier);
+			    prec->name, pcanMbbiDirect->inp->identifier);
 		#endif
 
 		prec->pact = TRUE;
 		pcanMbbiDirect->status = TIMEOUT_ALARM;
-
-		epicsTimerStartDelay(pcanMbbiDirect->timId,
-			pcanMbbiDirect->inp.timeout);
-		canWrite(pcanMbbiDirect->inp.canBusID, &message,
-			 pcanMbbiDirect->inp.timeout);
+		if (canReadAsync(pcanMbbiDirect->inp->canBusID,
+				 pcanMbbiDirect->inp->identifier,
+				 mbbiDirectDone, pcanMbbiDirect,
+				 pcanMbbiDirect->inp->timeout)) {
+		    pcanMbbiDirect->status = COMM_ALARM;
+		    callbackRequest(&pcanMbbiDirect->callback);
+		}
 		return DO_NOT_CONVERT;
 	    }
 	default:
@@ -295,25 +305,17 @@ static void ProcessCallback(CALLBACK *pcallback)
     dbScanUnlock(pRec);
 }
 
-static void mbbiDirectMessage (
+static void mbbiDirectDone (
     void *private,
+    int status,
     const canMessage_t *pmessage
 ) {
     mbbiDirectCanPrivate_t *pcanMbbiDirect = private;
 
-    if (!interruptAccept ||
-	pmessage->rtr == RTR) {
-	return;
-    }
-
-    pcanMbbiDirect->data = pmessage->data[pcanMbbiDirect->inp.offset];
-
-    if (pcanMbbiDirect->prec->scan == SCAN_IO_EVENT) {
-	pcanMbbiDirect->status = NO_ALARM;
-	scanIoRequest(pcanMbbiDirect->ioscanpvt);
-    } else if (pcanMbbiDirect->status == TIMEOUT_ALARM) {
-	pcanMbbiDirect->status = NO_ALARM;
-	epicsTimerCancel(pcanMbbiDirect->timId);
+    if (pcanMbbiDirect->status == TIMEOUT_ALARM) {
+	if (status == 0) {
+	    pcanMbbiDirect->status = NO_ALARM;
+	}
 	callbackRequest(&pcanMbbiDirect->callback);
     }
 }
@@ -54,6 +54,8 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <epicsExport.h>
 
 #include "canBus.h"
+#include "canDecode.h"
+#include "canCombine.h"
 
 
 #define DO_NOT_CONVERT	2
@@ -63,7 +65,9 @@ typedef struct mbboCanPrivate_s {
     struct mbboCanPrivate_s *nextPrivate;
     IOSCANPVT ioscanpvt;
     dbCommon *prec;
-    canIo_t out;
+    const canIo_t *out;
+    canCombinerID_t combiner;
+    canField_t field;
     epicsUInt32 data;
     int status;
 } mbboCanPrivate_t;
@@ -125,13 +129,13 @@ static long init_mbbo (
     pcanMbbo->ioscanpvt = NULL;
     pcanMbbo->status = NO_ALARM;
 
-    /* Convert the parameter string into members of the canIo structure */
-    status = canIoParse(prec->out.value.instio.string, &pcanMbbo->out);
+    /* Get the shared canIo structure for this address string */
+    status = canIoCompile(prec->out.value.instio.string, &pcanMbbo->out);
     if (status ||
-	pcanMbbo->out.parameter < 0 ||
-	pcanMbbo->out.parameter > 7) {
+	pcanMbbo->out->parameter < 0 ||
+	pcanMbbo->out->parameter > 7) {
 	if (canSilenceErrors) {
-	    pcanMbbo->out.canBusID = NULL;
+	    pcanMbbo->out = NULL;
 	    prec->pact = TRUE;
 	    return DO_NOT_CONVERT;
 	} else {
@@ -143,22 +147,37 @@ static long init_mbbo (
 
     #ifdef DEBUG
 	printf("canMbbo %s: Init bus=%s, id=%#x, off=%d, parm=%ld\n",
-		prec->name, pcanMbbo->out.busName, pcanMbbo->out.identifier,
-		pcanMbbo->out.offset, pcanMbbo->out.parameter);
+		prec->name, pcanMbbo->out->busName, pcanMbbo->out->identifier,
+		pcanMbbo->out->offset, pcanMbbo->out->parameter);
     #endif
 
     /* For mbbo records, the final parameter specifies the output bit shift,
        with the offset specifying the message byte number. */
-    prec->shft = pcanMbbo->out.parameter;
-    prec->mask <<= pcanMbbo->out.parameter;
+    prec->shft = pcanMbbo->out->parameter;
+    prec->mask <<= pcanMbbo->out->parameter;
 
     #ifdef DEBUG
-	printf("  bit=%ld, mask=%#lx\n", pcanMbbo->out.parameter, prec->mask);
+	printf("  bit=%ld, mask=%#lx\n", pcanMbbo->out->parameter, prec->mask);
     #endif
 
+    /* Claim the message bits through the shared output combiner */
+    pcanMbbo->field.type = CAN_FIELD_UINT;
+    pcanMbbo->field.offset = pcanMbbo->out->offset;
+    pcanMbbo->field.length = 1;
+    pcanMbbo->field.shift = 0;
+    pcanMbbo->field.mask = prec->mask;
+    status = canCombinerField(pcanMbbo->out, &pcanMbbo->field,
+			      &pcanMbbo->combiner);
+    if (status) {
+	pcanMbbo->out = NULL;
+	recGblRecordError(status, prec,
+			  "devMbboCan (init_record) canCombinerField failed");
+	return status;
+    }
+
     /* Find the bus matching this record */
     for (pbus = firstBus; pbus != NULL; pbus = pbus->nextBus) {
-    	if (pbus->canBusID == pcanMbbo->out.canBusID) break;
+    	if (pbus->canBusID == pcanMbbo->out->canBusID) break;
     }
 
     /* If not found, create one */
@@ -168,7 +187,7 @@ static long init_mbbo (
 
 	/* Fill it in */
 	pbus->firstPrivate = NULL;
-	pbus->canBusID = pcanMbbo->out.canBusID;
+	pbus->canBusID = pcanMbbo->out->canBusID;
 	callbackSetUser(pbus, &pbus->callback);
 	callbackSetCallback(busCallback, &pbus->callback);
 	callbackSetPriority(priorityMedium, &pbus->callback);
@@ -186,7 +205,7 @@ static long init_mbbo (
     pbus->firstPrivate = pcanMbbo;
 
     /* Register the message handler with the Canbus driver */
-    canMessage(pcanMbbo->out.canBusID, pcanMbbo->out.identifier,
+    canMessage(pcanMbbo->out->canBusID, pcanMbbo->out->identifier,
 		mbboMessage, pcanMbbo);
 
     return DO_NOT_CONVERT;
@@ -216,7 +235,7 @@ static long write_mbbo (
 ) {
     mbboCanPrivate_t *pcanMbbo = prec->dpvt;
 
-    if (pcanMbbo->out.canBusID == NULL) {
+    if (pcanMbbo->out == NULL) {
 	return -1;
     }
 
@@ -232,28 +251,23 @@ static long write_mbbo (
 
 	case NO_ALARM:
 	    {
-		canMessage_t message;
 		int status;
 
-		message.identifier = pcanMbbo->out.identifier;
-		message.rtr = SEND;
-
 		pcanMbbo->data = prec->rval & prec->mask;
 
-		message.data[pcanMbbo->out.offset] = pcanMbbo->data;
-		message.length  = pcanMbbo->out.offset + 1;
-
 		#ifdef DEBUG
-		    printf("canMbbo %s: SEND id=%#x, length=%d, data=%#lx\n", 
-			    prec->name, message.identifier, message.length, 
+		    printf("canMbbo %s: SEND id=%#x, offset=%d, data=%#lx\n", 
+			    prec->name, pcanMbbo->out->identifier,
+			    pcanMbbo->out->offset, 
 			    pcanMbbo->data);
 		#endif
 
-		status = canWrite(pcanMbbo->out.canBusID, &message, 
-				  pcanMbbo->out.timeout);
+		status = canCombinerValue(pcanMbbo->combiner, &pcanMbbo->field,
+					  pcanMbbo->data,
+					  pcanMbbo->out->timeout);
 		if (status) {
 		    #ifdef DEBUG
-			printf("canMbbo %s: canWrite status=%#x\n",
+			printf("canMbbo %s: canCombinerValue status=%#x\n",
 				prec->name, status);
 		    #endif
 
@@ -54,6 +54,8 @@ Copyright (c) 1995-2000 Andrew Johnson
 #include <epicsExport.h>
 
 #include "canBus.h"
+#include "canDecode.h"
+#include "canCombine.h"
 
 
 #define DO_NOT_CONVERT	2
@@ -63,7 +65,9 @@ typedef struct mbboDirectCanPrivate_s {
     struct mbboDirectCanPrivate_s *nextPrivate;
     IOSCANPVT ioscanpvt;
     dbCommon *prec;
-    canIo_t out;
+    const canIo_t *out;
+    canCombinerID_t combiner;
+    canField_t field;
     epicsUInt32 data;
     int status;
 } mbboDirectCanPrivate_t;
@@ -125,13 +129,13 @@ static long init_mbboDirect (
     pcanMbboDirect->ioscanpvt = NULL;
     pcanMbboDirect->status = NO_ALARM;
 
-    /* Convert the parameter string into members of the canIo structure */
-    status = canIoParse(prec->out.value.instio.string, &pcanMbboDirect->out);
+    /* Get the shared canIo structure for this address string */
+    status = canIoCompile(prec->out.value.instio.string, &pcanMbboDirect->out);
     if (status ||
-	pcanMbboDirect->out.parameter < 0 ||
-	pcanMbboDirect->out.parameter > 7) {
+	pcanMbboDirect->out->parameter < 0 ||
+	pcanMbboDirect->out->parameter > 7) {
 	if (canSilenceErrors) {
-	    pcanMbboDirect->out.canBusID = NULL;
+	    pcanMbboDirect->out = NULL;
 	    prec->pact = TRUE;
 	    return DO_NOT_CONVERT;
 	} else {
@@ -143,22 +147,37 @@ static long init_mbboDirect (
 
     #ifdef DEBUG
 	printf("canMbboDirect %s: Init bus=%s, id=%#x, off=%d, parm=%ld\n",
-		prec->name, pcanMbboDirect->out.busName, pcanMbboDirect->out.identifier,
-		pcanMbboDirect->out.offset, pcanMbboDirect->out.parameter);
+		prec->name, pcanMbboDirect->out->busName, pcanMbboDirect->out->identifier,
+		pcanMbboDirect->out->offset, pcanMbboDirect->out->parameter);
     #endif
 
     /* For mbboDirect records, the final parameter specifies the output bit shift,
        with the offset specifying the message byte number. */
-    prec->shft = pcanMbboDirect->out.parameter;
-    prec->mask <<= pcanMbboDirect->out.parameter;
+    prec->shft = pcanMbboDirect->out->parameter;
+    prec->mask <<= pcanMbboDirect->out->parameter;
 
     #ifdef DEBUG
-	printf("  bit=%ld, mask=%#lx\n", pcanMbboDirect->out.parameter, prec->mask);
+	printf("  bit=%ld, mask=%#lx\n", pcanMbboDirect->out->parameter, prec->mask);
     #endif
 
+    /* Claim the message bits through the shared output combiner */
+    pcanMbboDirect->field.type = CAN_FIELD_UINT;
+    pcanMbboDirect->field.offset = pcanMbboDirect->out->offset;
+    pcanMbboDirect->field.length = 1;
+    pcanMbboDirect->field.shift = 0;
+    pcanMbboDirect->field.mask = prec->mask;
+    status = canCombinerField(pcanMbboDirect->out, &pcanMbboDirect->field,
+			      &pcanMbboDirect->combiner);
+    if (status) {
+	pcanMbboDirect->out = NULL;
+	recGblRecordError(status, prec,
+			  "devMbboDirectCan (init_record) canCombinerField failed");
+	return status;
+    }
+
     /* Find the bus matching this record */
     for (pbus = firstBus; pbus != NULL; pbus = pbus->nextBus) {
-    	if (pbus->canBusID == pcanMbboDirect->out.canBusID) break;
+    	if (pbus->canBusID == pcanMbboDirect->out->canBusID) break;
     }
 
     /* If not found, create one */
@@ -168,7 +187,7 @@ static long init_mbboDirect (
 
 	/* Fill it in */
 	pbus->firstPrivate = NULL;
-	pbus->canBusID = pcanMbboDirect->out.canBusID;
+	pbus->canBusID = pcanMbboDirect->out->canBusID;
 	callbackSetUser(pbus, &pbus->callback);
 	callbackSetCallback(busCallback, &pbus->callback);
 	callbackSetPriority(priorityMedium, &pbus->callback);
@@ -186,7 +205,7 @@ static long init_mbboDirect (
     pbus->firstPrivate = pcanMbboDirect;
 
     /* Register the message handler with the Canbus driver */
-    canMessage(pcanMbboDirect->out.canBusID, pcanMbboDirect->out.identifier,
+    canMessage(pcanMbboDirect->out->canBusID, pcanMbboDirect->out->identifier,
 		mbboDirectMessage, pcanMbboDirect);
 
     return DO_NOT_CONVERT;
@@ -216,7 +235,7 @@ static long write_mbboDirect (
 ) {
     mbboDirectCanPrivate_t *pcanMbboDirect = prec->dpvt;
 
-    if (pcanMbboDirect->out.canBusID == NULL) {
+    if (pcanMbboDirect->out == NULL) {
 	return -1;
     }
 
@@ -232,28 +251,23 @@ static long write_mbboDirect (
 
 	case NO_ALARM:
 	    {
-		canMessage_t message;
 		int status;
 
-		message.identifier = pcanMbboDirect->out.identifier;
-		message.rtr = SEND;
-
 		pcanMbboDirect->data = prec->rval & prec->mask;
 
-		message.data[pcanMbboDirect->out.offset] = pcanMbboDirect->data;
-		message.length  = pcanMbboDirect->out.offset + 1;
-
 		#ifdef DEBUG
-		    printf("canMbboDirect %s: SEND id=%#x, length=%d, data=%#lx\n", 
-			    prec->name, message.identifier, message.length, 
+		    printf("canMbboDirect %s: SEND id=%#x, offset=%d, data=%#lx\n", 
+			    prec->name, pcanMbboDirect->out->identifier,
+			    pcanMbboDirect->out->offset, 
 			    pcanMbboDirect->data);
 		#endif
 
-		status = canWrite(pcanMbboDirect->out.canBusID, &message, 
-				  pcanMbboDirect->out.timeout);
+		status = canCombinerValue(pcanMbboDirect->combiner, &pcanMbboDirect->field,
+					  pcanMbboDirect->data,
+					  pcanMbboDirect->out->timeout);
 		if (status) {
 		    #ifdef DEBUG
-			printf("canMbboDirect %s: canWrite status=%#x\n",
+			printf("canMbboDirect %s: canCombinerValue status=%#x\n",
 				prec->name, status);
 		    #endif
 
@@ -40,7 +40,7 @@ Copyright (c) 1995-2000 Carl Lionberger and Andrew Johnson
 #include <string.h>
 
 #include <epicsTypes.h>
-#include <epicsTimer.h>
+#include <epicsTime.h>
 #include <errMdef.h>
 #include <devLib.h>
 #include <dbAccess.h>
@@ -62,11 +62,12 @@ Copyright (c) 1995-2000 Carl Lionberger and Andrew Johnson
 typedef struct siCanPrivate_s {
     CALLBACK callback;
     struct siCanPrivate_s *nextPrivate;
-    epicsTimerId timId;
+    epicsTimeStamp requested;	/* When the current RTR read began */
     IOSCANPVT ioscanpvt;
     dbCommon *prec;
-    canIo_t inp;
+    const canIo_t *inp;
     char data[CAN_DATA_SIZE + 1];
+    epicsTimeStamp time;
     int status;
 } siCanPrivate_t;
 
@@ -83,6 +84,7 @@ static long get_ioint_info(int cmd, struct stringinRecord *prec, IOSCANPVT *ppvt
 static long read_si(struct stringinRecord *prec);
 static void ProcessCallback(CALLBACK *pcallback);
 static void siMessage(void *private, const canMessage_t *pmessage);
+static void siDone(void *private, int status, const canMessage_t *pmessage);
 static void busSignal(void *private, int status);
 static void busCallback(CALLBACK *pCallback);
 
@@ -127,11 +129,11 @@ static long init_si (
     pcanSi->ioscanpvt = NULL;
     pcanSi->status = NO_ALARM;
 
-    /* Convert the address string into members of the canIo structure */
-    status = canIoParse(prec->inp.value.instio.string, &pcanSi->inp);
+    /* Get the shared canIo structure for this address string */
+    status = canIoCompile(prec->inp.value.instio.string, &pcanSi->inp);
     if (status) {
 	if (canSilenceErrors) {
-	    pcanSi->inp.canBusID = NULL;
+	    pcanSi->inp = NULL;
 	    prec->pact = TRUE;
 	    return 0;
 	} else {
@@ -143,13 +145,13 @@ static long init_si (
 
     #ifdef DEBUG
 	printf("siCan %s: Init bus=%s, id=%#x, off=%d, parm=%ld\n",
-		prec->name, pcanSi->inp.busName, pcanSi->inp.identifier,
-		pcanSi->inp.offset, pcanSi->inp.parameter);
+		prec->name, pcanSi->inp->busName, pcanSi->inp->identifier,
+		pcanSi->inp->offset, pcanSi->inp->parameter);
     #endif
 
     /* Find the bus matching this record */
     for (pbus = firstBus; pbus != NULL; pbus = pbus->nextBus) {
-    	if (pbus->canBusID == pcanSi->inp.canBusID) break;
+    	if (pbus->canBusID == pcanSi->inp->canBusID) break;
     }
 
     /* If not found, create one */
@@ -159,7 +161,7 @@ static long init_si (
 
 	/* Fill it in */
 	pbus->firstPrivate = NULL;
-	pbus->canBusID = pcanSi->inp.canBusID;
+	pbus->canBusID = pcanSi->inp->canBusID;
 	callbackSetUser(pbus, &pbus->callback);
 	callbackSetCallback(busCallback, &pbus->callback);
 	callbackSetPriority(priorityMedium, &pbus->callback);
@@ -181,15 +183,8 @@ static long init_si (
     callbackSetCallback(ProcessCallback, &pcanSi->callback);
     callbackSetPriority(prec->prio, &pcanSi->callback);
 
-    /* and create a timer for CANbus RTR timeouts */
-    pcanSi->timId = epicsTimerQueueCreateTimer(canTimerQ,
-		(epicsTimerCallback) callbackRequest, pcanSi);
-    if (pcanSi->timId == NULL) {
-	return S_dev_noMemory;
-    }
-
     /* Register the message handler with the Canbus driver */
-    canMessage(pcanSi->inp.canBusID, pcanSi->inp.identifier, siMessage, pcanSi);
+    canMessage(pcanSi->inp->canBusID, pcanSi->inp->identifier, siMessage, pcanSi);
 
     return 0;
 }
@@ -218,7 +213,7 @@ static long read_si (
 ) {
     siCanPrivate_t *pcanSi = prec->dpvt;
 
-    if (pcanSi->inp.canBusID == NULL) {
+    if (pcanSi->inp == NULL) {
 	return -1;
     }
 
@@ -237,28 +232,30 @@ static long read_si (
 	    if (prec->pact || prec->scan == SCAN_IO_EVENT) {
 		#ifdef DEBUG
 		    printf("canSi %s: message id=%#x, data=%p\n", 
-			    prec->name, pcanSi->inp.identifier, pcanSi->data);
+			    prec->name, pcanSi->inp->identifier, pcanSi->data);
 		#endif
 
                 strcpy(prec->val, pcanSi->data);
+		#ifdef epicsTimeEventDeviceTime
+		if (prec->tse == epicsTimeEventDeviceTime) {
+		    prec->time = pcanSi->time;
+		}
+		#endif
 		return 0;
 	    } else {
-		canMessage_t message;
-
-		message.identifier = pcanSi->inp.identifier;
-		message.rtr = RTR;
-		message.length = 8;
-
 		#ifdef DEBUG
 		    printf("canSi %s: RTR, id=%#x\n", 
-			    prec->name, pcanSi->inp.identifier);
+			    prec->name, pcanSi->inp->identifier);
 		#endif
 
 		prec->pact = TRUE;
 		pcanSi->status = TIMEOUT_ALARM;
-
-		epicsTimerStartDelay(pcanSi->timId, pcanSi->inp.timeout);
-		canWrite(pcanSi->inp.canBusID, &message, pcanSi->inp.timeout);
+		epicsTimeGetCurrent(&pcanSi->requested);
+		if (canReadAsync(pcanSi->inp->canBusID, pcanSi->inp->identifier,
+				 siDone, pcanSi, pcanSi->inp->timeout)) {
+		    pcanSi->status = COMM_ALARM;
+		    callbackRequest(&pcanSi->callback);
+		}
 		return 0;
 	    }
 	default:
@@ -289,22 +286,51 @@ static void siMessage (
 	return;
     }
 
-    if ((pcanSi->inp.offset == 1) &&
-	(pcanSi->inp.parameter != pmessage->data[0]))
+    if ((pcanSi->inp->offset == 1) &&
+	(pcanSi->inp->parameter != pmessage->data[0]))
         return;		/* Subaddressing ala wiener, but wrong one. */
 
-    memcpy(pcanSi->data, pmessage->data + pcanSi->inp.offset, 
-                         CAN_DATA_SIZE - pcanSi->inp.offset);
-    pcanSi->data[8 - pcanSi->inp.offset] = '\0';
+    memcpy(pcanSi->data, pmessage->data + pcanSi->inp->offset, 
+                         CAN_DATA_SIZE - pcanSi->inp->offset);
+    pcanSi->data[8 - pcanSi->inp->offset] = '\0';
+    pcanSi->time = pmessage->timestamp;
 
     if (pcanSi->prec->scan == SCAN_IO_EVENT) {
 	pcanSi->status = NO_ALARM;
 	scanIoRequest(pcanSi->ioscanpvt);
-    } else if (pcanSi->status == TIMEOUT_ALARM) {
+    }
+}
+
+static void siDone (
+    void *private,
+    int status,
+    const canMessage_t *pmessage
+) {
+    siCanPrivate_t *pcanSi = private;
+
+    if (pcanSi->status != TIMEOUT_ALARM) return;
+
+    if (status == 0 &&
+	(pcanSi->inp->offset == 1) &&
+	(pcanSi->inp->parameter != pmessage->data[0])) {
+	/* Reply for another subaddress, ask again in the time left */
+	epicsTimeStamp now;
+	double left;
+
+	epicsTimeGetCurrent(&now);
+	left = pcanSi->inp->timeout -
+	       epicsTimeDiffInSeconds(&now, &pcanSi->requested);
+	if ((left > 0 || pcanSi->inp->timeout < 0) &&
+	    canReadAsync(pcanSi->inp->canBusID, pcanSi->inp->identifier,
+			 siDone, pcanSi, left) == 0)
+	    return;
+	status = S_can_timeout;
+    }
+
+    if (status == 0) {
 	pcanSi->status = NO_ALARM;
-	epicsTimerCancel(pcanSi->timId);
-	callbackRequest(&pcanSi->callback);
     }
+    callbackRequest(&pcanSi->callback);
 }
 
 static void busSignal (
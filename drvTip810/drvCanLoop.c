@@ -0,0 +1,800 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    drvCanLoop.c
+
+Description:
+    Software loopback CAN bus driver.  Each loopback bus is attached to a
+    named net, and every message written to any bus on a net is received
+    by all the buses on that net, including the sender, just as every node
+    on a real CAN segment sees every frame.  There is no hardware, so the
+    whole CAN record stack can be run in a soft IOC on any host, to try
+    out databases or to load test the device support.  RTRs are answered
+    by whatever has registered a callback for the identifier, such as the
+    output records' device support.  Extended 29-bit identifiers can be
+    used.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <epicsTypes.h>
+#include <epicsMutex.h>
+#include <epicsMessageQueue.h>
+#include <epicsThread.h>
+#include <epicsTime.h>
+#include <epicsStdio.h>
+#include <drvSup.h>
+#include <iocsh.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+#include "canDispatch.h"
+#include "canPending.h"
+#include "canStats.h"
+#include "drvCanLoop.h"
+
+
+#define LOOP_Q_SIZE 1000	/* Default num messages to buffer per bus */
+#define LOOP_BATCH 32		/* Max messages dispatched per table use */
+#define LOOP_PRIORITY epicsThreadPriorityHigh
+
+
+/* EPICS Driver Support Entry Table */
+
+struct drvet drvCanLoop = {
+    2,
+    (DRVSUPFUN) canLoopReport,
+    (DRVSUPFUN) canLoopInitialise
+};
+epicsExportAddress(drvet, drvCanLoop);
+
+
+typedef struct loopNet_s {
+    struct loopNet_s *pnext;
+    struct loopDev_s *pfirst;		/* Buses on this net */
+    const char *pnetName;
+} loopNet_t;
+
+typedef struct loopSig_s {
+    struct loopSig_s *pnext;
+    canSigCallback_t *pcallback;
+    void *pprivate;
+} loopSig_t;
+
+typedef struct loopDev_s {
+    struct loopDev_s *pnext;		/* All loopback buses */
+    struct loopDev_s *pnextOnNet;	/* Buses on the same net */
+    loopNet_t *pnet;
+    const char *pbusName;
+    int queueSize;			/* Max messages recvQ can hold */
+    epicsMessageQueueId recvQ;		/* Messages for the receive task */
+    canDispatcherID_t dispatcher;	/* message callbacks, by ID */
+    canPendingID_t pending;		/* canRead replies awaited, by ID */
+    volatile int stopped;		/* canBusStop called */
+    epicsMutexId lock;			/* Protects everything below */
+    loopSig_t *psignal;			/* error signal callbacks */
+    canStats_t stats;			/* Receive counters are kept by
+					   the receive task, the rest
+					   under the lock */
+} loopDev_t;
+
+
+static loopDev_t *ploopFirst = NULL;
+static loopNet_t *ploopNets = NULL;
+static int loopRunning = FALSE;		/* Set by canLoopInitialise */
+
+/* Entry routines for the canBus interface */
+static int loopBusReset(void *pdev);
+static int loopBusStop(void *pdev);
+static int loopBusRestart(void *pdev);
+static int loopWrite(void *pdev, const canMessage_t *pmessage,
+		double timeout);
+static int loopWriteNotify(void *pdev, const canMessage_t *pmessage,
+		canTxCallback_t *pcallback, void *pprivate, double timeout);
+static int loopMessage(void *pdev, canID_t identifier,
+		canMsgCallback_t *pcallback, void *pprivate);
+static int loopMsgDelete(void *pdev, canID_t identifier,
+		canMsgCallback_t *pcallback, void *pprivate);
+static int loopSignal(void *pdev, canSigCallback_t *pcallback,
+		void *pprivate);
+static int loopRead(void *pdev, canMessage_t *pmessage, double timeout);
+static int loopReadAsync(void *pdev, canID_t identifier,
+		canReadCallback_t *pcallback, void *pprivate, double timeout);
+static const canStats_t *loopStats(void *pdev);
+
+static const canDriver_t loopDriver = {
+    "Loopback",
+    loopBusReset,
+    loopBusStop,
+    loopBusRestart,
+    loopWrite,
+    loopWriteNotify,
+    loopMessage,
+    loopMsgDelete,
+    loopSignal,
+    loopRead,
+    loopReadAsync,
+    loopStats
+};
+
+
+/*******************************************************************************
+
+Routine:
+    badIdentifier
+
+Purpose:
+    Check a standard or extended message identifier
+
+Returns:
+    TRUE if the identifier is out of range.
+
+*/
+
+static int badIdentifier (
+    canID_t identifier
+) {
+    if (identifier & CAN_ID_EXTENDED) {
+	return (identifier & ~CAN_ID_EXTENDED) >= CAN_EXT_IDENTIFIERS;
+    }
+    return identifier >= CAN_IDENTIFIERS;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    loopFree
+
+Purpose:
+    Free a bus that canLoopCreate couldn't finish
+
+Description:
+    Destroys whatever has been created for the bus, which must not yet
+    have been linked into a net or the list of buses, then frees it.
+
+Returns:
+    void
+
+*/
+
+static void loopFree (
+    loopDev_t *pdevice
+) {
+    if (pdevice->recvQ) epicsMessageQueueDestroy(pdevice->recvQ);
+    if (pdevice->lock) epicsMutexDestroy(pdevice->lock);
+    if (pdevice->dispatcher) canDispatcherDestroy(pdevice->dispatcher);
+    if (pdevice->pending) canPendingDestroy(pdevice->pending);
+    free(pdevice);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canLoopCreate
+
+Purpose:
+    Register a new loopback bus
+
+Description:
+    Creates a loopback bus and registers its name with the CAN bus
+    registry.  The bus is attached to the net called netName, which is
+    created if this is its first bus; an empty or NULL netName gives the
+    bus a net of its own, named after the bus.  Each bus buffers up to
+    queueSize received messages for its receive task, a zero queueSize
+    selecting the default; messages arriving when the buffer is full are
+    lost and counted.  Buses must be created before iocInit.
+
+Returns:
+    0, or
+    S_can_badParameter if called after iocInit or queueSize is negative,
+    ENOMEM if memory could not be allocated,
+    any result from canBusRegister().
+
+Example:
+    canLoopCreate "LOOP1", "net1", 0
+
+*/
+
+int canLoopCreate (
+    const char *pbusName,
+    const char *pnetName,
+    int queueSize
+) {
+    loopDev_t *pdevice, **ppdevice;
+    loopNet_t *pnet, *pnewNet = NULL;
+    int status;
+
+    if (loopRunning ||
+	queueSize < 0 ||
+	pbusName == NULL) {
+	return S_can_badParameter;
+    }
+    if (pnetName == NULL ||
+	*pnetName == '\0') {
+	pnetName = pbusName;
+    }
+
+    pdevice = calloc(1, sizeof(loopDev_t));
+    if (pdevice == NULL) {
+	return ENOMEM;
+    }
+    pdevice->pbusName = pbusName;
+    pdevice->queueSize = queueSize ? queueSize : LOOP_Q_SIZE;
+    pdevice->recvQ = epicsMessageQueueCreate(pdevice->queueSize,
+					     sizeof(canMessage_t));
+    pdevice->lock = epicsMutexCreate();
+    canStatsInit(&pdevice->stats, 0);
+    if (pdevice->recvQ == NULL ||
+	pdevice->lock == NULL ||
+	canDispatcherCreate(pbusName, &pdevice->dispatcher) ||
+	canPendingCreate(&pdevice->pending)) {
+	loopFree(pdevice);
+	return ENOMEM;
+    }
+
+    for (pnet = ploopNets; pnet != NULL; pnet = pnet->pnext) {
+	if (strcmp(pnet->pnetName, pnetName) == 0) break;
+    }
+    if (pnet == NULL) {
+	pnet = pnewNet = calloc(1, sizeof(loopNet_t) + strlen(pnetName) + 1);
+	if (pnet == NULL) {
+	    loopFree(pdevice);
+	    return ENOMEM;
+	}
+	pnet->pnetName = strcpy((char *) (pnet + 1), pnetName);
+    }
+
+    status = canBusRegister(pbusName, &loopDriver, pdevice);
+    if (status) {
+	free(pnewNet);
+	loopFree(pdevice);
+	return status;
+    }
+
+    /* Nothing can fail now, link everything in */
+    if (pnewNet != NULL) {
+	pnewNet->pnext = ploopNets;
+	ploopNets = pnewNet;
+    }
+    pdevice->pnet = pnet;
+    pdevice->pnextOnNet = pnet->pfirst;
+    pnet->pfirst = pdevice;
+    for (ppdevice = &ploopFirst; *ppdevice != NULL;
+	 ppdevice = &(*ppdevice)->pnext);
+    *ppdevice = pdevice;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canLoopReport
+
+Purpose:
+    Report status of all loopback buses
+
+Description:
+    Prints the name and net of each bus.  Interest level 1 adds the
+    message counters, queue use and receive latency, and level 2 the
+    dispatch table and the busiest identifiers.
+
+Returns:
+    0
+
+Example:
+    canLoopReport 1
+
+*/
+
+int canLoopReport (
+    int interest
+) {
+    loopDev_t *pdevice;
+
+    for (pdevice = ploopFirst; pdevice != NULL; pdevice = pdevice->pnext) {
+	printf("  '%s' : Loopback on net '%s'%s\n", pdevice->pbusName,
+	       pdevice->pnet->pnetName, pdevice->stopped ? ", stopped" : "");
+	if (interest < 1) continue;
+
+	epicsMutexLock(pdevice->lock);
+	printf("\tMessages Sent       : %5u\n", pdevice->stats.txFrames);
+	printf("\tMessages Received   : %5u\n", pdevice->stats.rxFrames);
+	printf("\tDiscarded Messages  : %5u\n", pdevice->stats.unused);
+	printf("\tLost, queue full    : %5u\n", pdevice->stats.lost);
+	printf("\tAborted, bus stopped: %5u\n", pdevice->stats.aborts);
+	printf("\tReceive queue holds %d messages, %d waiting, max %u.\n",
+	       pdevice->queueSize,
+	       epicsMessageQueuePending(pdevice->recvQ),
+	       pdevice->stats.recvMaxQueued);
+	epicsMutexUnlock(pdevice->lock);
+	canPendingReport(pdevice->pending);
+	canStatsReport(&pdevice->stats, 1);
+
+	if (interest > 1) {
+	    canDispatcherReport(pdevice->dispatcher, 1);
+	    canStatsReport(&pdevice->stats, 2);
+	}
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    loopRecvTask
+
+Purpose:
+    Receive task
+
+Description:
+    One of these tasks is started by canLoopInitialise for each bus.  It
+    takes messages from the bus's queue, runs the callbacks registered
+    for each one's identifier and completes any reads waiting for it.
+    The dispatch table is entered once for up to LOOP_BATCH messages.  An
+    empty message only wakes the task, so the dispatcher's epoch moves on
+    after a callback change even on a quiet bus.
+
+Returns:
+    void
+
+*/
+
+static void loopRecvTask (
+    void *pdev
+) {
+    loopDev_t *pdevice = pdev;
+    const canDispatchTable_t *ptable;
+    canMessage_t message;
+    epicsTimeStamp now;
+    int size, batch, queued;
+
+    while (TRUE) {
+	size = epicsMessageQueueReceive(pdevice->recvQ, &message,
+					sizeof(canMessage_t));
+	ptable = canDispatchEnter(pdevice->dispatcher);
+
+	queued = epicsMessageQueuePending(pdevice->recvQ) + 1;
+	pdevice->stats.recvQueued = queued;
+	if ((epicsUInt32) queued > pdevice->stats.recvMaxQueued) {
+	    pdevice->stats.recvMaxQueued = queued;
+	}
+
+	batch = 0;
+	while (size == sizeof(canMessage_t)) {
+	    epicsTimeGetCurrent(&now);
+	    canStatsRx(&pdevice->stats, &message,
+		       epicsTimeDiffInSeconds(&now, &message.timestamp));
+	    if (canDispatch(ptable, &message) == 0) {
+		pdevice->stats.unused++;
+	    }
+	    canPendingComplete(pdevice->pending, &message);
+	    /* Stop before fetching a message that this batch can't take */
+	    if (++batch == LOOP_BATCH) break;
+	    size = epicsMessageQueueTryReceive(pdevice->recvQ, &message,
+					       sizeof(canMessage_t));
+	}
+	canDispatchLeave(pdevice->dispatcher);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    canLoopInitialise
+
+Purpose:
+    Start the loopback buses
+
+Description:
+    Called by iocInit through the drvCanLoop driver table; starts a
+    receive task for each bus.
+
+Returns:
+    0, or
+    S_can_badParameter if a task couldn't be started.
+
+*/
+
+int canLoopInitialise (
+    void
+) {
+    loopDev_t *pdevice;
+    int status = 0;
+
+    for (pdevice = ploopFirst; pdevice != NULL; pdevice = pdevice->pnext) {
+	char taskName[32];
+
+	epicsSnprintf(taskName, sizeof(taskName), "canLoop:%s",
+		      pdevice->pbusName);
+	if (epicsThreadCreate(taskName, LOOP_PRIORITY,
+			      epicsThreadGetStackSize(epicsThreadStackMedium),
+			      loopRecvTask, pdevice) == 0) {
+	    printf("canLoop: Can't start receive task for bus '%s'\n",
+		   pdevice->pbusName);
+	    status = S_can_badParameter;
+	}
+    }
+    loopRunning = TRUE;
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    loopBusReset, loopBusStop, loopBusRestart
+
+Purpose:
+    Reset, stop or restart a loopback bus
+
+Description:
+    A stopped bus neither sends nor receives messages.  loopBusStop tells
+    the error signal callbacks that the bus is off, and loopBusRestart
+    that it is OK again.  loopBusReset also clears the counters.
+
+Returns:
+    0
+
+*/
+
+static void signalAll (
+    loopDev_t *pdevice,
+    int status
+) {
+    loopSig_t *psig;
+
+    epicsMutexLock(pdevice->lock);
+    for (psig = pdevice->psignal; psig != NULL; psig = psig->pnext) {
+	(*psig->pcallback)(psig->pprivate, status);
+    }
+    epicsMutexUnlock(pdevice->lock);
+}
+
+static int loopBusReset (
+    void *pdev
+) {
+    loopDev_t *pdevice = pdev;
+
+    epicsMutexLock(pdevice->lock);
+    canStatsClear(&pdevice->stats);
+    epicsMutexUnlock(pdevice->lock);
+    canPendingClear(pdevice->pending);
+    return loopBusRestart(pdevice);
+}
+
+static int loopBusStop (
+    void *pdev
+) {
+    loopDev_t *pdevice = pdev;
+
+    pdevice->stopped = TRUE;
+    signalAll(pdevice, CAN_BUS_OFF);
+    return 0;
+}
+
+static int loopBusRestart (
+    void *pdev
+) {
+    loopDev_t *pdevice = pdev;
+
+    pdevice->stopped = FALSE;
+    signalAll(pdevice, CAN_BUS_OK);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    loopWriteNotify, loopWrite
+
+Purpose:
+    Send a message to every bus on the net
+
+Description:
+    Timestamps a copy of the message and puts it on the receive queue of
+    each running bus on the sender's net, the sender included.  A bus
+    whose queue is full loses the message, as a controller would overrun.
+    Sending never waits, so the timeout is not used, and the completion
+    routine is called before loopWriteNotify returns.
+
+Returns:
+    0, or
+    S_can_badMessage for bad identifier, message length or rtr value,
+    S_can_txAborted if the bus is stopped.
+
+*/
+
+static int loopWriteNotify (
+    void *pdev,
+    const canMessage_t *pmessage,
+    canTxCallback_t *pcallback,
+    void *pprivate,
+    double timeout
+) {
+    loopDev_t *pdevice = pdev, *pdest;
+    canMessage_t message;
+
+    if (badIdentifier(pmessage->identifier) ||
+	pmessage->length > CAN_DATA_SIZE ||
+	(pmessage->rtr != SEND && pmessage->rtr != RTR)) {
+	return S_can_badMessage;
+    }
+
+    if (pdevice->stopped) {
+	epicsMutexLock(pdevice->lock);
+	pdevice->stats.aborts++;
+	epicsMutexUnlock(pdevice->lock);
+	return S_can_txAborted;
+    }
+
+    message = *pmessage;
+    epicsTimeGetCurrent(&message.timestamp);
+
+    for (pdest = pdevice->pnet->pfirst; pdest != NULL;
+	 pdest = pdest->pnextOnNet) {
+	if (pdest->stopped) continue;
+	if (epicsMessageQueueTrySend(pdest->recvQ, &message,
+				     sizeof(canMessage_t))) {
+	    epicsMutexLock(pdest->lock);
+	    pdest->stats.lost++;
+	    epicsMutexUnlock(pdest->lock);
+	}
+    }
+
+    epicsMutexLock(pdevice->lock);
+    canStatsTx(&pdevice->stats, &message);
+    epicsMutexUnlock(pdevice->lock);
+
+    if (pcallback != NULL) {
+	(*pcallback)(pprivate, 0);
+    }
+    return 0;
+}
+
+static int loopWrite (
+    void *pdev,
+    const canMessage_t *pmessage,
+    double timeout
+) {
+    return loopWriteNotify(pdev, pmessage, NULL, NULL, timeout);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    loopMessage, loopMsgDelete, loopSignal
+
+Purpose:
+    Register and remove callbacks
+
+Description:
+    Message callbacks are held by the bus's dispatcher.  After a change
+    the receive task is woken with an empty message so that the old
+    dispatch table can be freed.  Error signal callbacks are called by
+    canBusStop, canBusRestart and canBusReset.
+
+Returns:
+    0, or
+    S_can_badMessage for bad identifier or NULL callback routine,
+    S_can_noMessage for no matching message callback,
+    ENOMEM if malloc() fails.
+
+*/
+
+static int loopMessage (
+    void *pdev,
+    canID_t identifier,
+    canMsgCallback_t *pcallback,
+    void *pprivate
+) {
+    loopDev_t *pdevice = pdev;
+    int status;
+
+    if (badIdentifier(identifier) ||
+	pcallback == NULL) {
+	return S_can_badMessage;
+    }
+
+    status = canDispatcherAdd(pdevice->dispatcher, identifier, pcallback,
+			      pprivate);
+    if (status == 0 && loopRunning) {
+	epicsMessageQueueTrySend(pdevice->recvQ, &status, 0);
+    }
+    return status;
+}
+
+static int loopMsgDelete (
+    void *pdev,
+    canID_t identifier,
+    canMsgCallback_t *pcallback,
+    void *pprivate
+) {
+    loopDev_t *pdevice = pdev;
+    int status;
+
+    if (badIdentifier(identifier) ||
+	pcallback == NULL) {
+	return S_can_badMessage;
+    }
+
+    status = canDispatcherDelete(pdevice->dispatcher, identifier, pcallback,
+				 pprivate);
+    if (status == 0 && loopRunning) {
+	epicsMessageQueueTrySend(pdevice->recvQ, &status, 0);
+    }
+    return status;
+}
+
+static int loopSignal (
+    void *pdev,
+    canSigCallback_t *pcallback,
+    void *pprivate
+) {
+    loopDev_t *pdevice = pdev;
+    loopSig_t *psig = malloc(sizeof(loopSig_t));
+
+    if (psig == NULL) {
+	return ENOMEM;
+    }
+    psig->pcallback = pcallback;
+    psig->pprivate = pprivate;
+
+    epicsMutexLock(pdevice->lock);
+    psig->pnext = pdevice->psignal;
+    pdevice->psignal = psig;
+    epicsMutexUnlock(pdevice->lock);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    loopStats
+
+Purpose:
+    Return the traffic statistics of a loopback bus
+
+Description:
+    There is no ISR and no bus rate, so the ISR time and bus load are
+    always zero.  The receive latency is the time each message spent in
+    the receive queue.
+
+Returns:
+    Pointer to the statistics.
+
+*/
+
+static const canStats_t *loopStats (
+    void *pdev
+) {
+    loopDev_t *pdevice = pdev;
+
+    return &pdevice->stats;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    loopRead, loopReadAsync
+
+Purpose:
+    Send a Remote Transmission Request and get the reply
+
+Description:
+    The request is entered in the bus's pending read table (see
+    canPending.c) before its RTR is sent.  loopRead then waits for the
+    reply; loopReadAsync returns at once, and its completion routine is
+    called from the receive task with the reply or from the canTimerQ
+    thread with S_can_timeout.  A negative timeout waits forever.
+    Replies only arrive once iocInit has started the receive tasks.
+
+Returns:
+    0, or
+    S_can_badMessage for bad identifier, length or NULL callback routine,
+    S_can_timeout if loopRead got no reply in time,
+    ENOMEM if an event, timer or entry could not be created,
+    any error status from loopWrite().
+
+*/
+
+static int loopRead (
+    void *pdev,
+    canMessage_t *pmessage,
+    double timeout
+) {
+    loopDev_t *pdevice = pdev;
+
+    if (badIdentifier(pmessage->identifier) ||
+	pmessage->length > CAN_DATA_SIZE) {
+	return S_can_badMessage;
+    }
+
+    return canPendingRead(pdevice->pending, loopWrite, pdevice,
+			  pmessage, timeout);
+}
+
+static int loopReadAsync (
+    void *pdev,
+    canID_t identifier,
+    canReadCallback_t *pcallback,
+    void *pprivate,
+    double timeout
+) {
+    loopDev_t *pdevice = pdev;
+
+    if (badIdentifier(identifier) ||
+	pcallback == NULL) {
+	return S_can_badMessage;
+    }
+
+    return canPendingReadAsync(pdevice->pending, loopWrite, pdevice,
+			       identifier, pcallback, pprivate, timeout);
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* canLoopCreate(const char *busName, const char *netName, int queueSize) */
+static const iocshArg canLoopCreateArg0 = {"busName",iocshArgPersistentString};
+static const iocshArg canLoopCreateArg1 = {"netName",iocshArgPersistentString};
+static const iocshArg canLoopCreateArg2 = {"queueSize", iocshArgInt};
+static const iocshArg * const canLoopCreateArgs[3] = {
+    &canLoopCreateArg0, &canLoopCreateArg1, &canLoopCreateArg2};
+static const iocshFuncDef canLoopCreateFuncDef =
+    {"canLoopCreate",3,canLoopCreateArgs};
+static void canLoopCreateCallFunc(const iocshArgBuf *args)
+{
+    int status = canLoopCreate(args[0].sval, args[1].sval, args[2].ival);
+    if (status) {
+	printf("canLoopCreate: Error %#x\n", status);
+    }
+}
+
+/* canLoopReport(int interest) */
+static const iocshArg canLoopReportArg0 = {"interest", iocshArgInt};
+static const iocshArg * const canLoopReportArgs[1] = {&canLoopReportArg0};
+static const iocshFuncDef canLoopReportFuncDef =
+    {"canLoopReport",1,canLoopReportArgs};
+static void canLoopReportCallFunc(const iocshArgBuf *args)
+{
+    canLoopReport(args[0].ival);
+}
+
+static void drvCanLoopRegistrar(void) {
+    iocshRegister(&canLoopCreateFuncDef,canLoopCreateCallFunc);
+    iocshRegister(&canLoopReportFuncDef,canLoopReportCallFunc);
+}
+epicsExportRegistrar(drvCanLoopRegistrar);
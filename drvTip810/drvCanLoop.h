@@ -0,0 +1,40 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    drvCanLoop.h
+
+Description:
+    Header file for the software loopback CAN bus driver.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#ifndef INCdrvCanLoopH
+#define INCdrvCanLoopH
+
+#include "shareLib.h"
+
+
+epicsShareFunc int canLoopCreate(const char *busName, const char *netName,
+				 int queueSize);
+epicsShareFunc int canLoopReport(int interest);
+epicsShareFunc int canLoopInitialise(void);
+
+#endif /* INCdrvCanLoopH */
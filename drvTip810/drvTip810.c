@@ -36,7 +36,6 @@ Copyright (c) 1995-2007 Andrew Johnson
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
 #include <errno.h>
 
 #include <epicsTypes.h>
@@ -47,12 +46,18 @@ Copyright (c) 1995-2007 Andrew Johnson
 #include <epicsEvent.h>
 #include <epicsMutex.h>
 #include <epicsTimer.h>
+#include <epicsTime.h>
 #include <epicsThread.h>
 #include <epicsInterrupt.h>
-#include <epicsMessageQueue.h>
+#include <epicsRingBytes.h>
+#include <epicsStdio.h>
+#include <errlog.h>
 #include <epicsExport.h>
 
 #include "canBus.h"
+#include "canDispatch.h"
+#include "canPending.h"
+#include "canStats.h"
 #include "drvTip810.h"
 #include "drvIpac.h"
 #include "pca82c200.h"
@@ -60,7 +65,16 @@ Copyright (c) 1995-2007 Andrew Johnson
 
 /* Some local magic numbers */
 #define T810_MAGIC_NUMBER 81001
-#define RECV_Q_SIZE 1000	/* Num messages to buffer */
+#define RECV_Q_SIZE 1000	/* Default num messages to buffer per bus */
+#define RECV_PRIORITY epicsThreadPriorityHigh	/* Default receive task */
+#define TX_Q_SIZE 64		/* Default num messages to queue for sending */
+#define RECV_BATCH 32		/* Default max messages per receive drain */
+#define RECV_BATCH_BINS 12	/* Batch size histogram bins, powers of 2 */
+#define FILTER_GROUPS (CAN_IDENTIFIERS >> PCA_MSG_ID0_RSHIFT)
+				/* IDs sharing an acceptance code value */
+#define FILTER_NONE 0xff	/* Code which passes only the illegal IDs
+				   0x7f8 - 0x7ff, with a zero mask */
+#define PROFILE_TOP 10		/* Default IDs listed by t810ProfileReport */
 
 /* These are the IPAC IDs for this module */
 #define IP_MANUFACTURER_TEWS 0xb3 
@@ -76,20 +90,64 @@ struct drvet drvTip810 = {
 };
 epicsExportAddress(drvet, drvTip810);
 
-epicsTimerQueueId canTimerQ = NULL;
-
-
 typedef void callback_t(void *pprivate, long parameter);
 
-typedef struct callbackTable_s {
-    struct callbackTable_s *pnext;	/* linked list ... */
+typedef struct {
     void *pprivate;			/* reference for callback routine */
     callback_t *pcallback;		/* registered routine */
+} callbackEntry_t;
+
+/* Signal callback tables are never changed once published.  A new table
+ * replaces the old one, which is freed once the ISR has been seen to pass
+ * through two epoch changes, so it never needs a lock.  Message callbacks
+ * are held the same way by the bus's canDispatch dispatcher. */
+typedef struct retired_s {
+    struct retired_s *pnext;		/* list waiting to be freed */
+    volatile unsigned *pepoch;		/* epoch of the table's reader */
+    unsigned epoch;			/* its value when retired */
+} retired_t;
+
+typedef struct {
+    retired_t retired;			/* Must be first member */
+    int count;				/* entries in handler[] */
+    callbackEntry_t handler[1];		/* actually count entries */
 } callbackTable_t;
 
+typedef struct {
+    canMessage_t message;		/* message to send */
+    canTxCallback_t *pcallback;		/* completion routine, may be NULL */
+    void *pprivate;			/* reference for completion routine */
+    unsigned waitSeq;			/* blocking canWrite number, 0 = none */
+} txEntry_t;
+
+/* Per-ID profiler counters.  The receive task writes the rx, gap and
+ * callback members, the ISR the tx members. */
+typedef struct {
+    epicsUInt32 rxFrames;		/* messages received */
+    epicsUInt32 rxBytes;		/*   their data bytes */
+    epicsUInt32 rxBits;			/*   and estimated bits on the bus */
+    epicsUInt32 rtrs;			/* of which RTRs */
+    epicsUInt32 txFrames;		/* messages sent */
+    epicsUInt32 txBits;			/*   and their bits on the bus */
+    epicsTimeStamp lastArrival;		/* of the last message received */
+    double gapMin;			/* inter-arrival times, seconds */
+    double gapMax;
+    double gapSum;			/*   over rxFrames - 1 gaps */
+    double callbackTime;		/* total callback time, seconds */
+    double callbackMax;			/*   and the longest */
+} profileEntry_t;
+
+typedef struct {
+    volatile int enabled;		/* counting */
+    epicsTimeStamp started;		/* when enabled */
+    epicsTimeStamp stopped;		/* when last disabled */
+    profileEntry_t entry[CAN_IDENTIFIERS];
+} t810Profile_t;
+
 
-typedef struct canBusID_s {
-    struct canBusID_s *pnext;	/* To next device. Must be first member */
+
+typedef struct t810Dev_s {
+    struct t810Dev_s *pnext;	/* To next device. Must be first member */
     int magicNumber;		/* device pointer confirmation */
     char *pbusName;		/* Bus identification */
     int card;			/* Industry Pack address */
@@ -97,32 +155,87 @@ typedef struct canBusID_s {
     int irqNum; 		/* interrupt vector number */
     int busRate;		/* bit rate of bus in Kbits/sec */
     pca82c200_t *pchip;		/* controller registers */
-    epicsEventId txSem;		/* Transmit complete signal */
-    int txCount;		/* messages transmitted */
-    int rxCount;		/* messages received */
-    int overCount;		/* overrun - lost messages */
-    int unusedCount;		/* messages without callback */
+    epicsEventId txSem;		/* Transmit queue space available signal */
+    txEntry_t *ptxQueue;	/* Transmit FIFO, drained by the ISR */
+    int txQueueSize;		/* Max messages ptxQueue can hold */
+    int txHead;			/* Index of next message to send */
+    int txQueued;		/* Messages waiting in ptxQueue */
+    int txBusy;			/* Chip is sending txCurrent */
+    txEntry_t txCurrent;	/* Message in the chip transmit buffer */
+    int txBlocking;		/* canWrite waits for transmission */
+    epicsMutexId txWaitSem;	/* Blocking canWrite task Mutex */
+    epicsEventId txDoneSem;	/* Blocking canWrite completion signal */
+    int txDoneStatus;		/* Blocking canWrite completion status */
+    unsigned txSequence;	/* Number of the last blocking canWrite */
+    unsigned txWaitSeq;		/* Number of the one waiting, 0 if none */
+    canStats_t stats;		/* Traffic counters, for canBusStats */
     canID_t unusedId;		/* last ID received without a callback */
-    int errorCount;		/* Times entered Error state */
-    int busOffCount;		/* Times entered Bus Off state */
-    epicsMutexId readSem;	/* canRead task Mutex */
-    canMessage_t *preadBuffer;	/* canRead destination buffer */
-    epicsEventId rxSem;		/* canRead message arrival signal */
-    callbackTable_t *pmsgHandler[CAN_IDENTIFIERS];	/* message callbacks */
+    canPendingID_t pending;	/* canRead replies awaited, by ID */
+    epicsRingBytesId recvRing;	/* ISR -> receive task message buffer */
+    epicsEventId recvSignal;	/* Wakes receive task after ISR puts */
+    int recvQueueSize;		/* Max messages recvRing can hold */
+    int recvPriority;		/* Receive task priority */
+    int recvBatchSize;		/* Max messages taken from recvRing at once */
+    canMessage_t *precvBatch;	/* Receive task's drain buffer */
+    unsigned long recvBatchHist[RECV_BATCH_BINS];  /* Batch sizes, log2 */
+    int filterEnable;		/* Acceptance filter follows the handlers */
+    int filterUsers[FILTER_GROUPS];	/* Handlers and reads per ID group */
+    char filterRead[FILTER_GROUPS];	/* Group has been opened for reads */
+    epicsMutexId filterSem;	/* Protects filterUsers */
+    epicsUInt8 filterCode;	/* Acceptance code and mask wanted, */
+    epicsUInt8 filterMask;	/*   which the chip may not have yet */
+    int filterPending;		/* Chip busy, reprogram it from the ISR */
+    int filterChanges;		/* Times the chip has been reprogrammed */
+    epicsMutexId handlerSem;	/* Serialises callback table changes */
+    retired_t *pretired;	/* Replaced tables not yet freed */
+    int retiredCount;		/* Tables waiting in pretired */
+    volatile unsigned isrEpoch;	/* Odd while the ISR is running */
+    canDispatcherID_t dispatcher;	/* message callbacks, by ID */
+    t810Profile_t * volatile pprofile;	/* Per-ID profiler, never freed */
     callbackTable_t *psigHandler;	/* error signal callbacks */
 } t810Dev_t;
 
-typedef struct {
-   t810Dev_t *pdevice;
-   canMessage_t message;
-} t810Receipt_t;
-
 
 static t810Dev_t *pt810First = NULL;
-static epicsMessageQueueId receiptQueue = NULL;
+static t810Dev_t **pt810Index = NULL;	/* ISR parameter -> device */
+static int t810Running = FALSE;		/* Set by t810Initialise */
+static int filterRecording = FALSE;	/* Recorder has opened the filters */
+
+/* Entry routines for the canBus interface */
+static int t810BusReset(void *pdev);
+static int t810BusStop(void *pdev);
+static int t810BusRestart(void *pdev);
+static int t810Write(void *pdev, const canMessage_t *pmessage,
+		double timeout);
+static int t810WriteNotify(void *pdev, const canMessage_t *pmessage,
+		canTxCallback_t *pcallback, void *pprivate, double timeout);
+static int t810Message(void *pdev, canID_t identifier,
+		canMsgCallback_t *pcallback, void *pprivate);
+static int t810MsgDelete(void *pdev, canID_t identifier,
+		canMsgCallback_t *pcallback, void *pprivate);
+static int t810Signal(void *pdev, canSigCallback_t *pcallback,
+		void *pprivate);
+static int t810Read(void *pdev, canMessage_t *pmessage, double timeout);
+static int t810ReadAsync(void *pdev, canID_t identifier,
+		canReadCallback_t *pcallback, void *pprivate, double timeout);
+static const canStats_t *t810Stats(void *pdev);
+
+static const canDriver_t t810Driver = {
+    "TIP810",
+    t810BusReset,
+    t810BusStop,
+    t810BusRestart,
+    t810Write,
+    t810WriteNotify,
+    t810Message,
+    t810MsgDelete,
+    t810Signal,
+    t810Read,
+    t810ReadAsync,
+    t810Stats
+};
 
-int canSilenceErrors = FALSE;	/* for EPICS device support use */
-int t810maxQueued = 0;		/* not static so may be reset by operator */
+t810RecordHook_t *t810RecordHook = NULL;	/* Traffic recorder, if any */
 
 /*******************************************************************************
 
@@ -144,8 +257,8 @@ Returns:
 int t810Status (
     canBusID_t canBusID
 ) {
-    t810Dev_t *pdevice = canBusID;
-    if (canBusID != 0 &&
+    t810Dev_t *pdevice = canBusDevice(canBusID, &t810Driver);
+    if (pdevice != NULL &&
 	pdevice->magicNumber == T810_MAGIC_NUMBER) {
 	return pdevice->pchip->status;
     } else {
@@ -154,6 +267,35 @@ int t810Status (
 }
 
 
+/*******************************************************************************
+
+Routine:
+    t810Find
+
+Purpose:
+    Look up a TIP810 bus by name
+
+Returns:
+    0, or
+    S_can_noDevice if no bus has the given name,
+    S_t810_badDevice if the bus is not a TIP810.
+
+*/
+
+static int t810Find (
+    const char *pbusName,
+    t810Dev_t **ppdevice
+) {
+    canBusID_t busID;
+    int status = canOpen(pbusName, &busID);
+
+    if (status) return status;
+
+    *ppdevice = canBusDevice(busID, &t810Driver);
+    return *ppdevice ? 0 : S_t810_badDevice;
+}
+
+
 /*******************************************************************************
 
 Routine:
@@ -177,21 +319,16 @@ int t810Report (
     int interest
 ) {
     t810Dev_t *pdevice = pt810First;
-    canID_t id;
-    int printed;
+    const canStats_t *pstats;
     int status;
-
-    if (interest > 0) {
-	printf("  Receive queue holds %d messages, max %d = %d %% used.\n", 
-		RECV_Q_SIZE, t810maxQueued, 
-		(100 * t810maxQueued) / RECV_Q_SIZE);
-    }
+    int bin;
 
     while (pdevice != NULL) {
 	if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
 	    printf("t810 device list is corrupt\n");
 	    return S_t810_badDevice;
 	}
+	pstats = &pdevice->stats;
 
 	printf("  '%s' : IP Carrier %hd Slot %hd, Bus rate %d Kbits/sec\n", 
 		pdevice->pbusName, pdevice->card, pdevice->slot, 
@@ -199,34 +336,68 @@ int t810Report (
 
 	switch (interest) {
 	    case 1:
-		printf("\tMessages Sent       : %5d\n", pdevice->txCount);
-		printf("\tMessages Received   : %5d\n", pdevice->rxCount);
-		printf("\tMessage Overruns    : %5d\n", pdevice->overCount);
-		printf("\tDiscarded Messages  : %5d\n", pdevice->unusedCount);
-		if (pdevice->unusedCount > 0) {
+		printf("\tMessages Sent       : %5u\n", pstats->txFrames);
+		printf("\tMessages Received   : %5u\n", pstats->rxFrames);
+		printf("\tMessage Overruns    : %5u\n", pstats->overruns);
+		printf("\tDiscarded Messages  : %5u\n", pstats->unused);
+		if (pstats->unused > 0) {
 		    printf("\tLast Discarded ID   : %#5x\n", pdevice->unusedId);
 		}
-		printf("\tError Interrupts    : %5d\n", pdevice->errorCount);
-		printf("\tBus Off Events      : %5d\n", pdevice->busOffCount);
-		break;
-
-	    case 2:
-		printed = 0;
-		printf("\tCallbacks registered: ");
-		for (id=0; id < CAN_IDENTIFIERS; id++) {
-		    if (pdevice->pmsgHandler[id] != NULL) {
-			if (printed % 10 == 0) {
-			    printf("\n\t    ");
-			}
-			printf("0x%-3hx  ", id);
-			printed++;
+		if (pdevice->filterEnable && filterRecording) {
+		    printf("\tAcceptance filter   : Open while recording\n");
+		} else if (pdevice->filterEnable) {
+		    int passed = 1 << PCA_MSG_ID0_RSHIFT;
+		    int groups = 0;
+
+		    for (bin = 0; bin < 8; bin++) {
+			if (pdevice->filterMask & (1 << bin)) passed <<= 1;
+		    }
+		    for (bin = 0; bin < FILTER_GROUPS; bin++) {
+			if (pdevice->filterUsers[bin]) groups++;
 		    }
+		    printf("\tAcceptance filter   : code %#04x mask %#04x, "
+			   "%d changes%s\n", pdevice->filterCode,
+			   pdevice->filterMask, pdevice->filterChanges,
+			   pdevice->filterPending ? ", change pending" : "");
+		    printf("\tFilter passes %d groups of %d IDs for %d in use "
+			   "= %d %% efficient.\n", passed >> PCA_MSG_ID0_RSHIFT,
+			   1 << PCA_MSG_ID0_RSHIFT, groups,
+			   (100 * (groups << PCA_MSG_ID0_RSHIFT)) / passed);
+		} else {
+		    printf("\tAcceptance filter   : Disabled, all IDs pass\n");
 		}
-		if (printed == 0) {
-		    printf("None.");
+		printf("\tError Interrupts    : %5u\n", pstats->errors);
+		printf("\tBus Off Events      : %5u\n", pstats->busOffs);
+		printf("\tQueue Overflows     : %5u\n", pstats->lost);
+		printf("\tReceive queue holds %d messages, max %u = %u %% used.\n",
+			pdevice->recvQueueSize, pstats->recvMaxQueued,
+			(100 * pstats->recvMaxQueued) / pdevice->recvQueueSize);
+		canStatsReport(pstats, 1);
+		printf("\tReceive batch sizes, max %d:", pdevice->recvBatchSize);
+		for (bin = 0; bin < RECV_BATCH_BINS; bin++) {
+		    if (pdevice->recvBatchHist[bin] == 0) continue;
+		    if (bin == 0) {
+			printf(" 1:%lu", pdevice->recvBatchHist[bin]);
+		    } else if (bin == RECV_BATCH_BINS - 1) {
+			printf(" %d+:%lu", 1 << bin, pdevice->recvBatchHist[bin]);
+		    } else {
+			printf(" %d-%d:%lu", 1 << bin, (2 << bin) - 1,
+			       pdevice->recvBatchHist[bin]);
+		    }
 		}
-		printf("\n\tcanRead Status : %s\n", 
-			pdevice->preadBuffer ? "Active" : "Idle");
+		printf("\n");
+		printf("\tTransmit queue holds %d messages, max %u = %u %% used.\n",
+			pdevice->txQueueSize, pstats->txMaxQueued,
+			(100 * pstats->txMaxQueued) / pdevice->txQueueSize);
+		break;
+
+	    case 2:
+		canDispatcherReport(pdevice->dispatcher, 1);
+		canStatsReport(pstats, 2);
+		canPendingReport(pdevice->pending);
+		printf("\tcanWrite Mode  : %s, %d queued\n",
+			pdevice->txBlocking ? "Blocking" : "Queued",
+			pdevice->txQueued);
 		break;
 
 	    case 3:
@@ -257,6 +428,41 @@ int t810Report (
 }
 
 
+/*******************************************************************************
+
+Routine:
+    t810Free
+
+Purpose:
+    Free a device table that t810Create couldn't finish
+
+Description:
+    Destroys whatever has been created in the table, which must have
+    been filled in up to the checks of the resources, then frees it.
+
+Returns:
+    void
+
+*/
+
+static void t810Free (
+    t810Dev_t *pdevice
+) {
+    if (pdevice->txSem) epicsEventDestroy(pdevice->txSem);
+    if (pdevice->filterSem) epicsMutexDestroy(pdevice->filterSem);
+    if (pdevice->handlerSem) epicsMutexDestroy(pdevice->handlerSem);
+    if (pdevice->recvSignal) epicsEventDestroy(pdevice->recvSignal);
+    if (pdevice->recvRing) epicsRingBytesDelete(pdevice->recvRing);
+    if (pdevice->txWaitSem) epicsMutexDestroy(pdevice->txWaitSem);
+    if (pdevice->txDoneSem) epicsEventDestroy(pdevice->txDoneSem);
+    if (pdevice->dispatcher) canDispatcherDestroy(pdevice->dispatcher);
+    if (pdevice->pending) canPendingDestroy(pdevice->pending);
+    free(pdevice->precvBatch);
+    free(pdevice->ptxQueue);
+    free(pdevice);
+}
+
+
 /*******************************************************************************
 
 Routine:
@@ -266,19 +472,21 @@ Purpose:
     Register a new TIP810 device
 
 Description:
-    Checks that the given name and card/slot numbers are unique, then
-    creates a new device table, initialises it and adds it to the end
-    of the linked list.
+    Checks that the given card/slot numbers are unique, then creates a
+    new device table, initialises it, registers the bus name with the
+    CAN bus registry and adds it to the end of the linked list.  Each
+    device gets its own receive queue and task; a zero recvQueueSize or
+    recvPriority selects the default.
 
 Returns:
     0,
     ENOMEM if malloc() fails,
     S_t810_badBusRate for an unsupported bus rate,
     S_t810_duplicateDevice if card/slot already used,
-    any result from ipmValidate().
+    any result from canBusRegister() or ipmValidate().
 
 Example:
-    t810Create "CAN1", 0, 0, 0x60, 500
+    t810Create "CAN1", 0, 0, 0x60, 500, 2000, 0
 
 */
 
@@ -287,7 +495,9 @@ int t810Create (
     int card,		/* Ipac Driver card .. */
     int slot,		/* .. and slot number */
     int irqNum, 	/* interrupt vector number */
-    int busRate 	/* in Kbits/sec */
+    int busRate, 	/* in Kbits/sec */
+    int recvQueueSize,	/* messages to buffer, 0 = default */
+    int recvPriority	/* receive task priority, 0 = default */
 ) {
     static const struct {
 	int rate;
@@ -311,7 +521,7 @@ int t810Create (
 	{ 0,	0,		0		}
     };
     t810Dev_t *pdevice, *plist = (t810Dev_t *) &pt810First;
-    int status, rateIndex, id;
+    int status, rateIndex;
 
     status = ipmValidate(card, slot, IP_MANUFACTURER_TEWS, 
 			 IP_MODEL_TEWS_TIP810);
@@ -330,11 +540,16 @@ int t810Create (
     }
     /* Bus rate is legal and we now know the right chip settings */
 
+    if (recvQueueSize < 0 ||
+	recvPriority < epicsThreadPriorityMin ||
+	recvPriority > epicsThreadPriorityMax) {
+	return S_t810_badParameter;
+    }
+
     while (plist->pnext != NULL) {
 	plist = plist->pnext;
-	if (strcmp(plist->pbusName, pbusName) == 0 || 
-	    (plist->card == card && 
-	     plist->slot == slot)) {
+	if (plist->card == card &&
+	    plist->slot == slot) {
 	    return S_t810_duplicateDevice;
 	}
     }
@@ -354,29 +569,71 @@ int t810Create (
     pdevice->irqNum      = irqNum;
     pdevice->busRate     = busRate;
     pdevice->pchip       = (pca82c200_t *) ipmBaseAddr(card, slot, ipac_addrIO);
-    pdevice->preadBuffer = NULL;
     pdevice->psigHandler = NULL;
-
-    for (id=0; id<CAN_IDENTIFIERS; id++) {
-	pdevice->pmsgHandler[id] = NULL;
-    }
-
-    pdevice->txSem   = epicsEventCreate(epicsEventFull);
-    pdevice->rxSem   = epicsEventCreate(epicsEventEmpty);
-    pdevice->readSem = epicsMutexCreate();
+    pdevice->pretired    = NULL;
+    pdevice->retiredCount = 0;
+    pdevice->isrEpoch    = 0;
+    pdevice->pprofile    = NULL;
+    pdevice->recvQueueSize = recvQueueSize ? recvQueueSize : RECV_Q_SIZE;
+    pdevice->recvPriority  = recvPriority ? recvPriority : RECV_PRIORITY;
+    pdevice->recvBatchSize = RECV_BATCH;
+    memset(pdevice->recvBatchHist, 0, sizeof(pdevice->recvBatchHist));
+    pdevice->filterEnable = FALSE;
+    memset(pdevice->filterUsers, 0, sizeof(pdevice->filterUsers));
+    memset(pdevice->filterRead, 0, sizeof(pdevice->filterRead));
+    pdevice->filterCode = 0;		/* Pass everything */
+    pdevice->filterMask = 0xff;
+    pdevice->filterPending = FALSE;
+    pdevice->filterChanges = 0;
+    pdevice->txQueueSize = TX_Q_SIZE;
+    pdevice->txHead      = 0;
+    pdevice->txQueued    = 0;
+    pdevice->txBusy      = FALSE;
+    pdevice->txBlocking  = FALSE;
+    pdevice->txSequence  = 0;
+    pdevice->txWaitSeq   = 0;
+
+    canStatsInit(&pdevice->stats, busRate);
+
+    pdevice->txSem   = epicsEventCreate(epicsEventEmpty);
+    pdevice->filterSem = epicsMutexCreate();
+    pdevice->handlerSem = epicsMutexCreate();
+    pdevice->recvSignal = epicsEventCreate(epicsEventEmpty);
+    pdevice->recvRing  = epicsRingBytesCreate(pdevice->recvQueueSize *
+					      sizeof(canMessage_t));
+    pdevice->precvBatch = calloc(pdevice->recvBatchSize, sizeof(canMessage_t));
+    pdevice->ptxQueue  = calloc(pdevice->txQueueSize, sizeof(txEntry_t));
+    pdevice->txWaitSem = epicsMutexCreate();
+    pdevice->txDoneSem = epicsEventCreate(epicsEventEmpty);
+    pdevice->dispatcher = NULL;
+    pdevice->pending = NULL;
     if (pdevice->txSem == NULL ||
-	pdevice->rxSem == NULL ||
-	pdevice->readSem == NULL) {
-	free(pdevice);		/* Ought to free those semaphores, but... */
+	pdevice->ptxQueue == NULL ||
+	pdevice->txWaitSem == NULL ||
+	pdevice->txDoneSem == NULL ||
+	pdevice->filterSem == NULL ||
+	pdevice->handlerSem == NULL ||
+	pdevice->recvSignal == NULL ||
+	pdevice->recvRing == NULL ||
+	pdevice->precvBatch == NULL ||
+	canDispatcherCreate(pbusName, &pdevice->dispatcher) ||
+	canPendingCreate(&pdevice->pending)) {
+	t810Free(pdevice);
 	return ENOMEM;
     }
 
+    status = canBusRegister(pbusName, &t810Driver, pdevice);
+    if (status) {
+	t810Free(pdevice);
+	return status;
+    }
+
     plist->pnext = pdevice;
     /* device table interface stuff filled in and added to list */
 
     pdevice->pchip->control        = PCA_CR_RR;	/* Reset state */
-    pdevice->pchip->acceptanceCode = 0;
-    pdevice->pchip->acceptanceMask = 0xff;
+    pdevice->pchip->acceptanceCode = pdevice->filterCode;
+    pdevice->pchip->acceptanceMask = pdevice->filterMask;
     pdevice->pchip->busTiming0     = rateTable[rateIndex].busTiming0;
     pdevice->pchip->busTiming1     = rateTable[rateIndex].busTiming1;
     pdevice->pchip->outputControl  = PCA_OCR_OCM_NORMAL |
@@ -514,385 +771,432 @@ static void putTxMessage (
 /*******************************************************************************
 
 Routine:
-    doCallbacks
+    txStart
 
 Purpose:
-    calls all routines in the given list
+    Start sending the next queued message
 
 Description:
-
+    If the chip is running and its transmit buffer is free, takes the
+    message at the head of the transmit queue and gives it to the chip.
+    Must be called from the ISR or with interrupts locked out.
 
 Returns:
     void
 
 */
 
-static void doCallbacks (
-    callbackTable_t *phandler,
-    long parameter
+static void txStart (
+    t810Dev_t *pdevice
 ) {
-    while (phandler != NULL) {
-	(*phandler->pcallback)(phandler->pprivate, parameter);
-	phandler = phandler->pnext;
+    if (pdevice->txBusy ||
+	pdevice->txQueued == 0 ||
+	(pdevice->pchip->control & PCA_CR_RR) ||
+	!(pdevice->pchip->status & PCA_SR_TBS)) {
+	return;
     }
+
+    pdevice->txCurrent = pdevice->ptxQueue[pdevice->txHead];
+    if (++pdevice->txHead >= pdevice->txQueueSize) {
+	pdevice->txHead = 0;
+    }
+    pdevice->stats.txQueued = --pdevice->txQueued;
+    pdevice->txBusy = TRUE;
+
+    putTxMessage(pdevice->pchip, &pdevice->txCurrent.message);
 }
 
 
 /*******************************************************************************
 
 Routine:
-    t810ISR
+    txNotify
 
 Purpose:
-    Interrupt Service Routine
+    Wake the blocking canWrite that queued a message
 
 Description:
-
+    Each blocking canWrite numbers its message, and the completion is only
+    passed on if that canWrite is still the one waiting; a caller that
+    has timed out clears txWaitSeq, so the late completion of its message
+    cannot wake the next caller.  The test and the signal are made with
+    interrupts locked out, so must be called from the ISR or with
+    interrupts locked.
 
 Returns:
     void
 
 */
 
-static void t810ISR (
-    int pdev
+static void txNotify (
+    t810Dev_t *pdevice,
+    const txEntry_t *pentry,
+    int status
 ) {
-    t810Dev_t *pdevice = (t810Dev_t *) pdev;
-    int intSource = pdevice->pchip->interrupt;
-
-    if (intSource & PCA_IR_OI) {		/* Overrun Interrupt */
-        pdevice->overCount++;
-        canBusStop(pdevice->pbusName);		/* Reset the chip but not */
-        canBusRestart(pdevice->pbusName);	/* all the counters */
-
-	intSource = pdevice->pchip->interrupt;	/* Rescan interrupts */
+    if (pentry->waitSeq == 0 ||
+	pentry->waitSeq != pdevice->txWaitSeq) {
+	return;
     }
+    pdevice->txWaitSeq = 0;
+    pdevice->txDoneStatus = status;
+    epicsEventSignal(pdevice->txDoneSem);
+}
 
-    if (intSource & PCA_IR_RI) {		/* Receive Interrupt */
-	t810Receipt_t qmsg;
 
-	/* Take a local copy of the message */
-	qmsg.pdevice = pdevice;
-	getRxMessage(pdevice->pchip, &qmsg.message);
+/*******************************************************************************
 
-	/* Send it to the servicing task */
-	if (epicsMessageQueueTrySend(receiptQueue, &qmsg,
-				sizeof(t810Receipt_t)) && !canSilenceErrors)
-	    epicsInterruptContextMessage("Warning: CANbus receive queue overflow");
-    }
+Routine:
+    txDone
 
-    if (intSource & PCA_IR_EI) {		/* Error Interrupt */
-	callbackTable_t *phandler = pdevice->psigHandler;
-	int status;
+Purpose:
+    Finish with the message in the chip transmit buffer
 
-	switch (pdevice->pchip->status & (PCA_SR_ES | PCA_SR_BS)) {
-	    case PCA_SR_ES:
-		status = CAN_BUS_ERROR;
-		pdevice->errorCount++;
-		if (!canSilenceErrors)
-		    epicsInterruptContextMessage("t810ISR: CANbus error event");
-		break;
-	    case PCA_SR_BS:
-	    case PCA_SR_BS | PCA_SR_ES:
-		status = CAN_BUS_OFF;
-		pdevice->busOffCount++;
-		epicsEventSignal(pdevice->txSem);	/* Signal transmit */
-		pdevice->pchip->control &= ~PCA_CR_RR;	/* Clear Reset state */
-		if (!canSilenceErrors)
-		    epicsInterruptContextMessage("t810ISR: CANbus off event");
-		break;
-	    default:
-		status = CAN_BUS_OK;
-		if (!canSilenceErrors)
-		    epicsInterruptContextMessage("t810ISR: CANbus OK");
-		break;
-	}
+Description:
+    Calls the completion routine for the message which the chip was
+    sending, if there is one, then starts the next queued message and
+    wakes any task waiting for queue space.  Called from the ISR.
 
-	doCallbacks(phandler, status);
-    }
+Returns:
+    void
 
-    if (intSource & PCA_IR_TI) {		/* Transmit Interrupt */
-	pdevice->txCount++;
-	epicsEventSignal(pdevice->txSem);
+*/
+
+static void txDone (
+    t810Dev_t *pdevice,
+    int status
+) {
+    if (!pdevice->txBusy) {
+	return;
     }
+    pdevice->txBusy = FALSE;
 
-    if (intSource & PCA_IR_WUI) {		/* Wake-up Interrupt */
-	if (!canSilenceErrors)
-	    epicsInterruptContextMessage("Wake-up Interrupt from CANbus");
+    txNotify(pdevice, &pdevice->txCurrent, status);
+    if (pdevice->txCurrent.pcallback != NULL) {
+	(*pdevice->txCurrent.pcallback)(pdevice->txCurrent.pprivate, status);
     }
+    txStart(pdevice);
+    epicsEventSignal(pdevice->txSem);
 }
 
 
 /*******************************************************************************
 
 Routine:
-    t810RecvTask
+    txAbort
 
 Purpose:
-    Receive task
+    Recover the transmit queue after the chip has been reset
 
 Description:
-    This routine is a background task started by t810Initialise. It
-    takes messages out of the receive queue one by one and runs the
-    callbacks registered against the relevent message ID.
+    A chip reset abandons any transmission in progress, so the completion
+    routine of the message being sent is told it was aborted and the
+    next queued message is started.
 
 Returns:
-    int
+    void
 
 */
 
-static void t810RecvTask(void *dummy) {
-    t810Receipt_t rmsg;
-    callbackTable_t *phandler;
-    int numQueued;
-
-    if (receiptQueue == 0) {
-	fprintf(stderr, "CANbus Receive queue does not exist, task exiting.\n");
-	return;
+static void txAbort (
+    t810Dev_t *pdevice
+) {
+    txEntry_t aborted;
+    int wasBusy;
+    int key = epicsInterruptLock();
+
+    wasBusy = pdevice->txBusy;
+    if (wasBusy) {
+	aborted = pdevice->txCurrent;
+	pdevice->txBusy = FALSE;
+	pdevice->stats.aborts++;
+	txNotify(pdevice, &aborted, S_can_txAborted);
     }
-    printf("CANbus receive task started\n");
-
-    while (TRUE) {
-	numQueued = epicsMessageQueuePending(receiptQueue);
-        if (numQueued > t810maxQueued) t810maxQueued = numQueued;
-
-	epicsMessageQueueReceive(receiptQueue, &rmsg, sizeof(t810Receipt_t));
-	rmsg.pdevice->rxCount++;
+    txStart(pdevice);
+    epicsInterruptUnlock(key);
 
-	/* Look up the message ID and do the message callbacks */
-	phandler = rmsg.pdevice->pmsgHandler[rmsg.message.identifier];
-	if (phandler == NULL) {
-	    rmsg.pdevice->unusedId = rmsg.message.identifier;
-	    rmsg.pdevice->unusedCount++;
-	} else {
-	    doCallbacks(phandler, (long) &rmsg.message);
-	}
-
-	/* If canRead is waiting for this ID, give it the message and kick it */
-	if (rmsg.pdevice->preadBuffer != NULL &&
-	    rmsg.pdevice->preadBuffer->identifier == rmsg.message.identifier) {
-	    memcpy(rmsg.pdevice->preadBuffer, &rmsg.message, 
-		   sizeof(canMessage_t));
-	    rmsg.pdevice->preadBuffer = NULL;
-	    epicsEventSignal(rmsg.pdevice->rxSem);
-	}
-   }
+    if (wasBusy && aborted.pcallback != NULL) {
+	(*aborted.pcallback)(aborted.pprivate, S_can_txAborted);
+    }
+    epicsEventSignal(pdevice->txSem);
 }
 
+
 /*******************************************************************************
 
 Routine:
-    t810Initialise
+    filterApply
 
 Purpose:
-    Initialise driver and all registered hardware
+    Load the wanted acceptance filter into the chip
 
 Description:
-    Under EPICS this routine is called by iocInit, which must occur
-    after all t810Create calls in the startup script.  It completes the
-    initialisation of the CAN controller chip and interrupt vector
-    registers for all known TIP810 devices and starts the chips
-    running.  The receive queue is created and its processing task is
-    started to handle incoming data.  An exit hook is used to make
-    sure all interrupts are turned off when the IOC is shut down.
+    The acceptance registers can only be written in the chip's reset
+    state, and entering it abandons any frame being sent or received and
+    empties the receive buffer.  If the chip is running this only resets
+    it when it is neither sending nor receiving a frame, its transmitter
+    has nothing queued and its receive buffer is empty; otherwise it sets
+    filterPending and the ISR tries again after the next interrupt.  Must
+    be called with interrupts locked out.
 
 Returns:
-    int
+    void
 
 */
 
-int t810Initialise (
-    void
+static void filterApply (
+    t810Dev_t *pdevice
 ) {
-    t810Dev_t *pdevice = pt810First;
-    int status = 0;
+    pca82c200_t *pchip = pdevice->pchip;
+    int control = pchip->control;
 
-    epicsAtExit(t810Shutdown, NULL);
+    if (!(control & PCA_CR_RR)) {
+	if (pdevice->txBusy ||
+	    (pchip->status & (PCA_SR_RBS | PCA_SR_RS | PCA_SR_TS))) {
+	    pdevice->filterPending = TRUE;
+	    return;
+	}
+	pchip->control = control | PCA_CR_RR;
+    }
+    pchip->acceptanceCode = pdevice->filterCode;
+    pchip->acceptanceMask = pdevice->filterMask;
+    pchip->control = control;
 
-    receiptQueue = epicsMessageQueueCreate(RECV_Q_SIZE, sizeof(t810Receipt_t));
-    canTimerQ = epicsTimerQueueAllocate(1, epicsThreadPriorityLow);
-    if (receiptQueue == NULL ||
-	canTimerQ == NULL) return ENOMEM;
+    pdevice->filterPending = FALSE;
+    pdevice->filterChanges++;
+}
 
-    if (epicsThreadCreate("canRecvTask", epicsThreadPriorityHigh,
-			  epicsThreadGetStackSize(epicsThreadStackMedium),
-			  t810RecvTask, NULL) == 0) return -1;
 
-    while (pdevice != NULL) {
-	pdevice->txCount     = 0;
-	pdevice->rxCount     = 0;
-	pdevice->overCount   = 0;
-	pdevice->unusedCount = 0;
-	pdevice->errorCount  = 0;
-	pdevice->busOffCount = 0;
+/*******************************************************************************
 
-	status = ipmIntConnect(pdevice->card, pdevice->slot, pdevice->irqNum,
-			       t810ISR, (int)pdevice);
+Routine:
+    filterUpdate
 
-	/* The TIP810's intVec register is external to the PCA82C200 chip */
-	*((epicsUInt8 *) pdevice->pchip + 0x41) = pdevice->irqNum;
+Purpose:
+    Recalculate the acceptance filter after a change of users
 
-	ipmIrqCmd(pdevice->card, pdevice->slot, 0, ipac_irqEnable);
+Description:
+    Adds users to the count for the group of 8 IDs that share identifier's
+    acceptance code value, then finds the tightest code and mask that pass
+    every group with a user.  The code is taken from one group in use, and
+    the mask has a bit set wherever any other group in use differs from it.
+    With no users the filter passes only illegal IDs, and with filtering
+    disabled or the traffic recorder running it passes everything.  The
+    chip is only reprogrammed if the code or mask changes.  canMessage
+    and canMsgDelete change the users whenever they are called, which can
+    be at any time, plus filterRead once for each group that is read, so
+    with filtering enabled a bus whose callbacks come and go has its chip
+    reset each time.
 
-	pdevice->pchip->control = PCA_CR_OIE |
-				  PCA_CR_EIE |
-				  PCA_CR_TIE |
-				  PCA_CR_RIE;
+Returns:
+    void
 
-	pdevice = pdevice->pnext;
+*/
+
+static void filterUpdate (
+    t810Dev_t *pdevice,
+    canID_t identifier,
+    int users
+) {
+    epicsUInt8 code = FILTER_NONE;
+    epicsUInt8 mask = 0;
+    int group, first = -1;
+    int key;
+
+    epicsMutexLock(pdevice->filterSem);
+    pdevice->filterUsers[identifier >> PCA_MSG_ID0_RSHIFT] += users;
+
+    if (!pdevice->filterEnable || filterRecording) {
+	code = 0;
+	mask = 0xff;
+    } else {
+	for (group = 0; group < FILTER_GROUPS; group++) {
+	    if (pdevice->filterUsers[group] == 0) continue;
+	    if (first < 0) {
+		first = group;
+	    } else {
+		mask |= group ^ first;
+	    }
+	}
+	if (first >= 0) {
+	    code = first & ~mask;
+	}
     }
-    return status;
+
+    key = epicsInterruptLock();
+    if (code != pdevice->filterCode ||
+	mask != pdevice->filterMask) {
+	pdevice->filterCode = code;
+	pdevice->filterMask = mask;
+	filterApply(pdevice);
+    }
+    epicsInterruptUnlock(key);
+    epicsMutexUnlock(pdevice->filterSem);
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canOpen
+    filterRead
 
 Purpose:
-    Return device pointer for given CAN bus name
+    Open the acceptance filter for a canRead reply
 
 Description:
-    Searches through the linked list of known t810 devices for one
-    which matches the name given, and returns the device pointer
-    associated with the relevant device table.
+    The first read of an ID adds a user to its group, which is never
+    removed again.  Reads are normally repeated polls of the same IDs, and
+    closing the group after each reply would reset the chip twice per
+    read, losing any frames in flight.
 
 Returns:
-    0, or S_can_noDevice if no match found.
-
-Example:
-    void *can1;
-    status = canOpen("CAN1", &can1);
+    void
 
 */
 
-int canOpen (
-    const char *pbusName,
-    canBusID_t *pbusID
+static void filterRead (
+    t810Dev_t *pdevice,
+    canID_t identifier
 ) {
-    t810Dev_t *pdevice = pt810First;
+    int group = identifier >> PCA_MSG_ID0_RSHIFT;
 
-    while (pdevice != NULL) {
-	if (strcmp(pdevice->pbusName, pbusName) == 0) {
-	    *pbusID = pdevice;
-	    return 0;
-	}
-	pdevice = pdevice->pnext;
+    if (pdevice->filterRead[group]) return;
+
+    epicsMutexLock(pdevice->filterSem);
+    if (!pdevice->filterRead[group]) {
+	pdevice->filterRead[group] = TRUE;
+	filterUpdate(pdevice, identifier, 1);	/* filterSem is recursive */
     }
-    return S_can_noDevice;
+    epicsMutexUnlock(pdevice->filterSem);
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canBusReset
+    handlerReclaim
 
 Purpose:
-    Reset named CANbus
+    frees replaced callback tables that no reader can still be using
 
 Description:
-    Resets the chip and connected to the named bus and all counters
+    A table retired while its reader was dispatching may still be in use
+    until that dispatch ends, so it is only freed once the reader's epoch
+    counter has moved on by at least two.  Called with handlerSem held.
 
 Returns:
-    0, or S_can_noDevice if no match found.
-
-Example:
-    status = canBusReset("CAN1");
+    void
 
 */
 
-int canBusReset (
-    const char *pbusName
+static void handlerReclaim (
+    t810Dev_t *pdevice
 ) {
-    t810Dev_t *pdevice;
-    int status = canOpen(pbusName, &pdevice);
-
-    if (status) return status;
+    retired_t **ppretired = &pdevice->pretired;
 
-    pdevice->pchip->control |=  PCA_CR_RR;    /* Reset the chip */
-    pdevice->txCount   = 0;
-    pdevice->rxCount   = 0;
-    pdevice->overCount   = 0;
-    pdevice->unusedCount = 0;
-    pdevice->errorCount  = 0;
-    pdevice->busOffCount = 0;
-    epicsEventSignal(pdevice->txSem);
-    pdevice->pchip->control = PCA_CR_OIE |
-			      PCA_CR_EIE |
-			      PCA_CR_TIE |
-			      PCA_CR_RIE;
+    while (*ppretired != NULL) {
+	retired_t *pretired = *ppretired;
 
-    return 0;
+	if (*pretired->pepoch - pretired->epoch >= 2) {
+	    *ppretired = pretired->pnext;
+	    free(pretired);
+	    pdevice->retiredCount--;
+	} else {
+	    ppretired = &pretired->pnext;
+	}
+    }
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canBusStop
+    handlerRetire
 
 Purpose:
-    Stop I/O on named CANbus
+    disposes of a table that has just been replaced
 
 Description:
-    Holds the chip for the named bus in Reset state
+    A reader that fetched the old table before it was replaced carries on
+    using it undisturbed, so it is put on the retired list for
+    handlerReclaim to free later.  pepoch is the epoch counter of the
+    table's reader.  Before t810Initialise there are no readers and the
+    table is freed at once.  Called with handlerSem held.
 
 Returns:
-    0, or S_can_noDevice if no match found.
-
-Example:
-    status = canBusStop("CAN1");
+    void
 
 */
 
-int canBusStop (
-    const char *pbusName
+static void handlerRetire (
+    t810Dev_t *pdevice,
+    retired_t *pold,
+    volatile unsigned *pepoch
 ) {
-    t810Dev_t *pdevice;
-    int status = canOpen(pbusName, &pdevice);
-
-    if (status) return status;
+    if (pold == NULL) return;
 
-    pdevice->pchip->control |=  PCA_CR_RR;    /* Reset the chip */
-    return 0;
+    if (!t810Running) {
+	free(pold);
+	return;
+    }
+    pold->pepoch = pepoch;
+    pold->epoch = *pepoch;
+    pold->pnext = pdevice->pretired;
+    pdevice->pretired = pold;
+    pdevice->retiredCount++;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canBusRestart
+    signalAdd
 
-Purpose: 
-    Restart I/O on named CANbus
+Purpose:
+    adds an entry to the error signal callback table
 
 Description:
-    Restarts the chip for the named bus after a canBusStop
-
-Returns: 
-    0, or S_can_noDevice if no match found.
+    Builds a copy of the signal table with the callback added to the end,
+    and then publishes the copy with a single pointer store.
 
-Example: 
-    status = canBusRestart("CAN1");
+Returns:
+    0,
+    ENOMEM if malloc() fails.
 
 */
 
-int canBusRestart (
-    const char *pbusName
+static int signalAdd (
+    t810Dev_t *pdevice,
+    callback_t *pcallback,
+    void *pprivate
 ) {
-    t810Dev_t *pdevice;
-    int status = canOpen(pbusName, &pdevice);
-
-    if (status) return status;
+    callbackTable_t *pold, *pnew;
+    int count;
+    int key;
+
+    epicsMutexLock(pdevice->handlerSem);
+    handlerReclaim(pdevice);
+
+    pold = pdevice->psigHandler;
+    count = pold ? pold->count : 0;
+    pnew = malloc(sizeof(callbackTable_t) + count * sizeof(callbackEntry_t));
+    if (pnew == NULL) {
+	epicsMutexUnlock(pdevice->handlerSem);
+	return ENOMEM;
+    }
+    if (count) {
+	memcpy(pnew->handler, pold->handler, count * sizeof(callbackEntry_t));
+    }
+    pnew->handler[count].pcallback = pcallback;
+    pnew->handler[count].pprivate  = pprivate;
+    pnew->count = count + 1;
 
-    pdevice->pchip->control = PCA_CR_OIE |
-			      PCA_CR_EIE |
-			      PCA_CR_TIE |
-			      PCA_CR_RIE;
-    epicsEventSignal(pdevice->txSem);
+    /* Publish; the interrupt lock orders the table contents before it */
+    key = epicsInterruptLock();
+    pdevice->psigHandler = pnew;
+    epicsInterruptUnlock(key);
 
+    handlerRetire(pdevice, (retired_t *) pold, &pdevice->isrEpoch);
+    epicsMutexUnlock(pdevice->handlerSem);
     return 0;
 }
 
@@ -900,213 +1204,1237 @@ int canBusRestart (
 /*******************************************************************************
 
 Routine:
-    strdupn
+    doCallbacks
 
 Purpose:
-    duplicate n characters of a string and return pointer to new substring
+    calls all routines in the given handler vector
 
 Description:
-    Copies n characters from the input string to a newly malloc'ed memory
-    buffer, and adds a trailing '\0', then returns the new string pointer.
+    The caller fetches the table pointer once and passes in its handlers,
+    so a table being replaced at the same time cannot affect the dispatch.
 
 Returns:
-    char *newString, or NULL if malloc failed.
+    void
 
 */
 
-static char* strdupn (
-    const char *ct,
-    size_t n
+static void doCallbacks (
+    const callbackEntry_t *phandler,
+    int count,
+    long parameter
 ) {
-    char *duplicate;
+    const callbackEntry_t *pend = phandler + count;
 
-    duplicate = malloc(n+1);
-    if (duplicate == NULL) {
-	return NULL;
+    for (; phandler < pend; phandler++) {
+	(*phandler->pcallback)(phandler->pprivate, parameter);
     }
-
-    memcpy(duplicate, ct, n);
-    duplicate[n] = '\0';
-
-    return duplicate;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canIoParse
+    t810ISR
 
 Purpose:
-    Parse a CAN address string into a canIo_t structure
+    Interrupt Service Routine
 
 Description:
-    canString which must match the format below is converted by this routine
-    into the relevent fields of the canIo_t structure pointed to by pcanIo:
 
-    	busname{/timeout}:id{+n}{.offset} parameter
-
-    where
-    	busname is alphanumeric, all other fields are hex, decimal or octal
-    	timeout is in milliseconds
-	id and any number of +n components are summed to give the CAN Id
-	offset is the byte offset into the message
-	parameter is a string or integer for use by device support
 
 Returns:
-    0, or
-    S_can_badAddress for illegal input strings,
-    ENOMEM if malloc() fails,
-    S_can_noDevice for an unregistered bus name.
+    void
+
+*/
+
+static void t810ISR (
+    int index
+) {
+    t810Dev_t *pdevice = pt810Index[index];
+    int intSource = pdevice->pchip->interrupt;
+    epicsTimeStamp entry;
+
+    pdevice->isrEpoch++;			/* Odd: may use psigHandler */
+    if (epicsTimeGetCurrentInt(&entry) != epicsTimeOK) {
+	entry.secPastEpoch = 0;			/* No ISR clock, the receive */
+	entry.nsec = 0;				/* task will stamp messages */
+    }
+
+    if (intSource & PCA_IR_OI) {		/* Overrun Interrupt */
+        pdevice->stats.overruns++;
+        t810BusStop(pdevice);			/* Reset the chip but not */
+        t810BusRestart(pdevice);		/* all the counters; not by
+						   name, canOpen may block */
+
+	intSource = pdevice->pchip->interrupt;	/* Rescan interrupts */
+    }
+
+    if (intSource & PCA_IR_RI) {		/* Receive Interrupt */
+	canMessage_t message;
+
+	/* Stamp the message with its arrival time and take a local copy */
+	message.timestamp = entry;
+	getRxMessage(pdevice->pchip, &message);
+
+	/* Hand it to this bus's receive task.  We are the only writer to
+	 * recvRing and the task is the only reader, so no lock is needed */
+	if (epicsRingBytesPut(pdevice->recvRing, (char *) &message,
+			      sizeof(canMessage_t)) == 0) {
+	    pdevice->stats.lost++;
+	    if (!canSilenceErrors)
+		epicsInterruptContextMessage("Warning: CANbus receive queue overflow");
+	}
+	epicsEventSignal(pdevice->recvSignal);
+    }
+
+    if (intSource & PCA_IR_EI) {		/* Error Interrupt */
+	callbackTable_t *phandler = pdevice->psigHandler;
+	int status;
+
+	switch (pdevice->pchip->status & (PCA_SR_ES | PCA_SR_BS)) {
+	    case PCA_SR_ES:
+		status = CAN_BUS_ERROR;
+		pdevice->stats.errors++;
+		if (!canSilenceErrors)
+		    epicsInterruptContextMessage("t810ISR: CANbus error event");
+		break;
+	    case PCA_SR_BS:
+	    case PCA_SR_BS | PCA_SR_ES:
+		status = CAN_BUS_OFF;
+		pdevice->stats.busOffs++;
+		pdevice->pchip->control &= ~PCA_CR_RR;	/* Clear Reset state */
+		txAbort(pdevice);			/* Restart transmit */
+		if (!canSilenceErrors)
+		    epicsInterruptContextMessage("t810ISR: CANbus off event");
+		break;
+	    default:
+		status = CAN_BUS_OK;
+		if (!canSilenceErrors)
+		    epicsInterruptContextMessage("t810ISR: CANbus OK");
+		break;
+	}
+
+	if (phandler != NULL) {
+	    doCallbacks(phandler->handler, phandler->count, status);
+	}
+    }
+
+    if (intSource & PCA_IR_TI) {		/* Transmit Interrupt */
+	if (pdevice->txBusy) {
+	    const canMessage_t *psent = &pdevice->txCurrent.message;
+	    t810Profile_t *pprofile = pdevice->pprofile;
+
+	    canStatsTx(&pdevice->stats, psent);
+	    if (pprofile != NULL && pprofile->enabled) {
+		profileEntry_t *pentry = &pprofile->entry[psent->identifier];
+
+		pentry->txFrames++;
+		pentry->txBits += canStatsBits(psent);
+	    }
+	}
+	txDone(pdevice, 0);
+    }
+
+    if (intSource & PCA_IR_WUI) {		/* Wake-up Interrupt */
+	if (!canSilenceErrors)
+	    epicsInterruptContextMessage("Wake-up Interrupt from CANbus");
+    }
+
+    if (pdevice->filterPending) {		/* Acceptance filter change */
+	filterApply(pdevice);
+    }
+
+    canStatsIsr(&pdevice->stats, &entry);
+    pdevice->isrEpoch++;			/* Even: finished with it */
+}
+
+
+/*******************************************************************************
+
+Routine:
+    profileRx
+
+Purpose:
+    Profile a received message
+
+Description:
+    Called by the receive task after it has dispatched a message, with
+    the time it started, to count the message against its ID along with
+    its time since the last one and the time its callbacks took.
+
+Returns:
+    void
+
+*/
+
+static void profileRx (
+    t810Profile_t *pprofile,
+    const canMessage_t *pmessage,
+    const epicsTimeStamp *pbefore
+) {
+    profileEntry_t *pentry = &pprofile->entry[pmessage->identifier];
+    epicsTimeStamp after;
+    double callback, gap;
+
+    epicsTimeGetCurrent(&after);
+    callback = epicsTimeDiffInSeconds(&after, pbefore);
+    pentry->callbackTime += callback;
+    if (callback > pentry->callbackMax)
+	pentry->callbackMax = callback;
+
+    if (pentry->rxFrames > 0) {
+	gap = epicsTimeDiffInSeconds(&pmessage->timestamp,
+				     &pentry->lastArrival);
+	pentry->gapSum += gap;
+	if (pentry->rxFrames == 1 || gap < pentry->gapMin)
+	    pentry->gapMin = gap;
+	if (gap > pentry->gapMax)
+	    pentry->gapMax = gap;
+    }
+    pentry->lastArrival = pmessage->timestamp;
+
+    pentry->rxFrames++;
+    pentry->rxBits += canStatsBits(pmessage);
+    if (pmessage->rtr == RTR) {
+	pentry->rtrs++;
+    } else {
+	pentry->rxBytes += pmessage->length;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    isrClock
+
+Purpose:
+    Read the clock that the ISR stamps messages with
+
+Description:
+    Receive latencies are only meaningful if both ends are measured with
+    the same time provider, so the receive task reads the ISR-safe clock
+    too.  On a target without one the ISR leaves messages unstamped, and
+    this falls back to epicsTimeGetCurrent.
+
+Returns:
+    TRUE if the ISR clock was read, FALSE if the fallback was used.
+
+*/
+
+static int isrClock (
+    epicsTimeStamp *pnow
+) {
+    if (epicsTimeGetCurrentInt(pnow) == epicsTimeOK) {
+	return TRUE;
+    }
+    epicsTimeGetCurrent(pnow);
+    return FALSE;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810RecvTask
+
+Purpose:
+    Receive task
+
+Description:
+    One of these tasks is started by t810Initialise for each device.
+    Each time the ISR signals it the task drains its device's receive
+    ring, running the callbacks registered against each message ID in
+    turn, so a busy or slow bus cannot hold up any of the others.
+    Messages are taken from the ring up to recvBatchSize at a time, and
+    the dispatch table is entered afresh for each batch, so replaced
+    tables can be freed and new callbacks are seen even while the ring
+    never empties.  The task is the only writer of the receive
+    statistics.  A message that the ISR could not stamp is given the time
+    it was taken from the ring, and is not counted in the latency
+    histogram.
+
+Returns:
+    void
+
+*/
+
+static void t810RecvTask(void *pdev) {
+    t810Dev_t *pdevice = (t810Dev_t *) pdev;
+    canMessage_t *pmessage;
+    const canDispatchTable_t *ptable;
+    t810RecordHook_t *precordHook;
+    t810Profile_t *pprofile;
+    int numQueued, numBatch, bin, clockOk;
+    double latency;
+    epicsTimeStamp now, before;
+
+    while (TRUE) {
+	epicsEventWait(pdevice->recvSignal);
+
+	while (TRUE) {
+	    /* Entered per batch, so the epoch moves on however busy the bus */
+	    ptable = canDispatchEnter(pdevice->dispatcher);
+
+	    numQueued = epicsRingBytesUsedBytes(pdevice->recvRing) /
+			sizeof(canMessage_t);
+	    pdevice->stats.recvQueued = numQueued;
+	    if (numQueued == 0) {
+		canDispatchLeave(pdevice->dispatcher);
+		break;
+	    }
+	    if ((epicsUInt32) numQueued > pdevice->stats.recvMaxQueued)
+		pdevice->stats.recvMaxQueued = numQueued;
+
+	    /* The ISR only ever puts whole messages into the ring */
+	    numBatch = epicsRingBytesGet(pdevice->recvRing,
+				(char *) pdevice->precvBatch,
+				pdevice->recvBatchSize * sizeof(canMessage_t)) /
+		       sizeof(canMessage_t);
+
+	    for (bin = 0; (numBatch >> bin) > 1 && bin < RECV_BATCH_BINS - 1;
+		 bin++);
+	    pdevice->recvBatchHist[bin]++;
+
+	    /* Time each message spent waiting in recvRing */
+	    clockOk = isrClock(&now);
+	    precordHook = t810RecordHook;
+	    pprofile = pdevice->pprofile;
+	    if (pprofile != NULL && !pprofile->enabled) pprofile = NULL;
+
+	    for (pmessage = pdevice->precvBatch;
+		 pmessage < pdevice->precvBatch + numBatch; pmessage++) {
+		if (pmessage->timestamp.secPastEpoch == 0 &&
+		    pmessage->timestamp.nsec == 0) {
+		    pmessage->timestamp = now;
+		    latency = -1.0;
+		} else if (clockOk) {
+		    latency = epicsTimeDiffInSeconds(&now, &pmessage->timestamp);
+		} else {
+		    latency = -1.0;
+		}
+		canStatsRx(&pdevice->stats, pmessage, latency);
+
+		if (precordHook != NULL) {
+		    (*precordHook)(pdevice->pbusName, FALSE, pmessage);
+		}
+
+		if (pprofile != NULL) {
+		    epicsTimeGetCurrent(&before);
+		}
+
+		/* Look up the message ID and do the message callbacks */
+		if (canDispatch(ptable, pmessage) == 0) {
+		    pdevice->unusedId = pmessage->identifier;
+		    pdevice->stats.unused++;
+		}
+
+		/* If reads are waiting for this ID, give them the message */
+		canPendingComplete(pdevice->pending, pmessage);
+
+		if (pprofile != NULL) {
+		    profileRx(pprofile, pmessage, &before);
+		}
+	    }
+	    canDispatchLeave(pdevice->dispatcher);
+	}
+    }
+}
+
+/*******************************************************************************
+
+Routine:
+    t810RecvInject
+
+Purpose:
+    Feed a message into a bus's receive path
+
+Description:
+    Adds a copy of the message to the bus's receive ring as if the chip had
+    just received it, so that it goes through the normal receive task
+    dispatch to the message callbacks and any waiting canRead.  The
+    timestamp is set to the current time, read from the ISR's clock.
+    Used to replay recorded traffic and for testing; the ring is shared
+    with the ISR, so the put is made with interrupts locked out.
+
+Returns:
+    0, or
+    S_t810_badDevice for bad device pointer,
+    S_can_badMessage for bad identifier, message length or rtr value,
+    S_t810_queueFull if the receive ring has no room.
+
+Example:
+    status = t810RecvInject(busID, &message);
+
+*/
+
+int t810RecvInject (
+    canBusID_t busID,
+    const canMessage_t *pmessage
+) {
+    t810Dev_t *pdevice = canBusDevice(busID, &t810Driver);
+    canMessage_t message;
+    int key, put;
+
+    if (pdevice == NULL) {
+	return S_t810_badDevice;
+    }
+
+    if (pmessage->identifier >= CAN_IDENTIFIERS ||
+	pmessage->length > CAN_DATA_SIZE ||
+	(pmessage->rtr != SEND && pmessage->rtr != RTR)) {
+	return S_can_badMessage;
+    }
+
+    message = *pmessage;
+    isrClock(&message.timestamp);
+
+    key = epicsInterruptLock();
+    put = epicsRingBytesPut(pdevice->recvRing, (char *) &message,
+			    sizeof(canMessage_t));
+    epicsInterruptUnlock(key);
+
+    if (put == 0) {
+	return S_t810_queueFull;
+    }
+    epicsEventSignal(pdevice->recvSignal);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810RecvSync
+
+Purpose:
+    Wait for the receive task to finish with deleted callbacks
+
+Description:
+    canMsgDelete() can return while the receive task is still running the
+    old callbacks for a batch of messages.  This waits until that batch
+    is done, after which the private data of callbacks deleted before the
+    call may be freed.  It must not be called from a message callback.
+
+Returns:
+    0, or
+    S_t810_badDevice for bad device pointer.
+
+Example:
+    canMsgDelete(busID, 0x123, myCallback, pme);
+    if (t810RecvSync(busID) == 0) free(pme);
+
+*/
+
+int t810RecvSync (
+    canBusID_t busID
+) {
+    t810Dev_t *pdevice = canBusDevice(busID, &t810Driver);
+
+    if (pdevice == NULL) {
+	return S_t810_badDevice;
+    }
+
+    canDispatcherSync(pdevice->dispatcher);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810Initialise
+
+Purpose:
+    Initialise driver and all registered hardware
+
+Description:
+    Under EPICS this routine is called by iocInit, which must occur
+    after all t810Create calls in the startup script.  It completes the
+    initialisation of the CAN controller chip and interrupt vector
+    registers for all known TIP810 devices and starts the chips
+    running.  A receive task is started for each device to handle its
+    incoming data; these are all created before any chip is started, so
+    if one can't be created every chip stays in reset.  A device whose
+    interrupt can't be connected is left in reset and the others are
+    started.  The ISR parameter is the device's index into the
+    pt810Index table rather than its address, since a pointer will not
+    fit into the int that drvIpac passes on 64-bit systems.  An exit
+    hook is used to make sure all interrupts are turned off when the
+    IOC is shut down.
+
+Returns:
+    0, or
+    ENOMEM if memory or a receive task couldn't be allocated,
+    the first error from ipmIntConnect().
+
+*/
+
+int t810Initialise (
+    void
+) {
+    t810Dev_t *pdevice = pt810First;
+    int status = 0;
+    int index = 0;
+
+    epicsAtExit(t810Shutdown, NULL);
+
+    while (pdevice != NULL) {
+	index++;
+	pdevice = pdevice->pnext;
+    }
+    pt810Index = calloc(index + 1, sizeof(t810Dev_t *));
+    if (pt810Index == NULL) return ENOMEM;
+
+    /* All the receive tasks first, so a failure leaves every chip in reset */
+    for (pdevice = pt810First; pdevice != NULL; pdevice = pdevice->pnext) {
+	char taskName[32];
+
+	epicsSnprintf(taskName, sizeof(taskName), "canRecv:%s",
+		      pdevice->pbusName);
+	if (epicsThreadCreate(taskName, pdevice->recvPriority,
+			      epicsThreadGetStackSize(epicsThreadStackMedium),
+			      t810RecvTask, pdevice) == 0) {
+	    errlogPrintf("t810Initialise: Can't start receive task for %s\n",
+			 pdevice->pbusName);
+	    return ENOMEM;
+	}
+    }
+
+    index = 0;
+    for (pdevice = pt810First; pdevice != NULL; pdevice = pdevice->pnext) {
+	int connect;
+
+	canStatsClear(&pdevice->stats);
+
+	pt810Index[index] = pdevice;
+	connect = ipmIntConnect(pdevice->card, pdevice->slot, pdevice->irqNum,
+				t810ISR, index++);
+	if (connect) {
+	    /* Without its ISR the chip stays in reset; report the first */
+	    if (status == 0) status = connect;
+	    continue;
+	}
+
+	/* The TIP810's intVec register is external to the PCA82C200 chip */
+	*((epicsUInt8 *) pdevice->pchip + 0x41) = pdevice->irqNum;
+
+	ipmIrqCmd(pdevice->card, pdevice->slot, 0, ipac_irqEnable);
+
+	pdevice->pchip->control = PCA_CR_OIE |
+				  PCA_CR_EIE |
+				  PCA_CR_TIE |
+				  PCA_CR_RIE;
+    }
+
+    t810Running = TRUE;
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810BusReset
+
+Purpose:
+    Reset a TIP810 bus
+
+Description:
+    Resets the chip and all the counters of a TIP810 bus
+
+Returns:
+    0
+
+*/
+
+static int t810BusReset (
+    void *pdev
+) {
+    t810Dev_t *pdevice = pdev;
+
+    pdevice->pchip->control |=  PCA_CR_RR;    /* Reset the chip */
+    canStatsClear(&pdevice->stats);
+    memset(pdevice->recvBatchHist, 0, sizeof(pdevice->recvBatchHist));
+    canPendingClear(pdevice->pending);
+    pdevice->pchip->control = PCA_CR_OIE |
+			      PCA_CR_EIE |
+			      PCA_CR_TIE |
+			      PCA_CR_RIE;
+    txAbort(pdevice);
+
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810BusStop
+
+Purpose:
+    Stop I/O on a TIP810 bus
+
+Description:
+    Holds the chip in Reset state.  The ISR calls this and t810BusRestart
+    directly to recover from an overrun, so neither may block or look the
+    bus up by name.
+
+Returns:
+    0
+
+*/
+
+static int t810BusStop (
+    void *pdev
+) {
+    t810Dev_t *pdevice = pdev;
+
+    pdevice->pchip->control |=  PCA_CR_RR;    /* Reset the chip */
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810BusRestart
+
+Purpose: 
+    Restart I/O on a TIP810 bus
+
+Description:
+    Restarts the chip after a t810BusStop
+
+Returns:
+    0
+
+*/
+
+static int t810BusRestart (
+    void *pdev
+) {
+    t810Dev_t *pdevice = pdev;
+
+    pdevice->pchip->control = PCA_CR_OIE |
+			      PCA_CR_EIE |
+			      PCA_CR_TIE |
+			      PCA_CR_RIE;
+    txAbort(pdevice);
+
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810Stats
+
+Purpose:
+    Return the traffic statistics of a TIP810 bus
+
+Description:
+    The ISR keeps the transmit, error and interrupt counters and the
+    receive task the receive counters.  The transmit queue depth is
+    updated with interrupts locked out.  The ISR time includes the chip
+    register accesses, and is only as precise as epicsTimeGetCurrentInt()
+    on the target.
+
+Returns:
+    Pointer to the statistics.
+
+*/
+
+static const canStats_t *t810Stats (
+    void *pdev
+) {
+    t810Dev_t *pdevice = pdev;
+
+    return &pdevice->stats;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810WriteNotify
+
+Purpose:
+    queues a CAN message for sending and returns immediately
+
+Description:
+    Adds the message described by pmessage to the transmit queue for the
+    bus identified by canBusID, from where the ISR will send it as soon as
+    the messages ahead of it have gone.  If the queue is full the caller
+    waits up to timeout seconds for space to become free.  If pcallback
+    is not NULL it will be called with the pprivate value once the message
+    has been sent, with status 0, or if it is aborted by a chip reset,
+    with status S_can_txAborted.  The callback is called from interrupt
+    context so the same restrictions apply as for canMessage callbacks.
+
+Returns:
+    0, 
+    S_can_badMessage for bad identifier, message length or rtr value,
+    S_t810_badDevice for bad device pointer,
+    S_t810_timeout indicates the queue remained full.
+
+Example:
+
+
+*/
+
+static int txEnqueue (
+    t810Dev_t *pdevice,
+    const canMessage_t *pmessage,
+    canTxCallback_t *pcallback,
+    void *pprivate,
+    unsigned waitSeq,
+    double timeout
+) {
+    txEntry_t *pentry;
+    t810RecordHook_t *precordHook;
+    int key;
+
+    if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
+	return S_t810_badDevice;
+    }
+
+    if (pmessage->identifier >= CAN_IDENTIFIERS ||
+	pmessage->length > CAN_DATA_SIZE ||
+	(pmessage->rtr != SEND && pmessage->rtr != RTR)) {
+	return S_can_badMessage;
+    }
+
+    while (TRUE) {
+	key = epicsInterruptLock();
+	if (pdevice->txQueued < pdevice->txQueueSize) {
+	    break;
+	}
+	epicsInterruptUnlock(key);
+
+	/* Queue full, wait for the ISR to make space */
+	if (epicsEventWaitWithTimeout(pdevice->txSem, timeout) != epicsEventWaitOK) {
+	    return S_t810_timeout;
+	}
+    }
+
+    pentry = &pdevice->ptxQueue[(pdevice->txHead + pdevice->txQueued) %
+				pdevice->txQueueSize];
+    pentry->message   = *pmessage;
+    pentry->pcallback = pcallback;
+    pentry->pprivate  = pprivate;
+    pentry->waitSeq   = waitSeq;
+    pdevice->stats.txQueued = ++pdevice->txQueued;
+    if (pdevice->stats.txQueued > pdevice->stats.txMaxQueued) {
+	pdevice->stats.txMaxQueued = pdevice->stats.txQueued;
+    }
+    txStart(pdevice);
+    epicsInterruptUnlock(key);
+
+    precordHook = t810RecordHook;
+    if (precordHook != NULL) {
+	canMessage_t sent = *pmessage;	/* Stamped as queued, not as sent */
+
+	epicsTimeGetCurrent(&sent.timestamp);
+	(*precordHook)(pdevice->pbusName, TRUE, &sent);
+    }
+    return 0;
+}
+
+static int t810WriteNotify (
+    void *pdev,
+    const canMessage_t *pmessage,
+    canTxCallback_t *pcallback,
+    void *pprivate,
+    double timeout
+) {
+    return txEnqueue(pdev, pmessage, pcallback, pprivate, 0, timeout);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810Write
+
+Purpose:
+    writes a CAN message to the bus
+
+Description:
+    Sends the message described by pmessage out through the bus identified by
+    canBusID.  Normally the message is just added to the transmit queue by
+    canWriteNotify and this routine returns without waiting for it to be
+    sent.  If blocking mode has been selected for the bus using t810TxQueue,
+    callers are serialised and each waits until its message has actually
+    been transmitted.  The timeout value allows task recovery in the event
+    that the queue is full or the transmission is not completed within the
+    given number of seconds.  A message whose caller timed out stays in
+    the queue and is still sent, but its completion is ignored.
+
+Returns:
+    0, 
+    S_can_badMessage for bad identifier, message length or rtr value,
+    S_t810_badDevice for bad device pointer,
+    S_t810_timeout indicates timeout,
+    S_can_txAborted if a chip reset abandoned the transmission.
+
+Example:
+
+
+*/
+
+static int t810Write (
+    void *pdev,
+    const canMessage_t *pmessage,
+    double timeout
+) {
+    t810Dev_t *pdevice = pdev;
+    int status, key, done;
+
+    if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
+	return S_t810_badDevice;
+    }
+
+    if (!pdevice->txBlocking) {
+	return t810WriteNotify(pdevice, pmessage, NULL, NULL, timeout);
+    }
+
+    /* Ensure that only one task waits for a transmission at once */
+    if (epicsMutexLock(pdevice->txWaitSem) != epicsMutexLockOK) {
+	return S_t810_badDevice;
+    }
+
+    /* Number this call, skipping 0 which marks a non-blocking message */
+    if (++pdevice->txSequence == 0) {
+	pdevice->txSequence = 1;
+    }
+    key = epicsInterruptLock();
+    pdevice->txWaitSeq = pdevice->txSequence;
+    epicsInterruptUnlock(key);
+
+    status = txEnqueue(pdevice, pmessage, NULL, NULL, pdevice->txSequence,
+		       timeout);
+    if (status == 0 &&
+	epicsEventWaitWithTimeout(pdevice->txDoneSem, timeout) ==
+	    epicsEventWaitOK) {
+	status = pdevice->txDoneStatus;
+    } else {
+	/* Stop waiting; if txNotify beat us to it, take its signal */
+	key = epicsInterruptLock();
+	done = (pdevice->txWaitSeq == 0);
+	pdevice->txWaitSeq = 0;
+	epicsInterruptUnlock(key);
+	if (done) {
+	    epicsEventWait(pdevice->txDoneSem);
+	    status = pdevice->txDoneStatus;
+	} else if (status == 0) {
+	    status = S_t810_timeout;
+	}
+    }
+    epicsMutexUnlock(pdevice->txWaitSem);
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810TxQueue
+
+Purpose:
+    Configure the transmit queue of the named bus
+
+Description:
+    Sets the number of messages that the transmit queue of the named bus
+    can hold and selects whether canWrite waits for each message to be
+    sent (blocking != 0) or just queues it.  A zero queueSize leaves the
+    queue size unchanged.  The queue size can only be changed before
+    iocInit, but the mode may be changed at any time.
+
+Returns:
+    0, or
+    S_can_noDevice if no match found,
+    S_t810_badDevice if the bus is not a TIP810,
+    S_t810_badParameter if too late or queueSize is negative,
+    ENOMEM if calloc() fails.
 
 Example:
-    canIoParse("CAN1/20:0126+4+1.4 0xfff", &myIo);
+    status = t810TxQueue("CAN1", 200, 0);
 
 */
 
-int canIoParse (
-    char *canString, 
-    canIo_t *pcanIo
+int t810TxQueue (
+    const char *pbusName,
+    int queueSize,
+    int blocking
 ) {
-    char separator;
-    char *name;
+    t810Dev_t *pdevice;
+    txEntry_t *pqueue;
+    int status = t810Find(pbusName, &pdevice);
 
-    pcanIo->canBusID = NULL;
+    if (status) return status;
 
-    if (canString == NULL ||
-	pcanIo == NULL) {
-	return S_can_badAddress;
+    if (queueSize < 0 ||
+	(queueSize && t810Running)) {
+	return S_t810_badParameter;
     }
 
-    /* Get rid of leading whitespace and non-alphanumeric chars */
-    while (!isalnum(0xff & *canString)) {
-	if (*canString++ == '\0') {
-	    return S_can_badAddress;
+    if (queueSize) {
+	pqueue = calloc(queueSize, sizeof(txEntry_t));
+	if (pqueue == NULL) {
+	    return ENOMEM;
 	}
+	free(pdevice->ptxQueue);
+	pdevice->ptxQueue = pqueue;
+	pdevice->txQueueSize = queueSize;
     }
 
-    /* First part of string is the bus name */
-    name = canString;
+    pdevice->txBlocking = blocking;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810RecvBatch
+
+Purpose:
+    Set the receive batch size of the named bus
+
+Description:
+    Sets the largest number of messages that the bus's receive task takes
+    from its receive ring at once.  Larger batches cost less per message
+    when the bus is busy, smaller ones give the first callbacks of a burst
+    less delay.  The batch size histogram from t810Report(1) shows how
+    full the batches actually are.  This can only be changed before
+    iocInit.
+
+Returns:
+    0, or
+    S_can_noDevice if no match found,
+    S_t810_badDevice if the bus is not a TIP810,
+    S_t810_badParameter if too late or batchSize is not positive,
+    ENOMEM if calloc() fails.
+
+Example:
+    status = t810RecvBatch("CAN1", 64);
+
+*/
+
+int t810RecvBatch (
+    const char *pbusName,
+    int batchSize
+) {
+    t810Dev_t *pdevice;
+    canMessage_t *pbatch;
+    int status = t810Find(pbusName, &pdevice);
+
+    if (status) return status;
 
-    /* find the end of the busName */
-    canString = strpbrk(canString, "/:");
-    if (canString == NULL ||
-	*canString == '\0') {
-	return S_can_badAddress;
+    if (batchSize <= 0 ||
+	t810Running) {
+	return S_t810_badParameter;
     }
 
-    /* now we're at character after the end of the busName */
-    pcanIo->busName = strdupn(name, canString - name);
-    if (pcanIo->busName == NULL) {
+    pbatch = calloc(batchSize, sizeof(canMessage_t));
+    if (pbatch == NULL) {
 	return ENOMEM;
     }
-    separator = *canString++;
+    free(pdevice->precvBatch);
+    pdevice->precvBatch = pbatch;
+    pdevice->recvBatchSize = batchSize;
+    return 0;
+}
 
-    /* Handle /<timeout> if present, convert from ms to seconds */
-    if (separator == '/') {
-	pcanIo->timeout = ((double)strtol(canString, &canString, 0))/1000.0;
-	separator = *canString++;
-    } else {
-	pcanIo->timeout = -1.0;
-    }
 
-    /* String must contain :<canID> */
-    if (separator != ':') {
-	return S_can_badAddress;
-    }
-    pcanIo->identifier = strtoul(canString, &canString, 0);
-    separator = *canString++;
+/*******************************************************************************
 
-    /* Handle any number of optional +<n> additions to the ID */
-    while (separator == '+') {
-	pcanIo->identifier += strtol(canString, &canString, 0);
-	separator = *canString++;
+Routine:
+    t810Filter
+
+Purpose:
+    Enable or disable the acceptance filter
+
+Description:
+    By default the chip's acceptance filter passes all IDs.  Calling this
+    with enable non-zero makes the driver program it to pass only the IDs
+    that have callbacks registered or have been read, so frames that
+    nobody wants on a shared bus don't interrupt the CPU; enable zero
+    opens it to all IDs again.  Each change to the filter resets the chip,
+    which waits until it is idle, so filtering suits buses whose callbacks
+    are all registered by iocInit.  May be called at any time.
+
+Returns:
+    0, or
+    S_can_noDevice if no bus has the given name,
+    S_t810_badDevice if the bus is not a TIP810.
+
+Example:
+    status = t810Filter("CAN1", 1);
+
+*/
+
+int t810Filter (
+    const char *pbusName,
+    int enable
+) {
+    t810Dev_t *pdevice;
+    int status = t810Find(pbusName, &pdevice);
+
+    if (status) return status;
+
+    pdevice->filterEnable = enable;
+    filterUpdate(pdevice, 0, 0);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810FilterRecording
+
+Purpose:
+    Open the acceptance filters while the traffic recorder runs
+
+Description:
+    Called by t810RecordStart with recording TRUE and by the recorder task
+    with FALSE when it stops.  While recording, every bus passes all IDs
+    whether or not t810Filter has enabled its filter, so the log holds the
+    whole bus and not just the IDs this IOC uses.
+
+Returns:
+    void
+
+*/
+
+void t810FilterRecording (
+    int recording
+) {
+    t810Dev_t *pdevice;
+
+    filterRecording = recording;
+    for (pdevice = pt810First; pdevice != NULL; pdevice = pdevice->pnext) {
+	filterUpdate(pdevice, 0, 0);
     }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810Profile
+
+Purpose:
+    Start or stop the per-ID traffic profiler
+
+Description:
+    With enable non-zero, clears the profile of the named bus and starts
+    counting the frames, data bytes and RTRs received and sent with each
+    ID, the time between arrivals, and the time the receive task spends
+    in each ID's callbacks and canRead replies.  With enable zero, stops
+    counting but keeps the results for t810ProfileReport.  The profile
+    table takes about 150 KBytes per bus and is only allocated the first
+    time profiling is started.  Timing each dispatch costs two clock reads
+    per message, so profiling is off by default.  If t810Filter has
+    enabled the acceptance filter, it hides IDs that nobody on this IOC
+    uses; disable it again to profile the whole bus.
+
+Returns:
+    0, or
+    S_can_noDevice if no bus has the given name,
+    S_t810_badDevice if the bus is not a TIP810,
+    ENOMEM if calloc() fails.
+
+Example:
+    status = t810Profile("CAN1", 1);
+
+*/
 
-    /* Handle .<offset> if present */
-    if (separator == '.') {
-	pcanIo->offset = strtoul(canString, &canString, 0);
-	if (pcanIo->offset >= CAN_DATA_SIZE) {
-	    return S_can_badAddress;
+int t810Profile (
+    const char *pbusName,
+    int enable
+) {
+    t810Dev_t *pdevice;
+    t810Profile_t *pprofile;
+    int status = t810Find(pbusName, &pdevice);
+
+    if (status) return status;
+
+    pprofile = pdevice->pprofile;
+    if (!enable) {
+	if (pprofile != NULL && pprofile->enabled) {
+	    pprofile->enabled = FALSE;
+	    epicsTimeGetCurrent(&pprofile->stopped);
 	}
-	separator = *canString++;
-    } else {
-	pcanIo->offset = 0;
+	return 0;
     }
 
-    /* Final parameter is separated by whitespace */
-    if (separator != ' ' &&
-	separator != '\t') {
-	return S_can_badAddress;
+    if (pprofile == NULL) {
+	pprofile = calloc(1, sizeof(t810Profile_t));
+	if (pprofile == NULL) {
+	    return ENOMEM;
+	}
+	epicsTimeGetCurrent(&pprofile->started);
+	pprofile->enabled = TRUE;
+	pdevice->pprofile = pprofile;
+	return 0;
     }
-    pcanIo->parameter = strtol(canString, &pcanIo->paramStr, 0);
 
-    /* Ok, finally look up the bus name */
-    return canOpen(pcanIo->busName, &pcanIo->canBusID);
+    /* Counts made while this runs may survive; they're only statistics */
+    pprofile->enabled = FALSE;
+    memset(pprofile->entry, 0, sizeof(pprofile->entry));
+    epicsTimeGetCurrent(&pprofile->started);
+    pprofile->enabled = TRUE;
+    return 0;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canWrite
+    t810ProfileReport
 
 Purpose:
-    writes a CAN message to the bus
+    Print the busiest IDs found by the profiler
 
 Description:
-    Sends the message described by pmessage out through the bus identified by
-    canBusID.  After some simple argument checks it obtains exclusive access to
-    the transmit registers, then copies the message to the chip.  The timeout
-    value allows task recovery in the event that exclusive access is not
-    available within a the given number of seconds.
+    Lists the top IDs of the named bus from the profile started by
+    t810Profile, first by the bus time their frames used and then by the
+    time the receive task spent in their callbacks.  topN is the number
+    of IDs in each list, 0 for the default of 10.  The bus time counts
+    frames sent and received without stuff bits, so it reads up to 20 %
+    low.  The callback times are only as precise as the target's clock.
 
 Returns:
-    0, 
-    S_can_badMessage for bad identifier, message length or rtr value,
-    S_can_badDevice for bad device pointer,
-    S_t810_timeout indicates timeout,
-    S_t810_transmitterBusy indicates an internal error.
+    0, or
+    S_can_noDevice if no bus has the given name,
+    S_t810_badDevice if the bus is not a TIP810,
+    ENOMEM if malloc() fails.
 
 Example:
-
+    status = t810ProfileReport("CAN1", 5);
 
 */
 
-int canWrite (
-    canBusID_t busID,
-    const canMessage_t *pmessage,
-    double timeout
+typedef struct {
+    int identifier;
+    double key;
+} profileRank_t;
+
+static int profileCompare (
+    const void *p1,
+    const void *p2
 ) {
-    t810Dev_t *pdevice = busID;
+    const profileRank_t *prank1 = p1, *prank2 = p2;
 
-    if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
-	return S_t810_badDevice;
+    if (prank1->key != prank2->key) {
+	return prank1->key > prank2->key ? -1 : 1;
     }
+    return prank1->identifier - prank2->identifier;
+}
 
-    if (pmessage->identifier >= CAN_IDENTIFIERS ||
-	pmessage->length > CAN_DATA_SIZE ||
-	(pmessage->rtr != SEND && pmessage->rtr != RTR)) {
-	return S_can_badMessage;
+int t810ProfileReport (
+    const char *pbusName,
+    int topN
+) {
+    t810Dev_t *pdevice;
+    t810Profile_t *pprofile;
+    const profileEntry_t *pentry;
+    profileRank_t *prank;
+    epicsTimeStamp now;
+    double elapsed, bitTime, gapMean;
+    int id, numIds, i;
+    int status = t810Find(pbusName, &pdevice);
+
+    if (status) return status;
+
+    pprofile = pdevice->pprofile;
+    if (pprofile == NULL) {
+	printf("t810ProfileReport: '%s' has not been profiled, "
+	       "see t810Profile\n", pbusName);
+	return 0;
+    }
+    if (topN <= 0) {
+	topN = PROFILE_TOP;
+    }
+
+    prank = malloc(CAN_IDENTIFIERS * sizeof(profileRank_t));
+    if (prank == NULL) {
+	return ENOMEM;
     }
 
-    if (epicsEventWaitWithTimeout(pdevice->txSem, timeout) != epicsEventWaitOK) {
-	return S_t810_timeout;
+    if (pprofile->enabled) {
+	epicsTimeGetCurrent(&now);
+    } else {
+	now = pprofile->stopped;
+    }
+    elapsed = epicsTimeDiffInSeconds(&now, &pprofile->started);
+    if (elapsed <= 0.0) elapsed = 1e-6;
+    bitTime = 1.0 / (1000.0 * pdevice->busRate);
+
+    numIds = 0;
+    for (id = 0; id < CAN_IDENTIFIERS; id++) {
+	pentry = &pprofile->entry[id];
+	if (pentry->rxFrames == 0 && pentry->txFrames == 0) continue;
+	prank[numIds].identifier = id;
+	prank[numIds].key = (double) pentry->rxBits + pentry->txBits;
+	numIds++;
     }
 
-    if (pdevice->pchip->status & PCA_SR_TBS) {
-	putTxMessage(pdevice->pchip, pmessage);
+    printf("  '%s' : Profile over %.1f sec%s, %d IDs seen\n", pbusName,
+	   elapsed, pprofile->enabled ? " so far" : "", numIds);
+    if (topN > numIds) topN = numIds;
+    if (topN == 0) {
+	free(prank);
 	return 0;
     }
-    epicsEventSignal(pdevice->txSem);
-    return S_t810_transmitterBusy;
+
+    qsort(prank, numIds, sizeof(profileRank_t), profileCompare);
+    printf("    By bus time:\n"
+	   "\t   ID    Rx    Tx   Bytes  RTRs  Bus %%  "
+	   "Arrival gap min/mean/max msec\n");
+    for (i = 0; i < topN; i++) {
+	pentry = &pprofile->entry[prank[i].identifier];
+	printf("\t%#5x %5u %5u %7u %5u %6.2f", prank[i].identifier,
+	       pentry->rxFrames, pentry->txFrames, pentry->rxBytes,
+	       pentry->rtrs, 100.0 * prank[i].key * bitTime / elapsed);
+	if (pentry->rxFrames > 1) {
+	    gapMean = pentry->gapSum / (pentry->rxFrames - 1);
+	    printf("  %.3f/%.3f/%.3f", 1e3 * pentry->gapMin,
+		   1e3 * gapMean, 1e3 * pentry->gapMax);
+	}
+	printf("\n");
+    }
+
+    for (i = 0; i < numIds; i++) {
+	prank[i].key = pprofile->entry[prank[i].identifier].callbackTime;
+    }
+    qsort(prank, numIds, sizeof(profileRank_t), profileCompare);
+    printf("    By callback time:\n"
+	   "\t   ID    Rx  Total msec  CPU %%  Mean usec  Max usec\n");
+    for (i = 0; i < topN; i++) {
+	pentry = &pprofile->entry[prank[i].identifier];
+	if (pentry->rxFrames == 0) break;
+	printf("\t%#5x %5u %11.3f %6.2f %10.1f %9.1f\n",
+	       prank[i].identifier, pentry->rxFrames,
+	       1e3 * pentry->callbackTime,
+	       100.0 * pentry->callbackTime / elapsed,
+	       1e6 * pentry->callbackTime / pentry->rxFrames,
+	       1e6 * pentry->callbackMax);
+    }
+
+    free(prank);
+    return 0;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canMessage
+    t810Message
 
 Purpose:
     Register CAN message callback
@@ -1124,6 +2452,11 @@ Description:
 	void callback(void *pprivate, can_Message_t *pmessage); 
     The pprivate value supplied to canMessage is passed to the callback
     routine with each message to allow it to identify its context.
+    Callbacks may be added and deleted at any time, even while messages
+    are being dispatched and from within a callback; each message is
+    given to the callbacks registered when its dispatch started.  The
+    TIP810's controller only handles standard 11-bit identifiers, so an
+    extended identifier is rejected.
 
 Returns:
     0, 
@@ -1136,14 +2469,14 @@ Example:
 
 */
 
-int canMessage (
-    canBusID_t busID,
+static int t810Message (
+    void *pdev,
     canID_t identifier,
     canMsgCallback_t *pcallback,
     void *pprivate
 ) {
-    t810Dev_t *pdevice = busID;
-    callbackTable_t *phandler, *plist;
+    t810Dev_t *pdevice = pdev;
+    int status;
 
     if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
 	return S_t810_badDevice;
@@ -1154,30 +2487,21 @@ int canMessage (
 	return S_can_badMessage;
     }
 
-    phandler = malloc(sizeof (callbackTable_t));
-    if (phandler == NULL) {
-	return ENOMEM;
-    }
-
-    phandler->pnext     = NULL;
-    phandler->pprivate  = pprivate;
-    phandler->pcallback = (callback_t *) pcallback;
-
-    plist = (callbackTable_t *) (&pdevice->pmsgHandler[identifier]);
-    while (plist->pnext != NULL) {
-	plist = plist->pnext;
+    status = canDispatcherAdd(pdevice->dispatcher, identifier, pcallback,
+			 pprivate);
+    if (status == 0) {
+	filterUpdate(pdevice, identifier, 1);
+	/* Cycle the receive task so the old table can be freed */
+	epicsEventSignal(pdevice->recvSignal);
     }
-    /* plist now points to the last handler in the list */
-
-    plist->pnext = phandler;
-    return 0;
+    return status;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canMsgDelete
+    t810MsgDelete
 
 Purpose:
     Delete registered CAN message callback
@@ -1186,27 +2510,31 @@ Description:
     Deletes an existing callback routine for the given CAN message ID
     on the given device.  The first matching callback found in the list
     is deleted.  To match, the parameters to canMsgDelete must be
-    identical to those given to canMessage.
+    identical to those given to canMessage.  The callback may still be
+    called for a message whose dispatch began before it was deleted,
+    so its pprivate data must remain valid until the next message on
+    this bus has been handled.
 
 Returns:
     0, 
     S_can_badMessage for bad identifier or NULL callback routine,
     S_can_noMessage for no matching message callback,
-    S_t810_badDevice for bad device pointer.
+    S_t810_badDevice for bad device pointer,
+    ENOMEM if malloc() fails.
 
 Example:
 
 
 */
 
-int canMsgDelete (
-    canBusID_t busID,
+static int t810MsgDelete (
+    void *pdev,
     canID_t identifier,
     canMsgCallback_t *pcallback,
     void *pprivate
 ) {
-    t810Dev_t *pdevice = busID;
-    callbackTable_t *phandler, *plist;
+    t810Dev_t *pdevice = pdev;
+    int status;
 
     if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
 	return S_t810_badDevice;
@@ -1217,27 +2545,21 @@ int canMsgDelete (
 	return S_can_badMessage;
     }
 
-    plist = (callbackTable_t *) (&pdevice->pmsgHandler[identifier]);
-    while (plist->pnext != NULL) {
-	phandler = plist->pnext;
-	if (((canMsgCallback_t *)phandler->pcallback == pcallback) &&
-	    (phandler->pprivate  == pprivate)) {
-	    plist->pnext = phandler->pnext;
-	    phandler->pnext = NULL;		/* Just in case... */
-	    free(phandler);
-	    return 0;
-	}
-	plist = phandler;
+    status = canDispatcherDelete(pdevice->dispatcher, identifier, pcallback,
+			 pprivate);
+    if (status == 0) {
+	filterUpdate(pdevice, identifier, -1);
+	/* Cycle the receive task so the old table can be freed */
+	epicsEventSignal(pdevice->recvSignal);
     }
-
-    return S_can_noMessage;
+    return status;
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canSignal
+    t810Signal
 
 Purpose:
     Register CAN error signal callback
@@ -1269,42 +2591,25 @@ Example:
 
 */
 
-int canSignal (
-    canBusID_t busID,
+static int t810Signal (
+    void *pdev,
     canSigCallback_t *pcallback,
     void *pprivate
 ) {
-    t810Dev_t *pdevice = busID;
-    callbackTable_t *phandler, *plist;
+    t810Dev_t *pdevice = pdev;
 
     if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
 	return S_t810_badDevice;
     }
 
-    phandler = malloc(sizeof (callbackTable_t));
-    if (phandler == NULL) {
-	return ENOMEM;
-    }
-
-    phandler->pnext     = NULL;
-    phandler->pprivate  = pprivate;
-    phandler->pcallback = (callback_t *) pcallback;
-
-    plist = (callbackTable_t *) (&pdevice->psigHandler);
-    while (plist->pnext != NULL) {
-	plist = plist->pnext;
-    }
-    /* plist now points to the last handler in the list */
-
-    plist->pnext = phandler;
-    return 0;
+    return signalAdd(pdevice, (callback_t *) pcallback, pprivate);
 }
 
 
 /*******************************************************************************
 
 Routine:
-    canRead
+    t810Read
 
 Purpose:
     read incoming CAN message, any ID number
@@ -1316,11 +2621,19 @@ Description:
     it useful for simple software interfaces.  More complex ones ought
     to use the canMessage callback functions.
 
+    Any number of tasks may call canRead on the same bus at once.  Each
+    call opens the acceptance filter for the ID and adds an entry to the
+    bus's pending read table (see canPending.c) before sending its RTR,
+    and the receive task completes all entries for an ID when a message
+    with that ID arrives, so reads of different IDs overlap instead of
+    waiting for each other's round trips.
+
 Returns:
     0, or
     S_t810_badDevice for bad bus ID, 
     S_can_badMessage for bad message Identifier or length,
-    S_t810_timeout for timeout
+    S_t810_timeout for timeout,
+    ENOMEM if a read entry can't be allocated.
 
 Example:
     canMessage_t myBuffer = {
@@ -1332,12 +2645,12 @@ Example:
 
 */
 
-int canRead (
-    canBusID_t busID,
+static int t810Read (
+    void *pdev,
     canMessage_t *pmessage,
     double timeout
 ) {
-    t810Dev_t *pdevice = busID;
+    t810Dev_t *pdevice = pdev;
     int status;
 
     if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
@@ -1349,37 +2662,84 @@ int canRead (
 	return S_can_badMessage;
     }
 
-    /* Ensure that only one task canRead at once */
-    if (epicsMutexLock(pdevice->readSem) != epicsMutexLockOK) {
-	return S_t810_badDevice;
-    }
+    filterRead(pdevice, pmessage->identifier);
+    status = canPendingRead(pdevice->pending, t810Write, pdevice,
+			    pmessage, timeout);
+    return status == S_can_timeout ? S_t810_timeout : status;
+}
 
-    pdevice->preadBuffer = pmessage;
 
-    /* All set for the reply, now send the request */
-    pmessage->rtr = RTR;
+/*******************************************************************************
 
-    status = canWrite(busID, pmessage, timeout);
-    if (status == 0) {
-	/* Wait for the message to be recieved */
-	switch (epicsEventWaitWithTimeout(pdevice->rxSem, timeout)) {
-	case epicsEventWaitTimeout:
-	    status = S_t810_timeout;
-	    break;
-	case epicsEventWaitError:
-	    status = S_t810_badDevice;
-	    break;
-	default:
-	    break;
-	}
+Routine:
+    t810ReadAsync
+
+Purpose:
+    Send a Remote Transmission Request and return at once
+
+Description:
+    Asks for the message with the given identifier by queueing an RTR,
+    and arranges for callback(pprivate, status, pmessage) to be called
+    exactly once, either with status 0 and the reply when it arrives, or
+    with status S_can_timeout and a NULL pmessage if timeout seconds pass
+    first.  A negative timeout waits forever.  The RTR asks for a full 8
+    byte message.  Nothing here ever blocks; if the transmit queue is full
+    the request fails, and the callback will not be called.
+
+    Replies are called back from the bus's receive task and timeouts from
+    the canTimerQ thread, so the routine must not block either.  It may
+    start another canReadAsync.  Each request uses an entry from a free
+    list kept by the bus, together with its timer, so records polling
+    through this routine need no timers of their own.
+
+    Can only be used after t810Initialise has started the chips.
+
+Returns:
+    0, or
+    S_t810_badDevice for bad bus ID,
+    S_can_badMessage for bad identifier or NULL callback routine,
+    S_t810_badParameter if called before iocInit,
+    ENOMEM if malloc() or timer creation fails,
+    any error status from canWriteNotify().
+
+Example:
+    status = canReadAsync(busID, 0x139, readDone, pdata, 0.5);
+
+*/
+
+static int rtrQueue (
+    void *pdev,
+    const canMessage_t *prequest,
+    double timeout
+) {
+    return t810WriteNotify(pdev, prequest, NULL, NULL, timeout);
+}
+
+static int t810ReadAsync (
+    void *pdev,
+    canID_t identifier,
+    canReadCallback_t *pcallback,
+    void *pprivate,
+    double timeout
+) {
+    t810Dev_t *pdevice = pdev;
+
+    if (pdevice->magicNumber != T810_MAGIC_NUMBER) {
+	return S_t810_badDevice;
     }
-    if (status) {
-	/* Problem (timeout) sending the RTR or receiving the reply */
-	pdevice->preadBuffer = NULL;
-	epicsEventTryWait(pdevice->rxSem);	/* Try to clean up */
+
+    if (identifier >= CAN_IDENTIFIERS ||
+	pcallback == NULL) {
+	return S_can_badMessage;
     }
-    epicsMutexUnlock(pdevice->readSem);
-    return status;
+
+    if (!t810Running) {
+	return S_t810_badParameter;
+    }
+
+    filterRead(pdevice, identifier);
+    return canPendingReadAsync(pdevice->pending, rtrQueue, pdevice,
+			       identifier, pcallback, pprivate, timeout);
 }
 
 
@@ -1445,21 +2805,24 @@ int canTest (
  * EPICS iocsh Command registry
  */
 
-/* t810Create(char *pbusName, int card, int slot, int irqNum, int busRate) */
+/* t810Create(char *pbusName, int card, int slot, int irqNum, int busRate,
+ *	      int recvQueueSize, int recvPriority) */
 static const iocshArg t810CreateArg0 = {"busName",iocshArgPersistentString};
 static const iocshArg t810CreateArg1 = {"carrier", iocshArgInt};
 static const iocshArg t810CreateArg2 = {"slot", iocshArgInt};
 static const iocshArg t810CreateArg3 = {"intVector", iocshArgInt};
 static const iocshArg t810CreateArg4 = {"busRate", iocshArgInt};
-static const iocshArg * const t810CreateArgs[5] = {
+static const iocshArg t810CreateArg5 = {"recvQueueSize", iocshArgInt};
+static const iocshArg t810CreateArg6 = {"recvPriority", iocshArgInt};
+static const iocshArg * const t810CreateArgs[7] = {
     &t810CreateArg0, &t810CreateArg1, &t810CreateArg2, &t810CreateArg3,
-    &t810CreateArg4};
+    &t810CreateArg4, &t810CreateArg5, &t810CreateArg6};
 static const iocshFuncDef t810CreateFuncDef =
-    {"t810Create",5,t810CreateArgs};
+    {"t810Create",7,t810CreateArgs};
 static void t810CreateCallFunc(const iocshArgBuf *arg)
 {
     t810Create(arg[0].sval, arg[1].ival, arg[2].ival, arg[3].ival, 
-	       arg[4].ival);
+	       arg[4].ival, arg[5].ival, arg[6].ival);
 }
 
 /* t810Report(int interest) */
@@ -1472,42 +2835,75 @@ static void t810ReportCallFunc(const iocshArgBuf *args)
     t810Report(args[0].ival);
 }
 
-/* canBusReset(char *pbusName) */
-static const iocshArg canBusResetArg0 = {"busName", iocshArgString};
-static const iocshArg * const canBusResetArgs[1] = {&canBusResetArg0};
-static const iocshFuncDef canBusResetFuncDef =
-    {"canBusReset",1,canBusResetArgs};
-static void canBusResetCallFunc(const iocshArgBuf *args)
+/* t810TxQueue(char *pbusName, int queueSize, int blocking) */
+static const iocshArg t810TxQueueArg0 = {"busName", iocshArgString};
+static const iocshArg t810TxQueueArg1 = {"queueSize", iocshArgInt};
+static const iocshArg t810TxQueueArg2 = {"blocking", iocshArgInt};
+static const iocshArg * const t810TxQueueArgs[3] = {
+    &t810TxQueueArg0, &t810TxQueueArg1, &t810TxQueueArg2};
+static const iocshFuncDef t810TxQueueFuncDef =
+    {"t810TxQueue",3,t810TxQueueArgs};
+static void t810TxQueueCallFunc(const iocshArgBuf *args)
+{
+    t810TxQueue(args[0].sval, args[1].ival, args[2].ival);
+}
+
+/* t810RecvBatch(char *pbusName, int batchSize) */
+static const iocshArg t810RecvBatchArg0 = {"busName", iocshArgString};
+static const iocshArg t810RecvBatchArg1 = {"batchSize", iocshArgInt};
+static const iocshArg * const t810RecvBatchArgs[2] = {
+    &t810RecvBatchArg0, &t810RecvBatchArg1};
+static const iocshFuncDef t810RecvBatchFuncDef =
+    {"t810RecvBatch",2,t810RecvBatchArgs};
+static void t810RecvBatchCallFunc(const iocshArgBuf *args)
+{
+    t810RecvBatch(args[0].sval, args[1].ival);
+}
+
+/* int t810Filter(const char *busName, int enable) */
+static const iocshArg t810FilterArg0 = {"busName", iocshArgString};
+static const iocshArg t810FilterArg1 = {"enable", iocshArgInt};
+static const iocshArg * const t810FilterArgs[2] = {
+    &t810FilterArg0, &t810FilterArg1};
+static const iocshFuncDef t810FilterFuncDef =
+    {"t810Filter",2,t810FilterArgs};
+static void t810FilterCallFunc(const iocshArgBuf *args)
 {
-    canBusReset(args[0].sval);
+    t810Filter(args[0].sval, args[1].ival);
 }
 
-/* canBusStop(char *pbusName) */
-static const iocshArg canBusStopArg0 = {"busName", iocshArgString};
-static const iocshArg * const canBusStopArgs[1] = {&canBusStopArg0};
-static const iocshFuncDef canBusStopFuncDef =
-    {"canBusStop",1,canBusStopArgs};
-static void canBusStopCallFunc(const iocshArgBuf *args)
+/* int t810Profile(const char *busName, int enable) */
+static const iocshArg t810ProfileArg0 = {"busName", iocshArgString};
+static const iocshArg t810ProfileArg1 = {"enable", iocshArgInt};
+static const iocshArg * const t810ProfileArgs[2] = {
+    &t810ProfileArg0, &t810ProfileArg1};
+static const iocshFuncDef t810ProfileFuncDef =
+    {"t810Profile",2,t810ProfileArgs};
+static void t810ProfileCallFunc(const iocshArgBuf *args)
 {
-    canBusStop(args[0].sval);
+    t810Profile(args[0].sval, args[1].ival);
 }
 
-/* canBusRestart(char *pbusName) */
-static const iocshArg canBusRestartArg0 = {"busName", iocshArgString};
-static const iocshArg * const canBusRestartArgs[1] = {&canBusRestartArg0};
-static const iocshFuncDef canBusRestartFuncDef =
-    {"canBusRestart",1,canBusRestartArgs};
-static void canBusRestartCallFunc(const iocshArgBuf *args)
+/* int t810ProfileReport(const char *busName, int topN) */
+static const iocshArg t810ProfileReportArg0 = {"busName", iocshArgString};
+static const iocshArg t810ProfileReportArg1 = {"topN", iocshArgInt};
+static const iocshArg * const t810ProfileReportArgs[2] = {
+    &t810ProfileReportArg0, &t810ProfileReportArg1};
+static const iocshFuncDef t810ProfileReportFuncDef =
+    {"t810ProfileReport",2,t810ProfileReportArgs};
+static void t810ProfileReportCallFunc(const iocshArgBuf *args)
 {
-    canBusRestart(args[0].sval);
+    t810ProfileReport(args[0].sval, args[1].ival);
 }
 
 static void drvTip810Registrar(void) {
     iocshRegister(&t810CreateFuncDef,t810CreateCallFunc);
     iocshRegister(&t810ReportFuncDef,t810ReportCallFunc);
-    iocshRegister(&canBusResetFuncDef,canBusResetCallFunc);
-    iocshRegister(&canBusStopFuncDef,canBusStopCallFunc);
-    iocshRegister(&canBusRestartFuncDef,canBusRestartCallFunc);
+    iocshRegister(&t810TxQueueFuncDef,t810TxQueueCallFunc);
+    iocshRegister(&t810RecvBatchFuncDef,t810RecvBatchCallFunc);
+    iocshRegister(&t810FilterFuncDef,t810FilterCallFunc);
+    iocshRegister(&t810ProfileFuncDef,t810ProfileCallFunc);
+    iocshRegister(&t810ProfileReportFuncDef,t810ProfileReportCallFunc);
 }
 epicsExportRegistrar(drvTip810Registrar);
 
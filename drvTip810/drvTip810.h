@@ -50,12 +50,53 @@ Copyright (c) 1995-2000 Andrew Johnson
 #define S_t810_badDevice	(M_t810| 3) /*device pointer is not for t810*/
 #define S_t810_transmitterBusy	(M_t810| 4) /*transmit buffer unexpectedly busy*/
 #define S_t810_timeout		(M_t810| 5) /*timeout during request*/
+#define S_t810_badParameter	(M_t810| 6) /*illegal t810Create parameter*/
+#define S_t810_queueFull	(M_t810| 7) /*receive queue full*/
+
+
+/* Traffic recorder hook, called for every message received or queued to be
+ * sent, from the receive tasks and the sending tasks */
+
+typedef void t810RecordHook_t(const char *busName, int transmit,
+			      const canMessage_t *pmessage);
+
+extern t810RecordHook_t *t810RecordHook;
 
 
 epicsShareFunc int t810Status(canBusID_t busID);
 epicsShareFunc int t810Report(int page);
-epicsShareFunc int t810Create(char *busName, int card, int slot, int irqNum, int busRate);
+epicsShareFunc int t810Create(char *busName, int card, int slot, int irqNum,
+			      int busRate, int recvQueueSize, int recvPriority);
+epicsShareFunc int t810TxQueue(const char *busName, int queueSize, int blocking);
+epicsShareFunc int t810RecvBatch(const char *busName, int batchSize);
+epicsShareFunc int t810Filter(const char *busName, int enable);
+epicsShareFunc void t810FilterRecording(int recording);
+epicsShareFunc int t810Profile(const char *busName, int enable);
+epicsShareFunc int t810ProfileReport(const char *busName, int topN);
+epicsShareFunc int t810RecvInject(canBusID_t busID, const canMessage_t *pmessage);
+epicsShareFunc int t810RecvSync(canBusID_t busID);
 epicsShareFunc void t810Shutdown(void *dummy);
 epicsShareFunc int t810Initialise(void);
 
+/* Emulated TIP810 for the simulated IPAC carrier, Linux only */
+
+epicsShareFunc int t810SimCreate(int carrier, int slot);
+epicsShareFunc int t810SimInject(int carrier, int slot, double rate,
+				 int idFirst, int idCount, int idRandom,
+				 int length);
+epicsShareFunc int t810SimErrors(int carrier, int slot, int errorEvery,
+				 int busOffEvery);
+epicsShareFunc int t810SimReport(int interest);
+epicsShareFunc int t810SimBench(const char *busName, int carrier, int slot,
+				double seconds, double rate);
+
+/* Traffic recorder and replay engine, Linux only */
+
+epicsShareFunc int t810RecordStart(const char *baseName, int fileMB, int keep);
+epicsShareFunc void t810RecordStop(void);
+epicsShareFunc void t810RecordReport(void);
+epicsShareFunc int t810Replay(const char *fileName, double speed,
+			      const char *busName);
+epicsShareFunc void t810ReplayStop(void);
+
 #endif /* INCdrvTip810H */
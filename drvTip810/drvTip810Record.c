@@ -0,0 +1,1049 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    drvTip810Record.c
+
+Description:
+    CAN traffic recorder and replay engine for the TIP810 driver, Linux
+    only.  While recording, every message that any TIP810 bus receives or
+    is asked to send is buffered per bus and then appended by a recorder
+    task to a memory-mapped binary log, together with its timestamp and
+    bus name.  Each log file has a fixed size, and when it fills up
+    recording moves on to the next file in a numbered sequence, deleting
+    the oldest so that only a set number are kept.
+
+    The replay engine reads a log back and feeds its received messages
+    into the receive rings of the named buses through t810RecvInject(), so
+    they are dispatched to the message callbacks and canRead exactly as
+    if they had arrived from the chip.  Replay can be paced at the
+    recorded rate, at a multiple of it, or run as fast as the receive
+    tasks can take the messages, which makes it a repeatable throughput
+    benchmark.
+
+    The log is in the host's byte order.  Each file starts with a header
+    holding the bus names, followed by fixed-size records:
+
+	logHeader_t
+	logRecord_t [numRecords]
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <epicsTypes.h>
+#include <dbDefs.h>
+#include <iocsh.h>
+#include <epicsTime.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsThread.h>
+#include <epicsStdio.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+#include "drvTip810.h"
+
+
+#define LOG_MAGIC "CANLOG\r\n"	/* 8 bytes, no terminator */
+#define LOG_VERSION 2		/* 2: 32-bit identifiers */
+#define LOG_MAX_BUSES 16	/* Bus names a log can hold */
+#define LOG_HEADER_SIZE 1024	/* Space reserved for logHeader_t */
+#define LOG_FILE_MB 16		/* Default file size */
+#define LOG_MAX_FILE_MB 2047	/* Fits a 32-bit size_t and off_t */
+#define LOG_KEEP 4		/* Default number of files kept */
+
+#define LOG_RTR 0x01		/* logRecord_t flags */
+#define LOG_TX 0x02
+
+#define REC_BUFFER 4096		/* Records buffered per bus */
+#define REC_PERIOD 0.1		/* Max seconds between log writes */
+
+#define REPLAY_AHEAD 0.001	/* Sleep if this far ahead of schedule */
+
+
+typedef struct {
+    char magic[8];
+    epicsUInt32 version;
+    epicsUInt32 headerSize;	/* Offset of first record */
+    epicsUInt32 recordSize;	/* sizeof(logRecord_t) */
+    epicsUInt32 numBuses;
+    epicsUInt32 numRecords;	/* Updated as records are added */
+    epicsUInt32 sequence;	/* File number */
+    char busName[LOG_MAX_BUSES][CAN_BUSNAME_SIZE];
+} logHeader_t;
+
+typedef struct {
+    epicsUInt32 secPastEpoch;
+    epicsUInt32 nsec;
+    epicsUInt32 identifier;	/* As canMessage_t, may be extended */
+    epicsUInt8 flags;		/* LOG_RTR | LOG_TX */
+    epicsUInt8 length;
+    epicsUInt8 bus;		/* Index into busName[] */
+    epicsUInt8 spare[1];
+    epicsUInt8 data[CAN_DATA_SIZE];
+} logRecord_t;
+
+
+/* Each bus being recorded has a buffer of records, filled by its receive
+ * task and by the tasks sending on it, which serialise on the bus's own
+ * lock.  The recorder task empties the buffers into the log, so no file
+ * is touched while a message is being recorded. */
+
+typedef struct {
+    const char * volatile pbusName;	/* Driver's name pointer, NULL = free */
+    epicsMutexId lock;		/* Protects head, tail and dropped */
+    logRecord_t *pbuf;		/* REC_BUFFER records */
+    epicsUInt32 head;		/* Next record to fill */
+    epicsUInt32 tail;		/* Next record to log */
+    epicsUInt32 dropped;	/* Buffer was full */
+} recBus_t;
+
+static recBus_t recBus[LOG_MAX_BUSES];
+static epicsEventId recWakeup = NULL;	/* Buffer half full, or stopping */
+static epicsEventId recExited = NULL;	/* Recorder task has finished */
+static volatile int recStopping;
+static volatile epicsUInt32 recOverflow;	/* Bus LOG_MAX_BUSES + 1 */
+
+/* Recorder state, protected by recLock */
+
+static epicsMutexId recLock = NULL;
+static int recRunning = FALSE;
+static char *recBaseName = NULL;
+static size_t recFileSize;
+static int recKeep;
+static int recSequence;
+static char *precMap = NULL;
+static char *precNext = NULL;		/* Next file, opened in advance */
+static epicsUInt32 recMaxRecords;
+static int recNumBuses;			/* Names in the current header */
+static unsigned long recWritten;
+
+
+/* Replay state */
+
+static volatile int replayRunning = FALSE;
+static volatile int replayStop = FALSE;
+static unsigned long replayCount;
+static unsigned long replaySkipped;
+static unsigned long replayWaits;
+
+
+/*******************************************************************************
+
+Routine:
+    logName
+
+Purpose:
+    Build the name of a numbered log file
+
+Returns:
+    void
+
+*/
+
+static void logName (
+    char *name,
+    size_t size,
+    const char *baseName,
+    int sequence
+) {
+    epicsSnprintf(name, size, "%s.%d", baseName, sequence);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    logNames
+
+Purpose:
+    Copy new bus names into a log header
+
+Description:
+    Buses are given the next free slot in recBus[] the first time they
+    are recorded, and a slot's index is the bus number in the records.
+
+Returns:
+    void
+
+*/
+
+static void logNames (
+    char *pmap
+) {
+    logHeader_t *phead = (logHeader_t *) pmap;
+    int bus;
+
+    for (bus = phead->numBuses; bus < LOG_MAX_BUSES; bus++) {
+	const char *pbusName = recBus[bus].pbusName;
+
+	if (pbusName == NULL) break;
+	strncpy(phead->busName[bus], pbusName, CAN_BUSNAME_SIZE - 1);
+	phead->numBuses = bus + 1;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    logOpen, logClose
+
+Purpose:
+    Start and finish a log file
+
+Description:
+    logOpen creates a file of the sequence at its full size, maps it and
+    writes its header.  logClose unmaps a file and truncates it to the
+    records actually written.  Both are only called by the recorder task
+    or with it stopped.
+
+Returns:
+    logOpen returns the mapped file, or NULL if it failed; logClose is
+    void.
+
+*/
+
+static char * logOpen (
+    int sequence
+) {
+    char name[256];
+    logHeader_t *phead;
+    void *ptr;
+    int fd;
+
+    logName(name, sizeof(name), recBaseName, sequence);
+    fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+	printf("t810Record: Can't create '%s'\n", name);
+	return NULL;
+    }
+    if (ftruncate(fd, recFileSize) < 0) {
+	printf("t810Record: Can't size '%s'\n", name);
+	close(fd);
+	return NULL;
+    }
+    ptr = mmap(NULL, recFileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+	printf("t810Record: Can't map '%s'\n", name);
+	return NULL;
+    }
+
+    phead = ptr;
+    memcpy(phead->magic, LOG_MAGIC, sizeof(phead->magic));
+    phead->version    = LOG_VERSION;
+    phead->headerSize = LOG_HEADER_SIZE;
+    phead->recordSize = sizeof(logRecord_t);
+    phead->numBuses   = 0;
+    phead->numRecords = 0;
+    phead->sequence   = sequence;
+    logNames(ptr);
+    return ptr;
+}
+
+static void logClose (
+    char *pmap,
+    int sequence
+) {
+    char name[256];
+    logHeader_t *phead = (logHeader_t *) pmap;
+    size_t used;
+
+    if (pmap == NULL) return;
+
+    used = LOG_HEADER_SIZE + phead->numRecords * sizeof(logRecord_t);
+    munmap(pmap, recFileSize);
+
+    logName(name, sizeof(name), recBaseName, sequence);
+    if (used == LOG_HEADER_SIZE &&
+	sequence > recSequence) {
+	unlink(name);			/* Unused spare */
+    } else if (truncate(name, used) < 0) {
+	printf("t810Record: Can't truncate '%s'\n", name);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    logNext
+
+Purpose:
+    Move on to the next log file
+
+Description:
+    Switches to the file opened in advance, deletes the one that has
+    dropped off the end of the set being kept, then opens the following
+    file ready for next time.  If the spare couldn't be opened earlier it
+    gets another try here.  Called by the recorder task with recLock held.
+
+Returns:
+    0, or
+    ENOSPC if no next file could be opened.
+
+*/
+
+static int logNext (
+    void
+) {
+    char name[256];
+    char *pmap = precNext;
+
+    if (pmap == NULL) {
+	pmap = logOpen(recSequence + 1);
+	if (pmap == NULL) return ENOSPC;
+    }
+    logClose(precMap, recSequence);
+    precMap = pmap;
+    recSequence++;
+    logNames(precMap);
+
+    if (recSequence >= recKeep) {
+	logName(name, sizeof(name), recBaseName, recSequence - recKeep);
+	unlink(name);
+    }
+    precNext = logOpen(recSequence + 1);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    recordHook
+
+Purpose:
+    Buffer a message for the log
+
+Description:
+    Installed as t810RecordHook while recording.  It is called by the
+    receive tasks for received messages and by canWriteNotify for those
+    being sent, so several threads may record on one bus.  They serialise
+    on that bus's lock, and only the first message on a new bus takes
+    recLock, to give the bus a slot.  A message is dropped if its bus's
+    buffer is full, or would make more than LOG_MAX_BUSES buses.  The
+    recorder task is woken when a buffer gets half full.
+
+Returns:
+    void
+
+*/
+
+static void recordHook (
+    const char *pbusName,
+    int transmit,
+    const canMessage_t *pmessage
+) {
+    recBus_t *pbus;
+    logRecord_t *prec;
+    epicsUInt32 used;
+    int bus;
+
+    for (bus = 0; bus < LOG_MAX_BUSES; bus++) {
+	if (recBus[bus].pbusName == pbusName) break;
+    }
+    if (bus == LOG_MAX_BUSES) {
+	epicsMutexLock(recLock);
+	for (bus = 0; bus < LOG_MAX_BUSES; bus++) {
+	    if (recBus[bus].pbusName == pbusName) break;
+	    if (recBus[bus].pbusName == NULL) {
+		recBus[bus].pbusName = pbusName;
+		break;
+	    }
+	}
+	epicsMutexUnlock(recLock);
+	if (bus == LOG_MAX_BUSES) {
+	    recOverflow++;
+	    return;
+	}
+    }
+    pbus = &recBus[bus];
+
+    epicsMutexLock(pbus->lock);
+    used = pbus->head - pbus->tail;
+    if (used >= REC_BUFFER) {
+	pbus->dropped++;
+	epicsMutexUnlock(pbus->lock);
+	return;
+    }
+    prec = &pbus->pbuf[pbus->head % REC_BUFFER];
+    prec->secPastEpoch = pmessage->timestamp.secPastEpoch;
+    prec->nsec         = pmessage->timestamp.nsec;
+    prec->identifier   = pmessage->identifier;
+    prec->flags        = (pmessage->rtr == RTR ? LOG_RTR : 0) |
+			 (transmit ? LOG_TX : 0);
+    prec->length       = pmessage->length;
+    prec->bus          = bus;
+    memcpy(prec->data, pmessage->data, CAN_DATA_SIZE);
+    pbus->head++;
+    epicsMutexUnlock(pbus->lock);
+
+    if (used == REC_BUFFER / 2) {
+	epicsEventSignal(recWakeup);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    recordFlush
+
+Purpose:
+    Write the buffered messages to the log
+
+Description:
+    Takes the records that are in each bus's buffer now and merges them
+    into the log in time stamp order, moving on to the next file whenever
+    one fills.  The bus locks are only held to read the buffer positions
+    and to free the space afterwards.  Called by the recorder task with
+    recLock held.
+
+Returns:
+    0, or
+    ENOSPC if the log couldn't be continued.
+
+*/
+
+static int recordFlush (
+    void
+) {
+    epicsUInt32 tail[LOG_MAX_BUSES], head[LOG_MAX_BUSES];
+    logHeader_t *phead;
+    const logRecord_t *prec, *poldest;
+    int bus, numBuses, oldest;
+    int status = 0;
+
+    for (numBuses = 0; numBuses < LOG_MAX_BUSES; numBuses++) {
+	recBus_t *pbus = &recBus[numBuses];
+
+	if (pbus->pbusName == NULL) break;
+	epicsMutexLock(pbus->lock);
+	tail[numBuses] = pbus->tail;
+	head[numBuses] = pbus->head;
+	epicsMutexUnlock(pbus->lock);
+    }
+    if (numBuses > recNumBuses) {
+	logNames(precMap);
+	recNumBuses = numBuses;
+    }
+
+    while (TRUE) {
+	poldest = NULL;
+	oldest = 0;
+	for (bus = 0; bus < numBuses; bus++) {
+	    if (tail[bus] == head[bus]) continue;
+	    prec = &recBus[bus].pbuf[tail[bus] % REC_BUFFER];
+	    if (poldest == NULL ||
+		prec->secPastEpoch < poldest->secPastEpoch ||
+		(prec->secPastEpoch == poldest->secPastEpoch &&
+		 prec->nsec < poldest->nsec)) {
+		poldest = prec;
+		oldest = bus;
+	    }
+	}
+	if (poldest == NULL) break;
+
+	phead = (logHeader_t *) precMap;
+	if (phead->numRecords == recMaxRecords) {
+	    status = logNext();
+	    if (status) break;
+	    phead = (logHeader_t *) precMap;
+	}
+	((logRecord_t *) (precMap + LOG_HEADER_SIZE))[phead->numRecords] =
+	    *poldest;
+	phead->numRecords++;
+	recWritten++;
+	tail[oldest]++;
+    }
+
+    for (bus = 0; bus < numBuses; bus++) {
+	recBus_t *pbus = &recBus[bus];
+
+	epicsMutexLock(pbus->lock);
+	pbus->tail = tail[bus];
+	epicsMutexUnlock(pbus->lock);
+    }
+    return status;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    recordTask
+
+Purpose:
+    Recorder task
+
+Description:
+    Flushes the bus buffers to the log every REC_PERIOD seconds, or
+    sooner when one gets half full, and opens each log file before it is
+    needed.  On t810RecordStop it writes whatever is left, closes the log
+    and deletes the spare.  If the log can't be continued recording stops.
+
+Returns:
+    void
+
+*/
+
+static void recordTask (
+    void *parm
+) {
+    int stopping, status;
+
+    do {
+	epicsEventWaitWithTimeout(recWakeup, REC_PERIOD);
+	stopping = recStopping;
+
+	epicsMutexLock(recLock);
+	status = recordFlush();
+	if (status) {
+	    printf("t810Record: Log full, recording stopped\n");
+	    t810RecordHook = NULL;
+	    stopping = TRUE;
+	}
+	if (stopping) {
+	    t810FilterRecording(FALSE);
+	    logClose(precMap, recSequence);
+	    logClose(precNext, recSequence + 1);
+	    precMap = precNext = NULL;
+	    recRunning = FALSE;
+	}
+	epicsMutexUnlock(recLock);
+    } while (!stopping);
+
+    epicsEventSignal(recExited);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810RecordStart
+
+Purpose:
+    Start recording CAN traffic
+
+Description:
+    Starts logging all traffic on every TIP810 bus to the files
+    baseName.0, baseName.1 and so on, each of which holds up to fileMB
+    megabytes.  Only the latest keep files are kept, plus an empty spare
+    opened ready for the next.  Existing files with the same names are
+    overwritten.  Zero fileMB or keep selects the defaults of 16MB and 4
+    files; fileMB may be at most 2047, so that a file can be mapped on a
+    32-bit IOC.  Received messages are stamped with their arrival time, but
+    messages sent are stamped when they were queued for sending, not
+    when they went out on the bus.  Any acceptance filters turned on by
+    t810Filter are opened until recording stops.
+
+Returns:
+    0, or
+    S_t810_badParameter if already recording or a parameter is bad,
+    ENOMEM if malloc() or thread creation fails,
+    ENOSPC if the first file couldn't be created.
+
+Example:
+    t810RecordStart("/tmp/can", 64, 10)
+
+*/
+
+int t810RecordStart (
+    const char *baseName,
+    int fileMB,
+    int keep
+) {
+    int bus;
+
+    if (baseName == NULL || *baseName == '\0' ||
+	fileMB < 0 || fileMB > LOG_MAX_FILE_MB || keep < 0) {
+	return S_t810_badParameter;
+    }
+
+    /* Created on first use and kept, a failure is retried next time */
+    if (recWakeup == NULL) recWakeup = epicsEventCreate(epicsEventEmpty);
+    if (recExited == NULL) recExited = epicsEventCreate(epicsEventEmpty);
+    if (recWakeup == NULL ||
+	recExited == NULL) return ENOMEM;
+    for (bus = 0; bus < LOG_MAX_BUSES; bus++) {
+	if (recBus[bus].lock == NULL) recBus[bus].lock = epicsMutexCreate();
+	if (recBus[bus].pbuf == NULL)
+	    recBus[bus].pbuf = calloc(REC_BUFFER, sizeof(logRecord_t));
+	if (recBus[bus].lock == NULL ||
+	    recBus[bus].pbuf == NULL) return ENOMEM;
+    }
+    if (recLock == NULL) {
+	recLock = epicsMutexCreate();
+	if (recLock == NULL) return ENOMEM;
+    }
+
+    epicsMutexLock(recLock);
+    if (recRunning) {
+	epicsMutexUnlock(recLock);
+	return S_t810_badParameter;
+    }
+
+    free(recBaseName);
+    recBaseName = malloc(strlen(baseName) + 1);
+    if (recBaseName == NULL) {
+	epicsMutexUnlock(recLock);
+	return ENOMEM;
+    }
+    strcpy(recBaseName, baseName);
+
+    recFileSize = (size_t) (fileMB ? fileMB : LOG_FILE_MB) << 20;
+    recMaxRecords = (recFileSize - LOG_HEADER_SIZE) / sizeof(logRecord_t);
+    recKeep = keep ? keep : LOG_KEEP;
+    recSequence = 0;
+    recNumBuses = 0;
+    recWritten = 0;
+    recOverflow = 0;
+    for (bus = 0; bus < LOG_MAX_BUSES; bus++) {
+	recBus_t *pbus = &recBus[bus];
+
+	epicsMutexLock(pbus->lock);
+	pbus->pbusName = NULL;
+	pbus->head = pbus->tail = 0;
+	pbus->dropped = 0;
+	epicsMutexUnlock(pbus->lock);
+    }
+
+    precMap = logOpen(0);
+    if (precMap == NULL) {
+	epicsMutexUnlock(recLock);
+	return ENOSPC;
+    }
+    precNext = logOpen(1);
+
+    recStopping = FALSE;
+    epicsEventTryWait(recWakeup);
+    epicsEventTryWait(recExited);
+    if (epicsThreadCreate("t810Record", epicsThreadPriorityLow,
+			  epicsThreadGetStackSize(epicsThreadStackSmall),
+			  recordTask, NULL) == 0) {
+	logClose(precMap, 0);
+	logClose(precNext, 1);
+	precMap = precNext = NULL;
+	epicsMutexUnlock(recLock);
+	return ENOMEM;
+    }
+    recRunning = TRUE;
+    t810RecordHook = recordHook;
+    t810FilterRecording(TRUE);
+    epicsMutexUnlock(recLock);
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810RecordStop
+
+Purpose:
+    Stop recording CAN traffic
+
+Description:
+    Removes the recorder hook, then waits for the recorder task to write
+    the messages still buffered and close the current log file,
+    truncating it to the records written.
+
+Returns:
+    void
+
+*/
+
+void t810RecordStop (
+    void
+) {
+    int running;
+
+    if (recLock == NULL) return;
+
+    t810RecordHook = NULL;
+    epicsMutexLock(recLock);
+    running = recRunning && !recStopping;
+    recStopping = TRUE;
+    epicsMutexUnlock(recLock);
+
+    if (running) {
+	epicsEventSignal(recWakeup);
+	epicsEventWait(recExited);
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    replayTask
+
+Purpose:
+    Replay a log file
+
+Description:
+    Maps the log read-only and injects each of its received messages into
+    the receive ring of the bus it was recorded on, or of the bus named by
+    the caller.  Transmitted messages are skipped, as are messages for
+    buses that don't exist in this IOC.  If speed is positive the messages
+    are paced to their recorded intervals divided by speed; otherwise they
+    are injected as fast as possible, waiting whenever a receive ring is
+    full.  Prints the achieved rate at the end.
+
+Returns:
+    void
+
+*/
+
+typedef struct {
+    char *fileName;
+    char *busName;		/* Replace recorded bus names, or NULL */
+    double speed;
+} replayArgs_t;
+
+static void replayTask (
+    void *parm
+) {
+    replayArgs_t *pargs = parm;
+    canBusID_t busID[LOG_MAX_BUSES];
+    const logHeader_t *phead;
+    const logRecord_t *prec, *pend;
+    epicsTimeStamp start, now, first;
+    struct stat info;
+    double elapsed;
+    void *ptr;
+    int fd, bus;
+
+    fd = open(pargs->fileName, O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) < 0) {
+	printf("t810Replay: Can't open '%s'\n", pargs->fileName);
+	if (fd >= 0) close(fd);
+	goto done;
+    }
+    ptr = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+	printf("t810Replay: Can't map '%s'\n", pargs->fileName);
+	goto done;
+    }
+
+    phead = ptr;
+    if ((size_t) info.st_size < LOG_HEADER_SIZE ||
+	memcmp(phead->magic, LOG_MAGIC, sizeof(phead->magic)) != 0 ||
+	phead->version != LOG_VERSION ||
+	phead->recordSize != sizeof(logRecord_t) ||
+	phead->numBuses > LOG_MAX_BUSES ||
+	phead->headerSize + (size_t) phead->numRecords * sizeof(logRecord_t)
+	    > (size_t) info.st_size) {
+	printf("t810Replay: '%s' is not a CAN log\n", pargs->fileName);
+	munmap(ptr, info.st_size);
+	goto done;
+    }
+
+    for (bus = 0; bus < (int) phead->numBuses; bus++) {
+	const char *name = pargs->busName ? pargs->busName
+					  : phead->busName[bus];
+	if (canOpen(name, &busID[bus])) {
+	    printf("t810Replay: No bus '%s', skipping its messages\n", name);
+	    busID[bus] = NULL;
+	}
+    }
+
+    prec = (const logRecord_t *) ((const char *) ptr + phead->headerSize);
+    pend = prec + phead->numRecords;
+    if (prec < pend) {
+	first.secPastEpoch = prec->secPastEpoch;
+	first.nsec = prec->nsec;
+    }
+    epicsTimeGetCurrent(&start);
+
+    for (; prec < pend && !replayStop; prec++) {
+	canMessage_t message;
+	int status;
+
+	if ((prec->flags & LOG_TX) ||
+	    prec->bus >= phead->numBuses ||
+	    busID[prec->bus] == NULL) {
+	    replaySkipped++;
+	    continue;
+	}
+
+	if (pargs->speed > 0.0) {
+	    epicsTimeStamp when;
+	    double due;
+
+	    when.secPastEpoch = prec->secPastEpoch;
+	    when.nsec = prec->nsec;
+	    due = epicsTimeDiffInSeconds(&when, &first) / pargs->speed;
+	    epicsTimeGetCurrent(&now);
+	    elapsed = epicsTimeDiffInSeconds(&now, &start);
+	    if (due - elapsed > REPLAY_AHEAD) {
+		epicsThreadSleep(due - elapsed);
+	    }
+	}
+
+	message.identifier = prec->identifier;
+	message.rtr        = (prec->flags & LOG_RTR) ? RTR : SEND;
+	message.length     = prec->length;
+	memcpy(message.data, prec->data, CAN_DATA_SIZE);
+
+	while ((status = t810RecvInject(busID[prec->bus], &message)) ==
+	       S_t810_queueFull && !replayStop) {
+	    replayWaits++;
+	    epicsThreadSleep(0.0);
+	}
+	if (status == 0) {
+	    replayCount++;
+	} else {
+	    replaySkipped++;
+	}
+    }
+
+    epicsTimeGetCurrent(&now);
+    elapsed = epicsTimeDiffInSeconds(&now, &start);
+    printf("t810Replay: %lu messages in %.3f sec", replayCount, elapsed);
+    if (elapsed > 0.0) {
+	printf(" = %.0f msg/sec", replayCount / elapsed);
+    }
+    printf(", %lu skipped, %lu waits for a full queue%s\n",
+	   replaySkipped, replayWaits, replayStop ? " (stopped)" : "");
+    munmap(ptr, info.st_size);
+
+done:
+    free(pargs->fileName);
+    free(pargs->busName);
+    free(pargs);
+    replayRunning = FALSE;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810Replay
+
+Purpose:
+    Start replaying a CAN log file
+
+Description:
+    Starts a thread to replay the received messages in the named log
+    file.  A speed of 1.0 replays at the recorded rate, 10.0 ten times as
+    fast, and 0 as fast as possible.  If busName is given all messages are
+    sent to that bus, otherwise each goes to the bus it was recorded on.
+    Only one replay can run at a time.
+
+Returns:
+    0, or
+    S_t810_badParameter if a replay is already running,
+    ENOMEM if malloc() or thread creation fails.
+
+Example:
+    t810Replay("/tmp/can.3", 0, "")
+
+*/
+
+int t810Replay (
+    const char *fileName,
+    double speed,
+    const char *busName
+) {
+    replayArgs_t *pargs;
+
+    if (fileName == NULL || *fileName == '\0' ||
+	replayRunning) {
+	return S_t810_badParameter;
+    }
+
+    pargs = calloc(1, sizeof(replayArgs_t));
+    if (pargs == NULL) return ENOMEM;
+    pargs->fileName = malloc(strlen(fileName) + 1);
+    if (pargs->fileName == NULL) {
+	free(pargs);
+	return ENOMEM;
+    }
+    strcpy(pargs->fileName, fileName);
+    if (busName != NULL && *busName != '\0') {
+	pargs->busName = malloc(strlen(busName) + 1);
+	if (pargs->busName == NULL) {
+	    free(pargs->fileName);
+	    free(pargs);
+	    return ENOMEM;
+	}
+	strcpy(pargs->busName, busName);
+    }
+    pargs->speed = speed;
+
+    replayRunning = TRUE;
+    replayStop = FALSE;
+    replayCount = replaySkipped = replayWaits = 0;
+    if (epicsThreadCreate("t810Replay", epicsThreadPriorityMedium,
+			  epicsThreadGetStackSize(epicsThreadStackSmall),
+			  replayTask, pargs) == 0) {
+	replayRunning = FALSE;
+	free(pargs->fileName);
+	free(pargs->busName);
+	free(pargs);
+	return ENOMEM;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810ReplayStop
+
+Purpose:
+    Stop a running replay
+
+Returns:
+    void
+
+*/
+
+void t810ReplayStop (
+    void
+) {
+    replayStop = TRUE;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810RecordReport
+
+Purpose:
+    Report recorder and replay status
+
+Returns:
+    void
+
+*/
+
+void t810RecordReport (
+    void
+) {
+    if (recLock != NULL) {
+	unsigned long dropped = recOverflow;
+	int bus;
+
+	epicsMutexLock(recLock);
+	for (bus = 0; bus < recNumBuses; bus++) {
+	    dropped += recBus[bus].dropped;
+	}
+	if (recRunning) {
+	    printf("Recording to '%s.%d', keeping %d files of %lu MB\n",
+		   recBaseName, recSequence, recKeep,
+		   (unsigned long) (recFileSize >> 20));
+	    printf("  %d buses, %lu messages written, %lu dropped\n",
+		   recNumBuses, recWritten, dropped);
+	} else {
+	    printf("Not recording, last recording %lu messages, %lu dropped\n",
+		   recWritten, dropped);
+	}
+	epicsMutexUnlock(recLock);
+    } else {
+	printf("Not recording\n");
+    }
+
+    printf("%s, %lu messages replayed, %lu skipped, %lu waits\n",
+	   replayRunning ? "Replay running" : "No replay running",
+	   replayCount, replaySkipped, replayWaits);
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+/* t810RecordStart(char *baseName, int fileMB, int keep) */
+static const iocshArg t810RecordStartArg0 = {"baseName", iocshArgString};
+static const iocshArg t810RecordStartArg1 = {"fileMB", iocshArgInt};
+static const iocshArg t810RecordStartArg2 = {"keep", iocshArgInt};
+static const iocshArg * const t810RecordStartArgs[3] = {
+    &t810RecordStartArg0, &t810RecordStartArg1, &t810RecordStartArg2};
+static const iocshFuncDef t810RecordStartFuncDef =
+    {"t810RecordStart",3,t810RecordStartArgs};
+static void t810RecordStartCallFunc(const iocshArgBuf *args)
+{
+    int status = t810RecordStart(args[0].sval, args[1].ival, args[2].ival);
+    if (status)
+	printf("t810RecordStart: Error %#x\n", status);
+}
+
+/* t810RecordStop() */
+static const iocshFuncDef t810RecordStopFuncDef =
+    {"t810RecordStop",0,NULL};
+static void t810RecordStopCallFunc(const iocshArgBuf *args)
+{
+    t810RecordStop();
+}
+
+/* t810RecordReport() */
+static const iocshFuncDef t810RecordReportFuncDef =
+    {"t810RecordReport",0,NULL};
+static void t810RecordReportCallFunc(const iocshArgBuf *args)
+{
+    t810RecordReport();
+}
+
+/* t810Replay(char *fileName, double speed, char *busName) */
+static const iocshArg t810ReplayArg0 = {"fileName", iocshArgString};
+static const iocshArg t810ReplayArg1 = {"speed", iocshArgDouble};
+static const iocshArg t810ReplayArg2 = {"busName", iocshArgString};
+static const iocshArg * const t810ReplayArgs[3] = {
+    &t810ReplayArg0, &t810ReplayArg1, &t810ReplayArg2};
+static const iocshFuncDef t810ReplayFuncDef =
+    {"t810Replay",3,t810ReplayArgs};
+static void t810ReplayCallFunc(const iocshArgBuf *args)
+{
+    int status = t810Replay(args[0].sval, args[1].dval, args[2].sval);
+    if (status)
+	printf("t810Replay: Error %#x\n", status);
+}
+
+/* t810ReplayStop() */
+static const iocshFuncDef t810ReplayStopFuncDef =
+    {"t810ReplayStop",0,NULL};
+static void t810ReplayStopCallFunc(const iocshArgBuf *args)
+{
+    t810ReplayStop();
+}
+
+static void drvTip810RecordRegistrar(void) {
+    iocshRegister(&t810RecordStartFuncDef,t810RecordStartCallFunc);
+    iocshRegister(&t810RecordStopFuncDef,t810RecordStopCallFunc);
+    iocshRegister(&t810RecordReportFuncDef,t810RecordReportCallFunc);
+    iocshRegister(&t810ReplayFuncDef,t810ReplayCallFunc);
+    iocshRegister(&t810ReplayStopFuncDef,t810ReplayStopCallFunc);
+}
+epicsExportRegistrar(drvTip810RecordRegistrar);
@@ -0,0 +1,983 @@
+/*******************************************************************************
+
+Project:
+    CAN Bus Driver for EPICS
+
+File:
+    drvTip810Sim.c
+
+Description:
+    Register-level emulation of the PCA82C200 CAN controller on a TIP810,
+    for use in a slot of the simulated IPAC carrier (drvIpacSim.c).  Each
+    emulated chip has a thread which watches the registers that drvTip810
+    writes, acts on its commands, paces transmitted and received frames
+    according to the bit rate programmed into the bus timing registers,
+    and raises interrupts through ipacSimInterrupt().  Received frames can
+    be injected at a configurable rate and ID distribution, and error and
+    bus-off events at configurable intervals.
+
+    t810SimBench uses the emulator to measure the latency from a frame
+    arriving in the chip through the ISR and receive task to a canMessage
+    callback, and the frame rate that a bus can sustain.
+
+    This library is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License, or (at your option) any later version.
+
+    This library is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+    Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with this library; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+*******************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <epicsTypes.h>
+#include <dbDefs.h>
+#include <iocsh.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
+#include <epicsInterrupt.h>
+#include <epicsStdio.h>
+#include <epicsExport.h>
+
+#include "canBus.h"
+#include "drvTip810.h"
+#include "drvIpac.h"
+#include "drvIpacSim.h"
+#include "pca82c200.h"
+
+
+#define SIM_CLOCK 16e6		/* TIP810 oscillator frequency, Hz */
+#define SIM_IDLE_POLL 0.001	/* Register poll interval when idle */
+#define SIM_SPIN_LIMIT 0.002	/* Yield rather than sleep for waits < this */
+#define SIM_FRAME_BITS 47	/* Standard frame overhead, no stuff bits */
+#define STAMP_RING 16384	/* Injection times remembered, power of 2 */
+#define HIST_BINS 24		/* Latency histogram, log2 microseconds */
+#define INTVEC_OFFSET 0x41	/* TIP810 interrupt vector register */
+#define TX_TAKEN 0x0f		/* Descriptor 1 after a frame has been taken */
+
+
+typedef struct simChip_s {
+    struct simChip_s *pnext;
+    int carrier;		/* Simulated carrier .. */
+    int slot;			/* .. and slot number */
+    pca82c200_t *pchip;		/* Emulated registers */
+    int lastControl;		/* Control register at last poll */
+    /* Injection settings */
+    int injecting;		/* Generating received frames */
+    double rate;		/* frames/sec, 0 = bus limited, <0 = unpaced */
+    int idFirst;		/* Lowest injected ID */
+    int idCount;		/* Number of IDs to use */
+    int idRandom;		/* Pick IDs at random, else in sequence */
+    int length;			/* Data bytes per frame */
+    int errorEvery;		/* Error warning every N frames, 0 = never */
+    int busOffEvery;		/* Bus off every N frames, 0 = never */
+    /* Chip state */
+    msgBuffer_t rxHold;		/* Second receive buffer */
+    int rxHoldFull;
+    double txDoneAt;		/* When current transmission ends, 0 = idle */
+    double busFreeAt;		/* When the bus is next idle */
+    double nextInjectAt;	/* When the next frame should arrive */
+    epicsUInt32 random;		/* Random number state */
+    epicsUInt32 sequence;	/* Number of frames injected */
+    double stamp[STAMP_RING];	/* Injection time of recent frames */
+    /* Counters */
+    unsigned long injected;	/* Frames injected */
+    unsigned long transmitted;	/* Frames sent by the driver */
+    unsigned long overruns;	/* Frames lost, both receive buffers full */
+    unsigned long filtered;	/* Frames rejected by the acceptance filter */
+    unsigned long interrupts;	/* Interrupts raised */
+    unsigned long errors;	/* Error and bus-off events */
+} simChip_t;
+
+static simChip_t *psimFirst = NULL;
+static epicsTimeStamp simEpoch;
+
+
+/*******************************************************************************
+
+Routine:
+    simNow
+
+Purpose:
+    Returns the time in seconds since the first emulator was created
+
+*/
+
+static double simNow (
+    void
+) {
+    epicsTimeStamp now;
+
+    epicsTimeGetCurrent(&now);
+    return epicsTimeDiffInSeconds(&now, &simEpoch);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    simFind
+
+Purpose:
+    Returns the emulator for a carrier and slot, or NULL
+
+*/
+
+static simChip_t *simFind (
+    int carrier,
+    int slot
+) {
+    simChip_t *psim = psimFirst;
+
+    while (psim != NULL &&
+	   (psim->carrier != carrier || psim->slot != slot))
+	psim = psim->pnext;
+    return psim;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    bitTime
+
+Purpose:
+    Returns the length of one bit on the bus in seconds
+
+Description:
+    Derived from the bus timing registers in the same way as the real chip,
+    so the frame pacing follows whatever rate t810Create programmed.
+
+*/
+
+static double bitTime (
+    pca82c200_t *pchip
+) {
+    int brp = pchip->busTiming0 & 0x3f;
+    int tseg1 = pchip->busTiming1 & 0x0f;
+    int tseg2 = (pchip->busTiming1 >> 4) & 0x07;
+
+    return (2.0 * (brp + 1) / SIM_CLOCK) * (3 + tseg1 + tseg2);
+}
+
+static double frameTime (
+    pca82c200_t *pchip,
+    int desc1
+) {
+    int bytes = (desc1 & PCA_MSG_RTR) ? 0 : (desc1 & PCA_MSG_DLC_MASK);
+
+    if (bytes > CAN_DATA_SIZE)
+	bytes = CAN_DATA_SIZE;
+    return (SIM_FRAME_BITS + 8 * bytes) * bitTime(pchip);
+}
+
+
+/*******************************************************************************
+
+Routine:
+    simReset
+
+Purpose:
+    Puts the emulated chip into its reset state
+
+Description:
+    Abandons any transmission in progress and empties both receive buffers,
+    as the real chip does when the Reset Request bit is set.
+
+*/
+
+static void simReset (
+    simChip_t *psim
+) {
+    psim->pchip->status = PCA_SR_TBS | PCA_SR_TCS;
+    psim->pchip->interrupt = 0;
+    psim->pchip->txBuffer.descriptor1 = TX_TAKEN;
+    psim->rxHoldFull = FALSE;
+    psim->txDoneAt = 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    simRelease
+
+Purpose:
+    Releases the receive buffer
+
+Description:
+    Moves the frame in the second receive buffer, if any, into the receive
+    buffer, otherwise marks the receive buffer as empty.
+
+Returns:
+    Interrupt register bits to be raised.
+
+*/
+
+static int simRelease (
+    simChip_t *psim
+) {
+    pca82c200_t *pchip = psim->pchip;
+
+    if (psim->rxHoldFull) {
+	memcpy((void *) &pchip->rxBuffer, &psim->rxHold, sizeof(msgBuffer_t));
+	psim->rxHoldFull = FALSE;
+	return PCA_IR_RI;
+    }
+    pchip->status &= ~PCA_SR_RBS;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    simCommand
+
+Purpose:
+    Acts on any command written to the command register since the last poll
+
+Description:
+    Plain memory only holds the last value written to the command register,
+    and the driver's ISR can write Release Receive Buffer and Transmission
+    Request one after the other.  Hence a release is assumed to follow every
+    receive interrupt (see simDeliver), and after taking a frame from the
+    transmit buffer the emulator sets its data length code to 15, a value
+    that the driver never writes; a transmit buffer with any other length
+    is treated as a Transmission Request even if the command was lost.
+
+Returns:
+    void
+
+*/
+
+static void simCommand (
+    simChip_t *psim,
+    double now
+) {
+    pca82c200_t *pchip = psim->pchip;
+    int command;
+    int key = epicsInterruptLock();
+
+    command = pchip->command;
+    pchip->command = 0;
+    epicsInterruptUnlock(key);
+
+    if (command & PCA_CMR_COS) {
+	pchip->status &= ~PCA_SR_DO;
+    }
+
+    if ((command & PCA_CMR_AT) && psim->txDoneAt) {
+	psim->txDoneAt = 0;
+	pchip->status = (pchip->status & ~(PCA_SR_TS | PCA_SR_TCS)) |
+			PCA_SR_TBS;
+    }
+
+    if (((command & PCA_CMR_TR) ||
+	 (pchip->txBuffer.descriptor1 & PCA_MSG_DLC_MASK) != TX_TAKEN) &&
+	!psim->txDoneAt) {
+	double start = now > psim->busFreeAt ? now : psim->busFreeAt;
+
+	psim->txDoneAt = start + frameTime(pchip, pchip->txBuffer.descriptor1);
+	psim->busFreeAt = psim->txDoneAt;
+	pchip->txBuffer.descriptor1 = TX_TAKEN;
+	pchip->status = (pchip->status & ~(PCA_SR_TBS | PCA_SR_TCS)) |
+			PCA_SR_TS;
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    simInject
+
+Purpose:
+    Delivers a new frame to the emulated receive buffers
+
+Description:
+    Builds a frame using the injection settings.  If there are at least 4
+    data bytes the first 4 hold the frame's sequence number, which
+    t810SimBench uses to look up when it was injected.  Frames that the
+    acceptance filter rejects are dropped.  Otherwise the frame goes into
+    the receive buffer if that is free, or into the second buffer; if both
+    are full the frame is lost and a data overrun is flagged.
+
+Returns:
+    Interrupt register bits to be raised.
+
+*/
+
+static int simInject (
+    simChip_t *psim,
+    double now
+) {
+    pca82c200_t *pchip = psim->pchip;
+    epicsUInt32 seq = psim->sequence++;
+    msgBuffer_t frame;
+    int id, i, irq = 0;
+
+    if (psim->idRandom) {
+	psim->random = psim->random * 1103515245 + 12345;
+	id = psim->idFirst + (psim->random >> 8) % psim->idCount;
+    } else {
+	id = psim->idFirst + seq % psim->idCount;
+    }
+
+    frame.pad0 = frame.pad1 = 0;
+    frame.descriptor0 = id >> PCA_MSG_ID0_RSHIFT;
+    frame.descriptor1 = ((id << PCA_MSG_ID1_LSHIFT) & PCA_MSG_ID1_MASK) |
+			psim->length;
+    for (i = 0; i < CAN_DATA_SIZE; i++) {
+	frame.data[i] = i < 4 ? (seq >> (24 - 8 * i)) & 0xff : i;
+    }
+
+    psim->stamp[seq & (STAMP_RING - 1)] = now;
+    psim->injected++;
+
+    if ((frame.descriptor0 ^ pchip->acceptanceCode) &
+	~pchip->acceptanceMask) {
+	/* The acceptance filter compares the top 8 bits of the ID */
+	psim->filtered++;
+    } else if (!(pchip->status & PCA_SR_RBS)) {
+	memcpy((void *) &pchip->rxBuffer, &frame, sizeof(msgBuffer_t));
+	pchip->status |= PCA_SR_RBS;
+	irq |= PCA_IR_RI;
+    } else if (!psim->rxHoldFull) {
+	psim->rxHold = frame;
+	psim->rxHoldFull = TRUE;
+    } else {
+	psim->overruns++;
+	pchip->status |= PCA_SR_DO;
+	irq |= PCA_IR_OI;
+    }
+
+    if (psim->busOffEvery && psim->injected % psim->busOffEvery == 0) {
+	/* Bus off aborts any transmission and forces the chip into reset */
+	psim->errors++;
+	psim->txDoneAt = 0;
+	pchip->status |= PCA_SR_BS | PCA_SR_ES | PCA_SR_TBS | PCA_SR_TCS;
+	pchip->control |= PCA_CR_RR;
+	psim->lastControl = pchip->control;
+	irq |= PCA_IR_EI;
+    } else if (psim->errorEvery && psim->injected % psim->errorEvery == 0) {
+	/* Alternately raise and clear the error warning */
+	psim->errors++;
+	pchip->status ^= PCA_SR_ES;
+	irq |= PCA_IR_EI;
+    }
+
+    if (psim->rate > 0) {
+	psim->nextInjectAt += 1.0 / psim->rate;
+	if (psim->nextInjectAt < now)
+	    psim->nextInjectAt = now;	/* Don't try to catch up */
+    }
+    if (psim->rate >= 0) {
+	psim->busFreeAt = now + frameTime(pchip, frame.descriptor1);
+    }
+    return irq;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    simDeliver
+
+Purpose:
+    Raises an interrupt from the emulated chip
+
+Description:
+    Masks the interrupt sources with the enable bits in the control
+    register, presents the rest in the interrupt register and calls the
+    driver's ISR through the simulated carrier.  The interrupt register is
+    cleared afterwards, as reading it does on the real chip.
+
+Returns:
+    Interrupt register bits to be raised next.
+
+*/
+
+static int simDeliver (
+    simChip_t *psim,
+    int irq
+) {
+    pca82c200_t *pchip = psim->pchip;
+    int control = pchip->control;
+    int vector = *((epicsUInt8 *) pchip + INTVEC_OFFSET);
+
+    if (!(control & PCA_CR_RIE)) irq &= ~PCA_IR_RI;
+    if (!(control & PCA_CR_TIE)) irq &= ~PCA_IR_TI;
+    if (!(control & PCA_CR_EIE)) irq &= ~PCA_IR_EI;
+    if (!(control & PCA_CR_OIE)) irq &= ~PCA_IR_OI;
+    if (irq == 0)
+	return 0;
+
+    pchip->interrupt = irq;
+    psim->interrupts++;
+    ipacSimInterrupt(psim->carrier, psim->slot, vector);
+    pchip->interrupt = 0;
+
+    if (irq & PCA_IR_OI) {
+	/* The ISR has reset the chip, which clears the overrun */
+	pchip->status &= ~PCA_SR_DO;
+    }
+    if ((irq & PCA_IR_EI) && (pchip->status & PCA_SR_BS)) {
+	/* The ISR has restarted the chip, so the bus has recovered */
+	pchip->status &= ~(PCA_SR_BS | PCA_SR_ES);
+    }
+    return (irq & PCA_IR_RI) ? simRelease(psim) : 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    simTask
+
+Purpose:
+    Emulator thread, one per chip
+
+Description:
+    Polls the control and command registers, completes transmissions and
+    injects frames when they fall due, and raises the resulting interrupts.
+    Waits of more than a couple of milliseconds are slept through, shorter
+    ones spin yielding the CPU, so frame pacing is accurate to the
+    resolution of the system clock.
+
+*/
+
+static void simTask (
+    void *parg
+) {
+    simChip_t *psim = (simChip_t *) parg;
+    pca82c200_t *pchip = psim->pchip;
+    int pending = 0;
+
+    while (TRUE) {
+	double now = simNow();
+	double next = 0;
+	int control = pchip->control;
+	int irq = pending;
+
+	if (control & PCA_CR_RR) {
+	    if (!(psim->lastControl & PCA_CR_RR))
+		simReset(psim);
+	    psim->lastControl = control;
+	    pchip->command = 0;
+	    pending = 0;
+	    epicsThreadSleep(SIM_IDLE_POLL);
+	    continue;
+	}
+	if (psim->lastControl & PCA_CR_RR) {
+	    psim->busFreeAt = psim->nextInjectAt = now;
+	}
+	psim->lastControl = control;
+
+	simCommand(psim, now);
+
+	if (psim->txDoneAt) {
+	    if (now >= psim->txDoneAt) {
+		psim->txDoneAt = 0;
+		psim->transmitted++;
+		pchip->status = (pchip->status & ~PCA_SR_TS) |
+				PCA_SR_TBS | PCA_SR_TCS;
+		irq |= PCA_IR_TI;
+	    } else {
+		next = psim->txDoneAt;
+	    }
+	}
+
+	if (psim->injecting) {
+	    if (psim->rate < 0) {
+		if (!(pchip->status & PCA_SR_RBS))
+		    irq |= simInject(psim, now);
+	    } else {
+		double due = psim->nextInjectAt > psim->busFreeAt ?
+			     psim->nextInjectAt : psim->busFreeAt;
+		if (now >= due) {
+		    irq |= simInject(psim, now);
+		    if (psim->rate == 0)
+			psim->nextInjectAt = psim->busFreeAt;
+		} else if (next == 0 || due < next) {
+		    next = due;
+		}
+	    }
+	}
+
+	if (irq) {
+	    pending = simDeliver(psim, irq);
+	} else if (psim->injecting && psim->rate < 0) {
+	    epicsThreadSleep(0.0);
+	} else if (next == 0) {
+	    epicsThreadSleep(SIM_IDLE_POLL);
+	} else if (next - now > SIM_SPIN_LIMIT) {
+	    epicsThreadSleep(next - now - SIM_SPIN_LIMIT / 2);
+	} else {
+	    epicsThreadSleep(0.0);
+	}
+    }
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810SimCreate
+
+Purpose:
+    Install an emulated TIP810 in a simulated carrier slot
+
+Description:
+    Loads the slot's ID Prom with the TIP810 IDs, puts the emulated chip
+    into its reset state and starts the emulator thread.  Must be called
+    before t810Create for the same carrier and slot.
+
+Returns:
+    0, or
+    S_t810_duplicateDevice if the slot already has an emulator,
+    ENOMEM if malloc() or thread creation fails,
+    any result from ipacSimLoadId().
+
+Example:
+    t810SimCreate 0, 0
+
+*/
+
+int t810SimCreate (
+    int carrier,
+    int slot
+) {
+    simChip_t *psim;
+    char name[32];
+    int status;
+
+    if (simFind(carrier, slot) != NULL)
+	return S_t810_duplicateDevice;
+
+    status = ipacSimLoadId(carrier, slot, "0xb3/0x01");
+    if (status)
+	return status;
+
+    psim = calloc(1, sizeof(simChip_t));
+    if (psim == NULL)
+	return ENOMEM;
+
+    if (psimFirst == NULL)
+	epicsTimeGetCurrent(&simEpoch);
+
+    psim->carrier = carrier;
+    psim->slot    = slot;
+    psim->pchip   = (pca82c200_t *) ipmBaseAddr(carrier, slot, ipac_addrIO);
+    psim->idCount = 1;
+    psim->length  = CAN_DATA_SIZE;
+    psim->random  = 1;
+    psim->pchip->control = PCA_CR_RR;
+    psim->lastControl    = PCA_CR_RR;
+    simReset(psim);
+
+    epicsSnprintf(name, sizeof(name), "t810Sim:%d:%d", carrier, slot);
+    if (epicsThreadCreate(name, epicsThreadPriorityMax,
+			  epicsThreadGetStackSize(epicsThreadStackSmall),
+			  simTask, psim) == 0) {
+	free(psim);
+	return ENOMEM;
+    }
+
+    psim->pnext = psimFirst;
+    psimFirst = psim;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810SimInject
+
+Purpose:
+    Start or stop injecting received frames into an emulated chip
+
+Description:
+    Frames are injected at rate per second, or back to back at the bus bit
+    rate if rate is 0, or as fast as the driver can release the receive
+    buffer if rate is negative (ignoring the bus timing).  Each frame has
+    length data bytes and an ID in the range idFirst to idFirst+idCount-1,
+    chosen at random if idRandom is set or in sequence otherwise.  An
+    idCount of 0 stops injection.
+
+Returns:
+    0, or
+    S_can_noDevice if there is no emulator in the slot,
+    S_can_badMessage for a bad ID range or length.
+
+Example:
+    t810SimInject 0, 0, 1000, 0x100, 16, 1, 8
+
+*/
+
+int t810SimInject (
+    int carrier,
+    int slot,
+    double rate,
+    int idFirst,
+    int idCount,
+    int idRandom,
+    int length
+) {
+    simChip_t *psim = simFind(carrier, slot);
+
+    if (psim == NULL)
+	return S_can_noDevice;
+
+    if (idCount == 0) {
+	psim->injecting = FALSE;
+	return 0;
+    }
+
+    if (idFirst < 0 ||
+	idCount < 0 ||
+	idFirst + idCount > CAN_IDENTIFIERS ||
+	length < 0 ||
+	length > CAN_DATA_SIZE) {
+	return S_can_badMessage;
+    }
+
+    psim->injecting = FALSE;
+    psim->rate     = rate;
+    psim->idFirst  = idFirst;
+    psim->idCount  = idCount;
+    psim->idRandom = idRandom;
+    psim->length   = length;
+    psim->nextInjectAt = simNow();
+    psim->injecting = TRUE;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810SimErrors
+
+Purpose:
+    Set the error pattern of an emulated chip
+
+Description:
+    After every errorEvery injected frames the chip toggles its error
+    warning status and raises an error interrupt, and after every
+    busOffEvery frames it goes bus off.  Zero disables either event.
+
+Returns:
+    0, or
+    S_can_noDevice if there is no emulator in the slot.
+
+Example:
+    t810SimErrors 0, 0, 10000, 0
+
+*/
+
+int t810SimErrors (
+    int carrier,
+    int slot,
+    int errorEvery,
+    int busOffEvery
+) {
+    simChip_t *psim = simFind(carrier, slot);
+
+    if (psim == NULL)
+	return S_can_noDevice;
+
+    psim->errorEvery  = errorEvery > 0 ? errorEvery : 0;
+    psim->busOffEvery = busOffEvery > 0 ? busOffEvery : 0;
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810SimReport
+
+Purpose:
+    Report the state of all emulated chips
+
+Returns:
+    0
+
+*/
+
+int t810SimReport (
+    int interest
+) {
+    simChip_t *psim = psimFirst;
+
+    while (psim != NULL) {
+	printf("  Emulated TIP810 : IP Carrier %d Slot %d, %s\n",
+		psim->carrier, psim->slot,
+		psim->pchip->control & PCA_CR_RR ? "Reset" : "Running");
+	if (interest > 0) {
+	    printf("\tBit time            : %.3f usec\n",
+		    bitTime(psim->pchip) * 1e6);
+	    printf("\tFrames Injected     : %lu\n", psim->injected);
+	    printf("\tFrames Transmitted  : %lu\n", psim->transmitted);
+	    printf("\tReceive Overruns    : %lu\n", psim->overruns);
+	    printf("\tFrames Filtered     : %lu\n", psim->filtered);
+	    printf("\tError Events        : %lu\n", psim->errors);
+	    printf("\tInterrupts Raised   : %lu\n", psim->interrupts);
+	}
+	psim = psim->pnext;
+    }
+    return 0;
+}
+
+
+/*******************************************************************************
+
+Routine:
+    t810SimBench
+
+Purpose:
+    Measure receive latency and throughput of a bus using the emulator
+
+Description:
+    Registers a callback for every ID in the emulator's injection range,
+    injects frames for the given number of seconds at the given rate (as
+    for t810SimInject, using the ID distribution from the most recent
+    t810SimInject call), then reports the frame rates achieved, the number
+    of frames lost, and the latency from each frame's arrival in the chip
+    to its callback.  Driver error messages are silenced during the run.
+    Run the benchmark with increasing rates to find the highest rate the
+    bus sustains without loss; a negative rate measures the driver's own
+    limit, regardless of the bus bit rate.
+
+Returns:
+    0, or
+    S_can_noDevice if the bus or emulator is unknown,
+    ENOMEM if memory could not be allocated,
+    any result from canMessage().
+
+Example:
+    t810SimBench "CAN1", 0, 0, 10, 5000
+
+*/
+
+typedef struct {
+    simChip_t *psim;
+    unsigned long count;
+    double sum;
+    double min;
+    double max;
+    unsigned long hist[HIST_BINS];
+} bench_t;
+
+static void benchCallback (
+    void *pprivate,
+    const canMessage_t *pmessage
+) {
+    bench_t *pbench = (bench_t *) pprivate;
+    epicsUInt32 seq;
+    double latency;
+    int bin = 0;
+
+    if (pmessage->length < 4)
+	return;
+
+    seq = pmessage->data[0] << 24 | pmessage->data[1] << 16 |
+	  pmessage->data[2] << 8 | pmessage->data[3];
+    latency = simNow() - pbench->psim->stamp[seq & (STAMP_RING - 1)];
+
+    pbench->count++;
+    pbench->sum += latency;
+    if (latency < pbench->min) pbench->min = latency;
+    if (latency > pbench->max) pbench->max = latency;
+
+    latency *= 1e6;
+    while (latency >= 2 && bin < HIST_BINS - 1) {
+	latency /= 2;
+	bin++;
+    }
+    pbench->hist[bin]++;
+}
+
+int t810SimBench (
+    const char *pbusName,
+    int carrier,
+    int slot,
+    double seconds,
+    double rate
+) {
+    simChip_t *psim = simFind(carrier, slot);
+    canBusID_t busID;
+    bench_t *pbench;
+    unsigned long injected, overruns;
+    int silence = canSilenceErrors;
+    double start, elapsed;
+    int id, status, bin;
+
+    if (psim == NULL)
+	return S_can_noDevice;
+    status = canOpen(pbusName, &busID);
+    if (status)
+	return status;
+
+    /* The receive task may still be using it after the deletes below */
+    pbench = calloc(1, sizeof(bench_t));
+    if (pbench == NULL)
+	return ENOMEM;
+    pbench->psim = psim;
+    pbench->min  = 1e9;
+
+    for (id = psim->idFirst; id < psim->idFirst + psim->idCount; id++) {
+	status = canMessage(busID, id, benchCallback, pbench);
+	if (status)
+	    goto done;
+    }
+
+    canSilenceErrors = TRUE;
+    injected = psim->injected;
+    overruns = psim->overruns;
+    status = t810SimInject(carrier, slot, rate, psim->idFirst, psim->idCount,
+			   psim->idRandom, psim->length < 4 ? 4 : psim->length);
+    if (status)
+	goto done;
+
+    start = simNow();
+    epicsThreadSleep(seconds);
+    psim->injecting = FALSE;
+    elapsed = simNow() - start;
+    epicsThreadSleep(0.5);		/* Let the receive task catch up */
+    canSilenceErrors = silence;
+
+    injected = psim->injected - injected;
+    overruns = psim->overruns - overruns;
+
+    printf("t810SimBench: '%s' for %.1f sec, ", pbusName, elapsed);
+    if (rate > 0)
+	printf("%g frames/sec requested\n", rate);
+    else
+	printf("%s\n", rate == 0 ? "bus limited" : "unpaced");
+    printf("\tFrames Injected     : %lu = %.0f/sec\n",
+	    injected, injected / elapsed);
+    printf("\tFrames Received     : %lu = %.0f/sec\n",
+	    pbench->count, pbench->count / elapsed);
+    printf("\tChip Overruns       : %lu\n", overruns);
+    printf("\tFrames Lost         : %lu\n",
+	    injected > pbench->count ? injected - pbench->count : 0);
+    if (pbench->count) {
+	printf("\tLatency (usec)      : min %.1f, mean %.1f, max %.1f\n",
+		pbench->min * 1e6, pbench->sum * 1e6 / pbench->count,
+		pbench->max * 1e6);
+	for (bin = 0; bin < HIST_BINS; bin++) {
+	    if (pbench->hist[bin])
+		printf("\t    < %8lu usec : %lu\n",
+			2ul << bin, pbench->hist[bin]);
+	}
+    }
+
+done:
+    canSilenceErrors = silence;
+    for (id = psim->idFirst; id < psim->idFirst + psim->idCount; id++) {
+	canMsgDelete(busID, id, benchCallback, pbench);
+    }
+    if (t810RecvSync(busID) == 0)
+	free(pbench);
+    return status;
+}
+
+
+/*******************************************************************************
+ * EPICS iocsh Command registry
+ */
+
+static const iocshArg simArgCarrier = {"carrier", iocshArgInt};
+static const iocshArg simArgSlot = {"slot", iocshArgInt};
+
+/* t810SimCreate(int carrier, int slot) */
+static const iocshArg * const t810SimCreateArgs[2] = {
+    &simArgCarrier, &simArgSlot};
+static const iocshFuncDef t810SimCreateFuncDef =
+    {"t810SimCreate",2,t810SimCreateArgs};
+static void t810SimCreateCallFunc(const iocshArgBuf *args)
+{
+    t810SimCreate(args[0].ival, args[1].ival);
+}
+
+/* t810SimInject(int carrier, int slot, double rate, int idFirst,
+ *		 int idCount, int idRandom, int length) */
+static const iocshArg t810SimInjectArg2 = {"rate", iocshArgDouble};
+static const iocshArg t810SimInjectArg3 = {"idFirst", iocshArgInt};
+static const iocshArg t810SimInjectArg4 = {"idCount", iocshArgInt};
+static const iocshArg t810SimInjectArg5 = {"idRandom", iocshArgInt};
+static const iocshArg t810SimInjectArg6 = {"length", iocshArgInt};
+static const iocshArg * const t810SimInjectArgs[7] = {
+    &simArgCarrier, &simArgSlot, &t810SimInjectArg2, &t810SimInjectArg3,
+    &t810SimInjectArg4, &t810SimInjectArg5, &t810SimInjectArg6};
+static const iocshFuncDef t810SimInjectFuncDef =
+    {"t810SimInject",7,t810SimInjectArgs};
+static void t810SimInjectCallFunc(const iocshArgBuf *args)
+{
+    t810SimInject(args[0].ival, args[1].ival, args[2].dval, args[3].ival,
+		  args[4].ival, args[5].ival, args[6].ival);
+}
+
+/* t810SimErrors(int carrier, int slot, int errorEvery, int busOffEvery) */
+static const iocshArg t810SimErrorsArg2 = {"errorEvery", iocshArgInt};
+static const iocshArg t810SimErrorsArg3 = {"busOffEvery", iocshArgInt};
+static const iocshArg * const t810SimErrorsArgs[4] = {
+    &simArgCarrier, &simArgSlot, &t810SimErrorsArg2, &t810SimErrorsArg3};
+static const iocshFuncDef t810SimErrorsFuncDef =
+    {"t810SimErrors",4,t810SimErrorsArgs};
+static void t810SimErrorsCallFunc(const iocshArgBuf *args)
+{
+    t810SimErrors(args[0].ival, args[1].ival, args[2].ival, args[3].ival);
+}
+
+/* t810SimReport(int interest) */
+static const iocshArg t810SimReportArg0 = {"interest", iocshArgInt};
+static const iocshArg * const t810SimReportArgs[1] = {&t810SimReportArg0};
+static const iocshFuncDef t810SimReportFuncDef =
+    {"t810SimReport",1,t810SimReportArgs};
+static void t810SimReportCallFunc(const iocshArgBuf *args)
+{
+    t810SimReport(args[0].ival);
+}
+
+/* t810SimBench(char *pbusName, int carrier, int slot, double seconds,
+ *		double rate) */
+static const iocshArg t810SimBenchArg0 = {"busName", iocshArgString};
+static const iocshArg t810SimBenchArg3 = {"seconds", iocshArgDouble};
+static const iocshArg t810SimBenchArg4 = {"rate", iocshArgDouble};
+static const iocshArg * const t810SimBenchArgs[5] = {
+    &t810SimBenchArg0, &simArgCarrier, &simArgSlot, &t810SimBenchArg3,
+    &t810SimBenchArg4};
+static const iocshFuncDef t810SimBenchFuncDef =
+    {"t810SimBench",5,t810SimBenchArgs};
+static void t810SimBenchCallFunc(const iocshArgBuf *args)
+{
+    int status = t810SimBench(args[0].sval, args[1].ival, args[2].ival,
+			      args[3].dval, args[4].dval);
+    if (status)
+	printf("t810SimBench: Error %#x\n", status);
+}
+
+static void drvTip810SimRegistrar(void) {
+    iocshRegister(&t810SimCreateFuncDef,t810SimCreateCallFunc);
+    iocshRegister(&t810SimInjectFuncDef,t810SimInjectCallFunc);
+    iocshRegister(&t810SimErrorsFuncDef,t810SimErrorsCallFunc);
+    iocshRegister(&t810SimReportFuncDef,t810SimReportCallFunc);
+    iocshRegister(&t810SimBenchFuncDef,t810SimBenchCallFunc);
+}
+epicsExportRegistrar(drvTip810SimRegistrar);